@@ -0,0 +1,226 @@
+// BVH build time and ray throughput on obj meshes, incoherent rays through
+// the binary BVH and primary-ray grids through the 4-wide BVH in packets.
+//
+// usage: bvh-bench [model.obj ...]   (default: suzanne.obj brain.obj)
+
+#include <cfloat>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "src/bvh.hpp"
+#include "src/bvh4.hpp"
+#include "src/obj.hpp"
+#include "src/parallel.hpp"
+
+#define BUILD_REPEAT 10
+#define RAY_CNT 1000000
+#define GRID_W 1024
+#define GRID_H 768
+// packets cover 4x2 (AVX) or 2x2 pixel tiles
+#define TILE_W (RAY_PACKET_WIDTH / 2)
+#define TILE_H 2
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+static float frand() { return rand() / float(RAND_MAX); }
+
+struct Camera {
+    vec3 eye, dir00, dx, dy;  // ray to pixel (x, y) is dir00 + x*dx + y*dy
+};
+
+// looks at the mesh from +z with a 45 degree vertical field of view
+static Camera gridCamera(const AABB& bounds) {
+    vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float radius = length(bounds.max - bounds.min) * 0.5f;
+    float half_h = tan(radians(22.5f));
+    float half_w = half_h * GRID_W / GRID_H;
+    Camera cam;
+    cam.eye = center + vec3(0.0f, 0.0f, radius / half_h * 1.1f);
+    cam.dx = vec3(2.0f * half_w / GRID_W, 0.0f, 0.0f);
+    cam.dy = vec3(0.0f, -2.0f * half_h / GRID_H, 0.0f);
+    cam.dir00 = vec3(-half_w, half_h, -1.0f) + (cam.dx + cam.dy) * 0.5f;
+    return cam;
+}
+
+static vec3 pixelDir(const Camera& cam, int x, int y) {
+    return normalize(cam.dir00 + cam.dx * float(x) + cam.dy * float(y));
+}
+
+// traces rows [y0, y1) in packets, returns the rays that hit
+static unsigned int tracePackets(const BVH4& bvh4, const Camera& cam, int y0,
+                                 int y1, vector<float>& depth) {
+    unsigned int hits = 0;
+    RayPacket rays;
+    PacketHit hit;
+    for (int i = 0; i < RAY_PACKET_WIDTH; ++i) {
+        rays.ox[i] = cam.eye.x;
+        rays.oy[i] = cam.eye.y;
+        rays.oz[i] = cam.eye.z;
+        rays.tmax[i] = FLT_MAX;
+    }
+    for (int ty = y0; ty < y1; ty += TILE_H) {
+        for (int tx = 0; tx < GRID_W; tx += TILE_W) {
+            for (int i = 0; i < RAY_PACKET_WIDTH; ++i) {
+                vec3 d = pixelDir(cam, tx + i % TILE_W, ty + i / TILE_W);
+                rays.dx[i] = d.x;
+                rays.dy[i] = d.y;
+                rays.dz[i] = d.z;
+            }
+            int mask = intersectPacket(bvh4, rays, hit);
+            for (int i = 0; i < RAY_PACKET_WIDTH; ++i) {
+                int x = tx + i % TILE_W, y = ty + i / TILE_W;
+                depth[y * GRID_W + x] = hit.t[i];
+                hits += (mask >> i) & 1;
+            }
+        }
+    }
+    return hits;
+}
+
+static void runGrid(const BVH& bvh, const AABB& bounds) {
+    BVH4 bvh4;
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    collapseBVH(bvh, bvh4);
+    double collapse_ms = msSince(t0);
+
+    Camera cam = gridCamera(bounds);
+    const int ray_cnt = GRID_W * GRID_H;
+    vector<float> depth(ray_cnt), ref(ray_cnt);
+
+    t0 = chrono::steady_clock::now();
+    for (int y = 0; y < GRID_H; ++y) {
+        for (int x = 0; x < GRID_W; ++x) {
+            RayHit hit;
+            intersectBVH(bvh, cam.eye, pixelDir(cam, x, y), FLT_MAX, hit);
+            ref[y * GRID_W + x] = hit.t;
+        }
+    }
+    double binary_ms = msSince(t0);
+
+    t0 = chrono::steady_clock::now();
+    for (int y = 0; y < GRID_H; ++y) {
+        for (int x = 0; x < GRID_W; ++x) {
+            RayHit hit;
+            intersectBVH4(bvh4, cam.eye, pixelDir(cam, x, y), FLT_MAX, hit);
+            depth[y * GRID_W + x] = hit.t;
+        }
+    }
+    double single_ms = msSince(t0);
+
+    t0 = chrono::steady_clock::now();
+    unsigned int hits = tracePackets(bvh4, cam, 0, GRID_H, depth);
+    double packet_ms = msSince(t0);
+
+    unsigned int mismatches = 0;
+    for (int i = 0; i < ray_cnt; ++i) {
+        if (fabs(depth[i] - ref[i]) > 1e-4f * std::max(1.0f, ref[i])) {
+            ++mismatches;
+        }
+    }
+
+    t0 = chrono::steady_clock::now();
+    parallelFor(0, GRID_H / TILE_H, 8, [&](size_t lo, size_t hi) {
+        tracePackets(bvh4, cam, lo * TILE_H, hi * TILE_H, depth);
+    });
+    double parallel_ms = msSince(t0);
+
+    printf("    %dx%d primary rays, %.1f%% hit, bvh4 %u nodes (%.2f ms)\n",
+           GRID_W, GRID_H, hits * 100.0 / ray_cnt,
+           (unsigned int)bvh4.nodes.size(), collapse_ms);
+    printf("    binary:       %.2f Mrays/s\n", ray_cnt / binary_ms * 1e-3);
+    printf("    bvh4 single:  %.2f Mrays/s\n", ray_cnt / single_ms * 1e-3);
+    printf("    bvh4 packet:  %.2f Mrays/s (%d-wide %s, %u mismatches)\n",
+           ray_cnt / packet_ms * 1e-3, RAY_PACKET_WIDTH, simdName(),
+           mismatches);
+    printf("    bvh4 packet:  %.2f Mrays/s on %u threads\n",
+           ray_cnt / parallel_ms * 1e-3, workerCount());
+}
+
+static void run(const char* path) {
+    vector<vec3> vertices;
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    if (loadOBJ(path, vertices, uvs, normals) < 0) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        return;
+    }
+
+    BVH bvh;
+    double build_ms = 0.0;
+    for (int r = 0; r < BUILD_REPEAT; ++r) {
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        buildBVH(vertices, bvh);
+        build_ms += msSince(t0);
+    }
+    build_ms /= BUILD_REPEAT;
+
+    // rays from a sphere around the mesh towards points inside its bounds
+    AABB bounds = computeBounds(vertices);
+    vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float radius = length(bounds.max - bounds.min);
+    vector<vec3> origins(RAY_CNT), dirs(RAY_CNT);
+    srand(42);
+    for (int i = 0; i < RAY_CNT; ++i) {
+        vec3 s = normalize(vec3(frand(), frand(), frand()) * 2.0f - 1.0f);
+        vec3 target = mix(bounds.min, bounds.max,
+                          vec3(frand(), frand(), frand()));
+        origins[i] = center + s * radius;
+        dirs[i] = normalize(target - origins[i]);
+    }
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    unsigned int hits = 0;
+    for (int i = 0; i < RAY_CNT; ++i) {
+        RayHit hit;
+        hits += intersectBVH(bvh, origins[i], dirs[i], FLT_MAX, hit);
+    }
+    double closest_ms = msSince(t0);
+
+    t0 = chrono::steady_clock::now();
+    unsigned int occluded = 0;
+    for (int i = 0; i < RAY_CNT; ++i) {
+        occluded += occludedBVH(bvh, origins[i], dirs[i], FLT_MAX);
+    }
+    double any_ms = msSince(t0);
+
+    t0 = chrono::steady_clock::now();
+    parallelFor(0, RAY_CNT, 4096, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+            RayHit hit;
+            intersectBVH(bvh, origins[i], dirs[i], FLT_MAX, hit);
+        }
+    });
+    double parallel_ms = msSince(t0);
+
+    printf("%s: %u triangles, %u nodes, depth %d\n", path,
+           (unsigned int)bvh.tris.size(), (unsigned int)bvh.nodes.size(),
+           bvhDepth(bvh));
+    printf("    build:        %.2f ms (%u threads)\n", build_ms,
+           workerCount());
+    printf("    closest hit:  %.2f Mrays/s (%.1f%% hit)\n",
+           RAY_CNT / closest_ms * 1e-3, hits * 100.0 / RAY_CNT);
+    printf("    any hit:      %.2f Mrays/s (%.1f%% occluded)\n",
+           RAY_CNT / any_ms * 1e-3, occluded * 100.0 / RAY_CNT);
+    printf("    closest hit:  %.2f Mrays/s on %u threads\n",
+           RAY_CNT / parallel_ms * 1e-3, workerCount());
+    runGrid(bvh, bounds);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        run("suzanne.obj");
+        run("brain.obj");
+    }
+    for (int i = 1; i < argc; ++i) run(argv[i]);
+    return 0;
+}
@@ -0,0 +1,122 @@
+// Meshlet build time and cluster culling rates on obj meshes, seen from a
+// ring of cameras around the mesh and from close up. Triangles in meshlets
+// rejected by their normal cone are checked to really face away.
+//
+// usage: meshlet-bench [model.obj ...]   (default: brain.obj)
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+using namespace glm;
+
+#include "src/culling.hpp"
+#include "src/mesh-index.hpp"
+#include "src/meshlets.hpp"
+#include "src/obj.hpp"
+
+#define RING_VIEWS 16
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+// front facing triangles inside meshlets the cone test rejected
+static unsigned int coneErrors(const MeshletMesh& mm, const IndexedMesh& mesh,
+                               const vec3& eye) {
+    unsigned int errors = 0;
+    for (size_t i = 0; i < mm.meshlets.size(); ++i) {
+        const Meshlet& m = mm.meshlets[i];
+        vec3 view = m.center - eye;
+        if (dot(view, m.cone_axis) < m.cone_cutoff * length(view) + m.radius) {
+            continue;
+        }
+        for (uint32_t t = 0; t < m.triangle_cnt; ++t) {
+            const uint8_t* tri = &mm.triangles[(m.triangle_offset + t) * 3];
+            const uint32_t* verts = &mm.vertices[m.vertex_offset];
+            const vec3& a = mesh.positions[verts[tri[0]]];
+            const vec3& b = mesh.positions[verts[tri[1]]];
+            const vec3& c = mesh.positions[verts[tri[2]]];
+            if (dot(a - eye, cross(b - a, c - a)) < 0.0f) ++errors;
+        }
+    }
+    return errors;
+}
+
+static void cullViews(const char* name, const MeshletMesh& mm,
+                      const IndexedMesh& mesh, const vec3& center,
+                      float distance) {
+    mat4 p_mat = perspective(radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+    MeshletCullStats stats = {0, 0, 0, 0, 0};
+    vector<DrawIndirectCmd> cmds;
+    unsigned int errors = 0;
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    double cull_ms = 0.0;
+    for (int i = 0; i < RING_VIEWS; ++i) {
+        float angle = 6.2831853f * i / RING_VIEWS;
+        vec3 eye = center + distance * vec3(sin(angle), 0.3f, cos(angle));
+        mat4 v_mat = lookAt(eye, center, vec3(0.0f, 1.0f, 0.0f));
+        Frustum frustum;
+        extractFrustum(p_mat * v_mat, frustum);
+
+        cmds.clear();
+        t0 = chrono::steady_clock::now();
+        cullMeshlets(mm, frustum, vec3(0.0f), eye, NULL, 0, cmds, stats);
+        cull_ms += msSince(t0);
+        errors += coneErrors(mm, mesh, eye);
+    }
+    printf("    %-10s %5.1f%% culled (%4.1f%% frustum, %4.1f%% backface), "
+           "%.1f draws, %.1f us per view, %u cone errors\n", name,
+           100.0 * (stats.frustum_culled + stats.backface_culled) /
+               stats.meshlets,
+           100.0 * stats.frustum_culled / stats.meshlets,
+           100.0 * stats.backface_culled / stats.meshlets,
+           double(stats.cmds) / RING_VIEWS, cull_ms * 1e3 / RING_VIEWS,
+           errors);
+}
+
+static void run(const char* path) {
+    vector<vec3> vertices;
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    if (loadOBJ(path, vertices, uvs, normals) < 0) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        return;
+    }
+    IndexedMesh mesh;
+    indexMesh(vertices, vector<vec2>(), vector<vec3>(), mesh);
+
+    MeshletMesh mm;
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    buildMeshlets(mesh.positions, mesh.indices, mm);
+    double build_ms = msSince(t0);
+
+    size_t tri_cnt = mesh.indices.size() / 3;
+    AABB bounds = computeBounds(mesh.positions);
+    vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float radius = length(bounds.max - bounds.min) * 0.5f;
+    size_t meshlet_cnt = mm.meshlets.size();
+    printf("%s: %u triangles, %u meshlets in %.1f ms\n", path,
+           (unsigned int)tri_cnt, (unsigned int)meshlet_cnt, build_ms);
+    printf("    %.1f vertices (%.0f%% of %d), %.1f triangles (%.0f%% of %d) "
+           "per meshlet, %.2f vertex refs per vertex\n",
+           double(mm.vertices.size()) / meshlet_cnt,
+           100.0 * mm.vertices.size() / meshlet_cnt / MESHLET_MAX_VERTICES,
+           MESHLET_MAX_VERTICES, double(tri_cnt) / meshlet_cnt,
+           100.0 * tri_cnt / meshlet_cnt / MESHLET_MAX_TRIANGLES,
+           MESHLET_MAX_TRIANGLES,
+           double(mm.vertices.size()) / mesh.positions.size());
+
+    cullViews("orbit", mm, mesh, center, radius * 3.0f);
+    cullViews("close up", mm, mesh, center, radius * 0.9f);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) run("brain.obj");
+    for (int i = 1; i < argc; ++i) run(argv[i]);
+    return 0;
+}
@@ -0,0 +1,126 @@
+// Smooth normal generation time on obj meshes and a synthetic heightfield.
+//
+// usage: normals-bench [--grid N] [model.obj ...]
+//        (default: suzanne.obj brain.obj and a 1000x1000 quad grid, 2M tris)
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "src/normals.hpp"
+#include "src/obj.hpp"
+#include "src/parallel.hpp"
+
+#define REPEAT 5
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+static double timeNormals(const vector<vec3>& vertices, vector<vec3>& normals,
+                          NormalWeighting weighting, float crease_deg) {
+    double best = 1e30;
+    for (int r = 0; r < REPEAT; ++r) {
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        generateNormals(vertices, normals, weighting, crease_deg);
+        double ms = msSince(t0);
+        if (ms < best) best = ms;
+    }
+    return best;
+}
+
+static void run(const char* name, const vector<vec3>& vertices,
+                const vector<vec3>& file_normals) {
+    size_t tri_cnt = vertices.size() / 3;
+    vector<vec3> normals;
+    double area_ms = timeNormals(vertices, normals, NORMAL_WEIGHT_AREA,
+                                 NORMAL_NO_CREASE);
+    double crease_ms = timeNormals(vertices, normals, NORMAL_WEIGHT_ANGLE,
+                                   60.0f);
+    double angle_ms = timeNormals(vertices, normals, NORMAL_WEIGHT_ANGLE,
+                                  NORMAL_NO_CREASE);
+
+    printf("%s: %u triangles, %u threads\n", name, (unsigned int)tri_cnt,
+           workerCount());
+    printf("    area weighted:   %8.2f ms (%.1f Mtris/s)\n", area_ms,
+           tri_cnt / area_ms * 1e-3);
+    printf("    angle weighted:  %8.2f ms (%.1f Mtris/s)\n", angle_ms,
+           tri_cnt / angle_ms * 1e-3);
+    printf("    60 deg crease:   %8.2f ms (%.1f Mtris/s)\n", crease_ms,
+           tri_cnt / crease_ms * 1e-3);
+    if (file_normals.size() == normals.size()) {
+        double deviation = 0.0;
+        for (size_t i = 0; i < normals.size(); ++i) {
+            float d = dot(normals[i], normalize(file_normals[i]));
+            deviation += degrees(acos(std::max(-1.0f, std::min(1.0f, d))));
+        }
+        printf("    mean deviation from file normals: %.2f deg\n",
+               deviation / normals.size());
+    }
+}
+
+// n x n quads over a wavy heightfield, as a triangle soup
+static void makeGrid(int n, vector<vec3>& vertices) {
+    vertices.clear();
+    vertices.reserve(size_t(n) * n * 6);
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            vec3 p[4];
+            for (int c = 0; c < 4; ++c) {
+                float u = float(x + (c & 1)) / n, v = float(y + (c >> 1)) / n;
+                p[c] = vec3(u, v, 0.05f * sin(u * 40.0f) * cos(v * 30.0f));
+            }
+            vertices.push_back(p[0]);
+            vertices.push_back(p[1]);
+            vertices.push_back(p[3]);
+            vertices.push_back(p[0]);
+            vertices.push_back(p[3]);
+            vertices.push_back(p[2]);
+        }
+    }
+}
+
+static void runFile(const char* path) {
+    vector<vec3> vertices;
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    if (loadOBJ(path, vertices, uvs, normals) < 0) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        return;
+    }
+    run(path, vertices, normals);
+}
+
+int main(int argc, char* argv[]) {
+    int grid = 1000;
+    vector<const char*> paths;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+            grid = atoi(argv[++i]);
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty() && argc < 2) {
+        paths.push_back("suzanne.obj");
+        paths.push_back("brain.obj");
+    }
+    for (size_t i = 0; i < paths.size(); ++i) runFile(paths[i]);
+
+    if (grid > 0) {
+        vector<vec3> vertices;
+        makeGrid(grid, vertices);
+        char name[64];
+        snprintf(name, sizeof(name), "%dx%d grid", grid, grid);
+        run(name, vertices, vector<vec3>());
+    }
+    return 0;
+}
@@ -0,0 +1,296 @@
+// Obj loading throughput, allocations and peak heap for every loading mode,
+// on the bundled models and on synthetic meshes generated from a seed. The
+// results go to stdout as JSON for comparing builds; progress goes to
+// stderr.
+//
+// usage: obj-bench [--synthetic 1M,10M,100M|none] [--seed N]
+//                  [--data-dir DIR] [--min-ms MS] [model.obj ...]
+//        (default: cube.obj suzanne.obj brain.obj, every synthetic size,
+//         seed 1, $TMPDIR or /tmp, 1000 ms per mode)
+//
+// Synthetic meshes are obj-gen's default tori (v/vt/vn triangles), written
+// once to DIR/synthetic-<triangles>-<seed>.obj and reused while the file is
+// there. Sizes whose loading would not fit in physical memory are reported
+// as skipped.
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "src/mesh-index.hpp"
+#include "src/normals.hpp"
+#include "src/obj.hpp"
+#include "src/parallel.hpp"
+#include "src/simd.hpp"
+#include "src/synthetic.hpp"
+
+#define MIN_RUNS 3
+#define MAX_RUNS 1000
+// operator new keeps the size in front of each block, aligned for anything
+#define ALLOC_HEADER 16
+
+// heap use of the whole process, through operator new
+static atomic<size_t> alloc_cnt(0);
+static atomic<size_t> alloc_bytes(0);
+static atomic<size_t> heap_bytes(0);
+static atomic<size_t> heap_peak(0);
+
+void* operator new(size_t size) {
+    char* p = (char*)malloc(size + ALLOC_HEADER);
+    if (p == NULL) throw bad_alloc();
+    *(size_t*)p = size;
+    alloc_cnt.fetch_add(1, memory_order_relaxed);
+    alloc_bytes.fetch_add(size, memory_order_relaxed);
+    size_t now = heap_bytes.fetch_add(size, memory_order_relaxed) + size;
+    size_t peak = heap_peak.load(memory_order_relaxed);
+    while (now > peak &&
+           !heap_peak.compare_exchange_weak(peak, now,
+                                            memory_order_relaxed)) {
+    }
+    return p + ALLOC_HEADER;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr == NULL) return;
+    char* p = (char*)ptr - ALLOC_HEADER;
+    heap_bytes.fetch_sub(*(size_t*)p, memory_order_relaxed);
+    free(p);
+}
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+static size_t fileSize(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? size_t(st.st_size) : 0;
+}
+
+static bool readFile(const char* path, vector<char>& data) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) return false;
+    data.resize(fileSize(path));
+    size_t n = data.empty() ? 0 : fread(&data[0], 1, data.size(), fp);
+    fclose(fp);
+    return n == data.size();
+}
+
+struct Dataset {
+    string name;
+    string path;
+    size_t tri_target;  // 0 for files given on the command line
+    uint32_t seed;
+};
+
+enum Mode { MODE_LOAD, MODE_PARSE, MODE_INDEX, MODE_CNT };
+static const char* mode_names[MODE_CNT] = {"loadOBJ", "parseOBJ",
+                                           "loadOBJ+indexMesh"};
+
+struct ModeResult {
+    int runs;
+    size_t tri_cnt;
+    double min_ms, median_ms;
+    size_t allocs, alloc_bytes;  // per run
+    size_t peak_bytes;           // heap above what was live before the run
+};
+
+// one loading pass; returns the triangle count
+static size_t runMode(Mode mode, const Dataset& set,
+                      const vector<char>& data) {
+    vector<vec3> vertices;
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    if (mode == MODE_PARSE) {
+        parseOBJ(&data[0], data.size(), vertices, uvs, normals);
+    } else {
+        loadOBJ(set.path.c_str(), vertices, uvs, normals);
+    }
+    if (mode == MODE_INDEX) {
+        if (normals.size() != vertices.size()) {
+            generateNormals(vertices, normals);
+        }
+        IndexedMesh mesh;
+        indexMesh(vertices, uvs, normals, mesh);
+    }
+    return vertices.size() / 3;
+}
+
+static ModeResult measure(Mode mode, const Dataset& set,
+                          const vector<char>& data, double min_ms) {
+    ModeResult res;
+    vector<double> times;
+    times.reserve(MAX_RUNS);  // outside the counted allocations
+    size_t allocs0 = alloc_cnt, bytes0 = alloc_bytes;
+    res.peak_bytes = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    do {
+        size_t live = heap_bytes;
+        heap_peak = live;
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        res.tri_cnt = runMode(mode, set, data);
+        times.push_back(msSince(t0));
+        res.peak_bytes = std::max(res.peak_bytes, heap_peak - live);
+    } while (times.size() < MIN_RUNS ||
+             (msSince(start) < min_ms && times.size() < MAX_RUNS));
+    res.runs = times.size();
+    res.allocs = (alloc_cnt - allocs0) / res.runs;
+    res.alloc_bytes = (alloc_bytes - bytes0) / res.runs;
+    sort(times.begin(), times.end());
+    res.min_ms = times[0];
+    res.median_ms = times[times.size() / 2];
+    return res;
+}
+
+// bytes a load of tri_cnt triangles with uvs and normals holds at its
+// peak: the file up to three times while its buffer grows, three index
+// lists and the output
+static double estimateLoadBytes(size_t tri_cnt) {
+    double file_bytes = tri_cnt * 105.0;
+    return 3.0 * file_bytes +
+           tri_cnt * 3.0 * (3 * sizeof(long) + 2 * sizeof(vec3) +
+                            sizeof(vec2));
+}
+
+static size_t parseCount(const char* s) {
+    char* end;
+    double n = strtod(s, &end);
+    if (*end == 'k' || *end == 'K') n *= 1e3;
+    if (*end == 'm' || *end == 'M') n *= 1e6;
+    if (*end == 'g' || *end == 'G') n *= 1e9;
+    return size_t(n);
+}
+
+int main(int argc, char* argv[]) {
+    vector<const char*> paths;
+    const char* synthetic = "1M,10M,100M";
+    uint32_t seed = 1;
+    string data_dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    double min_ms = 1000.0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc) {
+            synthetic = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--data-dir") == 0 && i + 1 < argc) {
+            data_dir = argv[++i];
+        } else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+            min_ms = atof(argv[++i]);
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) {
+        paths.push_back("cube.obj");
+        paths.push_back("suzanne.obj");
+        paths.push_back("brain.obj");
+    }
+
+    vector<Dataset> sets;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        Dataset set = {paths[i], paths[i], 0, 0};
+        sets.push_back(set);
+    }
+    for (const char* s = synthetic; strcmp(synthetic, "none") != 0 && *s;) {
+        size_t tri_target = parseCount(s);
+        const char* comma = strchr(s, ',');
+        s = comma ? comma + 1 : s + strlen(s);
+        if (tri_target < 2) continue;
+        Dataset set;
+        set.tri_target = tri_target;
+        set.seed = seed;
+        char name[64];
+        snprintf(name, sizeof(name), "synthetic-%u-%u",
+                 (unsigned int)tri_target, seed);
+        set.name = name;
+        set.path = data_dir + "/" + name + ".obj";
+        sets.push_back(set);
+    }
+
+    double phys_bytes =
+        double(sysconf(_SC_PHYS_PAGES)) * double(sysconf(_SC_PAGESIZE));
+    printf("{\n");
+    printf("  \"compiler\": \"%s\",\n", __VERSION__);
+    printf("  \"simd\": \"%s\",\n", simdName());
+    printf("  \"threads\": %u,\n", workerCount());
+    printf("  \"time\": %ld,\n", long(time(NULL)));
+    printf("  \"datasets\": [");
+    for (size_t d = 0; d < sets.size(); ++d) {
+        const Dataset& set = sets[d];
+        printf("%s\n    {\"name\": \"%s\", \"path\": \"%s\"", d ? "," : "",
+               set.name.c_str(), set.path.c_str());
+        if (set.tri_target) {
+            printf(", \"seed\": %u, \"triangles_requested\": %u", set.seed,
+                   (unsigned int)set.tri_target);
+            double need = estimateLoadBytes(set.tri_target);
+            if (need > 0.8 * phys_bytes) {
+                fprintf(stderr, "%s: skipped, needs about %.1f GB\n",
+                        set.name.c_str(), need * 1e-9);
+                printf(", \"skipped\": \"needs about %.1f GB of %.1f GB\"}",
+                       need * 1e-9, phys_bytes * 1e-9);
+                continue;
+            }
+            if (fileSize(set.path.c_str()) == 0) {
+                fprintf(stderr, "%s: generating %s\n", set.name.c_str(),
+                        set.path.c_str());
+                chrono::steady_clock::time_point t0 =
+                    chrono::steady_clock::now();
+                SyntheticOptions options =
+                    defaultSyntheticOptions(set.tri_target);
+                options.seed = set.seed;
+                if (!writeSyntheticOBJ(set.path.c_str(), options, NULL)) {
+                    remove(set.path.c_str());
+                    printf(", \"skipped\": \"cannot write\"}");
+                    continue;
+                }
+                fprintf(stderr, "%s: written in %.0f ms\n", set.name.c_str(),
+                        msSince(t0));
+            }
+        }
+
+        vector<char> data;
+        if (!readFile(set.path.c_str(), data) || data.empty()) {
+            fprintf(stderr, "Failed to open %s.\n", set.path.c_str());
+            printf(", \"skipped\": \"cannot read\"}");
+            continue;
+        }
+        printf(", \"bytes\": %u, \"modes\": [", (unsigned int)data.size());
+        for (int m = 0; m < MODE_CNT; ++m) {
+            ModeResult res = measure(Mode(m), set, data, min_ms);
+            double mb_s = data.size() / res.median_ms * 1e-3;
+            double mtris_s = res.tri_cnt / res.median_ms * 1e-3;
+            fprintf(stderr, "%s %s: %.1f ms, %.1f MB/s, %.2f Mtris/s, "
+                    "%u allocations, %.1f MB peak\n",
+                    set.name.c_str(), mode_names[m], res.median_ms, mb_s,
+                    mtris_s, (unsigned int)res.allocs,
+                    res.peak_bytes * 1e-6);
+            printf("%s\n      {\"mode\": \"%s\", \"triangles\": %u, "
+                   "\"runs\": %d, \"min_ms\": %.3f, \"median_ms\": %.3f, "
+                   "\"mb_per_s\": %.2f, \"mtris_per_s\": %.3f, "
+                   "\"allocations\": %u, \"allocated_bytes\": %.0f, "
+                   "\"peak_heap_bytes\": %.0f}",
+                   m ? "," : "", mode_names[m], (unsigned int)res.tri_cnt,
+                   res.runs, res.min_ms, res.median_ms, mb_s, mtris_s,
+                   (unsigned int)res.allocs, double(res.alloc_bytes),
+                   double(res.peak_bytes));
+        }
+        printf("\n    ]}");
+        fflush(stdout);
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
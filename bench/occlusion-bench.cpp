@@ -0,0 +1,210 @@
+// Software occlusion culling of a dense field of instances seen from
+// inside it: occluder rasterization and pyramid time at 1024x512, instance
+// and meshlet boxes culled, and a check that no vertex of a culled instance
+// lies in front of the occluder depth.
+//
+// usage: occlusion-bench [--grid N] [model.obj]
+//        (default: brain.obj on a 32x32 grid)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+using namespace glm;
+
+#include "src/culling.hpp"
+#include "src/mesh-index.hpp"
+#include "src/meshlets.hpp"
+#include "src/obj.hpp"
+#include "src/occlusion.hpp"
+#include "src/parallel.hpp"
+#include "src/simplify.hpp"
+
+#define BUFFER_WIDTH 1024
+#define BUFFER_HEIGHT 512
+#define REPEATS 20
+#define MAX_OCCLUDERS 32
+#define OCCLUDER_TRIANGLES 200000
+// occluders may be coarser than what is drawn
+#define OCCLUDER_PIXEL_ERROR 1.0f
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+struct ByDistance {
+    const vector<float>* distance;
+    bool operator()(int a, int b) const {
+        return (*distance)[a] < (*distance)[b];
+    }
+};
+
+int main(int argc, char* argv[]) {
+    int grid = 32;
+    const char* path = "brain.obj";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+            grid = std::max(1, atoi(argv[++i]));
+        } else {
+            path = argv[i];
+        }
+    }
+
+    vector<vec3> vertices;
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    if (loadOBJ(path, vertices, uvs, normals) < 0) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        return 1;
+    }
+    IndexedMesh mesh;
+    indexMesh(vertices, vector<vec2>(), vector<vec3>(), mesh);
+    LODChain chain;
+    buildLODChain(mesh, chain);
+    MeshletMesh meshlets;
+    buildMeshlets(mesh.positions, mesh.indices, meshlets);
+    AABB bounds = computeBounds(mesh.positions);
+    vec3 extent = bounds.max - bounds.min;
+    float spacing = std::max(extent.x, std::max(extent.y, extent.z)) * 1.1f;
+
+    // instances on a ground grid with every other row shifted by half a
+    // spacing to cover the gaps, the camera at one edge looking across
+    int instance_cnt = grid * grid;
+    vector<vec3> offsets(instance_cnt);
+    BoxSoA boxes;
+    boxes.resize(instance_cnt);
+    for (int i = 0; i < instance_cnt; ++i) {
+        float x = i % grid - (grid - 1) * 0.5f + (i / grid % 2) * 0.5f;
+        offsets[i] = vec3(x * spacing, 0.0f, -(i / grid) * spacing);
+        AABB box = {bounds.min + offsets[i], bounds.max + offsets[i]};
+        boxes.set(i, box);
+    }
+    vec3 eye(0.0f, extent.y * 0.25f, spacing * 3.0f);
+    mat4 p_mat = perspective(radians(60.0f), float(BUFFER_WIDTH) /
+                             BUFFER_HEIGHT, 0.1f, 1000.0f);
+    mat4 v_mat = lookAt(eye, eye + vec3(0.0f, 0.0f, -1.0f),
+                        vec3(0.0f, 1.0f, 0.0f));
+    mat4 vp_mat = p_mat * v_mat;
+    Frustum frustum;
+    extractFrustum(vp_mat, frustum);
+    vector<unsigned char> visible(instance_cnt);
+    size_t frustum_cnt = cullBoxes(frustum, boxes, &visible[0]);
+
+    // nearest visible instances occlude, at the coarsest level of detail
+    // within OCCLUDER_PIXEL_ERROR pixels of the occlusion buffer
+    vector<float> distance(instance_cnt);
+    vector<int> order;
+    for (int i = 0; i < instance_cnt; ++i) {
+        distance[i] = length(offsets[i] - eye);
+        if (visible[i]) order.push_back(i);
+    }
+    ByDistance by_distance = {&distance};
+    sort(order.begin(), order.end(), by_distance);
+    float proj_scale = lodProjScale(p_mat, BUFFER_HEIGHT);
+    vector<int> occluders;
+    vector<const LODLevel*> occluder_lods;
+    size_t occluder_tris = 0;
+    for (size_t k = 0; k < order.size() && occluders.size() < MAX_OCCLUDERS;
+         ++k) {
+        const LODLevel& lod = chain.levels[selectLOD(
+            chain.levels, distance[order[k]], proj_scale,
+            OCCLUDER_PIXEL_ERROR)];
+        if (occluder_tris + lod.count / 3 > OCCLUDER_TRIANGLES) break;
+        occluders.push_back(order[k]);
+        occluder_lods.push_back(&lod);
+        occluder_tris += lod.count / 3;
+    }
+
+    OcclusionBuffer occlusion;
+    occlusion.init(BUFFER_WIDTH, BUFFER_HEIGHT);
+    double setup_ms = 0.0, raster_ms = 0.0, pyramid_ms = 0.0, total_ms = 0.0;
+    for (int r = 0; r < REPEATS; ++r) {
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        occlusion.begin(vp_mat);
+        for (size_t k = 0; k < occluders.size(); ++k) {
+            const LODLevel& lod = *occluder_lods[k];
+            occlusion.addOccluder(mesh.positions,
+                                  &chain.indices[lod.first], lod.count,
+                                  translate(mat4(1.0f), offsets[occluders[k]]));
+        }
+        occlusion.end();
+        total_ms += msSince(t0);
+        setup_ms += occlusion.getStats().setup_ms;
+        raster_ms += occlusion.getStats().raster_ms;
+        pyramid_ms += occlusion.getStats().pyramid_ms;
+    }
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    vector<unsigned char> unoccluded;
+    size_t unoccluded_cnt = 0;
+    for (int r = 0; r < REPEATS; ++r) {
+        unoccluded = visible;
+        unoccluded_cnt = occlusion.testBoxes(boxes, &unoccluded[0]);
+    }
+    double test_us = msSince(t0) * 1e3 / REPEATS;
+
+    // meshlet boxes of the instances that survived
+    size_t meshlet_cnt = 0, meshlet_visible = 0;
+    t0 = chrono::steady_clock::now();
+    for (int i = 0; i < instance_cnt; ++i) {
+        if (!unoccluded[i]) continue;
+        for (size_t m = 0; m < meshlets.meshlets.size(); ++m) {
+            const Meshlet& ml = meshlets.meshlets[m];
+            vec3 c = ml.center + offsets[i];
+            AABB box = {c - vec3(ml.radius), c + vec3(ml.radius)};
+            ++meshlet_cnt;
+            meshlet_visible += occlusion.testBox(box);
+        }
+    }
+    double meshlet_us = msSince(t0) * 1e3;
+
+    // a culled instance must not have a vertex nearer than the occluders
+    unsigned int leaks = 0;
+    const float* depth = occlusion.level(0);
+    int pitch = occlusion.levelPitch(0);
+    for (int i = 0; i < instance_cnt; ++i) {
+        if (!visible[i] || unoccluded[i]) continue;
+        for (size_t v = 0; v < mesh.positions.size(); ++v) {
+            vec4 c = vp_mat * vec4(mesh.positions[v] + offsets[i], 1.0f);
+            if (c.z < -c.w) continue;
+            int x = int((c.x / c.w * 0.5f + 0.5f) * BUFFER_WIDTH);
+            int y = int((c.y / c.w * 0.5f + 0.5f) * BUFFER_HEIGHT);
+            if (x < 0 || y < 0 || x >= BUFFER_WIDTH || y >= BUFFER_HEIGHT) {
+                continue;
+            }
+            float z = c.z / c.w * 0.5f + 0.5f;
+            if (z < depth[size_t(y) * pitch + x]) ++leaks;
+        }
+    }
+
+    const OcclusionStats& stats = occlusion.getStats();
+    printf("%s: %dx%d instances, %dx%d buffer, %u threads\n", path, grid,
+           grid, BUFFER_WIDTH, BUFFER_HEIGHT, workerCount());
+    printf("    occluders: %u, %u triangles, %u binned\n", stats.occluders,
+           stats.triangles, stats.binned);
+    printf("    render:    %.2f ms (setup %.2f, raster %.2f, pyramid %.2f)\n",
+           total_ms / REPEATS, setup_ms / REPEATS, raster_ms / REPEATS,
+           pyramid_ms / REPEATS);
+    printf("    instances: %u in frustum, %u unoccluded (%.1f%% culled), "
+           "%.1f us to test\n", (unsigned int)frustum_cnt,
+           (unsigned int)unoccluded_cnt,
+           100.0 * (frustum_cnt - unoccluded_cnt) / std::max<size_t>(
+                                                        frustum_cnt, 1),
+           test_us);
+    printf("    meshlets:  %u of unoccluded instances, %u unoccluded "
+           "(%.1f%% culled), %.1f us to test\n", (unsigned int)meshlet_cnt,
+           (unsigned int)meshlet_visible,
+           100.0 * (meshlet_cnt - meshlet_visible) /
+               std::max<size_t>(meshlet_cnt, 1),
+           meshlet_us);
+    printf("    vertices of culled instances in front of occluders: %u\n",
+           leaks);
+    return 0;
+}
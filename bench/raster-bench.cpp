@@ -0,0 +1,137 @@
+// Software rasterizer frame time: obj meshes shaded like StandardShading
+// at 1024x768 from a ring of cameras around them, no GL needed. The last
+// frame can be saved for image tests.
+//
+// usage: raster-bench [--frames N] [--output image.png|ppm] [model.obj ...]
+//        (default: brain.obj, 60 frames)
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+using namespace glm;
+
+#include "src/culling.hpp"
+#include "src/image.hpp"
+#include "src/mesh-index.hpp"
+#include "src/normals.hpp"
+#include "src/obj.hpp"
+#include "src/parallel.hpp"
+#include "src/simd.hpp"
+#include "src/soft-raster.hpp"
+#include "src/texture.hpp"
+
+#define WIDTH 1024
+#define HEIGHT 768
+#define FOV 45.0f
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+static void run(const char* path, const Texture& texture, int frame_cnt,
+                const char* output_path) {
+    vector<vec3> vertices;
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    int res = loadOBJ(path, vertices, uvs, normals);
+    if (res < 0 || vertices.empty()) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        return;
+    }
+    if (normals.size() != vertices.size()) generateNormals(vertices, normals);
+    IndexedMesh mesh;
+    indexMesh(vertices, res ? uvs : vector<vec2>(), normals, mesh);
+    vector<float> ao;
+    SoftMesh soft_mesh = {&mesh.positions, &mesh.normals, &mesh.uvs, &ao};
+
+    // framed so the bounding sphere fills the view height
+    AABB bounds = computeBounds(mesh.positions);
+    vec3 center = (bounds.min + bounds.max) * 0.5f;
+    float radius = length(bounds.max - bounds.min) * 0.5f;
+    float distance = radius / sin(radians(FOV) * 0.5f);
+    mat4 p_mat = perspective(radians(FOV), float(WIDTH) / HEIGHT,
+                             distance * 0.1f, distance * 10.0f);
+
+    SoftRasterizer raster;
+    raster.init(WIDTH, HEIGHT);
+    SoftRasterStats total;
+    memset(&total, 0, sizeof(total));
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    for (int f = 0; f < frame_cnt; ++f) {
+        float angle = 6.2831853f * f / frame_cnt;
+        vec3 eye = center + distance * vec3(sin(angle), 0.3f, cos(angle));
+        mat4 v_mat = lookAt(eye, center, vec3(0.0f, 1.0f, 0.0f));
+        // the viewer's light at (4, 4, 4), turning with the camera
+        vec3 light = center + vec3(4.0f * (cos(angle) + sin(angle)), 4.0f,
+                                   4.0f * (cos(angle) - sin(angle)));
+        raster.begin(v_mat, p_mat, light);
+        raster.draw(soft_mesh, &mesh.indices[0], mesh.indices.size(),
+                    mat4(1.0f), &texture);
+        raster.end();
+
+        const SoftRasterStats& s = raster.getStats();
+        total.binned += s.binned;
+        total.blocks += s.blocks;
+        total.blocks_culled += s.blocks_culled;
+        total.blocks_hidden += s.blocks_hidden;
+        total.pixels += s.pixels;
+        total.vertex_ms += s.vertex_ms;
+        total.setup_ms += s.setup_ms;
+        total.raster_ms += s.raster_ms;
+    }
+    double ms = msSince(t0) / frame_cnt;
+
+    size_t tri_cnt = mesh.indices.size() / 3;
+    printf("%s: %u triangles, %dx%d, %u threads (%s)\n", path,
+           (unsigned int)tri_cnt, WIDTH, HEIGHT, workerCount(), simdName());
+    printf("    frame:  %.2f ms (%.0f fps, %.1f Mtris/s)\n", ms, 1e3 / ms,
+           tri_cnt / ms * 1e-3);
+    printf("    stages: vertex %.2f, setup %.2f, raster and shade %.2f ms\n",
+           total.vertex_ms / frame_cnt, total.setup_ms / frame_cnt,
+           total.raster_ms / frame_cnt);
+    printf("    %u triangles binned, %u pixels shaded per frame\n",
+           total.binned / frame_cnt, total.pixels / frame_cnt);
+    printf("    blocks: %u per frame, %.1f%% outside an edge, %.1f%% hidden\n",
+           total.blocks / frame_cnt,
+           100.0 * total.blocks_culled / std::max(total.blocks, 1u),
+           100.0 * total.blocks_hidden / std::max(total.blocks, 1u));
+
+    if (output_path) {
+        vector<unsigned char> rgb;
+        raster.readPixels(rgb);
+        if (writeImage(output_path, WIDTH, HEIGHT, rgb)) {
+            printf("    wrote the last frame to %s\n", output_path);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int frame_cnt = 60;
+    const char* output_path = NULL;
+    vector<const char*> paths;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frame_cnt = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) paths.push_back("brain.obj");
+
+    Texture texture;
+    if (!loadDDSTexture("uvmap.DDS", texture)) return 1;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        run(paths[i], texture, frame_cnt, output_path);
+    }
+    return 0;
+}
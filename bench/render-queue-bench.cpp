@@ -0,0 +1,94 @@
+// Sort cost and state changes of the render queue for synthetic scenes.
+//
+// usage: render-queue-bench [draws ...]   (default: 10000 100000)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+using namespace std;
+
+#include "src/render-queue.hpp"
+
+#define PROGRAM_CNT 8
+#define TEXTURE_CNT 64
+#define VERTEX_ARRAY_CNT 256
+#define REPEAT 20
+
+static bool keyLess(const SortItem& a, const SortItem& b) {
+    return a.key < b.key;
+}
+
+static void fillQueue(RenderQueue& queue, int draw_cnt, unsigned int seed) {
+    srand(seed);
+    queue.clear();
+    for (int i = 0; i < draw_cnt; ++i) {
+        DrawCmd cmd;
+        unsigned int program = rand() % PROGRAM_CNT;
+        unsigned int texture = rand() % TEXTURE_CNT;
+        unsigned int vertex_array = rand() % VERTEX_ARRAY_CNT;
+        cmd.program = program + 1;
+        cmd.texture = texture + 1;
+        cmd.vertex_array = vertex_array + 1;
+        cmd.mesh = vertex_array;
+        cmd.first = 0;
+        cmd.count = 3;
+        cmd.indirect_first = cmd.indirect_count = 0;
+        float depth = rand() / float(RAND_MAX) * 100.0f;
+        queue.push(cmd, program, texture, vertex_array, depth);
+    }
+}
+
+static void run(int draw_cnt) {
+    RenderQueue queue;
+    fillQueue(queue, draw_cnt, 1234);
+    StateChanges before = queue.countStateChanges();
+
+    // rebuilding the queue is part of the per-frame cost
+    double radix_ms = 0.0;
+    for (int r = 0; r < REPEAT; ++r) {
+        fillQueue(queue, draw_cnt, 1234);
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        queue.sort();
+        radix_ms += chrono::duration<double, milli>(
+                        chrono::steady_clock::now() - t0)
+                        .count();
+    }
+    StateChanges after = queue.countStateChanges();
+
+    // std::sort on the same keys for reference
+    vector<SortItem> items(draw_cnt);
+    double std_ms = 0.0;
+    for (int r = 0; r < REPEAT; ++r) {
+        srand(r);
+        for (int i = 0; i < draw_cnt; ++i) {
+            items[i].key = makeSortKey(rand() % PROGRAM_CNT,
+                                       rand() % TEXTURE_CNT,
+                                       rand() % VERTEX_ARRAY_CNT,
+                                       rand() / float(RAND_MAX) * 100.0f);
+            items[i].cmd = i;
+        }
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        sort(items.begin(), items.end(), keyLess);
+        std_ms += chrono::duration<double, milli>(
+                      chrono::steady_clock::now() - t0)
+                      .count();
+    }
+
+    printf("%8d draws: radix %.3f ms (std::sort %.3f ms)\n", draw_cnt,
+           radix_ms / REPEAT, std_ms / REPEAT);
+    printf("    unsorted: %u program / %u texture / %u vao changes\n",
+           before.programs, before.materials, before.vertex_arrays);
+    printf("    sorted:   %u program / %u texture / %u vao changes\n",
+           after.programs, after.materials, after.vertex_arrays);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        run(10000);
+        run(100000);
+    }
+    for (int i = 1; i < argc; ++i) run(atoi(argv[i]));
+    return 0;
+}
@@ -0,0 +1,266 @@
+// Scaling of the work-stealing pool from one thread to every core: the
+// scheduler's own overhead (loop items, forked tasks, dependency chains)
+// and the stages that share the pool (obj parsing, normal generation, BVH
+// build, DXT decode and frustum culling).
+//
+// usage: scaling-bench [--triangles N] [--max-threads N]
+//        (default: a 1M triangle synthetic torus, up to hardware threads)
+//
+// Thread counts are the powers of two up to the maximum, then the maximum.
+// Each row is the best of REPEAT runs; the stages also report their
+// speedup over one thread.
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+using namespace glm;
+
+#include "src/bvh.hpp"
+#include "src/culling.hpp"
+#include "src/dds.hpp"
+#include "src/normals.hpp"
+#include "src/obj.hpp"
+#include "src/parallel.hpp"
+#include "src/synthetic.hpp"
+#include "src/texture.hpp"
+
+#define REPEAT 3
+#define LOOP_ITEMS 1000000
+#define TASK_DEPTH 16  // a binary tree of 2^16 forked tasks
+#define CHAIN_LENGTH 1000
+#define TEXTURE_SIZE 4096
+#define BOX_CNT 1000000
+
+enum Stage {
+    STAGE_LOOP,   // ns per item of an empty grain 1 loop
+    STAGE_TASKS,  // ns per forked task
+    STAGE_CHAIN,  // us per dependency of a chain of tasks
+    STAGE_PARSE,
+    STAGE_NORMALS,
+    STAGE_BVH,
+    STAGE_DECODE,
+    STAGE_CULL,
+    STAGE_CNT
+};
+
+static const char* stage_names[STAGE_CNT] = {
+    "loop ns/item", "task ns",    "chain us/dep", "parse ms",
+    "normals ms",   "bvh ms",     "decode ms",    "cull ms"};
+
+struct Inputs {
+    vector<char> obj;
+    vector<vec3> vertices;
+    DDSImage image;
+    BoxSoA boxes;
+    Frustum frustum;
+};
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+static size_t parseCount(const char* s) {
+    char* end;
+    double n = strtod(s, &end);
+    if (*end == 'k' || *end == 'K') n *= 1e3;
+    if (*end == 'm' || *end == 'M') n *= 1e6;
+    return size_t(n);
+}
+
+static uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static bool readFile(const char* path, vector<char>& data) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) return false;
+    char chunk[65536];
+    for (size_t n; (n = fread(chunk, 1, sizeof(chunk), fp)) > 0;) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool makeInputs(size_t triangles, Inputs& in) {
+    const char* tmp = getenv("TMPDIR");
+    string path = string(tmp ? tmp : "/tmp") + "/scaling-bench.obj";
+    SyntheticOptions options = defaultSyntheticOptions(triangles);
+    bool ok = writeSyntheticOBJ(path.c_str(), options, NULL) &&
+              readFile(path.c_str(), in.obj);
+    remove(path.c_str());
+    if (!ok) {
+        fprintf(stderr, "Failed to generate %s.\n", path.c_str());
+        return false;
+    }
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    parseOBJ(&in.obj[0], in.obj.size(), in.vertices, uvs, normals);
+
+    // random DXT1 blocks decode as well as real ones
+    uint32_t rng = 1;
+    in.image.four_cc = FOURCC_DXT1;
+    in.image.block_size = 8;
+    in.image.data.resize(size_t(TEXTURE_SIZE / 4) * (TEXTURE_SIZE / 4) * 8);
+    for (size_t i = 0; i < in.image.data.size(); ++i) {
+        in.image.data[i] = (unsigned char)nextRandom(rng);
+    }
+    DDSLevel level = {TEXTURE_SIZE, TEXTURE_SIZE, 0, in.image.data.size()};
+    in.image.levels.push_back(level);
+
+    // unit boxes scattered in front of the camera and around it
+    in.boxes.resize(BOX_CNT);
+    for (size_t i = 0; i < BOX_CNT; ++i) {
+        vec3 c(float(nextRandom(rng) % 2000) - 1000.0f,
+               float(nextRandom(rng) % 200) - 100.0f,
+               float(nextRandom(rng) % 2000) - 1000.0f);
+        AABB box = {c - vec3(0.5f), c + vec3(0.5f)};
+        in.boxes.set(i, box);
+    }
+    mat4 p_mat = perspective(radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    mat4 v_mat = lookAt(vec3(0.0f), vec3(0.0f, 0.0f, -1.0f),
+                        vec3(0.0f, 1.0f, 0.0f));
+    extractFrustum(p_mat * v_mat, in.frustum);
+    return true;
+}
+
+static size_t forkTasks(int depth) {
+    if (depth == 0) return 1;
+    size_t left = 0, right;
+    TaskGroup group;
+    group.run([&left, depth]() { left = forkTasks(depth - 1); });
+    right = forkTasks(depth - 1);
+    group.wait();
+    return left + right;
+}
+
+static double runStage(Stage stage, const Inputs& in) {
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    switch (stage) {
+        case STAGE_LOOP: {
+            atomic<size_t> items(0);
+            parallelFor(0, LOOP_ITEMS, 1, [&](size_t lo, size_t hi) {
+                items.fetch_add(hi - lo, memory_order_relaxed);
+            });
+            return msSince(t0) * 1e6 / LOOP_ITEMS;
+        }
+        case STAGE_TASKS: {
+            size_t tasks = forkTasks(TASK_DEPTH);
+            return msSince(t0) * 1e6 / tasks;
+        }
+        case STAGE_CHAIN: {
+            vector<unique_ptr<Task> > chain;
+            int hops = 0;
+            for (int i = 0; i < CHAIN_LENGTH; ++i) {
+                chain.push_back(unique_ptr<Task>(new Task([&hops]() {
+                    ++hops;
+                })));
+                if (i) chain[i]->after(*chain[i - 1]);
+            }
+            for (int i = CHAIN_LENGTH; i-- > 0;) chain[i]->submit();
+            chain.back()->wait();
+            return msSince(t0) * 1e3 / hops;
+        }
+        case STAGE_PARSE: {
+            vector<vec3> vertices, normals;
+            vector<vec2> uvs;
+            parseOBJ(&in.obj[0], in.obj.size(), vertices, uvs, normals);
+            break;
+        }
+        case STAGE_NORMALS: {
+            vector<vec3> normals;
+            generateNormals(in.vertices, normals);
+            break;
+        }
+        case STAGE_BVH: {
+            BVH bvh;
+            buildBVH(in.vertices, bvh);
+            break;
+        }
+        case STAGE_DECODE: {
+            Texture texture;
+            decodeDDS(in.image, texture);
+            break;
+        }
+        case STAGE_CULL: {
+            vector<unsigned char> visible(in.boxes.count);
+            cullBoxes(in.frustum, in.boxes, &visible[0]);
+            break;
+        }
+        default:
+            break;
+    }
+    return msSince(t0);
+}
+
+int main(int argc, char* argv[]) {
+    size_t triangles = 1000000;
+    unsigned int max_threads = thread::hardware_concurrency();
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--triangles") == 0 && i + 1 < argc) {
+            triangles = parseCount(argv[++i]);
+        } else if (strcmp(argv[i], "--max-threads") == 0 && i + 1 < argc) {
+            max_threads = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: scaling-bench [--triangles N] "
+                            "[--max-threads N]\n");
+            return 1;
+        }
+    }
+    if (max_threads < 1) max_threads = 1;
+
+    Inputs in;
+    if (!makeInputs(triangles, in)) return 1;
+    printf("%u triangles (%.1f MB obj), %dx%d DXT1, %u boxes\n",
+           (unsigned int)(in.vertices.size() / 3), in.obj.size() * 1e-6,
+           TEXTURE_SIZE, TEXTURE_SIZE, BOX_CNT);
+
+    vector<unsigned int> counts;
+    for (unsigned int t = 1; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+
+    printf("%-14s", "threads");
+    for (size_t c = 0; c < counts.size(); ++c) printf(" %9u", counts[c]);
+    printf("\n");
+    vector<double> best(counts.size() * STAGE_CNT, 1e30);
+    for (size_t c = 0; c < counts.size(); ++c) {
+        setWorkerCount(counts[c]);
+        for (int s = 0; s < STAGE_CNT; ++s) {
+            for (int r = 0; r < REPEAT; ++r) {
+                double v = runStage(Stage(s), in);
+                best[s * counts.size() + c] =
+                    std::min(best[s * counts.size() + c], v);
+            }
+        }
+    }
+    for (int s = 0; s < STAGE_CNT; ++s) {
+        printf("%-14s", stage_names[s]);
+        for (size_t c = 0; c < counts.size(); ++c) {
+            printf(" %9.2f", best[s * counts.size() + c]);
+        }
+        // overheads should stay flat, only the stages have a speedup
+        if (s >= STAGE_PARSE) {
+            printf("  x%.2f", best[s * counts.size()] /
+                                  best[s * counts.size() + counts.size() - 1]);
+        }
+        printf("\n");
+    }
+    setWorkerCount(0);
+    return 0;
+}
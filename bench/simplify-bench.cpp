@@ -0,0 +1,138 @@
+// Quadric simplification and LOD chain build time on obj meshes, and the
+// triangles a row of receding instances costs with and without LOD
+// selection.
+//
+// usage: simplify-bench [model.obj ...]   (default: suzanne.obj brain.obj)
+//
+// Every level of each chain is checked for indices past the vertex buffer
+// and degenerate triangles; the exit status is 1 when any is found or a
+// chain has no level below the mesh itself.
+
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+using namespace glm;
+
+#include "src/mesh-index.hpp"
+#include "src/normals.hpp"
+#include "src/obj.hpp"
+#include "src/parallel.hpp"
+#include "src/simplify.hpp"
+
+#define VIEW_HEIGHT 768
+#define ROW_INSTANCES 100
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+// triangles of a level that are out of the chain, index past the vertex
+// buffer or are degenerate
+static unsigned int badTriangles(const LODChain& chain, const LODLevel& level,
+                                 size_t vertex_cnt) {
+    if (level.count % 3 != 0 ||
+        size_t(level.first) + level.count > chain.indices.size()) {
+        return level.count / 3 + 1;
+    }
+    unsigned int bad = 0;
+    for (uint32_t c = level.first; c < level.first + level.count; c += 3) {
+        uint32_t a = chain.indices[c], b = chain.indices[c + 1];
+        uint32_t d = chain.indices[c + 2];
+        bad += a >= vertex_cnt || b >= vertex_cnt || d >= vertex_cnt ||
+               a == b || b == d || d == a;
+    }
+    return bad;
+}
+
+// returns false when a level of the chain is invalid
+static bool run(const char* path) {
+    vector<vec3> vertices;
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    if (loadOBJ(path, vertices, uvs, normals) < 0) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        return false;
+    }
+    if (normals.size() != vertices.size()) generateNormals(vertices, normals);
+    IndexedMesh mesh;
+    indexMesh(vertices, uvs, normals, mesh);
+    size_t tri_cnt = mesh.indices.size() / 3;
+
+    vector<uint32_t> lod;
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    float error = simplifyMesh(mesh, mesh.indices, tri_cnt / 10 * 3, FLT_MAX,
+                               lod);
+    double simplify_ms = msSince(t0);
+
+    LODChain chain;
+    t0 = chrono::steady_clock::now();
+    buildLODChain(mesh, chain);
+    double chain_ms = msSince(t0);
+
+    vec3 lo = mesh.positions[0], hi = mesh.positions[0];
+    for (size_t v = 0; v < mesh.positions.size(); ++v) {
+        lo = min(lo, mesh.positions[v]);
+        hi = max(hi, mesh.positions[v]);
+    }
+    float extent = length(hi - lo);
+
+    printf("%s: %u triangles, %u vertices, %u threads\n", path,
+           (unsigned int)tri_cnt, (unsigned int)mesh.positions.size(),
+           workerCount());
+    printf("    to 10%%:  %u triangles in %.1f ms, error %.4f (%.3f%% of "
+           "extent)\n", (unsigned int)lod.size() / 3, simplify_ms, error,
+           error / extent * 100.0f);
+    printf("    chain:   %u levels in %.1f ms\n",
+           (unsigned int)chain.levels.size(), chain_ms);
+    unsigned int bad = 0;
+    for (size_t l = 0; l < chain.levels.size(); ++l) {
+        unsigned int level_bad =
+            badTriangles(chain, chain.levels[l], mesh.positions.size());
+        printf("        lod %u: %7u triangles, error %.4f%s\n",
+               (unsigned int)l, chain.levels[l].count / 3,
+               chain.levels[l].error, level_bad ? ", INVALID" : "");
+        bad += level_bad;
+    }
+    if (chain.levels.size() < 2 || bad) {
+        printf("    chain check failed: %u levels, %u bad triangles\n",
+               (unsigned int)chain.levels.size(), bad);
+    }
+
+    // instances every extent units straight ahead of the camera
+    mat4 p_mat = perspective(radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
+    float proj_scale = lodProjScale(p_mat, VIEW_HEIGHT);
+    size_t full = 0, selected = 0, near_full = 0, near_selected = 0;
+    for (int i = 1; i <= ROW_INSTANCES; ++i) {
+        float distance = extent * i;
+        const LODLevel& level =
+            chain.levels[selectLOD(chain.levels, distance, proj_scale)];
+        full += tri_cnt;
+        selected += level.count / 3;
+        if (i <= 10) {
+            near_full += tri_cnt;
+            near_selected += level.count / 3;
+        }
+    }
+    printf("    %d instances 1-%dx extent away: %u -> %u triangles "
+           "(%.1fx fewer, %.1fx beyond 10x)\n", ROW_INSTANCES, ROW_INSTANCES,
+           (unsigned int)full, (unsigned int)selected,
+           double(full) / selected,
+           double(full - near_full) / (selected - near_selected));
+    return chain.levels.size() >= 2 && bad == 0;
+}
+
+int main(int argc, char* argv[]) {
+    bool ok = true;
+    if (argc < 2) {
+        ok = run("suzanne.obj") && ok;
+        ok = run("brain.obj") && ok;
+    }
+    for (int i = 1; i < argc; ++i) ok = run(argv[i]) && ok;
+    return ok ? 0 : 1;
+}
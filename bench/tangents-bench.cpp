@@ -0,0 +1,128 @@
+// Vertex dedup and tangent generation time on obj meshes and a large
+// uv-mapped grid whose right half mirrors its uvs, as on symmetric models.
+//
+// usage: tangents-bench [--grid N] [model.obj ...]
+//        (default: suzanne.obj and a 1000x1000 quad grid, 2M tris)
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "src/mesh-index.hpp"
+#include "src/obj.hpp"
+#include "src/parallel.hpp"
+#include "src/tangents.hpp"
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+static void run(const char* name, const vector<vec3>& vertices,
+                const vector<vec2>& uvs, const vector<vec3>& normals,
+                IndexedMesh& mesh) {
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    indexMesh(vertices, uvs, normals, mesh);
+    double index_ms = msSince(t0);
+    size_t indexed_cnt = mesh.positions.size();
+
+    t0 = chrono::steady_clock::now();
+    if (!generateTangents(mesh)) {
+        fprintf(stderr, "Failed to generate tangents for %s, it needs uvs "
+                        "and normals.\n", name);
+        return;
+    }
+    double tangent_ms = msSince(t0);
+
+    // tangents must lie in the normal plane
+    float max_dot = 0.0f;
+    for (size_t v = 0; v < mesh.positions.size(); ++v) {
+        max_dot = std::max(max_dot, fabs(dot(mesh.normals[v],
+                                             vec3(mesh.tangents[v]))));
+    }
+    size_t tri_cnt = mesh.indices.size() / 3;
+    printf("%s: %u triangles, %u threads\n", name, (unsigned int)tri_cnt,
+           workerCount());
+    printf("    vertices:  %u corners -> %u shared -> %u with tangent "
+           "splits\n", (unsigned int)vertices.size(),
+           (unsigned int)indexed_cnt, (unsigned int)mesh.positions.size());
+    printf("    dedup:     %8.2f ms\n", index_ms);
+    printf("    tangents:  %8.2f ms (%.1f Mtris/s), max |n.t| %.2g\n",
+           tangent_ms, tri_cnt / tangent_ms * 1e-3, max_dot);
+}
+
+// n x n quads on a wavy heightfield with analytic normals; u runs along +x
+// on the left half and back along -x on the right half
+static void makeGrid(int n, vector<vec3>& vertices, vector<vec2>& uvs,
+                     vector<vec3>& normals) {
+    static const int quad[6] = {0, 1, 3, 0, 3, 2};
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            for (int k = 0; k < 6; ++k) {
+                int c = quad[k];
+                float px = float(x + (c & 1)) / n, py = float(y + (c >> 1)) / n;
+                float h = 0.02f * sin(px * 40.0f) * sin(py * 30.0f);
+                float dx = 0.8f * cos(px * 40.0f) * sin(py * 30.0f);
+                float dy = 0.6f * sin(px * 40.0f) * cos(py * 30.0f);
+                vertices.push_back(vec3(px, py, h));
+                normals.push_back(normalize(vec3(-dx, -dy, 1.0f)));
+                float u = px < 0.5f ? px : 1.0f - px;
+                uvs.push_back(vec2(u, -py));  // v flipped like loadOBJ
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int grid = 1000;
+    vector<const char*> paths;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+            grid = atoi(argv[++i]);
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (argc < 2) paths.push_back("suzanne.obj");
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        vector<vec3> vertices;
+        vector<vec2> uvs;
+        vector<vec3> normals;
+        if (loadOBJ(paths[i], vertices, uvs, normals) < 0) {
+            fprintf(stderr, "Failed to open %s.\n", paths[i]);
+            continue;
+        }
+        IndexedMesh mesh;
+        run(paths[i], vertices, uvs, normals, mesh);
+    }
+
+    if (grid > 0) {
+        vector<vec3> vertices;
+        vector<vec2> uvs;
+        vector<vec3> normals;
+        makeGrid(grid, vertices, uvs, normals);
+        char name[64];
+        snprintf(name, sizeof(name), "%dx%d mirrored grid", grid, grid);
+        IndexedMesh mesh;
+        run(name, vertices, uvs, normals, mesh);
+
+        // left half must follow +x with a positive sign, right half -x
+        unsigned int wrong = 0;
+        for (size_t v = 0; v < mesh.positions.size(); ++v) {
+            float expect = mesh.positions[v].x < 0.5f ? 1.0f : -1.0f;
+            if (mesh.positions[v].x == 0.5f) continue;  // the seam
+            const vec4& t = mesh.tangents[v];
+            if (t.w != expect || t.x * expect < 0.5f) ++wrong;
+        }
+        printf("    orientation mismatches: %u\n", wrong);
+    }
+    return 0;
+}
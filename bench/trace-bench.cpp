@@ -0,0 +1,95 @@
+// Cost of a TRACE_SCOPE: recording, not recording yet, and nested scopes on
+// several threads at once (thread cpu time there). Built without
+// OBJ_LOADER_TRACE the scopes are gone and every case measures the empty
+// loop.
+//
+// usage: trace-bench [scopes per thread]   (default: 1000000)
+
+#include <time.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "src/parallel.hpp"
+#include "src/trace.hpp"
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+// cpu time of the calling thread, so oversubscribed runs measure the
+// scopes rather than the scheduler
+static double threadMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+// keeps the loops from being folded away when the scopes are compiled out
+static volatile unsigned int sink;
+
+static void flatScopes(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        TRACE_SCOPE("flat");
+        sink = i;
+    }
+}
+
+static void nestedScopes(size_t n) {
+    for (size_t i = 0; i < n; i += 4) {
+        TRACE_SCOPE("outer");
+        sink = i;
+        for (int k = 0; k < 3; ++k) {
+            TRACE_SCOPE("inner");
+            sink = k;
+        }
+    }
+}
+
+static void report(const char* name, size_t scope_cnt, double ms) {
+    printf("%-28s %10u scopes %8.1f ms %7.1f ns per scope\n", name,
+           (unsigned int)scope_cnt, ms, ms * 1e6 / scope_cnt);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    n = (n + 3) / 4 * 4;
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    flatScopes(n);
+    report("before startTrace", n, msSince(t0));
+
+    startTrace();
+    flatScopes(n);  // first pass allocates the event chunks
+    t0 = chrono::steady_clock::now();
+    flatScopes(n);
+    report("recording", n, msSince(t0));
+
+    t0 = chrono::steady_clock::now();
+    nestedScopes(n);
+    report("recording, nested", n, msSince(t0));
+
+    unsigned int thread_cnt = workerCount();
+    vector<double> thread_ms(thread_cnt);
+    vector<thread> threads;
+    for (unsigned int i = 0; i < thread_cnt; ++i) {
+        threads.push_back(thread([&thread_ms, i, n]() {
+            double t = threadMs();
+            nestedScopes(n);
+            thread_ms[i] = threadMs() - t;
+        }));
+    }
+    double cpu_ms = 0.0;
+    for (unsigned int i = 0; i < thread_cnt; ++i) {
+        threads[i].join();
+        cpu_ms += thread_ms[i];
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "recording, %u threads", thread_cnt);
+    report(name, n * thread_cnt, cpu_ms);
+    return 0;
+}
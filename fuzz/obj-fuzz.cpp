@@ -0,0 +1,309 @@
+// Adversarial input for the obj parser. Built with OBJ_LOADER_FUZZ (clang)
+// this is a libFuzzer target; otherwise it runs a corpus through the same
+// checks and then times every input grown two ways, flagging the ones whose
+// parse time or memory grows faster than their size.
+//
+// usage: obj-fuzz [--threads N] [--min-bytes N] [--max-exponent X]
+//                 corpus-dir|input.obj ...
+//        (default: 1 thread, grown from 64 KB, exponent 1.5)
+//        obj-fuzz -rss_limit_mb=512 -max_len=65536 fuzz/corpus (libFuzzer)
+//
+// "tall" repeats the whole input, so costs that grow with the element
+// count show; "wide" repeats the arguments of every line, so costs that
+// grow with the line length show. Each is parsed at 1x, 8x and 64x the
+// base size and the growth is fitted as size^exponent: 1 is linear, and
+// the working set leaving the caches alone lifts it to about 1.2, while a
+// quadratic cost fits near 2. Inputs larger than the base size are cut to
+// their first lines. The exit status is 1 when any input failed a check or
+// was flagged.
+
+#include <stdint.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "src/memory-stats.hpp"
+#include "src/obj.hpp"
+#include "src/parallel.hpp"
+
+#define REPEAT 3
+#define SIZE_CNT 3  // sizes each fit is made over
+#define GROWTH 8    // between consecutive sizes
+
+// Every corner past the first three of a face takes at least 2 bytes
+// ("1 ") and adds a triangle, so no input makes more corners than this.
+#define MAX_CORNERS_PER_BYTE 2
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "Failed check: %s\n", what);
+        abort();
+    }
+}
+
+// The input copied to end right before an unreadable page, so reads past
+// it fault even inside libc, where the sanitizers do not look (strtof).
+class GuardedCopy {
+   public:
+    GuardedCopy(const uint8_t* data, size_t size) : map(NULL), map_size(0) {
+#ifndef _WIN32
+        size_t page = sysconf(_SC_PAGESIZE);
+        map_size = (size + page - 1) / page * page + page;
+        void* p = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            map = (char*)p;
+            mprotect(map + map_size - page, page, PROT_NONE);
+            begin = map + map_size - page - size;
+            memcpy(begin, data, size);
+            return;
+        }
+#endif
+        copy.assign(data, data + size);
+        begin = copy.empty() ? NULL : &copy[0];
+    }
+    ~GuardedCopy() {
+#ifndef _WIN32
+        if (map) munmap(map, map_size);
+#endif
+    }
+    const char* data() const { return begin; }
+
+   private:
+    GuardedCopy(const GuardedCopy&);
+    GuardedCopy& operator=(const GuardedCopy&);
+
+    char* map;
+    size_t map_size;
+    char* begin;
+    vector<char> copy;  // without mmap
+};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    vector<vec3> vertices, normals;
+    vector<vec2> uvs;
+    GuardedCopy input(data, size);
+    int res = parseOBJ(input.data(), size, vertices, uvs, normals);
+    check(res == 0 || res == 1, "parseOBJ returns 0 or 1");
+    check(vertices.size() % 3 == 0, "whole triangles");
+    check(uvs.empty() || uvs.size() == vertices.size(), "a uv per corner");
+    check(normals.empty() || normals.size() == vertices.size(),
+          "a normal per corner");
+    check(vertices.size() <= size * MAX_CORNERS_PER_BYTE,
+          "corners linear in the input");
+    return 0;
+}
+
+#ifndef OBJ_FUZZ_LIBFUZZER
+
+struct Cost {
+    double ns;
+    size_t bytes;  // loader peak and the outputs
+};
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+static bool readFile(const string& path, string& data) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open %s.\n", path.c_str());
+        return false;
+    }
+    char chunk[65536];
+    for (size_t n; (n = fread(chunk, 1, sizeof(chunk), fp)) > 0;) {
+        data.append(chunk, n);
+    }
+    fclose(fp);
+    return true;
+}
+
+static void addInputs(const char* arg, vector<string>& inputs) {
+#ifndef _WIN32
+    struct stat st;
+    if (stat(arg, &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(arg);
+        if (dir == NULL) {
+            fprintf(stderr, "Failed to open corpus %s.\n", arg);
+            return;
+        }
+        for (struct dirent* entry; (entry = readdir(dir)) != NULL;) {
+            if (entry->d_name[0] == '.') continue;
+            inputs.push_back(string(arg) + "/" + entry->d_name);
+        }
+        closedir(dir);
+        return;
+    }
+#endif
+    inputs.push_back(arg);
+}
+
+// a prefix cut at a line end is still an obj file
+static string prefix(const string& data, size_t bytes) {
+    size_t eol = data.size() > bytes ? data.find('\n', bytes) : string::npos;
+    return eol == string::npos ? data : data.substr(0, eol + 1);
+}
+
+static string growTall(const string& data, size_t times) {
+    string line_end = data.empty() || data[data.size() - 1] == '\n' ? "" : "\n";
+    string grown;
+    grown.reserve((data.size() + 1) * times);
+    for (size_t i = 0; i < times; ++i) grown += data + line_end;
+    return grown;
+}
+
+// "f 1 2 3" becomes "f 1 2 3 1 2 3 ...", the keyword once
+static string growWide(const string& data, size_t times) {
+    string grown;
+    grown.reserve(data.size() * times);
+    size_t p = 0;
+    while (p < data.size()) {
+        size_t eol = data.find('\n', p);
+        if (eol == string::npos) eol = data.size();
+        size_t args = data.find_first_not_of(" \t", p);
+        if (args > eol) args = eol;
+        args = std::min(data.find_first_of(" \t", args), eol);
+        size_t args_end = eol;
+        if (args_end > args && data[args_end - 1] == '\r') --args_end;
+        grown.append(data, p, args - p);
+        for (size_t i = 0; i < times; ++i) {
+            grown.append(data, args, args_end - args);
+        }
+        grown.append(data, args_end, eol - args_end);
+        grown += '\n';
+        p = eol + 1;
+    }
+    return grown;
+}
+
+static Cost measure(const string& data) {
+    Cost best = {1e30, 0};
+    for (int r = 0; r < REPEAT; ++r) {
+        vector<vec3> vertices, normals;
+        vector<vec2> uvs;
+        resetMemoryPeak(MEMORY_LOADER);
+        size_t before = getMemoryStats(MEMORY_LOADER).current;
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        parseOBJ(data.c_str(), data.size(), vertices, uvs, normals);
+        double ns = msSince(t0) * 1e6;
+        best.ns = std::min(best.ns, ns);
+        best.bytes = getMemoryStats(MEMORY_LOADER).peak - before +
+                     capacityBytes(vertices) + capacityBytes(uvs) +
+                     capacityBytes(normals);
+    }
+    return best;
+}
+
+// least squares fit of cost = c * size^exponent
+static double exponent(const double* sizes, const double* costs) {
+    double mean_x = 0.0, mean_y = 0.0;
+    for (int s = 0; s < SIZE_CNT; ++s) {
+        if (costs[s] <= 0.0) return 0.0;
+        mean_x += log(sizes[s]) / SIZE_CNT;
+        mean_y += log(costs[s]) / SIZE_CNT;
+    }
+    double sxy = 0.0, sxx = 0.0;
+    for (int s = 0; s < SIZE_CNT; ++s) {
+        double dx = log(sizes[s]) - mean_x;
+        sxy += dx * (log(costs[s]) - mean_y);
+        sxx += dx * dx;
+    }
+    return sxx > 0.0 ? sxy / sxx : 0.0;
+}
+
+// returns false when the input is flagged
+static bool timeGrowth(const string& input, const char* mode,
+                       size_t min_bytes, double max_exponent) {
+    // Widening changes the shape of a file until its lines are a few times
+    // their length (faces become fans), so it starts at GROWTH times.
+    bool wide = strcmp(mode, "wide") == 0;
+    size_t first = wide ? GROWTH : 1;
+    string data = prefix(input, min_bytes / first);
+    size_t unit = (wide ? growWide(data, 1) : growTall(data, 1)).size();
+    size_t base = std::max(first, min_bytes / std::max<size_t>(unit, 1));
+    double sizes[SIZE_CNT], times[SIZE_CNT], bytes[SIZE_CNT];
+    for (size_t s = 0, times_grown = base; s < SIZE_CNT;
+         ++s, times_grown *= GROWTH) {
+        string grown = wide ? growWide(data, times_grown)
+                            : growTall(data, times_grown);
+        Cost cost = measure(grown);
+        sizes[s] = grown.size();
+        times[s] = cost.ns;
+        bytes[s] = cost.bytes;
+    }
+    double time_exp = exponent(sizes, times);
+    double memory_exp = exponent(sizes, bytes);
+    bool flagged = time_exp > max_exponent || memory_exp > max_exponent;
+    double largest = sizes[SIZE_CNT - 1];
+    printf("  %-4s %8.1f -> %8.1f KB  %6.2f ns/byte  time ^%.2f  memory "
+           "^%.2f  %.1f bytes/byte%s\n",
+           mode, sizes[0] * 1e-3, largest * 1e-3,
+           times[SIZE_CNT - 1] / largest, time_exp, memory_exp,
+           bytes[SIZE_CNT - 1] / largest, flagged ? "  SUPER-LINEAR" : "");
+    return !flagged;
+}
+
+int main(int argc, char* argv[]) {
+    size_t min_bytes = 64 << 10;
+    double max_exponent = 1.5;
+    unsigned int threads = 1;  // parsing stays serial below OBJ_PARALLEL_BYTES
+    vector<string> inputs;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--min-bytes") == 0 && i + 1 < argc) {
+            min_bytes = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--max-exponent") == 0 && i + 1 < argc) {
+            max_exponent = atof(argv[++i]);
+        } else {
+            addInputs(argv[i], inputs);
+        }
+    }
+    if (inputs.empty()) {
+        fprintf(stderr, "usage: obj-fuzz [--threads N] [--min-bytes N] "
+                        "[--max-exponent X] corpus-dir|input.obj ...\n");
+        return 1;
+    }
+    sort(inputs.begin(), inputs.end());
+    setWorkerCount(threads);
+
+    unsigned int flagged = 0, failed = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        string data;
+        if (!readFile(inputs[i], data)) {
+            ++failed;
+            continue;
+        }
+        // the checks abort, so a failing input is the last one printed
+        printf("%s: %u bytes\n", inputs[i].c_str(), (unsigned int)data.size());
+        fflush(stdout);
+        LLVMFuzzerTestOneInput((const uint8_t*)data.data(), data.size());
+        if (data.empty()) continue;
+        bool ok = timeGrowth(data, "tall", min_bytes, max_exponent);
+        ok = timeGrowth(data, "wide", min_bytes, max_exponent) && ok;
+        flagged += !ok;
+    }
+    printf("%u inputs, %u super-linear, %u unreadable\n",
+           (unsigned int)inputs.size(), flagged, failed);
+    return flagged || failed ? 1 : 0;
+}
+
+#endif
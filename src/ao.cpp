@@ -0,0 +1,167 @@
+#include "ao.hpp"
+
+#include <stdint.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+using namespace std;
+using namespace glm;
+
+#include "culling.hpp"
+#include "file-stamp.hpp"
+#include "mesh-index.hpp"
+#include "normals.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+#define AO_MAGIC "AO02"
+// rays start this fraction of the bounds diagonal off the surface
+#define AO_BIAS 1e-3f
+
+namespace {
+
+struct AOHeader {
+    char magic[4];
+    uint32_t corner_cnt;
+    uint32_t ray_cnt;
+    FileStamp source;  // of the obj the bake was made from
+};
+
+uint32_t hashIndex(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// fraction of cosine weighted hemisphere rays around n that escape
+float occlusionAt(const BVH& bvh, const vec3& p, const vec3& n, int ray_cnt,
+                  float bias, float max_dist, uint32_t seed) {
+    vec3 t = fabs(n.x) > 0.5f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f);
+    vec3 b = normalize(cross(n, t));
+    t = cross(b, n);
+    vec3 origin = p + n * bias;
+
+    // stratified over a sqrt(n) grid, jittered per vertex against banding
+    int side = int(sqrt(float(ray_cnt)));
+    if (side < 1) side = 1;
+    int open = 0;
+    uint32_t rng = hashIndex(seed);
+    for (int i = 0; i < ray_cnt; ++i) {
+        rng = hashIndex(rng + i);
+        float jx = (rng & 0xffff) / 65536.0f;
+        float jy = (rng >> 16) / 65536.0f;
+        int cell = i % (side * side);
+        float u1 = (cell % side + jx) / side;
+        float u2 = (cell / side + jy) / side;
+        float r = sqrt(u1), phi = 6.2831853f * u2;
+        vec3 dir = t * (r * cos(phi)) + b * (r * sin(phi)) +
+                   n * sqrt(std::max(0.0f, 1.0f - u1));
+        open += !occludedBVH(bvh, origin, dir, max_dist);
+    }
+    return float(open) / float(ray_cnt);
+}
+
+bool readCache(const string& path, const FileStamp& source,
+               size_t corner_cnt, vector<float>& ao) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    AOHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, AO_MAGIC, 4) == 0 &&
+              header.corner_cnt == corner_cnt && header.ray_cnt == AO_RAYS &&
+              header.source == source;
+    if (ok) {
+        ao.resize(corner_cnt);
+        ok = fread(&ao[0], sizeof(float), corner_cnt, file) == corner_cnt;
+    }
+    fclose(file);
+    return ok;
+}
+
+bool writeCache(const string& path, const FileStamp& source,
+                const vector<float>& ao) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to write AO cache %s.\n", path.c_str());
+        return false;
+    }
+    AOHeader header;
+    memset(&header, 0, sizeof(header));  // the padding too
+    memcpy(header.magic, AO_MAGIC, 4);
+    header.corner_cnt = ao.size();
+    header.ray_cnt = AO_RAYS;
+    header.source = source;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(&ao[0], sizeof(float), ao.size(), file) == ao.size();
+    fclose(file);
+    if (!ok) fprintf(stderr, "Failed to write AO cache %s.\n", path.c_str());
+    return ok;
+}
+
+}  // namespace
+
+void bakeAO(const BVH& bvh, const vector<vec3>& vertices,
+            const vector<vec3>& normals, vector<float>& ao, int ray_cnt) {
+    TRACE_SCOPE("bakeAO");
+    ao.assign(vertices.size(), 1.0f);
+    if (vertices.empty()) return;
+
+    vector<vec3> welded;
+    const vector<vec3>* corner_normals = &normals;
+    if (normals.size() != vertices.size()) {
+        generateNormals(vertices, welded, NORMAL_WEIGHT_AREA);
+        corner_normals = &welded;
+    }
+
+    // one sample per distinct position and normal
+    vector<vec3> keys(vertices.size() * 2);
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        keys[i * 2] = vertices[i];
+        keys[i * 2 + 1] = (*corner_normals)[i];
+    }
+    vector<uint32_t> corner_ids;
+    uint32_t sample_cnt = weldVertices(&keys[0], vertices.size(),
+                                       sizeof(vec3) * 2, corner_ids);
+    vector<uint32_t> sample_corner(sample_cnt);
+    for (size_t i = vertices.size(); i-- > 0;) sample_corner[corner_ids[i]] = i;
+
+    AABB bounds = computeBounds(vertices);
+    float diag = length(bounds.max - bounds.min);
+    vector<float> samples(sample_corner.size());
+    // chunks are claimed dynamically, so threads that drew open surface
+    // move on to the rest instead of idling
+    parallelFor(0, samples.size(), 64, [&](size_t lo, size_t hi) {
+        for (size_t s = lo; s < hi; ++s) {
+            uint32_t c = sample_corner[s];
+            vec3 n = normalize((*corner_normals)[c]);
+            samples[s] = occlusionAt(bvh, vertices[c], n, ray_cnt,
+                                     diag * AO_BIAS, diag * AO_DISTANCE, s);
+        }
+    });
+    for (size_t i = 0; i < vertices.size(); ++i) ao[i] = samples[corner_ids[i]];
+}
+
+bool loadOrBakeAO(const char* obj_path, const BVH& bvh,
+                  const vector<vec3>& vertices, const vector<vec3>& normals,
+                  vector<float>& ao) {
+    string cache = string(obj_path) + ".ao";
+    FileStamp source;
+    bool stamped = fileStamp(obj_path, source);
+    if (stamped && readCache(cache, source, vertices.size(), ao)) return true;
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    bakeAO(bvh, vertices, normals, ao);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() -
+                                                t0).count();
+    printf("baked AO for %s: %u corners, %d rays, %.0f ms on %u threads\n",
+           obj_path, (unsigned int)vertices.size(), AO_RAYS, ms,
+           workerCount());
+    // a bake of an obj that cannot be stat'ed is used but not cached
+    return !stamped || writeCache(cache, source, ao);
+}
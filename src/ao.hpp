@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.hpp"
+
+#define AO_RAYS 64
+// occluders farther than this fraction of the bounds diagonal are ignored
+#define AO_DISTANCE 0.25f
+
+// Per-corner ambient occlusion of a triangle soup, 1 for fully open. Corners
+// sharing a position and normal are baked once; without normals the area
+// weighted face normals of each welded position are used. Vertices are
+// baked in parallel with ray_cnt cosine weighted hemisphere rays each.
+void bakeAO(const BVH& bvh, const std::vector<glm::vec3>& vertices,
+            const std::vector<glm::vec3>& normals, std::vector<float>& ao,
+            int ray_cnt = AO_RAYS);
+
+// reads the bake cached in obj_path + ".ao" when it was made from the obj
+// as it is now (the same size and modification time) and matches the mesh,
+// otherwise bakes and rewrites the cache
+bool loadOrBakeAO(const char* obj_path, const BVH& bvh,
+                  const std::vector<glm::vec3>& vertices,
+                  const std::vector<glm::vec3>& normals,
+                  std::vector<float>& ao);
@@ -0,0 +1,460 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <mutex>
+using namespace std;
+using namespace glm;
+
+#include "parallel.hpp"
+#include "trace.hpp"
+
+// subtrees larger than this are handed to another thread
+#define BVH_PARALLEL_SPLIT 4096
+// ranges larger than this are binned in parallel
+#define BVH_PARALLEL_BINNING (1 << 16)
+#define BVH_STACK_SIZE 64
+// deeper nodes become leaves so traversal stacks can never overflow
+#define BVH_MAX_DEPTH (BVH_STACK_SIZE - 2)
+
+namespace {
+
+struct BuildNode {
+    AABB bounds;
+    uint32_t left;  // first of two consecutive children, 0 for leaves
+    uint32_t first;
+    uint32_t count;
+};
+
+struct Bin {
+    AABB bounds;
+    uint32_t count;
+};
+
+struct Builder {
+    const vector<vec3>* vertices;
+    vector<AABB> tri_bounds;
+    vector<vec3> centroids;
+    vector<uint32_t> idx;
+    vector<BuildNode> nodes;
+    atomic<uint32_t> next_node;
+};
+
+void emptyBox(AABB& box) {
+    box.min = vec3(FLT_MAX);
+    box.max = vec3(-FLT_MAX);
+}
+
+void growBox(AABB& box, const AABB& other) {
+    box.min = min(box.min, other.min);
+    box.max = max(box.max, other.max);
+}
+
+float halfArea(const AABB& box) {
+    vec3 e = box.max - box.min;
+    if (e.x < 0) return 0.0f;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+// bins of all three axes for idx[first, first + count)
+void binRange(const Builder& b, uint32_t first, uint32_t count,
+              const AABB& cbounds, Bin bins[3][BVH_BINS]) {
+    vec3 extent = cbounds.max - cbounds.min;
+    vec3 scale;
+    for (int a = 0; a < 3; ++a) {
+        scale[a] = extent[a] > 0 ? BVH_BINS / extent[a] : 0.0f;
+    }
+    for (int a = 0; a < 3; ++a) {
+        for (int i = 0; i < BVH_BINS; ++i) {
+            emptyBox(bins[a][i].bounds);
+            bins[a][i].count = 0;
+        }
+    }
+    for (uint32_t i = first; i < first + count; ++i) {
+        uint32_t t = b.idx[i];
+        vec3 rel = (b.centroids[t] - cbounds.min) * scale;
+        for (int a = 0; a < 3; ++a) {
+            int bin = std::min(int(rel[a]), BVH_BINS - 1);
+            growBox(bins[a][bin].bounds, b.tri_bounds[t]);
+            ++bins[a][bin].count;
+        }
+    }
+}
+
+void mergeBins(Bin dst[3][BVH_BINS], const Bin src[3][BVH_BINS]) {
+    for (int a = 0; a < 3; ++a) {
+        for (int i = 0; i < BVH_BINS; ++i) {
+            growBox(dst[a][i].bounds, src[a][i].bounds);
+            dst[a][i].count += src[a][i].count;
+        }
+    }
+}
+
+void binParallel(const Builder& b, uint32_t first, uint32_t count,
+                 const AABB& cbounds, Bin bins[3][BVH_BINS]) {
+    for (int a = 0; a < 3; ++a) {
+        for (int i = 0; i < BVH_BINS; ++i) {
+            emptyBox(bins[a][i].bounds);
+            bins[a][i].count = 0;
+        }
+    }
+    mutex merge_lock;
+    size_t grain = count / (workerCount() * 4) + 1;
+    parallelFor(first, first + count, grain, [&](size_t lo, size_t hi) {
+        Bin local[3][BVH_BINS];
+        binRange(b, lo, hi - lo, cbounds, local);
+        lock_guard<mutex> lock(merge_lock);
+        mergeBins(bins, local);
+    });
+}
+
+void buildNode(Builder& b, uint32_t node_i, int depth) {
+    BuildNode& node = b.nodes[node_i];
+    uint32_t first = node.first, count = node.count;
+
+    AABB cbounds;
+    emptyBox(node.bounds);
+    emptyBox(cbounds);
+    for (uint32_t i = first; i < first + count; ++i) {
+        uint32_t t = b.idx[i];
+        growBox(node.bounds, b.tri_bounds[t]);
+        cbounds.min = min(cbounds.min, b.centroids[t]);
+        cbounds.max = max(cbounds.max, b.centroids[t]);
+    }
+    node.left = 0;
+    if (count <= 2 || depth >= BVH_MAX_DEPTH) return;
+
+    Bin bins[3][BVH_BINS];
+    if (count >= BVH_PARALLEL_BINNING) {
+        binParallel(b, first, count, cbounds, bins);
+    } else {
+        binRange(b, first, count, cbounds, bins);
+    }
+
+    // sweep every axis for the cheapest split plane
+    float best_cost = FLT_MAX;
+    int best_axis = -1, best_bin = 0;
+    for (int a = 0; a < 3; ++a) {
+        if (cbounds.max[a] <= cbounds.min[a]) continue;
+        float right_area[BVH_BINS];
+        uint32_t right_cnt[BVH_BINS];
+        AABB acc;
+        emptyBox(acc);
+        uint32_t cnt = 0;
+        for (int i = BVH_BINS - 1; i > 0; --i) {
+            growBox(acc, bins[a][i].bounds);
+            cnt += bins[a][i].count;
+            right_area[i] = halfArea(acc);
+            right_cnt[i] = cnt;
+        }
+        emptyBox(acc);
+        cnt = 0;
+        for (int i = 0; i < BVH_BINS - 1; ++i) {
+            growBox(acc, bins[a][i].bounds);
+            cnt += bins[a][i].count;
+            if (cnt == 0 || right_cnt[i + 1] == 0) continue;
+            float cost =
+                halfArea(acc) * cnt + right_area[i + 1] * right_cnt[i + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = a;
+                best_bin = i;
+            }
+        }
+    }
+
+    // traversal step costs about as much as one triangle test
+    float leaf_cost = float(count);
+    float split_cost = 1.0f + best_cost / halfArea(node.bounds);
+
+    uint32_t mid;
+    if (best_axis >= 0 && (split_cost < leaf_cost || count > BVH_MAX_LEAF)) {
+        float lo = cbounds.min[best_axis];
+        float scale = BVH_BINS / (cbounds.max[best_axis] - lo);
+        uint32_t* it = partition(
+            &b.idx[first], &b.idx[first] + count, [&](uint32_t t) {
+                int bin = int((b.centroids[t][best_axis] - lo) * scale);
+                return std::min(bin, BVH_BINS - 1) <= best_bin;
+            });
+        mid = uint32_t(it - &b.idx[0]);
+        if (mid == first || mid == first + count) mid = first + count / 2;
+    } else if (count > BVH_MAX_LEAF) {
+        // coincident centroids, any split is as good as another
+        mid = first + count / 2;
+    } else {
+        return;
+    }
+
+    uint32_t left = b.next_node.fetch_add(2);
+    node.left = left;
+    b.nodes[left].first = first;
+    b.nodes[left].count = mid - first;
+    b.nodes[left + 1].first = mid;
+    b.nodes[left + 1].count = first + count - mid;
+
+    if (count >= BVH_PARALLEL_SPLIT) {
+        TaskGroup group;
+        group.run([&b, left, depth]() { buildNode(b, left, depth + 1); });
+        buildNode(b, left + 1, depth + 1);
+        group.wait();
+    } else {
+        buildNode(b, left, depth + 1);
+        buildNode(b, left + 1, depth + 1);
+    }
+}
+
+// depth-first copy of the build tree into the final layout
+uint32_t flatten(const Builder& b, uint32_t node_i, BVH& bvh) {
+    const BuildNode& src = b.nodes[node_i];
+    uint32_t out = bvh.nodes.size();
+    bvh.nodes.push_back(BVHNode());
+    bvh.nodes[out].bmin = src.bounds.min;
+    bvh.nodes[out].bmax = src.bounds.max;
+
+    if (src.left == 0) {
+        bvh.nodes[out].offset = bvh.tris.size();
+        bvh.nodes[out].count = src.count;
+        const vector<vec3>& v = *b.vertices;
+        for (uint32_t i = src.first; i < src.first + src.count; ++i) {
+            uint32_t t = b.idx[i];
+            BVHTriangle tri;
+            tri.v0 = v[t * 3];
+            tri.e1 = v[t * 3 + 1] - tri.v0;
+            tri.e2 = v[t * 3 + 2] - tri.v0;
+            bvh.tris.push_back(tri);
+            bvh.tri_ids.push_back(t);
+        }
+        return out;
+    }
+
+    flatten(b, src.left, bvh);
+    uint32_t right = flatten(b, src.left + 1, bvh);
+    bvh.nodes[out].offset = right;
+    bvh.nodes[out].count = 0;
+    return out;
+}
+
+// slab test, returns the entry distance or FLT_MAX on a miss
+inline float hitBox(const BVHNode& node, const vec3& o, const vec3& inv_d,
+                    float tmax) {
+    vec3 t1 = (node.bmin - o) * inv_d;
+    vec3 t2 = (node.bmax - o) * inv_d;
+    vec3 tn = min(t1, t2), tf = max(t1, t2);
+    float t_near = std::max(std::max(tn.x, tn.y), std::max(tn.z, 0.0f));
+    float t_far = std::min(std::min(tf.x, tf.y), std::min(tf.z, tmax));
+    return t_near <= t_far ? t_near : FLT_MAX;
+}
+
+// Moller-Trumbore
+inline bool hitTriangle(const BVHTriangle& tri, const vec3& o, const vec3& d,
+                        float tmax, float& t, float& u, float& v) {
+    vec3 p = cross(d, tri.e2);
+    float det = dot(tri.e1, p);
+    if (fabs(det) < 1e-12f) return false;
+    float inv_det = 1.0f / det;
+    vec3 s = o - tri.v0;
+    u = dot(s, p) * inv_det;
+    if (u < 0.0f || u > 1.0f) return false;
+    vec3 q = cross(s, tri.e1);
+    v = dot(d, q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    t = dot(tri.e2, q) * inv_det;
+    return t >= 0.0f && t < tmax;
+}
+
+vec3 safeInverse(const vec3& d) {
+    vec3 inv;
+    for (int a = 0; a < 3; ++a) {
+        inv[a] = 1.0f / (fabs(d[a]) > 1e-20f ? d[a] : copysign(1e-20f, d[a]));
+    }
+    return inv;
+}
+
+// separating axis test of a triangle against a box (Akenine-Moller)
+bool triangleOverlapsBox(const BVHTriangle& tri, const vec3& center,
+                         const vec3& half) {
+    vec3 v[3];
+    v[0] = tri.v0 - center;
+    v[1] = v[0] + tri.e1;
+    v[2] = v[0] + tri.e2;
+    vec3 edges[3] = {v[1] - v[0], v[2] - v[1], v[0] - v[2]};
+
+    vec3 axes[13];
+    int axis_cnt = 0;
+    axes[axis_cnt++] = vec3(1, 0, 0);
+    axes[axis_cnt++] = vec3(0, 1, 0);
+    axes[axis_cnt++] = vec3(0, 0, 1);
+    axes[axis_cnt++] = cross(tri.e1, tri.e2);
+    for (int i = 0; i < 3; ++i) {
+        for (int e = 0; e < 3; ++e) {
+            vec3 unit(0.0f);
+            unit[i] = 1.0f;
+            axes[axis_cnt++] = cross(unit, edges[e]);
+        }
+    }
+
+    for (int i = 0; i < axis_cnt; ++i) {
+        const vec3& a = axes[i];
+        if (a.x == 0 && a.y == 0 && a.z == 0) continue;
+        float p0 = dot(v[0], a), p1 = dot(v[1], a), p2 = dot(v[2], a);
+        float r = half.x * fabs(a.x) + half.y * fabs(a.y) + half.z * fabs(a.z);
+        float lo = std::min(p0, std::min(p1, p2));
+        float hi = std::max(p0, std::max(p1, p2));
+        if (lo > r || hi < -r) return false;
+    }
+    return true;
+}
+
+int depthOf(const BVH& bvh, uint32_t node_i) {
+    const BVHNode& node = bvh.nodes[node_i];
+    if (node.count) return 1;
+    return 1 + std::max(depthOf(bvh, node_i + 1), depthOf(bvh, node.offset));
+}
+
+}  // namespace
+
+void buildBVH(const vector<vec3>& vertices, BVH& bvh) {
+    TRACE_SCOPE("buildBVH");
+    bvh.nodes.clear();
+    bvh.tris.clear();
+    bvh.tri_ids.clear();
+
+    uint32_t tri_cnt = vertices.size() / 3;
+    if (tri_cnt == 0) return;
+
+    Builder b;
+    b.vertices = &vertices;
+    b.tri_bounds.resize(tri_cnt);
+    b.centroids.resize(tri_cnt);
+    b.idx.resize(tri_cnt);
+    parallelFor(0, tri_cnt, 4096, [&](size_t lo, size_t hi) {
+        for (size_t t = lo; t < hi; ++t) {
+            const vec3& a = vertices[t * 3];
+            const vec3& c = vertices[t * 3 + 1];
+            const vec3& d = vertices[t * 3 + 2];
+            b.tri_bounds[t].min = min(a, min(c, d));
+            b.tri_bounds[t].max = max(a, max(c, d));
+            b.centroids[t] = (a + c + d) * (1.0f / 3.0f);
+            b.idx[t] = t;
+        }
+    });
+
+    b.nodes.resize(tri_cnt * 2);
+    b.next_node = 1;
+    b.nodes[0].first = 0;
+    b.nodes[0].count = tri_cnt;
+    buildNode(b, 0, 0);
+
+    bvh.nodes.reserve(b.next_node);
+    bvh.tris.reserve(tri_cnt);
+    bvh.tri_ids.reserve(tri_cnt);
+    flatten(b, 0, bvh);
+}
+
+bool intersectBVH(const BVH& bvh, const vec3& origin, const vec3& dir,
+                  float tmax, RayHit& hit) {
+    if (bvh.nodes.empty()) return false;
+    vec3 inv_d = safeInverse(dir);
+    hit.t = tmax;
+    bool found = false;
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    uint32_t node_i = 0;
+    if (hitBox(bvh.nodes[0], origin, inv_d, tmax) == FLT_MAX) return false;
+
+    for (;;) {
+        const BVHNode& node = bvh.nodes[node_i];
+        if (node.count) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                float t, u, v;
+                if (hitTriangle(bvh.tris[i], origin, dir, hit.t, t, u, v)) {
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.tri = bvh.tri_ids[i];
+                    found = true;
+                }
+            }
+        } else {
+            // visit the nearer child first, keep the other for later
+            uint32_t near_i = node_i + 1, far_i = node.offset;
+            float near_t = hitBox(bvh.nodes[near_i], origin, inv_d, hit.t);
+            float far_t = hitBox(bvh.nodes[far_i], origin, inv_d, hit.t);
+            if (far_t < near_t) {
+                swap(near_i, far_i);
+                swap(near_t, far_t);
+            }
+            if (near_t != FLT_MAX) {
+                if (far_t != FLT_MAX) stack[top++] = far_i;
+                node_i = near_i;
+                continue;
+            }
+        }
+        if (top == 0) break;
+        node_i = stack[--top];
+    }
+    return found;
+}
+
+bool occludedBVH(const BVH& bvh, const vec3& origin, const vec3& dir,
+                 float tmax) {
+    if (bvh.nodes.empty()) return false;
+    vec3 inv_d = safeInverse(dir);
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+        const BVHNode& node = bvh.nodes[stack[--top]];
+        if (hitBox(node, origin, inv_d, tmax) == FLT_MAX) continue;
+        if (node.count) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                float t, u, v;
+                if (hitTriangle(bvh.tris[i], origin, dir, tmax, t, u, v)) {
+                    return true;
+                }
+            }
+        } else {
+            stack[top++] = node.offset;
+            stack[top++] = uint32_t(&node - &bvh.nodes[0]) + 1;
+        }
+    }
+    return false;
+}
+
+size_t queryBVH(const BVH& bvh, const AABB& box, vector<uint32_t>& out) {
+    if (bvh.nodes.empty()) return 0;
+    size_t start = out.size();
+    vec3 center = (box.min + box.max) * 0.5f;
+    vec3 half = (box.max - box.min) * 0.5f;
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+        uint32_t node_i = stack[--top];
+        const BVHNode& node = bvh.nodes[node_i];
+        if (any(lessThan(node.bmax, box.min)) ||
+            any(greaterThan(node.bmin, box.max))) {
+            continue;
+        }
+        if (node.count) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                if (triangleOverlapsBox(bvh.tris[i], center, half)) {
+                    out.push_back(bvh.tri_ids[i]);
+                }
+            }
+        } else {
+            stack[top++] = node.offset;
+            stack[top++] = node_i + 1;
+        }
+    }
+    return out.size() - start;
+}
+
+int bvhDepth(const BVH& bvh) {
+    return bvh.nodes.empty() ? 0 : depthOf(bvh, 0);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "culling.hpp"
+
+#define BVH_MAX_LEAF 4
+#define BVH_BINS 16
+
+// 32 bytes, two nodes per cache line. Nodes are stored depth first: the
+// left child of an interior node directly follows it.
+struct BVHNode {
+    glm::vec3 bmin;
+    uint32_t offset;  // interior: right child index, leaf: first triangle
+    glm::vec3 bmax;
+    uint32_t count;  // triangles in a leaf, 0 for interior nodes
+};
+
+// triangles are copied into leaf order with the edges Moller-Trumbore needs
+struct BVHTriangle {
+    glm::vec3 v0;
+    glm::vec3 e1;
+    glm::vec3 e2;
+};
+
+struct BVH {
+    std::vector<BVHNode> nodes;
+    std::vector<BVHTriangle> tris;
+    std::vector<uint32_t> tri_ids;  // leaf order -> input triangle
+};
+
+struct RayHit {
+    float t;
+    float u, v;  // barycentrics of the hit on the triangle
+    uint32_t tri;
+};
+
+// binned SAH build over a triangle soup (3 vertices per triangle, as
+// returned by loadOBJ); large subtrees are built in parallel
+void buildBVH(const std::vector<glm::vec3>& vertices, BVH& bvh);
+
+// closest hit along origin + t * dir for t in [0, tmax)
+bool intersectBVH(const BVH& bvh, const glm::vec3& origin,
+                  const glm::vec3& dir, float tmax, RayHit& hit);
+// any hit in [0, tmax), for shadow and occlusion rays
+bool occludedBVH(const BVH& bvh, const glm::vec3& origin,
+                 const glm::vec3& dir, float tmax);
+// input indices of all triangles overlapping box, returns the count added
+size_t queryBVH(const BVH& bvh, const AABB& box, std::vector<uint32_t>& out);
+
+int bvhDepth(const BVH& bvh);
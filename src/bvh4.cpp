@@ -0,0 +1,291 @@
+#include "bvh4.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+using namespace std;
+using namespace glm;
+
+// binary depth is capped at 62, each 4-wide level pushes at most 3 nodes
+#define BVH4_STACK_SIZE 256
+
+namespace {
+
+float surfaceArea(const BVHNode& node) {
+    vec3 e = node.bmax - node.bmin;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+uint32_t collapse(const BVH& bvh, uint32_t src_i, BVH4& out) {
+    uint32_t out_i = out.nodes.size();
+    out.nodes.push_back(BVH4Node());
+
+    uint32_t kids[4];
+    int kid_cnt = 0;
+    const BVHNode& src = bvh.nodes[src_i];
+    if (src.count) {
+        kids[kid_cnt++] = src_i;  // a single leaf root
+    } else {
+        kids[kid_cnt++] = src_i + 1;
+        kids[kid_cnt++] = src.offset;
+    }
+    while (kid_cnt < 4) {
+        int best = -1;
+        float best_area = -1.0f;
+        for (int i = 0; i < kid_cnt; ++i) {
+            const BVHNode& kid = bvh.nodes[kids[i]];
+            if (!kid.count && surfaceArea(kid) > best_area) {
+                best = i;
+                best_area = surfaceArea(kid);
+            }
+        }
+        if (best < 0) break;
+        uint32_t opened = kids[best];
+        kids[best] = opened + 1;
+        kids[kid_cnt++] = bvh.nodes[opened].offset;
+    }
+
+    for (int c = 0; c < 4; ++c) {
+        uint32_t child = BVH4_EMPTY, count = 0;
+        if (c < kid_cnt) {
+            const BVHNode& kid = bvh.nodes[kids[c]];
+            // recursion may grow out.nodes, so index it afresh below
+            child = kid.count ? kid.offset : collapse(bvh, kids[c], out);
+            count = kid.count;
+        }
+        BVH4Node& node = out.nodes[out_i];
+        for (int a = 0; a < 3; ++a) {
+            node.bmin[a][c] = c < kid_cnt ? bvh.nodes[kids[c]].bmin[a] : 0.0f;
+            node.bmax[a][c] = c < kid_cnt ? bvh.nodes[kids[c]].bmax[a] : 0.0f;
+        }
+        node.child[c] = child;
+        node.count[c] = count;
+    }
+    return out_i;
+}
+
+vec3 safeInverse(const vec3& d) {
+    vec3 inv;
+    for (int a = 0; a < 3; ++a) {
+        inv[a] = 1.0f / (fabs(d[a]) > 1e-20f ? d[a] : copysign(1e-20f, d[a]));
+    }
+    return inv;
+}
+
+// Moller-Trumbore, same operation order as the binary BVH
+inline bool hitTriangle(const BVHTriangle& tri, const vec3& o, const vec3& d,
+                        float tmax, float& t, float& u, float& v) {
+    vec3 p = cross(d, tri.e2);
+    float det = dot(tri.e1, p);
+    if (fabs(det) < 1e-12f) return false;
+    float inv_det = 1.0f / det;
+    vec3 s = o - tri.v0;
+    u = dot(s, p) * inv_det;
+    if (u < 0.0f || u > 1.0f) return false;
+    vec3 q = cross(s, tri.e1);
+    v = dot(d, q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    t = dot(tri.e2, q) * inv_det;
+    return t >= 0.0f && t < tmax;
+}
+
+// the packet's rays with reciprocal directions, broadcast once per trace
+struct PacketRays {
+    vfloat ox, oy, oz;
+    vfloat dx, dy, dz;
+    vfloat inv_dx, inv_dy, inv_dz;
+};
+
+// slab test of every lane against child c, returns the lanes that enter it
+// before their current closest hit and the entry distances
+inline int hitChild(const BVH4Node& node, int c, const PacketRays& r,
+                    const vfloat& t, vfloat& t_near) {
+    vfloat tx0 = (vfloat(node.bmin[0][c]) - r.ox) * r.inv_dx;
+    vfloat tx1 = (vfloat(node.bmax[0][c]) - r.ox) * r.inv_dx;
+    vfloat ty0 = (vfloat(node.bmin[1][c]) - r.oy) * r.inv_dy;
+    vfloat ty1 = (vfloat(node.bmax[1][c]) - r.oy) * r.inv_dy;
+    vfloat tz0 = (vfloat(node.bmin[2][c]) - r.oz) * r.inv_dz;
+    vfloat tz1 = (vfloat(node.bmax[2][c]) - r.oz) * r.inv_dz;
+    t_near = vmax(vmax(vmin(tx0, tx1), vmin(ty0, ty1)),
+                  vmax(vmin(tz0, tz1), vfloat(0.0f)));
+    vfloat t_far = vmin(vmin(vmax(tx0, tx1), vmax(ty0, ty1)),
+                        vmin(vmax(tz0, tz1), t));
+    return movemask(t_near <= t_far);
+}
+
+// Moller-Trumbore with the triangle broadcast across the packet, returns
+// the mask of lanes whose closest hit it is so far
+inline vfloat hitTrianglePacket(const BVHTriangle& tri, const PacketRays& r,
+                                const vfloat& t, vfloat& t_hit, vfloat& u,
+                                vfloat& v) {
+    vfloat e1x(tri.e1.x), e1y(tri.e1.y), e1z(tri.e1.z);
+    vfloat e2x(tri.e2.x), e2y(tri.e2.y), e2z(tri.e2.z);
+    vfloat px = r.dy * e2z - e2y * r.dz;
+    vfloat py = r.dz * e2x - e2z * r.dx;
+    vfloat pz = r.dx * e2y - e2x * r.dy;
+    vfloat det = e1x * px + e1y * py + e1z * pz;
+    vfloat inv_det = vfloat(1.0f) / det;
+    vfloat sx = r.ox - vfloat(tri.v0.x);
+    vfloat sy = r.oy - vfloat(tri.v0.y);
+    vfloat sz = r.oz - vfloat(tri.v0.z);
+    u = (sx * px + sy * py + sz * pz) * inv_det;
+    vfloat qx = sy * e1z - e1y * sz;
+    vfloat qy = sz * e1x - e1z * sx;
+    vfloat qz = sx * e1y - e1x * sy;
+    v = (r.dx * qx + r.dy * qy + r.dz * qz) * inv_det;
+    t_hit = (e2x * qx + e2y * qy + e2z * qz) * inv_det;
+    vfloat zero(0.0f), one(1.0f);
+    return (vfloat(1e-12f) <= vabs(det)) & (zero <= u) & (u <= one) &
+           (zero <= v) & (u + v <= one) & (zero <= t_hit) & (t_hit < t);
+}
+
+}  // namespace
+
+void collapseBVH(const BVH& bvh, BVH4& out) {
+    out.nodes.clear();
+    out.tris = bvh.tris;
+    out.tri_ids = bvh.tri_ids;
+    if (bvh.nodes.empty()) return;
+    out.nodes.reserve(bvh.nodes.size() / 2 + 1);
+    collapse(bvh, 0, out);
+}
+
+bool intersectBVH4(const BVH4& bvh, const vec3& origin, const vec3& dir,
+                   float tmax, RayHit& hit) {
+    if (bvh.nodes.empty()) return false;
+    vec3 inv_d = safeInverse(dir);
+    hit.t = tmax;
+    bool found = false;
+
+    uint32_t stack[BVH4_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+        const BVH4Node& node = bvh.nodes[stack[--top]];
+        float near_t[4];
+        int order[4], hit_cnt = 0;
+        for (int c = 0; c < 4; ++c) {
+            if (node.child[c] == BVH4_EMPTY) continue;
+            float t_near = 0.0f, t_far = hit.t;
+            for (int a = 0; a < 3; ++a) {
+                float t0 = (node.bmin[a][c] - origin[a]) * inv_d[a];
+                float t1 = (node.bmax[a][c] - origin[a]) * inv_d[a];
+                t_near = std::max(t_near, std::min(t0, t1));
+                t_far = std::min(t_far, std::max(t0, t1));
+            }
+            if (t_near > t_far) continue;
+            near_t[c] = t_near;
+            int i = hit_cnt++;
+            // insertion sort, farthest first so the nearest is popped first
+            while (i > 0 && near_t[order[i - 1]] < t_near) {
+                order[i] = order[i - 1];
+                --i;
+            }
+            order[i] = c;
+        }
+        // leaves nearest first, their hits shorten the rays for the rest
+        for (int i = hit_cnt - 1; i >= 0; --i) {
+            int c = order[i];
+            if (!node.count[c]) continue;
+            uint32_t first = node.child[c], last = first + node.count[c];
+            for (uint32_t k = first; k < last; ++k) {
+                float t, u, v;
+                if (hitTriangle(bvh.tris[k], origin, dir, hit.t, t, u, v)) {
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.tri = bvh.tri_ids[k];
+                    found = true;
+                }
+            }
+        }
+        for (int i = 0; i < hit_cnt; ++i) {
+            if (!node.count[order[i]]) stack[top++] = node.child[order[i]];
+        }
+    }
+    return found;
+}
+
+int intersectPacket(const BVH4& bvh, const RayPacket& rays, PacketHit& hit) {
+    for (int i = 0; i < RAY_PACKET_WIDTH; ++i) hit.t[i] = rays.tmax[i];
+    if (bvh.nodes.empty()) return 0;
+
+    PacketRays r;
+    float inv[3][RAY_PACKET_WIDTH];
+    for (int i = 0; i < RAY_PACKET_WIDTH; ++i) {
+        vec3 inv_d = safeInverse(vec3(rays.dx[i], rays.dy[i], rays.dz[i]));
+        inv[0][i] = inv_d.x;
+        inv[1][i] = inv_d.y;
+        inv[2][i] = inv_d.z;
+    }
+    r.ox = vload(rays.ox);
+    r.oy = vload(rays.oy);
+    r.oz = vload(rays.oz);
+    r.dx = vload(rays.dx);
+    r.dy = vload(rays.dy);
+    r.dz = vload(rays.dz);
+    r.inv_dx = vload(inv[0]);
+    r.inv_dy = vload(inv[1]);
+    r.inv_dz = vload(inv[2]);
+
+    vfloat t = vload(rays.tmax);
+    vfloat u(0.0f), v(0.0f);
+    int found = 0;
+
+    uint32_t stack[BVH4_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top) {
+        const BVH4Node& node = bvh.nodes[stack[--top]];
+        float near_t[4];
+        int order[4], hit_cnt = 0;
+        for (int c = 0; c < 4; ++c) {
+            if (node.child[c] == BVH4_EMPTY) continue;
+            vfloat t_near;
+            int mask = hitChild(node, c, r, t, t_near);
+            if (!mask) continue;
+
+            // order children by the nearest entry of any active lane
+            float lanes[RAY_PACKET_WIDTH];
+            vstore(lanes, t_near);
+            float d = FLT_MAX;
+            for (int i = 0; i < RAY_PACKET_WIDTH; ++i) {
+                if (mask & (1 << i)) d = std::min(d, lanes[i]);
+            }
+            near_t[c] = d;
+            int i = hit_cnt++;
+            while (i > 0 && near_t[order[i - 1]] < d) {
+                order[i] = order[i - 1];
+                --i;
+            }
+            order[i] = c;
+        }
+        // leaves nearest first, their hits shorten the rays for the rest
+        for (int i = hit_cnt - 1; i >= 0; --i) {
+            int c = order[i];
+            if (!node.count[c]) continue;
+            uint32_t first = node.child[c], last = first + node.count[c];
+            for (uint32_t k = first; k < last; ++k) {
+                vfloat t_hit, u_hit, v_hit;
+                vfloat m = hitTrianglePacket(bvh.tris[k], r, t, t_hit, u_hit,
+                                             v_hit);
+                int mask = movemask(m);
+                if (!mask) continue;
+                t = select(m, t_hit, t);
+                u = select(m, u_hit, u);
+                v = select(m, v_hit, v);
+                for (int l = 0; l < RAY_PACKET_WIDTH; ++l) {
+                    if (mask & (1 << l)) hit.tri[l] = bvh.tri_ids[k];
+                }
+                found |= mask;
+            }
+        }
+        for (int i = 0; i < hit_cnt; ++i) {
+            if (!node.count[order[i]]) stack[top++] = node.child[order[i]];
+        }
+    }
+    vstore(hit.t, t);
+    vstore(hit.u, u);
+    vstore(hit.v, v);
+    return found;
+}
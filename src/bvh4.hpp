@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.hpp"
+#include "simd.hpp"
+
+// rays traced together by intersectPacket: 8 with AVX, 4 otherwise
+#define RAY_PACKET_WIDTH SIMD_WIDTH
+#define BVH4_EMPTY 0xffffffffu
+
+// 128 bytes, two cache lines. Child bounds are stored per axis so one
+// packet slab test reads four children's planes from a single row.
+struct BVH4Node {
+    float bmin[3][4];
+    float bmax[3][4];
+    uint32_t child[4];  // node index, first triangle of a leaf, or BVH4_EMPTY
+    uint32_t count[4];  // triangles in a leaf child, 0 for interior children
+};
+
+struct BVH4 {
+    std::vector<BVH4Node> nodes;
+    std::vector<BVHTriangle> tris;
+    std::vector<uint32_t> tri_ids;  // leaf order -> input triangle
+};
+
+// structure of arrays, lane i is one ray; set tmax < 0 for unused lanes
+struct RayPacket {
+    float ox[RAY_PACKET_WIDTH], oy[RAY_PACKET_WIDTH], oz[RAY_PACKET_WIDTH];
+    float dx[RAY_PACKET_WIDTH], dy[RAY_PACKET_WIDTH], dz[RAY_PACKET_WIDTH];
+    float tmax[RAY_PACKET_WIDTH];
+};
+
+struct PacketHit {
+    float t[RAY_PACKET_WIDTH];
+    float u[RAY_PACKET_WIDTH], v[RAY_PACKET_WIDTH];
+    uint32_t tri[RAY_PACKET_WIDTH];
+};
+
+// collapses a binary BVH into 4-wide nodes, opening the child with the
+// largest surface area until each node has four children or only leaves
+void collapseBVH(const BVH& bvh, BVH4& out);
+
+// closest hit of a single ray, the fallback for rays that are not coherent
+bool intersectBVH4(const BVH4& bvh, const glm::vec3& origin,
+                   const glm::vec3& dir, float tmax, RayHit& hit);
+// closest hits of a packet of coherent rays, returns the mask of lanes hit;
+// lanes that miss keep t = tmax
+int intersectPacket(const BVH4& bvh, const RayPacket& rays, PacketHit& hit);
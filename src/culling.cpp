@@ -0,0 +1,153 @@
+#include "culling.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+using namespace std;
+using namespace glm;
+
+#include "parallel.hpp"
+#include "simd.hpp"
+
+// fewer boxes are tested on the calling thread
+#define CULL_PARALLEL_BOXES 16384
+// groups of 8 boxes per call, a whole number of SIMD_WIDTH
+#define CULL_GRAIN 256
+
+void BoxSoA::resize(size_t n) {
+    count = n;
+    size_t padded = (n + 7) & ~size_t(7);
+    // padding boxes are inverted (min > max) so every plane rejects them
+    min_x.assign(padded, FLT_MAX);
+    min_y.assign(padded, FLT_MAX);
+    min_z.assign(padded, FLT_MAX);
+    max_x.assign(padded, -FLT_MAX);
+    max_y.assign(padded, -FLT_MAX);
+    max_z.assign(padded, -FLT_MAX);
+}
+
+void BoxSoA::set(size_t i, const AABB& box) {
+    min_x[i] = box.min.x;
+    min_y[i] = box.min.y;
+    min_z[i] = box.min.z;
+    max_x[i] = box.max.x;
+    max_y[i] = box.max.y;
+    max_z[i] = box.max.z;
+}
+
+AABB computeBounds(const vector<vec3>& vertices) {
+    AABB box;
+    box.min = vec3(FLT_MAX);
+    box.max = vec3(-FLT_MAX);
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        box.min = min(box.min, vertices[i]);
+        box.max = max(box.max, vertices[i]);
+    }
+    return box;
+}
+
+AABB transformBounds(const AABB& box, const mat4& m) {
+    AABB out;
+    out.min = out.max = vec3(m[3]);
+    for (int col = 0; col < 3; ++col) {
+        for (int row = 0; row < 3; ++row) {
+            float a = m[col][row] * box.min[col];
+            float b = m[col][row] * box.max[col];
+            out.min[row] += a < b ? a : b;
+            out.max[row] += a < b ? b : a;
+        }
+    }
+    return out;
+}
+
+void extractFrustum(const mat4& vp_mat, Frustum& frustum) {
+    // rows of the matrix; glm is column major
+    vec4 r0(vp_mat[0][0], vp_mat[1][0], vp_mat[2][0], vp_mat[3][0]);
+    vec4 r1(vp_mat[0][1], vp_mat[1][1], vp_mat[2][1], vp_mat[3][1]);
+    vec4 r2(vp_mat[0][2], vp_mat[1][2], vp_mat[2][2], vp_mat[3][2]);
+    vec4 r3(vp_mat[0][3], vp_mat[1][3], vp_mat[2][3], vp_mat[3][3]);
+
+    frustum.planes[0] = r3 + r0;
+    frustum.planes[1] = r3 - r0;
+    frustum.planes[2] = r3 + r1;
+    frustum.planes[3] = r3 - r1;
+    frustum.planes[4] = r3 + r2;
+    frustum.planes[5] = r3 - r2;
+    for (int i = 0; i < 6; ++i) {
+        frustum.planes[i] /= length(vec3(frustum.planes[i]));
+    }
+}
+
+namespace {
+
+size_t cullRangeScalar(const Frustum& frustum, const BoxSoA& boxes,
+                       size_t first, size_t last, unsigned char* visible) {
+    size_t visible_cnt = 0;
+    for (size_t i = first; i < last; ++i) {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; ++p) {
+            const vec4& pl = frustum.planes[p];
+            // the box corner furthest along the plane normal
+            float x = pl.x > 0 ? boxes.max_x[i] : boxes.min_x[i];
+            float y = pl.y > 0 ? boxes.max_y[i] : boxes.min_y[i];
+            float z = pl.z > 0 ? boxes.max_z[i] : boxes.min_z[i];
+            inside = pl.x * x + pl.y * y + pl.z * z + pl.w >= 0;
+        }
+        visible[i] = inside;
+        visible_cnt += inside;
+    }
+    return visible_cnt;
+}
+
+// SIMD_WIDTH boxes at a time; first is a multiple of SIMD_WIDTH, and the
+// padding to 8 boxes keeps the loads past last inside the arrays
+size_t cullRange(const Frustum& frustum, const BoxSoA& boxes, size_t first,
+                 size_t last, unsigned char* visible) {
+    size_t visible_cnt = 0;
+    for (size_t i = first; i < last; i += SIMD_WIDTH) {
+        vfloat outside(0.0f);
+        for (int p = 0; p < 6; ++p) {
+            const vec4& pl = frustum.planes[p];
+            // the corner choice only depends on the plane, not the box
+            const float* xs = pl.x > 0 ? &boxes.max_x[i] : &boxes.min_x[i];
+            const float* ys = pl.y > 0 ? &boxes.max_y[i] : &boxes.min_y[i];
+            const float* zs = pl.z > 0 ? &boxes.max_z[i] : &boxes.min_z[i];
+            vfloat d = vload(xs) * vfloat(pl.x) + vload(ys) * vfloat(pl.y) +
+                       (vload(zs) * vfloat(pl.z) + vfloat(pl.w));
+            outside = outside | (d < vfloat(0.0f));
+        }
+        int mask = ~movemask(outside) & SIMD_ALL_LANES;
+        size_t n = std::min<size_t>(last - i, SIMD_WIDTH);
+        for (size_t j = 0; j < n; ++j) {
+            visible[i + j] = (mask >> j) & 1;
+            visible_cnt += (mask >> j) & 1;
+        }
+    }
+    return visible_cnt;
+}
+
+}  // namespace
+
+size_t cullBoxesScalar(const Frustum& frustum, const BoxSoA& boxes,
+                       unsigned char* visible) {
+    return cullRangeScalar(frustum, boxes, 0, boxes.count, visible);
+}
+
+size_t cullBoxes(const Frustum& frustum, const BoxSoA& boxes,
+                 unsigned char* visible) {
+    if (boxes.count < CULL_PARALLEL_BOXES) {
+        return cullRange(frustum, boxes, 0, boxes.count, visible);
+    }
+    // split on groups of 8 boxes, so every SIMD load stays in the padding
+    atomic<size_t> visible_cnt(0);
+    parallelFor(0, (boxes.count + 7) / 8, CULL_GRAIN,
+                [&](size_t lo, size_t hi) {
+                    size_t last = std::min(hi * 8, boxes.count);
+                    visible_cnt.fetch_add(
+                        cullRange(frustum, boxes, lo * 8, last, visible),
+                        memory_order_relaxed);
+                });
+    return visible_cnt;
+}
+
+const char* cullingPath() { return simdName(); }
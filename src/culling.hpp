@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// plane i is (n, d) with n.p + d >= 0 inside; left right bottom top near far
+struct Frustum {
+    glm::vec4 planes[6];
+};
+
+// Boxes in structure-of-arrays form so one SIMD register holds the same
+// coordinate of 4 (SSE) or 8 (AVX) boxes. Arrays are padded to a multiple
+// of 8 with empty boxes that always fail the test.
+struct BoxSoA {
+    std::vector<float> min_x, min_y, min_z;
+    std::vector<float> max_x, max_y, max_z;
+    size_t count;
+
+    BoxSoA() : count(0) {}
+    void resize(size_t n);
+    void set(size_t i, const AABB& box);
+};
+
+AABB computeBounds(const std::vector<glm::vec3>& vertices);
+// bounds of a box after an affine transform (Arvo)
+AABB transformBounds(const AABB& box, const glm::mat4& m);
+
+// Gribb/Hartmann plane extraction from a projection * view matrix
+void extractFrustum(const glm::mat4& vp_mat, Frustum& frustum);
+
+// writes 1/0 per box into visible, returns the number of visible boxes;
+// large sets are tested on every worker thread
+size_t cullBoxes(const Frustum& frustum, const BoxSoA& boxes,
+                 unsigned char* visible);
+// plain reference version
+size_t cullBoxesScalar(const Frustum& frustum, const BoxSoA& boxes,
+                       unsigned char* visible);
+
+// "avx", "sse" or "scalar", the simd.hpp path cullBoxes was compiled with
+const char* cullingPath();
@@ -0,0 +1,83 @@
+#include "dds.hpp"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+#include "trace.hpp"
+
+#define DDS_HEADER_SIZE 128  // magic and surface description
+
+namespace {
+
+inline uint32_t readU32(const unsigned char* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+}
+
+}  // namespace
+
+bool parseDDS(const unsigned char* data, size_t size, DDSImage& image) {
+    if (size < DDS_HEADER_SIZE || memcmp(data, "DDS ", 4) != 0) {
+        fprintf(stderr, "Failed to read DDS header.\n");
+        return false;
+    }
+    int height = readU32(data + 12);
+    int width = readU32(data + 16);
+    unsigned int mip_map_cnt = std::max(1u, readU32(data + 28));
+    image.four_cc = readU32(data + 84);
+    if (image.four_cc != FOURCC_DXT1 && image.four_cc != FOURCC_DXT3 &&
+        image.four_cc != FOURCC_DXT5) {
+        fprintf(stderr, "Failed to read DDS: not DXT1, DXT3 or DXT5.\n");
+        return false;
+    }
+    image.block_size = image.four_cc == FOURCC_DXT1 ? 8 : 16;
+    image.data.assign(data + DDS_HEADER_SIZE, data + size);
+    image.memory.set(MEMORY_TEXTURE, capacityBytes(image.data));
+
+    image.levels.clear();
+    size_t offset = 0;
+    for (unsigned int l = 0; l < mip_map_cnt && width > 0 && height > 0;
+         ++l) {
+        DDSLevel level;
+        level.width = width;
+        level.height = height;
+        level.offset = offset;
+        level.size = size_t((width + 3) / 4) * ((height + 3) / 4) *
+                     image.block_size;
+        if (offset + level.size > image.data.size()) break;
+        image.levels.push_back(level);
+        offset += level.size;
+        if (width == 1 && height == 1) break;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    if (image.levels.empty()) {
+        fprintf(stderr, "Failed to read DDS: no complete level.\n");
+        return false;
+    }
+    return true;
+}
+
+bool loadDDS(const char* path, DDSImage& image) {
+    TRACE_SCOPE("loadDDS");
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open image %s.\n", path);
+        return false;
+    }
+    vector<unsigned char> data;
+    unsigned char chunk[65536];
+    for (size_t n; (n = fread(chunk, 1, sizeof(chunk), fp)) > 0;) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(fp);
+    MemoryCharge file_bytes;
+    file_bytes.set(MEMORY_LOADER, capacityBytes(data));
+    if (!parseDDS(data.empty() ? NULL : &data[0], data.size(), image)) {
+        fprintf(stderr, "Failed to load %s.\n", path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include "memory-stats.hpp"
+
+#define FOURCC_DXT1 0x31545844  // ASCII of "DXT1"
+#define FOURCC_DXT3 0x33545844
+#define FOURCC_DXT5 0x35545844
+
+struct DDSLevel {
+    int width, height;
+    size_t offset, size;  // compressed blocks in DDSImage::data
+};
+
+// a DXT compressed DDS file, kept compressed
+struct DDSImage {
+    unsigned int four_cc;     // FOURCC_DXT1, FOURCC_DXT3 or FOURCC_DXT5
+    unsigned int block_size;  // bytes per 4x4 block
+    std::vector<DDSLevel> levels;  // complete mip levels, largest first
+    std::vector<unsigned char> data;  // everything after the header
+    MemoryCharge memory;  // data, as MEMORY_TEXTURE
+};
+
+// Parse a DDS file held in memory. Fails for formats other than DXT1, DXT3
+// and DXT5; a truncated mip chain keeps its complete levels.
+bool parseDDS(const unsigned char* data, size_t size, DDSImage& image);
+
+bool loadDDS(const char* path, DDSImage& image);
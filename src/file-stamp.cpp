@@ -0,0 +1,19 @@
+#include "file-stamp.hpp"
+
+#include <sys/stat.h>
+
+bool fileStamp(const char* path, FileStamp& stamp) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    stamp.size = st.st_size;
+#if defined(__APPLE__)
+    stamp.mtime_ns = int64_t(st.st_mtimespec.tv_sec) * 1000000000 +
+                     st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    stamp.mtime_ns = int64_t(st.st_mtime) * 1000000000;
+#else
+    stamp.mtime_ns =
+        int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
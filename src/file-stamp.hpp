@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+// What a cache records of the file it was built from, compared exactly: a
+// timestamp alone with one-second resolution misses an edit made in the
+// same second as the cache was written.
+struct FileStamp {
+    uint64_t size;
+    int64_t mtime_ns;  // nanoseconds since the epoch
+};
+
+// false when path cannot be stat'ed
+bool fileStamp(const char* path, FileStamp& stamp);
+
+inline bool operator==(const FileStamp& a, const FileStamp& b) {
+    return a.size == b.size && a.mtime_ns == b.mtime_ns;
+}
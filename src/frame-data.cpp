@@ -0,0 +1,123 @@
+#include "frame-data.hpp"
+#include "gl-state.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+#include "trace.hpp"
+
+FrameRing::FrameRing()
+    : buffer(0),
+      mapped(NULL),
+      persistent(false),
+      region_size(0),
+      align(256),
+      frame(0),
+      head(0) {
+    memset(fences, 0, sizeof(fences));
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool FrameRing::init(GLsizeiptr frame_bytes) {
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+    if (align < 1) align = 256;
+    region_size = (frame_bytes + align - 1) / align * align;
+    GLsizeiptr total = region_size * FRAME_RING_FRAMES;
+
+    glGenBuffers(1, &buffer);
+    gl_state.bindBuffer(GL_UNIFORM_BUFFER, buffer);
+
+    persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    if (persistent) {
+        GLbitfield flags =
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, total, NULL, flags);
+        mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0,
+                                                  total, flags);
+        if (mapped == NULL) {
+            fprintf(stderr, "Failed to map frame ring buffer.\n");
+            destroy();
+            return false;
+        }
+    } else {
+        glBufferData(GL_UNIFORM_BUFFER, total, NULL, GL_DYNAMIC_DRAW);
+    }
+    setBufferBytes(buffer, total);
+    return true;
+}
+
+void FrameRing::destroy() {
+    for (int i = 0; i < FRAME_RING_FRAMES; ++i) {
+        if (fences[i]) glDeleteSync(fences[i]);
+        fences[i] = 0;
+    }
+    if (buffer) {
+        if (mapped) {
+            gl_state.bindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+        gl_state.bindBuffer(GL_UNIFORM_BUFFER, 0);
+        deleteBuffer(buffer);
+    }
+    buffer = 0;
+    mapped = NULL;
+}
+
+void FrameRing::waitFence(int i) {
+    if (fences[i] == 0) return;
+
+    // poll first so the common (GPU already done) case costs one call
+    GLenum res = glClientWaitSync(fences[i], 0, 0);
+    if (res == GL_TIMEOUT_EXPIRED) {
+        TRACE_SCOPE("fence wait");
+        ++stats.fence_waits;
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        do {
+            res = glClientWaitSync(fences[i], GL_SYNC_FLUSH_COMMANDS_BIT,
+                                   1000000);  // 1 ms
+        } while (res == GL_TIMEOUT_EXPIRED);
+        stats.wait_ms += chrono::duration<double, milli>(
+                             chrono::steady_clock::now() - t0)
+                             .count();
+    }
+    glDeleteSync(fences[i]);
+    fences[i] = 0;
+}
+
+void FrameRing::beginFrame() {
+    frame = (frame + 1) % FRAME_RING_FRAMES;
+    head = 0;
+    ++stats.frames;
+
+    waitFence(frame);
+}
+
+void FrameRing::endFrame() {
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLintptr FrameRing::push(const void* data, GLsizeiptr size) {
+    if (buffer == 0 || head + size > region_size) {
+        ++stats.overflows;
+        return -1;
+    }
+
+    GLintptr offset = frame * region_size + head;
+    stats.bytes += size;
+    head = (head + size + align - 1) / align * align;
+
+    if (persistent) {
+        memcpy(mapped + offset, data, size);
+    } else {
+        // the fence already guarantees the region is idle
+        gl_state.bindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+    }
+    return offset;
+}
+
+void FrameRing::bindRange(GLuint index, GLintptr offset, GLsizeiptr size) {
+    gl_state.bindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+}
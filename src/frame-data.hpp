@@ -0,0 +1,71 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// number of frames the CPU may run ahead of the GPU
+#define FRAME_RING_FRAMES 3
+
+// uniform block binding points shared by all programs
+#define VIEW_DATA_BINDING 0
+#define DRAW_DATA_BINDING 1
+
+// std140 layout of the ViewData uniform block, written once per frame
+struct ViewData {
+    glm::mat4 v;
+    glm::mat4 p;
+    glm::vec4 light_pos;  // xyz: light position in worldspace
+};
+
+// std140 layout of the DrawData uniform block, written once per draw
+struct DrawData {
+    glm::mat4 mvp;
+    glm::mat4 m;
+};
+
+struct FrameRingStats {
+    unsigned int frames;       // frames begun
+    unsigned int fence_waits;  // frames that blocked on a GPU fence
+    double wait_ms;            // total time blocked on fences
+    unsigned int overflows;    // allocations that did not fit in a frame
+    size_t bytes;              // total bytes pushed
+};
+
+// Triple-buffered uniform ring. With GL_ARB_buffer_storage the buffer is
+// mapped once (persistent + coherent) and written with plain memcpy; each
+// frame's region is guarded by a fence so the CPU never overwrites data the
+// GPU has not consumed yet. Without it, writes fall back to glBufferSubData
+// into the same fenced regions.
+class FrameRing {
+   public:
+    FrameRing();
+
+    bool init(GLsizeiptr frame_bytes);
+    void destroy();
+
+    // wait until the next region is free and start writing into it
+    void beginFrame();
+    // fence the region written this frame
+    void endFrame();
+
+    // copy size bytes into the current region, returns the buffer offset
+    // or -1 if the region is full
+    GLintptr push(const void* data, GLsizeiptr size);
+    void bindRange(GLuint index, GLintptr offset, GLsizeiptr size);
+
+    bool isPersistent() const { return persistent; }
+    const FrameRingStats& getStats() const { return stats; }
+
+   private:
+    void waitFence(int frame);
+
+    GLuint buffer;
+    unsigned char* mapped;  // persistent mapping of the whole ring
+    bool persistent;
+    GLsizeiptr region_size;
+    GLint align;
+    int frame;
+    GLsizeiptr head;
+    GLsync fences[FRAME_RING_FRAMES];
+    FrameRingStats stats;
+};
@@ -0,0 +1,111 @@
+#include "frame-stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+FrameStats::FrameStats() : csv(NULL), csv_rows(0) {}
+
+FrameStats::~FrameStats() { closeCSV(); }
+
+bool FrameStats::openCSV(const char* path) {
+    closeCSV();
+    csv = fopen(path, "w");
+    if (csv == NULL) {
+        fprintf(stderr, "Failed to create %s.\n", path);
+        return false;
+    }
+    fprintf(csv, "frame,frame_ms,cpu_ms,gpu_ms,draws,triangles,"
+                 "state_changes,upload_bytes\n");
+    csv_rows = samples.size();
+    return true;
+}
+
+void FrameStats::closeCSV() {
+    if (csv == NULL) return;
+    writeRows(samples.size());
+    fclose(csv);
+    csv = NULL;
+}
+
+void FrameStats::writeRows(size_t end) {
+    for (; csv_rows < end; ++csv_rows) {
+        const FrameSample& s = samples[csv_rows];
+        fprintf(csv, "%u,%.3f,%.3f,", s.frame, s.frame_ms, s.cpu_ms);
+        if (s.gpu_ms >= 0.0) fprintf(csv, "%.3f", s.gpu_ms);
+        fprintf(csv, ",%u,%u,%u,%u\n", s.draws, s.triangles, s.state_changes,
+                (unsigned int)s.upload_bytes);
+    }
+}
+
+void FrameStats::add(const FrameSample& sample) {
+    samples.push_back(sample);
+    if (csv && samples.size() > FRAME_STATS_CSV_DELAY) {
+        writeRows(samples.size() - FRAME_STATS_CSV_DELAY);
+    }
+}
+
+void FrameStats::setGPUTime(unsigned int frame, double ms) {
+    // frames are added in order, so the match is near the end
+    for (size_t i = samples.size(); i > csv_rows; --i) {
+        if (samples[i - 1].frame == frame) {
+            samples[i - 1].gpu_ms = ms;
+            return;
+        }
+        if (samples[i - 1].frame < frame) return;
+    }
+}
+
+FramePercentiles FrameStats::percentiles(FrameMetric metric,
+                                         size_t window) const {
+    size_t first = window && window < samples.size()
+                       ? samples.size() - window
+                       : 0;
+    vector<double> values;
+    values.reserve(samples.size() - first);
+    for (size_t i = first; i < samples.size(); ++i) {
+        const FrameSample& s = samples[i];
+        double v = metric == FRAME_TIME       ? s.frame_ms
+                   : metric == FRAME_CPU_TIME ? s.cpu_ms
+                                              : s.gpu_ms;
+        if (v >= 0.0) values.push_back(v);
+    }
+    FramePercentiles res = {values.size(), 0.0, 0.0, 0.0};
+    if (values.empty()) return res;
+    sort(values.begin(), values.end());
+    double ps[3] = {0.50, 0.95, 0.99};
+    double* out[3] = {&res.p50, &res.p95, &res.p99};
+    for (int k = 0; k < 3; ++k) {
+        size_t rank = size_t(ceil(ps[k] * values.size()));
+        *out[k] = values[std::max<size_t>(rank, 1) - 1];
+    }
+    return res;
+}
+
+void FrameStats::print(FILE* fp, size_t window) const {
+    if (samples.empty()) return;
+    size_t first = window && window < samples.size()
+                       ? samples.size() - window
+                       : 0;
+    size_t n = samples.size() - first;
+    double draws = 0.0, triangles = 0.0, changes = 0.0, bytes = 0.0;
+    for (size_t i = first; i < samples.size(); ++i) {
+        draws += samples[i].draws;
+        triangles += samples[i].triangles;
+        changes += samples[i].state_changes;
+        bytes += samples[i].upload_bytes;
+    }
+    FramePercentiles frame = percentiles(FRAME_TIME, window);
+    FramePercentiles cpu = percentiles(FRAME_CPU_TIME, window);
+    FramePercentiles gpu = percentiles(FRAME_GPU_TIME, window);
+    fprintf(fp, "frame stats (%u frames, p50/p95/p99): frame %.2f/%.2f/%.2f "
+                "ms, cpu %.2f/%.2f/%.2f ms",
+            (unsigned int)n, frame.p50, frame.p95, frame.p99, cpu.p50,
+            cpu.p95, cpu.p99);
+    if (gpu.count) {
+        fprintf(fp, ", gpu %.2f/%.2f/%.2f ms", gpu.p50, gpu.p95, gpu.p99);
+    }
+    fprintf(fp, "; per frame %.1f draws, %.0f triangles, %.1f state "
+                "changes, %.1f KB uploaded\n",
+            draws / n, triangles / n, changes / n, bytes / n * 1e-3);
+}
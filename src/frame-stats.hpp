@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <vector>
+
+// frames the rolling percentiles are taken over
+#define FRAME_STATS_WINDOW 256
+// CSV rows wait this many frames for their GPU time, which comes back late
+#define FRAME_STATS_CSV_DELAY 8
+
+struct FrameSample {
+    unsigned int frame;
+    double frame_ms;  // end of the previous frame to the end of this one
+    double cpu_ms;    // work on the CPU, without waiting for the swap
+    double gpu_ms;    // negative until the GPU time is known
+    unsigned int draws;          // draw calls submitted
+    unsigned int triangles;
+    unsigned int state_changes;  // GL state calls that reached the driver
+    size_t upload_bytes;         // buffer and texture data sent to GL
+};
+
+enum FrameMetric { FRAME_TIME, FRAME_CPU_TIME, FRAME_GPU_TIME };
+
+struct FramePercentiles {
+    size_t count;  // frames with a value
+    double p50, p95, p99;
+};
+
+// Every frame of a run, with rolling percentiles for periodic reports and
+// an optional CSV of the raw samples for comparing runs.
+class FrameStats {
+   public:
+    FrameStats();
+    ~FrameStats();
+
+    // one row per frame from now on; fails if path cannot be created
+    bool openCSV(const char* path);
+    // write the remaining rows and close the file
+    void closeCSV();
+
+    void add(const FrameSample& sample);
+    // GPU times arrive a few frames late; ignored once the row is written
+    void setGPUTime(unsigned int frame, double ms);
+
+    // nearest rank percentiles over the last window frames, 0 for all
+    FramePercentiles percentiles(FrameMetric metric, size_t window) const;
+    // one line of percentiles and per frame averages over the last window
+    // frames, 0 for all
+    void print(FILE* fp, size_t window) const;
+
+    size_t size() const { return samples.size(); }
+
+   private:
+    void writeRows(size_t end);
+
+    std::vector<FrameSample> samples;
+    FILE* csv;
+    size_t csv_rows;  // samples written to csv
+};
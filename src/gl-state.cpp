@@ -0,0 +1,215 @@
+#include "gl-state.hpp"
+
+#include <cstring>
+#include <map>
+using namespace std;
+
+#include "memory-stats.hpp"
+
+// never a valid GL name, forces the next call through
+#define STATE_UNKNOWN 0xFFFFFFFFu
+
+GLStateCache gl_state;
+
+GLStateCache::GLStateCache() {
+    memset(&last_frame, 0, sizeof(last_frame));
+    memset(&total, 0, sizeof(total));
+    memset(&frame, 0, sizeof(frame));
+    invalidate();
+}
+
+void GLStateCache::invalidate() {
+    program = STATE_UNKNOWN;
+    vertex_array = STATE_UNKNOWN;
+    for (int i = 0; i < 4; ++i) buffers[i] = STATE_UNKNOWN;
+    for (int i = 0; i < STATE_MAX_BUFFER_BINDINGS; ++i) {
+        uniform_ranges[i].buffer = STATE_UNKNOWN;
+    }
+    active_unit = STATE_UNKNOWN;
+    for (int i = 0; i < STATE_MAX_TEXTURE_UNITS; ++i) {
+        textures[i] = STATE_UNKNOWN;
+        texture_targets[i] = 0;
+    }
+    for (int i = 0; i < 4; ++i) caps[i] = -1;
+}
+
+bool GLStateCache::elide(bool same) {
+    if (same) {
+        ++frame.elided;
+        ++total.elided;
+    } else {
+        ++frame.issued;
+        ++total.issued;
+    }
+    return same;
+}
+
+int GLStateCache::bufferSlot(GLenum target) const {
+    switch (target) {
+        case GL_ARRAY_BUFFER:
+            return 0;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return 1;
+        case GL_UNIFORM_BUFFER:
+            return 2;
+        case GL_COPY_WRITE_BUFFER:
+            return 3;
+    }
+    return -1;
+}
+
+int GLStateCache::capSlot(GLenum cap) const {
+    switch (cap) {
+        case GL_DEPTH_TEST:
+            return 0;
+        case GL_CULL_FACE:
+            return 1;
+        case GL_BLEND:
+            return 2;
+        case GL_SCISSOR_TEST:
+            return 3;
+    }
+    return -1;
+}
+
+void GLStateCache::useProgram(GLuint prog_id) {
+    if (elide(program == prog_id)) return;
+    program = prog_id;
+    glUseProgram(prog_id);
+}
+
+void GLStateCache::bindVertexArray(GLuint v_array_id) {
+    if (elide(vertex_array == v_array_id)) return;
+    vertex_array = v_array_id;
+    // the element array binding is part of the vertex array object
+    buffers[1] = STATE_UNKNOWN;
+    glBindVertexArray(v_array_id);
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+    int slot = bufferSlot(target);
+    if (slot < 0) {
+        elide(false);
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (elide(buffers[slot] == buffer)) return;
+    buffers[slot] = buffer;
+    glBindBuffer(target, buffer);
+}
+
+void GLStateCache::bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+                                   GLintptr offset, GLsizeiptr size) {
+    if (target != GL_UNIFORM_BUFFER || index >= STATE_MAX_BUFFER_BINDINGS) {
+        elide(false);
+        glBindBufferRange(target, index, buffer, offset, size);
+        return;
+    }
+    RangeBinding& r = uniform_ranges[index];
+    if (elide(r.buffer == buffer && r.offset == offset && r.size == size)) {
+        return;
+    }
+    r.buffer = buffer;
+    r.offset = offset;
+    r.size = size;
+    // binding an indexed range also replaces the generic binding
+    buffers[2] = buffer;
+    glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    if (unit >= STATE_MAX_TEXTURE_UNITS) {
+        elide(false);
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        active_unit = unit;
+        return;
+    }
+    if (elide(textures[unit] == texture && texture_targets[unit] == target)) {
+        return;
+    }
+    if (active_unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        active_unit = unit;
+    }
+    textures[unit] = texture;
+    texture_targets[unit] = target;
+    glBindTexture(target, texture);
+}
+
+void GLStateCache::setCap(GLenum cap, bool on) {
+    int slot = capSlot(cap);
+    if (slot >= 0 && elide(caps[slot] == (on ? 1 : 0))) return;
+    if (slot < 0) {
+        elide(false);
+    } else {
+        caps[slot] = on ? 1 : 0;
+    }
+    if (on) {
+        glEnable(cap);
+    } else {
+        glDisable(cap);
+    }
+}
+
+void GLStateCache::enable(GLenum cap) { setCap(cap, true); }
+
+void GLStateCache::disable(GLenum cap) { setCap(cap, false); }
+
+void GLStateCache::forgetBuffer(GLuint buffer) {
+    for (int i = 0; i < 4; ++i) {
+        if (buffers[i] == buffer) buffers[i] = STATE_UNKNOWN;
+    }
+    for (int i = 0; i < STATE_MAX_BUFFER_BINDINGS; ++i) {
+        if (uniform_ranges[i].buffer == buffer) {
+            uniform_ranges[i].buffer = STATE_UNKNOWN;
+        }
+    }
+}
+
+void GLStateCache::forgetVertexArray(GLuint v_array_id) {
+    if (vertex_array == v_array_id) vertex_array = STATE_UNKNOWN;
+}
+
+void GLStateCache::forgetTexture(GLuint texture) {
+    for (int i = 0; i < STATE_MAX_TEXTURE_UNITS; ++i) {
+        if (textures[i] == texture) textures[i] = STATE_UNKNOWN;
+    }
+}
+
+void GLStateCache::beginFrame() {
+    last_frame = frame;
+    memset(&frame, 0, sizeof(frame));
+}
+
+// object name -> bytes charged, touched from the GL thread only
+static map<GLuint, size_t> buffer_bytes, texture_bytes;
+
+static void setBytes(map<GLuint, size_t>& sizes, MemoryTag tag, GLuint name,
+                     size_t bytes) {
+    size_t& charged = sizes[name];
+    memoryRelease(tag, charged);
+    memoryCharge(tag, bytes);
+    charged = bytes;
+    if (bytes == 0) sizes.erase(name);
+}
+
+void setBufferBytes(GLuint buffer, size_t bytes) {
+    setBytes(buffer_bytes, MEMORY_GL_BUFFERS, buffer, bytes);
+}
+
+void setTextureBytes(GLuint texture, size_t bytes) {
+    setBytes(texture_bytes, MEMORY_GL_TEXTURES, texture, bytes);
+}
+
+void deleteBuffer(GLuint buffer) {
+    setBufferBytes(buffer, 0);
+    gl_state.forgetBuffer(buffer);
+    glDeleteBuffers(1, &buffer);
+}
+
+void deleteTexture(GLuint texture) {
+    setTextureBytes(texture, 0);
+    gl_state.forgetTexture(texture);
+    glDeleteTextures(1, &texture);
+}
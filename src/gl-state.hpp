@@ -0,0 +1,76 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#define STATE_MAX_TEXTURE_UNITS 16
+#define STATE_MAX_BUFFER_BINDINGS 16
+
+struct GLStateStats {
+    unsigned int issued;  // calls forwarded to GL
+    unsigned int elided;  // calls filtered as redundant
+};
+
+// Shadow copy of the binding state we touch every frame. Calls that would
+// not change anything are dropped before they reach the driver. Anything
+// that changes bindings behind its back must call invalidate().
+class GLStateCache {
+   public:
+    GLStateCache();
+
+    void invalidate();
+
+    void useProgram(GLuint prog_id);
+    void bindVertexArray(GLuint v_array_id);
+    void bindBuffer(GLenum target, GLuint buffer);
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+                         GLintptr offset, GLsizeiptr size);
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+    void enable(GLenum cap);
+    void disable(GLenum cap);
+
+    // Call before deleting an object: GL reuses freed names, so a slot
+    // still holding one would skip binding the next object given it.
+    void forgetBuffer(GLuint buffer);
+    void forgetVertexArray(GLuint v_array_id);
+    void forgetTexture(GLuint texture);
+
+    // start counting a new frame, the previous frame stays readable
+    void beginFrame();
+    const GLStateStats& getFrameStats() const { return last_frame; }
+    const GLStateStats& getTotalStats() const { return total; }
+
+   private:
+    struct RangeBinding {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    int bufferSlot(GLenum target) const;
+    int capSlot(GLenum cap) const;
+    void setCap(GLenum cap, bool on);
+    bool elide(bool same);
+
+    GLuint program;
+    GLuint vertex_array;
+    GLuint buffers[4];  // array, element array, uniform, copy write
+    RangeBinding uniform_ranges[STATE_MAX_BUFFER_BINDINGS];
+    GLuint active_unit;
+    GLuint textures[STATE_MAX_TEXTURE_UNITS];
+    GLenum texture_targets[STATE_MAX_TEXTURE_UNITS];
+    signed char caps[4];  // depth test, cull face, blend, scissor; -1 unknown
+
+    GLStateStats frame;
+    GLStateStats last_frame;
+    GLStateStats total;
+};
+
+extern GLStateCache gl_state;
+
+// Storage of GL buffers and textures, charged to the memory-stats tags. A
+// new size replaces the old one; the delete calls drop it with the object
+// and clear the name from gl_state.
+void setBufferBytes(GLuint buffer, size_t bytes);
+void setTextureBytes(GLuint texture, size_t bytes);
+void deleteBuffer(GLuint buffer);
+void deleteTexture(GLuint texture);
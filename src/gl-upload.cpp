@@ -0,0 +1,126 @@
+#include "gl-upload.hpp"
+
+#include <cstdio>
+using namespace std;
+using namespace glm;
+
+#include "gl-state.hpp"
+#include "trace.hpp"
+
+void uploadMesh(const MeshData& mesh, MeshBuffers& buffers) {
+    TRACE_SCOPE("uploadMesh");
+    glGenVertexArrays(1, &buffers.v_array_id);
+    gl_state.bindVertexArray(buffers.v_array_id);
+
+    // attribute layout is vertex array state, so it is set up only once
+    glGenBuffers(1, &buffers.vertexbuffer);
+    gl_state.bindBuffer(GL_ARRAY_BUFFER, buffers.vertexbuffer);
+    glBufferData(GL_ARRAY_BUFFER, mesh.positions.size() * sizeof(vec3),
+                 &mesh.positions[0], GL_STATIC_DRAW);
+    setBufferBytes(buffers.vertexbuffer, mesh.positions.size() * sizeof(vec3));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0,         // attribute
+                          3,         // size
+                          GL_FLOAT,  // type
+                          GL_FALSE,  // normalized?
+                          0,         // stride
+                          (void*)0   // array buffer offset
+                          );
+
+    buffers.uvbuffer = 0;
+    if (!mesh.uvs.empty()) {
+        glGenBuffers(1, &buffers.uvbuffer);
+        gl_state.bindBuffer(GL_ARRAY_BUFFER, buffers.uvbuffer);
+        glBufferData(GL_ARRAY_BUFFER, mesh.uvs.size() * sizeof(vec2),
+                     &mesh.uvs[0], GL_STATIC_DRAW);
+        setBufferBytes(buffers.uvbuffer, mesh.uvs.size() * sizeof(vec2));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1,         // attribute
+                              2,         // size
+                              GL_FLOAT,  // type
+                              GL_FALSE,  // normalized?
+                              0,         // stride
+                              (void*)0   // array buffer offset
+                              );
+    }
+
+    glGenBuffers(1, &buffers.normalbuffer);
+    gl_state.bindBuffer(GL_ARRAY_BUFFER, buffers.normalbuffer);
+    glBufferData(GL_ARRAY_BUFFER, mesh.normals.size() * sizeof(vec3),
+                 &mesh.normals[0], GL_STATIC_DRAW);
+    setBufferBytes(buffers.normalbuffer, mesh.normals.size() * sizeof(vec3));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2,         // attribute
+                          3,         // size
+                          GL_FLOAT,  // type
+                          GL_FALSE,  // normalized?
+                          0,         // stride
+                          (void*)0   // array buffer offset
+                          );
+
+    buffers.aobuffer = 0;
+    if (!mesh.ao.empty()) {
+        glGenBuffers(1, &buffers.aobuffer);
+        gl_state.bindBuffer(GL_ARRAY_BUFFER, buffers.aobuffer);
+        glBufferData(GL_ARRAY_BUFFER, mesh.ao.size() * sizeof(float),
+                     &mesh.ao[0], GL_STATIC_DRAW);
+        setBufferBytes(buffers.aobuffer, mesh.ao.size() * sizeof(float));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    }
+
+    // the element binding is recorded in the vertex array
+    glGenBuffers(1, &buffers.indexbuffer);
+    gl_state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indexbuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 mesh.indices.size() * sizeof(uint32_t), &mesh.indices[0],
+                 GL_STATIC_DRAW);
+    setBufferBytes(buffers.indexbuffer,
+                   mesh.indices.size() * sizeof(uint32_t));
+}
+
+void deleteMesh(MeshBuffers& buffers) {
+    deleteBuffer(buffers.vertexbuffer);
+    if (buffers.uvbuffer) deleteBuffer(buffers.uvbuffer);
+    deleteBuffer(buffers.normalbuffer);
+    if (buffers.aobuffer) deleteBuffer(buffers.aobuffer);
+    deleteBuffer(buffers.indexbuffer);
+    gl_state.forgetVertexArray(buffers.v_array_id);
+    glDeleteVertexArrays(1, &buffers.v_array_id);
+}
+
+GLuint uploadDDS(const DDSImage& image) {
+    TRACE_SCOPE("uploadDDS");
+    GLenum format;
+    switch (image.four_cc) {
+        case FOURCC_DXT1:
+            format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            break;
+        case FOURCC_DXT3:
+            format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+            break;
+        case FOURCC_DXT5:
+            format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            break;
+        default:
+            fprintf(stderr, "Failed to upload DDS: unknown format.\n");
+            return 0;
+    }
+
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    gl_state.bindTexture(0, GL_TEXTURE_2D, texture_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // load mipmaps
+    size_t bytes = 0;
+    for (size_t l = 0; l < image.levels.size(); ++l) {
+        const DDSLevel& level = image.levels[l];
+        glCompressedTexImage2D(GL_TEXTURE_2D, l, format, level.width,
+                               level.height, 0, level.size,
+                               &image.data[level.offset]);
+        bytes += level.size;
+    }
+    setTextureBytes(texture_id, bytes);
+    return texture_id;
+}
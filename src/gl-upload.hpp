@@ -0,0 +1,25 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "dds.hpp"
+#include "mesh.hpp"
+
+// GL objects of one MeshData
+struct MeshBuffers {
+    GLuint v_array_id;
+    GLuint vertexbuffer;
+    GLuint uvbuffer;     // 0 without uvs
+    GLuint normalbuffer;
+    GLuint aobuffer;     // 0 when ambient occlusion is off
+    GLuint indexbuffer;  // MeshData::indices
+};
+
+// Upload a mesh into its own vertex array object: positions, uvs and
+// normals in attributes 0 to 2 and baked ambient occlusion in attribute 3
+// when the mesh has it. Leaves the vertex array bound.
+void uploadMesh(const MeshData& mesh, MeshBuffers& buffers);
+void deleteMesh(MeshBuffers& buffers);
+
+// compressed texture with every level of the image; 0 on failure
+GLuint uploadDDS(const DDSImage& image);
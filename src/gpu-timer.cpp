@@ -0,0 +1,156 @@
+#include "gpu-timer.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+#include "trace.hpp"
+
+// the GPU and CPU clocks are paired again this often, they drift apart
+#define GPU_TIMER_CALIBRATE_FRAMES 256
+
+GPUTimer::GPUTimer()
+    : available(false),
+      track(-1),
+      issued(0),
+      resolved(0),
+      in_frame(false),
+      gpu_to_cpu_ns(0) {
+    memset(frames, 0, sizeof(frames));
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool GPUTimer::init() {
+    available = false;
+    if (!GLEW_VERSION_3_3 && !GLEW_ARB_timer_query) {
+        fprintf(stderr, "Failed to find timer queries, GPU time is not "
+                        "measured.\n");
+        return false;
+    }
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    if (bits == 0) {
+        fprintf(stderr, "Failed to find a GPU timestamp counter, GPU time "
+                        "is not measured.\n");
+        return false;
+    }
+    for (int f = 0; f < GPU_TIMER_FRAMES; ++f) {
+        glGenQueries(2 + 2 * GPU_TIMER_MAX_PASSES, frames[f].queries);
+        frames[f].pending = false;
+    }
+    track = traceTrack("GPU");
+    available = true;
+    calibrate();
+    return true;
+}
+
+void GPUTimer::destroy() {
+    if (!available) return;
+    for (int f = 0; f < GPU_TIMER_FRAMES; ++f) {
+        glDeleteQueries(2 + 2 * GPU_TIMER_MAX_PASSES, frames[f].queries);
+    }
+    available = false;
+}
+
+// read both clocks back to back; GL_TIMESTAMP is the time the GPU has
+// reached the commands issued so far, which is as close as GL gets
+void GPUTimer::calibrate() {
+    GLint64 gpu_ns = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_ns);
+    int64_t cpu_ns = chrono::duration_cast<chrono::nanoseconds>(
+                         chrono::steady_clock::now().time_since_epoch())
+                         .count();
+    gpu_to_cpu_ns = cpu_ns - gpu_ns;
+}
+
+bool GPUTimer::resolve(Frame& frame) {
+    // timestamps complete in order, so the frame end comes last
+    GLint ready = 0;
+    glGetQueryObjectiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &ready);
+    if (!ready) return false;
+
+    GLuint64 t[2 + 2 * GPU_TIMER_MAX_PASSES];
+    int query_cnt = 2 + 2 * frame.pass_cnt;
+    for (int q = 0; q < query_cnt; ++q) {
+        glGetQueryObjectui64v(frame.queries[q], GL_QUERY_RESULT, &t[q]);
+    }
+    traceTrackEvent(track, "gpu frame", int64_t(t[0]) + gpu_to_cpu_ns,
+                    int64_t(t[1]) + gpu_to_cpu_ns);
+    stats.frame_ms = (t[1] - t[0]) * 1e-6;
+    frame.ms = stats.frame_ms;
+    frame.done = true;
+    stats.pass_cnt = frame.pass_cnt;
+    for (int p = 0; p < frame.pass_cnt; ++p) {
+        GLuint64 begin = t[2 + 2 * p], end = t[3 + 2 * p];
+        traceTrackEvent(track, frame.names[p], int64_t(begin) + gpu_to_cpu_ns,
+                        int64_t(end) + gpu_to_cpu_ns);
+        stats.pass_names[p] = frame.names[p];
+        stats.pass_ms[p] = end > begin ? (end - begin) * 1e-6 : 0.0;
+    }
+    ++stats.frames;
+    stats.latency = issued - frame.number;
+    frame.pending = false;
+    return true;
+}
+
+void GPUTimer::collect() {
+    if (!available) return;
+    while (resolved < issued) {
+        Frame& frame = frames[resolved % GPU_TIMER_FRAMES];
+        if (frame.pending && frame.number == resolved && !resolve(frame)) {
+            break;
+        }
+        ++resolved;
+    }
+}
+
+void GPUTimer::beginFrame() {
+    if (!available) return;
+    collect();
+    if (issued % GPU_TIMER_CALIBRATE_FRAMES == 0) calibrate();
+
+    Frame& frame = frames[issued % GPU_TIMER_FRAMES];
+    if (frame.pending) {
+        // still running GPU_TIMER_FRAMES later; waiting would stall
+        ++stats.dropped;
+        frame.pending = false;
+        resolved = issued - GPU_TIMER_FRAMES + 1;
+    }
+    frame.number = issued;
+    frame.done = false;
+    frame.pass_cnt = 0;
+    glQueryCounter(frame.queries[0], GL_TIMESTAMP);
+    in_frame = true;
+}
+
+void GPUTimer::endFrame() {
+    if (!in_frame) return;
+    Frame& frame = frames[issued % GPU_TIMER_FRAMES];
+    glQueryCounter(frame.queries[1], GL_TIMESTAMP);
+    frame.pending = true;
+    ++issued;
+    in_frame = false;
+}
+
+bool GPUTimer::getFrameTime(unsigned int number, double& ms) const {
+    const Frame& frame = frames[number % GPU_TIMER_FRAMES];
+    if (!frame.done || frame.number != number) return false;
+    ms = frame.ms;
+    return true;
+}
+
+int GPUTimer::beginPass(const char* name) {
+    Frame& frame = frames[issued % GPU_TIMER_FRAMES];
+    if (!in_frame || frame.pass_cnt == GPU_TIMER_MAX_PASSES) return -1;
+    int pass = frame.pass_cnt++;
+    frame.names[pass] = name;
+    glQueryCounter(frame.queries[2 + 2 * pass], GL_TIMESTAMP);
+    return pass;
+}
+
+void GPUTimer::endPass(int pass) {
+    if (pass < 0 || !in_frame) return;
+    Frame& frame = frames[issued % GPU_TIMER_FRAMES];
+    glQueryCounter(frame.queries[3 + 2 * pass], GL_TIMESTAMP);
+}
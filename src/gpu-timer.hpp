@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+// frames of queries in flight; results are read this many frames late at
+// most, and frames still not done by then are dropped
+#define GPU_TIMER_FRAMES 4
+// timed passes per frame
+#define GPU_TIMER_MAX_PASSES 16
+
+struct GPUTimerStats {
+    unsigned int frames;   // frames read back
+    unsigned int dropped;  // frames whose queries were reused before done
+    unsigned int latency;  // frames between issuing and reading the last
+    // the last frame read back
+    double frame_ms;
+    int pass_cnt;
+    const char* pass_names[GPU_TIMER_MAX_PASSES];
+    double pass_ms[GPU_TIMER_MAX_PASSES];
+};
+
+// GPU time of each frame and of named passes inside it, from GL_TIMESTAMP
+// queries (glQueryCounter), so passes may nest. Results are polled, never
+// waited for, and go into the "GPU" trace track in CPU time. init() fails
+// on contexts without timer queries; every call is a no-op then.
+class GPUTimer {
+   public:
+    GPUTimer();
+
+    bool init();
+    void destroy();
+
+    // read back finished frames and start timing the next one
+    void beginFrame();
+    void endFrame();
+    // returns the pass id for endPass, -1 when not timed
+    int beginPass(const char* name);
+    void endPass(int pass);
+    // read back the frames that have finished, without waiting
+    void collect();
+    // GPU time of a frame read back within the last GPU_TIMER_FRAMES frames;
+    // frames are numbered from 0 by beginFrame
+    bool getFrameTime(unsigned int frame, double& ms) const;
+
+    bool isAvailable() const { return available; }
+    const GPUTimerStats& getStats() const { return stats; }
+
+   private:
+    struct Frame {
+        unsigned int number;
+        bool pending;  // issued and not read back
+        bool done;     // read back into ms
+        double ms;
+        int pass_cnt;
+        const char* names[GPU_TIMER_MAX_PASSES];
+        // frame begin and end, then begin and end of every pass
+        GLuint queries[2 + 2 * GPU_TIMER_MAX_PASSES];
+    };
+
+    void calibrate();
+    bool resolve(Frame& frame);
+
+    bool available;
+    int track;
+    Frame frames[GPU_TIMER_FRAMES];
+    unsigned int issued;    // frames begun
+    unsigned int resolved;  // frames before this one are read or dropped
+    bool in_frame;
+    int64_t gpu_to_cpu_ns;  // added to GPU timestamps
+    GPUTimerStats stats;
+};
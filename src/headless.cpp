@@ -0,0 +1,219 @@
+#include "headless.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#ifdef OBJ_LOADER_EGL
+// keep Xlib out of eglplatform.h
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// whole word match in a space separated extension string
+static bool hasExtension(const char* list, const char* name) {
+    if (list == NULL) return false;
+    size_t len = strlen(name);
+    for (const char* p = strstr(list, name); p; p = strstr(p + len, name)) {
+        if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+HeadlessContext::HeadlessContext()
+    : display(NULL),
+      context(NULL),
+      surface(NULL),
+      width(0),
+      height(0),
+      framebuffer(0),
+      resolve_framebuffer(0),
+      resolve_target(0) {
+    targets[0] = targets[1] = 0;
+}
+
+bool HeadlessContext::init() {
+#ifdef OBJ_LOADER_EGL
+    EGLDisplay dpy = EGL_NO_DISPLAY;
+    const char* client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (hasExtension(client, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+                "eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) {
+            dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                     EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+    if (dpy == EGL_NO_DISPLAY) dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major, minor;
+    if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, &major, &minor)) {
+        fprintf(stderr, "Failed to initialize EGL.\n");
+        return false;
+    }
+    display = dpy;
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "Failed to bind the OpenGL API in EGL.\n");
+        destroy();
+        return false;
+    }
+
+    // without surfaceless contexts a 1x1 pbuffer is current instead
+    const char* extensions = eglQueryString(dpy, EGL_EXTENSIONS);
+    bool surfaceless = hasExtension(extensions, "EGL_KHR_surfaceless_context");
+    EGLint config_attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                               EGL_SURFACE_TYPE,
+                               surfaceless ? 0 : EGL_PBUFFER_BIT, EGL_NONE};
+    EGLConfig config = NULL;
+    EGLint config_cnt = 0;
+    if (!eglChooseConfig(dpy, config_attribs, &config, 1, &config_cnt) ||
+        config_cnt == 0) {
+        if (!surfaceless ||
+            !hasExtension(extensions, "EGL_KHR_no_config_context")) {
+            fprintf(stderr, "Failed to find an EGL config.\n");
+            destroy();
+            return false;
+        }
+        config = NULL;  // EGL_NO_CONFIG_KHR
+    }
+
+    // same context as the window asks GLFW for
+    EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE,
+        EGL_NONE};
+    context = eglCreateContext(dpy, config, EGL_NO_CONTEXT, context_attribs);
+    if (context == EGL_NO_CONTEXT) {
+        context = NULL;
+        fprintf(stderr, "Failed to create an OpenGL 3.3 context in EGL.\n");
+        destroy();
+        return false;
+    }
+    if (!surfaceless) {
+        EGLint pbuffer_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        surface = eglCreatePbufferSurface(dpy, config, pbuffer_attribs);
+        if (surface == EGL_NO_SURFACE) {
+            surface = NULL;
+            fprintf(stderr, "Failed to create an EGL pbuffer.\n");
+            destroy();
+            return false;
+        }
+    }
+    EGLSurface draw = surface ? (EGLSurface)surface : EGL_NO_SURFACE;
+    if (!eglMakeCurrent(dpy, draw, draw, (EGLContext)context)) {
+        fprintf(stderr, "Failed to make the EGL context current.\n");
+        destroy();
+        return false;
+    }
+    return true;
+#else
+    fprintf(stderr, "Failed to create a headless context: built without "
+                    "EGL.\n");
+    return false;
+#endif
+}
+
+bool HeadlessContext::createFramebuffer(int width, int height, int samples) {
+    this->width = width;
+    this->height = height;
+    GLint max_samples = 0;
+    glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+    samples = std::min(samples, int(max_samples));
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(2, targets);
+    static const GLenum formats[2] = {GL_RGBA8, GL_DEPTH_COMPONENT24};
+    static const GLenum attachments[2] = {GL_COLOR_ATTACHMENT0,
+                                          GL_DEPTH_ATTACHMENT};
+    for (int i = 0; i < 2; ++i) {
+        glBindRenderbuffer(GL_RENDERBUFFER, targets[i]);
+        if (samples > 1) {
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples,
+                                             formats[i], width, height);
+        } else {
+            glRenderbufferStorage(GL_RENDERBUFFER, formats[i], width, height);
+        }
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachments[i],
+                                  GL_RENDERBUFFER, targets[i]);
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Failed to create the offscreen framebuffer.\n");
+        return false;
+    }
+
+    if (samples > 1) {
+        glGenFramebuffers(1, &resolve_framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, resolve_framebuffer);
+        glGenRenderbuffers(1, &resolve_target);
+        glBindRenderbuffer(GL_RENDERBUFFER, resolve_target);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                  GL_RENDERBUFFER, resolve_target);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+            GL_FRAMEBUFFER_COMPLETE) {
+            fprintf(stderr, "Failed to create the resolve framebuffer.\n");
+            return false;
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+    // RGBA8 and a 24 bit depth padded to 32, per sample, plus the resolve
+    size_t pixels = size_t(width) * height;
+    target_bytes.set(MEMORY_GL_TEXTURES,
+                     pixels * std::max(samples, 1) * 8 +
+                         (samples > 1 ? pixels * 4 : 0));
+    return true;
+}
+
+void HeadlessContext::destroy() {
+#ifdef OBJ_LOADER_EGL
+    if (context) {
+        if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+        if (targets[0]) glDeleteRenderbuffers(2, targets);
+        if (resolve_framebuffer) glDeleteFramebuffers(1, &resolve_framebuffer);
+        if (resolve_target) glDeleteRenderbuffers(1, &resolve_target);
+        eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT);
+        eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+    }
+    if (surface) eglDestroySurface((EGLDisplay)display, (EGLSurface)surface);
+    if (display) eglTerminate((EGLDisplay)display);
+#endif
+    display = context = surface = NULL;
+    framebuffer = resolve_framebuffer = resolve_target = 0;
+    targets[0] = targets[1] = 0;
+    target_bytes.set(MEMORY_GL_TEXTURES, 0);
+}
+
+void HeadlessContext::readPixels(vector<unsigned char>& rgb) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    if (resolve_framebuffer) {
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_framebuffer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, resolve_framebuffer);
+    }
+    readFramebuffer(width, height, rgb);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void readFramebuffer(int width, int height, vector<unsigned char>& rgb) {
+    size_t row = size_t(width) * 3;
+    vector<unsigned char> pixels(row * height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+    // GL rows run bottom up
+    rgb.resize(pixels.size());
+    for (int y = 0; y < height; ++y) {
+        memcpy(&rgb[y * row], &pixels[(height - 1 - y) * row], row);
+    }
+}
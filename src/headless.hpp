@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "memory-stats.hpp"
+
+// Offscreen GL 3.3 core context for machines without a display. EGL picks
+// the surfaceless Mesa platform when it is there (llvmpipe renders without
+// a GPU) and the default display otherwise; the context is made current
+// without a surface and renders into a framebuffer object. Built only when
+// CMake finds EGL; otherwise init() fails.
+class HeadlessContext {
+   public:
+    HeadlessContext();
+
+    // create the context and make it current; glewInit() comes after
+    bool init();
+    // color and depth targets, multisampled if samples > 1; leaves the
+    // framebuffer bound with a full viewport
+    bool createFramebuffer(int width, int height, int samples);
+    void destroy();
+
+    // resolve the color buffer and read it as top-down RGB rows
+    void readPixels(std::vector<unsigned char>& rgb);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // what scenes are drawn into, multisampled when samples > 1
+    GLuint getFramebuffer() const { return framebuffer; }
+
+   private:
+    void* display;  // EGLDisplay
+    void* context;  // EGLContext
+    void* surface;  // EGLSurface, a 1x1 pbuffer without surfaceless support
+    int width, height;
+    GLuint framebuffer;
+    GLuint targets[2];  // color, depth
+    GLuint resolve_framebuffer;  // single sampled copy, 0 without samples
+    GLuint resolve_target;
+    MemoryCharge target_bytes;  // all targets, as MEMORY_GL_TEXTURES
+};
+
+// read the bound read framebuffer (the back buffer of a window) as top-down
+// RGB rows
+void readFramebuffer(int width, int height, std::vector<unsigned char>& rgb);
@@ -0,0 +1,132 @@
+#include "image.hpp"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+using namespace std;
+
+// largest stored deflate block
+#define DEFLATE_STORED_MAX 65535
+
+bool writePPM(const char* path, int width, int height,
+              const vector<unsigned char>& rgb) {
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open %s for writing.\n", path);
+        return false;
+    }
+    fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    size_t size = size_t(width) * height * 3;
+    bool ok = fwrite(&rgb[0], 1, size, fp) == size;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) fprintf(stderr, "Failed to write %s.\n", path);
+    return ok;
+}
+
+static void putU32(vector<unsigned char>& out, uint32_t v) {
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+static uint32_t crc32(const unsigned char* data, size_t size) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+    }
+    uint32_t c = 0xffffffffu;
+    for (size_t i = 0; i < size; ++i) {
+        c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+    }
+    return c ^ 0xffffffffu;
+}
+
+// length, type, data and a crc over type and data
+static void putChunk(vector<unsigned char>& out, const char* type,
+                     const vector<unsigned char>& data) {
+    putU32(out, data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putU32(out, crc32(&out[start], out.size() - start));
+}
+
+bool writePNG(const char* path, int width, int height,
+              const vector<unsigned char>& rgb) {
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G',
+                                               '\r', '\n', 0x1a, '\n'};
+    vector<unsigned char> png(signature, signature + 8);
+
+    vector<unsigned char> header;
+    putU32(header, width);
+    putU32(header, height);
+    header.push_back(8);  // bits per channel
+    header.push_back(2);  // truecolor
+    header.push_back(0);  // deflate
+    header.push_back(0);  // adaptive filtering
+    header.push_back(0);  // no interlace
+    putChunk(png, "IHDR", header);
+
+    // every row starts with filter type 0 (none)
+    size_t row = size_t(width) * 3;
+    vector<unsigned char> raw;
+    raw.reserve((row + 1) * height);
+    for (int y = 0; y < height; ++y) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + y * row,
+                   rgb.begin() + (y + 1) * row);
+    }
+
+    // zlib stream of stored blocks
+    vector<unsigned char> data;
+    data.reserve(raw.size() + raw.size() / DEFLATE_STORED_MAX * 5 + 16);
+    data.push_back(0x78);
+    data.push_back(0x01);
+    size_t pos = 0;
+    do {
+        size_t len = std::min<size_t>(raw.size() - pos, DEFLATE_STORED_MAX);
+        data.push_back(pos + len == raw.size());  // final block flag
+        data.push_back(len);
+        data.push_back(len >> 8);
+        data.push_back(~len);
+        data.push_back(~len >> 8);
+        data.insert(data.end(), raw.begin() + pos, raw.begin() + pos + len);
+        pos += len;
+    } while (pos < raw.size());
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < raw.size(); ++i) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    putU32(data, b << 16 | a);
+    putChunk(png, "IDAT", data);
+    putChunk(png, "IEND", vector<unsigned char>());
+
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to open %s for writing.\n", path);
+        return false;
+    }
+    bool ok = fwrite(&png[0], 1, png.size(), fp) == png.size();
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) fprintf(stderr, "Failed to write %s.\n", path);
+    return ok;
+}
+
+bool writeImage(const char* path, int width, int height,
+                const vector<unsigned char>& rgb) {
+    size_t len = strlen(path);
+    if (len >= 4 && strcmp(path + len - 4, ".png") == 0) {
+        return writePNG(path, width, height, rgb);
+    }
+    return writePPM(path, width, height, rgb);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <vector>
+
+// Image files of 8 bit RGB pixels in top-down rows. PNG is written with
+// stored (uncompressed) deflate blocks, so no zlib is needed.
+bool writePPM(const char* path, int width, int height,
+              const std::vector<unsigned char>& rgb);
+bool writePNG(const char* path, int width, int height,
+              const std::vector<unsigned char>& rgb);
+// PNG when path ends in .png, PPM otherwise
+bool writeImage(const char* path, int width, int height,
+                const std::vector<unsigned char>& rgb);
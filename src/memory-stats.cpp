@@ -0,0 +1,101 @@
+#include "memory-stats.hpp"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <atomic>
+using namespace std;
+
+namespace {
+
+struct Counters {
+    atomic<size_t> current;
+    atomic<size_t> peak;
+    atomic<size_t> charges;
+};
+
+// zero initialized as statics
+Counters tag_counters[MEMORY_TAG_CNT];
+Counters cpu_counters, gl_counters;
+
+const char* tag_names[MEMORY_TAG_CNT] = {"loader", "mesh", "texture",
+                                         "gl buffers", "gl textures"};
+
+void charge(Counters& c, size_t bytes) {
+    size_t now = c.current.fetch_add(bytes) + bytes;
+    size_t peak = c.peak.load(memory_order_relaxed);
+    while (now > peak && !c.peak.compare_exchange_weak(peak, now)) {
+    }
+    c.charges.fetch_add(1, memory_order_relaxed);
+}
+
+bool isGL(MemoryTag tag) {
+    return tag == MEMORY_GL_BUFFERS || tag == MEMORY_GL_TEXTURES;
+}
+
+void printRow(FILE* fp, const char* name, const Counters& c) {
+    fprintf(fp, "  %-12s %10.2f %10.2f %8u\n", name, c.current * 1e-6,
+            c.peak * 1e-6, (unsigned int)c.charges);
+}
+
+}  // namespace
+
+void memoryCharge(MemoryTag tag, size_t bytes) {
+    if (bytes == 0) return;
+    charge(tag_counters[tag], bytes);
+    charge(isGL(tag) ? gl_counters : cpu_counters, bytes);
+}
+
+void memoryRelease(MemoryTag tag, size_t bytes) {
+    tag_counters[tag].current.fetch_sub(bytes);
+    (isGL(tag) ? gl_counters : cpu_counters).current.fetch_sub(bytes);
+}
+
+MemoryStats getMemoryStats(MemoryTag tag) {
+    const Counters& c = tag_counters[tag];
+    MemoryStats stats = {c.current, c.peak, c.charges};
+    return stats;
+}
+
+void resetMemoryPeak(MemoryTag tag) {
+    Counters& c = tag_counters[tag];
+    c.peak.store(c.current.load());
+}
+
+void printMemoryReport(FILE* fp) {
+    fprintf(fp, "memory:        current MB    peak MB  charges\n");
+    for (int t = 0; t < MEMORY_TAG_CNT; ++t) {
+        if (t == MEMORY_GL_BUFFERS) printRow(fp, "cpu total", cpu_counters);
+        printRow(fp, tag_names[t], tag_counters[t]);
+    }
+    printRow(fp, "gl total", gl_counters);
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        double rss_mb = usage.ru_maxrss * 1e-6;  // bytes
+#else
+        double rss_mb = usage.ru_maxrss * 1.024e-3;  // kilobytes
+#endif
+        fprintf(fp, "  process peak rss %.2f MB\n", rss_mb);
+    }
+#endif
+}
+
+MemoryCharge::MemoryCharge(const MemoryCharge& other)
+    : tag(other.tag), bytes(0) {
+    set(other.tag, other.bytes);
+}
+
+MemoryCharge& MemoryCharge::operator=(const MemoryCharge& other) {
+    set(other.tag, other.bytes);
+    return *this;
+}
+
+void MemoryCharge::set(MemoryTag new_tag, size_t new_bytes) {
+    if (bytes) memoryRelease(tag, bytes);
+    tag = new_tag;
+    bytes = new_bytes;
+    memoryCharge(tag, bytes);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <vector>
+
+// What a loaded model costs, by subsystem. Charges are made where the
+// memory is sized (vector capacities, GL upload sizes), not per
+// allocation, so the numbers are exact for what they cover and miss what
+// no subsystem claims.
+enum MemoryTag {
+    MEMORY_LOADER,       // parsing and indexing temporaries
+    MEMORY_MESH,         // MeshData arrays kept for drawing and picking
+    MEMORY_TEXTURE,      // compressed and decoded images on the CPU
+    MEMORY_GL_BUFFERS,   // glBufferData and glBufferStorage sizes
+    MEMORY_GL_TEXTURES,  // glTexImage2D, glCompressedTexImage2D sizes and
+                         // offscreen render targets
+    MEMORY_TAG_CNT
+};
+
+struct MemoryStats {
+    size_t current;
+    size_t peak;
+    size_t charges;
+};
+
+void memoryCharge(MemoryTag tag, size_t bytes);
+void memoryRelease(MemoryTag tag, size_t bytes);
+MemoryStats getMemoryStats(MemoryTag tag);
+// starts the peak of a tag over from its current size, to measure one step
+void resetMemoryPeak(MemoryTag tag);
+// current and peak per tag, CPU and GL totals and the process peak RSS
+void printMemoryReport(FILE* fp);
+
+// Bytes charged to a tag for as long as the owner lives; a copy charges
+// its bytes again.
+class MemoryCharge {
+   public:
+    MemoryCharge() : tag(MEMORY_LOADER), bytes(0) {}
+    MemoryCharge(const MemoryCharge& other);
+    MemoryCharge& operator=(const MemoryCharge& other);
+    ~MemoryCharge() { set(tag, 0); }
+
+    // charge bytes instead of what was charged before
+    void set(MemoryTag tag, size_t bytes);
+    size_t getBytes() const { return bytes; }
+
+   private:
+    MemoryTag tag;
+    size_t bytes;
+};
+
+template <class T>
+size_t capacityBytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
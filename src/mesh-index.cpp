@@ -0,0 +1,117 @@
+#include "mesh-index.hpp"
+
+#include <cstring>
+using namespace std;
+using namespace glm;
+
+#include "trace.hpp"
+
+#define WELD_EMPTY 0xffffffffu
+
+namespace {
+
+uint32_t hashBytes(const unsigned char* p, size_t n) {
+    uint32_t h = 2166136261u;  // FNV-1a over 32-bit words, then bytes
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint32_t w;
+        memcpy(&w, p + i, 4);
+        h = (h ^ w) * 16777619u;
+    }
+    for (; i < n; ++i) h = (h ^ p[i]) * 16777619u;
+    h ^= h >> 15;  // FNV leaves the low bits weak for power of two tables
+    return h * 0x2c1b3c6du;
+}
+
+}  // namespace
+
+uint32_t weldVertices(const void* data, size_t count, size_t stride,
+                      vector<uint32_t>& remap) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    remap.resize(count);
+
+    // meshes share most vertices between several triangles, so the table
+    // starts small and doubles at half load to stay cache friendly
+    size_t table_size = 64;
+    while (table_size < count / 4) table_size *= 2;
+    vector<uint32_t> table(table_size, WELD_EMPTY);  // first vertex of a key
+    vector<uint32_t> firsts;  // unique index -> first vertex
+    size_t mask = table_size - 1;
+
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char* v = bytes + i * stride;
+        size_t slot = hashBytes(v, stride) & mask;
+        for (;;) {
+            uint32_t first = table[slot];
+            if (first == WELD_EMPTY) {
+                table[slot] = i;
+                remap[i] = firsts.size();
+                firsts.push_back(i);
+                break;
+            }
+            if (memcmp(bytes + first * stride, v, stride) == 0) {
+                remap[i] = remap[first];
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+
+        if (firsts.size() * 2 > table_size) {
+            table_size *= 2;
+            mask = table_size - 1;
+            table.assign(table_size, WELD_EMPTY);
+            for (size_t u = 0; u < firsts.size(); ++u) {
+                slot = hashBytes(bytes + firsts[u] * stride, stride) & mask;
+                while (table[slot] != WELD_EMPTY) slot = (slot + 1) & mask;
+                table[slot] = firsts[u];
+            }
+        }
+    }
+    return firsts.size();
+}
+
+void buildAdjacency(const vector<uint32_t>& indices, uint32_t vertex_cnt,
+                    VertexAdjacency& adj) {
+    adj.offsets.assign(vertex_cnt + 1, 0);
+    for (size_t i = 0; i < indices.size(); ++i) ++adj.offsets[indices[i] + 1];
+    for (uint32_t v = 0; v < vertex_cnt; ++v) {
+        adj.offsets[v + 1] += adj.offsets[v];
+    }
+    adj.corners.resize(indices.size());
+    vector<uint32_t> cursor(adj.offsets.begin(), adj.offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i) {
+        adj.corners[cursor[indices[i]]++] = i;
+    }
+}
+
+void indexMesh(const vector<vec3>& vertices, const vector<vec2>& uvs,
+               const vector<vec3>& normals, IndexedMesh& mesh) {
+    TRACE_SCOPE("indexMesh");
+    size_t corner_cnt = vertices.size();
+    bool has_uvs = uvs.size() == corner_cnt;
+    bool has_normals = normals.size() == corner_cnt;
+
+    // pack each corner's attributes so they weld as one key
+    size_t floats = 3 + (has_uvs ? 2 : 0) + (has_normals ? 3 : 0);
+    vector<float> keys(corner_cnt * floats);
+    for (size_t i = 0; i < corner_cnt; ++i) {
+        float* k = &keys[i * floats];
+        memcpy(k, &vertices[i][0], sizeof(vec3));
+        if (has_uvs) memcpy(k + 3, &uvs[i][0], sizeof(vec2));
+        if (has_normals) memcpy(k + floats - 3, &normals[i][0], sizeof(vec3));
+    }
+    uint32_t vertex_cnt = weldVertices(corner_cnt ? &keys[0] : NULL,
+                                       corner_cnt, floats * sizeof(float),
+                                       mesh.indices);
+
+    mesh.positions.resize(vertex_cnt);
+    mesh.uvs.resize(has_uvs ? vertex_cnt : 0);
+    mesh.normals.resize(has_normals ? vertex_cnt : 0);
+    mesh.tangents.clear();
+    for (size_t i = 0; i < corner_cnt; ++i) {
+        uint32_t v = mesh.indices[i];
+        mesh.positions[v] = vertices[i];
+        if (has_uvs) mesh.uvs[v] = uvs[i];
+        if (has_normals) mesh.normals[v] = normals[i];
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Welds bit-identical vertices of stride bytes each with an open addressing
+// hash table in linear time. remap[i] is the unique index of vertex i,
+// unique indices are assigned in first-seen order. Returns the unique count.
+uint32_t weldVertices(const void* data, size_t count, size_t stride,
+                      std::vector<uint32_t>& remap);
+
+// vertex -> corner adjacency in compressed sparse row form: the corners
+// (index buffer positions) using vertex v are corners[offsets[v]] up to
+// corners[offsets[v + 1]], in increasing order
+struct VertexAdjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> corners;
+};
+
+// counting sort over the index buffer, linear in indices + vertex_cnt
+void buildAdjacency(const std::vector<uint32_t>& indices, uint32_t vertex_cnt,
+                    VertexAdjacency& adj);
+
+// shared vertices and a triangle list into them
+struct IndexedMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;  // empty when the file has none
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec4> tangents;  // xyz tangent, w bitangent sign
+    std::vector<uint32_t> indices;
+};
+
+// welds per-corner arrays as returned by loadOBJ into shared vertices;
+// uvs and normals are either empty or one per corner
+void indexMesh(const std::vector<glm::vec3>& vertices,
+               const std::vector<glm::vec2>& uvs,
+               const std::vector<glm::vec3>& normals, IndexedMesh& mesh);
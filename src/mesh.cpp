@@ -0,0 +1,118 @@
+#include "mesh.hpp"
+
+#include <chrono>
+#include <cstdio>
+using namespace std;
+using namespace glm;
+
+#include "ao.hpp"
+#include "mesh-index.hpp"
+#include "normals.hpp"
+#include "obj.hpp"
+#include "trace.hpp"
+
+namespace {
+
+double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+size_t meshBytes(const MeshData& mesh) {
+    return capacityBytes(mesh.positions) + capacityBytes(mesh.normals) +
+           capacityBytes(mesh.uvs) + capacityBytes(mesh.ao) +
+           capacityBytes(mesh.indices) + capacityBytes(mesh.lods) +
+           capacityBytes(mesh.meshlets.meshlets) +
+           capacityBytes(mesh.meshlets.vertices) +
+           capacityBytes(mesh.meshlets.triangles) +
+           capacityBytes(mesh.bvh.nodes) + capacityBytes(mesh.bvh.tris) +
+           capacityBytes(mesh.bvh.tri_ids);
+}
+
+}  // namespace
+
+bool loadMesh(const char* path, const MeshOptions& options, MeshData& mesh) {
+    TRACE_SCOPE("loadMesh");
+    vector<vec3> vertices;
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    int res = loadOBJ(path, vertices, uvs, normals);
+    if (res < 0 || vertices.empty()) {
+        fprintf(stderr, "Failed to parse obj file %s.\n", path);
+        return false;
+    }
+    // per corner arrays, the largest loader temporaries
+    MemoryCharge corners;
+    corners.set(MEMORY_LOADER, capacityBytes(vertices) + capacityBytes(uvs) +
+                                   capacityBytes(normals));
+    mesh.textured = res != 0;
+    mesh.path = path;
+    mesh.bounds = computeBounds(vertices);
+    mesh.radius = length(mesh.bounds.max - mesh.bounds.min) * 0.5f;
+    buildBVH(vertices, mesh.bvh);
+    if (normals.size() != vertices.size()) {
+        // position-only files such as brain.obj still get lit
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        generateNormals(vertices, normals);
+        printf("generated normals for %s in %.1f ms\n", path, msSince(t0));
+    }
+
+    // ao is baked per corner, so fetch it before the corners are welded
+    vector<float> ao;
+    bool has_ao = options.bake_ao &&
+                  loadOrBakeAO(path, mesh.bvh, vertices, normals, ao);
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    IndexedMesh indexed;
+    indexMesh(vertices, mesh.textured ? uvs : vector<vec2>(), normals,
+              indexed);
+    LODChain chain;
+    if (options.build_lods) {
+        buildLODChain(indexed, chain);
+    } else {
+        chain.indices = indexed.indices;
+        LODLevel full = {0, uint32_t(indexed.indices.size()), 0.0f};
+        chain.levels.push_back(full);
+    }
+    mesh.lods = chain.levels;
+    mesh.meshlet_first = chain.indices.size();
+    mesh.meshlets = MeshletMesh();
+    if (options.build_meshlets) {
+        buildMeshlets(indexed.positions, indexed.indices, mesh.meshlets);
+        vector<uint32_t> meshlet_indices;
+        meshletIndices(mesh.meshlets, meshlet_indices);
+        chain.indices.insert(chain.indices.end(), meshlet_indices.begin(),
+                             meshlet_indices.end());
+    }
+    printf("indexed %s: %u corners -> %u vertices, %u lods, %u meshlets "
+           "in %.1f ms\n",
+           path, (unsigned int)vertices.size(),
+           (unsigned int)indexed.positions.size(),
+           (unsigned int)chain.levels.size(),
+           (unsigned int)mesh.meshlets.meshlets.size(), msSince(t0));
+    corners.set(MEMORY_LOADER,
+                capacityBytes(vertices) + capacityBytes(uvs) +
+                    capacityBytes(normals) + capacityBytes(ao) +
+                    capacityBytes(indexed.positions) +
+                    capacityBytes(indexed.normals) +
+                    capacityBytes(indexed.uvs) +
+                    capacityBytes(indexed.indices) +
+                    capacityBytes(chain.indices));
+
+    // corners welded into one vertex share position and normal, so they
+    // were baked to the same value
+    mesh.ao.clear();
+    if (has_ao) {
+        mesh.ao.resize(indexed.positions.size());
+        for (size_t c = 0; c < indexed.indices.size(); ++c) {
+            mesh.ao[indexed.indices[c]] = ao[c];
+        }
+    }
+    corners.set(MEMORY_LOADER, 0);  // the arrays kept move to MEMORY_MESH
+    mesh.positions.swap(indexed.positions);
+    mesh.normals.swap(indexed.normals);
+    mesh.uvs.swap(indexed.uvs);
+    mesh.indices.swap(chain.indices);
+    mesh.memory.set(MEMORY_MESH, meshBytes(mesh));
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.hpp"
+#include "culling.hpp"
+#include "memory-stats.hpp"
+#include "meshlets.hpp"
+#include "simplify.hpp"
+
+struct MeshOptions {
+    bool bake_ao;         // per vertex ambient occlusion, cached on disk
+    bool build_lods;      // chain of simplified index ranges
+    bool build_meshlets;  // clusters of the full detail level
+};
+
+// An obj file indexed and processed for drawing, without any GL objects;
+// gl-upload.hpp puts it into buffers.
+struct MeshData {
+    std::string path;
+    bool textured;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;  // empty unless textured
+    std::vector<float> ao;       // empty unless baked
+    std::vector<uint32_t> indices;  // every level of detail back to back,
+                                    // then the meshlet triangles
+    std::vector<LODLevel> lods;
+    MeshletMesh meshlets;
+    uint32_t meshlet_first;  // their triangles in indices
+    AABB bounds;
+    float radius;  // bounding sphere around the bounds center
+    BVH bvh;  // for picking and the ao bake
+    MemoryCharge memory;  // everything above, as MEMORY_MESH
+};
+
+// load an obj file, generating normals for files without them, and build
+// what options ask for
+bool loadMesh(const char* path, const MeshOptions& options, MeshData& mesh);
@@ -0,0 +1,250 @@
+#include "meshlets.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+using namespace std;
+using namespace glm;
+
+#include "mesh-index.hpp"
+#include "trace.hpp"
+
+// cones wider than about 84 degrees never cull, do not bother testing them
+#define MESHLET_MIN_CONE_DOT 0.1f
+
+#define MESHLET_NO_VERTEX 0xff
+
+// how much a normal off the meshlet's average stretches the distance a
+// candidate triangle is scored by; tighter cones cull more back faces
+#define MESHLET_CONE_WEIGHT 4.0f
+
+namespace {
+
+void computeMeshletBounds(const vector<vec3>& positions, const MeshletMesh& out,
+                          Meshlet& m) {
+    const uint32_t* verts = &out.vertices[m.vertex_offset];
+    vec3 lo(FLT_MAX), hi(-FLT_MAX);
+    for (uint32_t i = 0; i < m.vertex_cnt; ++i) {
+        lo = glm::min(lo, positions[verts[i]]);
+        hi = glm::max(hi, positions[verts[i]]);
+    }
+    m.center = (lo + hi) * 0.5f;
+    m.radius = 0.0f;
+    for (uint32_t i = 0; i < m.vertex_cnt; ++i) {
+        m.radius = std::max(m.radius, length(positions[verts[i]] - m.center));
+    }
+
+    // unit normals so small triangles count as much as big ones
+    const uint8_t* tris = &out.triangles[m.triangle_offset * 3];
+    vector<vec3> normals;
+    normals.reserve(m.triangle_cnt);
+    vec3 sum(0.0f);
+    for (uint32_t t = 0; t < m.triangle_cnt; ++t) {
+        const vec3& a = positions[verts[tris[t * 3]]];
+        const vec3& b = positions[verts[tris[t * 3 + 1]]];
+        const vec3& c = positions[verts[tris[t * 3 + 2]]];
+        vec3 n = cross(b - a, c - a);
+        float len = length(n);
+        if (len == 0.0f) continue;
+        normals.push_back(n / len);
+        sum += n / len;
+    }
+    m.cone_axis = vec3(0.0f, 0.0f, 1.0f);
+    m.cone_cutoff = 1.0f;
+    float sum_len = length(sum);
+    if (sum_len == 0.0f) return;
+    m.cone_axis = sum / sum_len;
+    float min_dot = 1.0f;
+    for (size_t t = 0; t < normals.size(); ++t) {
+        min_dot = std::min(min_dot, dot(normals[t], m.cone_axis));
+    }
+    if (min_dot >= MESHLET_MIN_CONE_DOT) {
+        m.cone_cutoff = sqrt(1.0f - min_dot * min_dot);
+    }
+}
+
+}  // namespace
+
+void buildMeshlets(const vector<vec3>& positions,
+                   const vector<uint32_t>& indices, MeshletMesh& out) {
+    TRACE_SCOPE("buildMeshlets");
+    out.meshlets.clear();
+    out.vertices.clear();
+    out.triangles.clear();
+    size_t tri_cnt = indices.size() / 3;
+    VertexAdjacency adj;
+    buildAdjacency(indices, positions.size(), adj);
+
+    vector<vec3> centroids(tri_cnt), normals(tri_cnt);
+    for (size_t t = 0; t < tri_cnt; ++t) {
+        const vec3& a = positions[indices[t * 3]];
+        const vec3& b = positions[indices[t * 3 + 1]];
+        const vec3& c = positions[indices[t * 3 + 2]];
+        centroids[t] = (a + b + c) / 3.0f;
+        vec3 n = cross(b - a, c - a);
+        float len = length(n);
+        normals[t] = len > 0.0f ? n / len : vec3(0.0f);
+    }
+
+    // unemitted triangles per vertex
+    vector<uint32_t> live(positions.size());
+    for (size_t v = 0; v < positions.size(); ++v) {
+        live[v] = adj.offsets[v + 1] - adj.offsets[v];
+    }
+
+    vector<unsigned char> emitted(tri_cnt, 0);
+    vector<uint8_t> local(positions.size(), MESHLET_NO_VERTEX);
+    size_t seed = 0;
+    uint32_t last_offset = 0, last_cnt = 0;  // vertices of the last meshlet
+    Meshlet m = {0, 0, 0, 0, vec3(0.0f), 0.0f, vec3(0.0f), 0.0f};
+    vec3 centroid_sum(0.0f), normal_sum(0.0f);
+    for (;;) {
+        // pick the adjacent triangle that adds the fewest vertices, then
+        // the one closest to the meshlet in position and orientation
+        size_t best = tri_cnt;
+        int best_new = 4;
+        float best_score = FLT_MAX;
+        vec3 center = centroid_sum / std::max(float(m.triangle_cnt), 1.0f);
+        float normal_len = length(normal_sum);
+        vec3 axis = normal_len > 0.0f ? normal_sum / normal_len : vec3(0.0f);
+        for (uint32_t i = 0; i < m.vertex_cnt; ++i) {
+            uint32_t v = out.vertices[m.vertex_offset + i];
+            for (uint32_t k = adj.offsets[v]; k < adj.offsets[v + 1]; ++k) {
+                size_t t = adj.corners[k] / 3;
+                if (emitted[t]) continue;
+                int added = (local[indices[t * 3]] == MESHLET_NO_VERTEX) +
+                            (local[indices[t * 3 + 1]] == MESHLET_NO_VERTEX) +
+                            (local[indices[t * 3 + 2]] == MESHLET_NO_VERTEX);
+                if (added > best_new) continue;
+                float score = length(centroids[t] - center) *
+                              (1.0f + MESHLET_CONE_WEIGHT *
+                                          (1.0f - dot(normals[t], axis)));
+                if (added < best_new || score < best_score) {
+                    best = t;
+                    best_new = added;
+                    best_score = score;
+                }
+            }
+        }
+
+        bool full = m.triangle_cnt == MESHLET_MAX_TRIANGLES ||
+                    (best < tri_cnt &&
+                     m.vertex_cnt + best_new > MESHLET_MAX_VERTICES);
+        if (m.triangle_cnt > 0 && (best == tri_cnt || full)) {
+            computeMeshletBounds(positions, out, m);
+            out.meshlets.push_back(m);
+            for (uint32_t i = 0; i < m.vertex_cnt; ++i) {
+                local[out.vertices[m.vertex_offset + i]] = MESHLET_NO_VERTEX;
+            }
+            last_offset = m.vertex_offset;
+            last_cnt = m.vertex_cnt;
+            m.vertex_offset = out.vertices.size();
+            m.triangle_offset = out.triangles.size() / 3;
+            m.vertex_cnt = m.triangle_cnt = 0;
+            centroid_sum = normal_sum = vec3(0.0f);
+            continue;
+        }
+        if (best == tri_cnt) {
+            // start next to the last meshlet where the fewest triangles
+            // are left, so growth follows a front instead of leaving
+            // small islands behind; else take the next in index order
+            uint32_t best_live = UINT32_MAX;
+            for (uint32_t i = 0; i < last_cnt; ++i) {
+                uint32_t v = out.vertices[last_offset + i];
+                for (uint32_t k = adj.offsets[v]; k < adj.offsets[v + 1];
+                     ++k) {
+                    size_t t = adj.corners[k] / 3;
+                    if (emitted[t]) continue;
+                    uint32_t l = live[indices[t * 3]] +
+                                 live[indices[t * 3 + 1]] +
+                                 live[indices[t * 3 + 2]];
+                    if (l < best_live) {
+                        best = t;
+                        best_live = l;
+                    }
+                }
+            }
+            if (best == tri_cnt) {
+                while (seed < tri_cnt && emitted[seed]) ++seed;
+                if (seed == tri_cnt) break;
+                best = seed;
+            }
+        }
+
+        emitted[best] = 1;
+        for (int c = 0; c < 3; ++c) --live[indices[best * 3 + c]];
+        centroid_sum += centroids[best];
+        normal_sum += normals[best];
+        for (int c = 0; c < 3; ++c) {
+            uint32_t v = indices[best * 3 + c];
+            if (local[v] == MESHLET_NO_VERTEX) {
+                local[v] = m.vertex_cnt++;
+                out.vertices.push_back(v);
+            }
+            out.triangles.push_back(local[v]);
+        }
+        ++m.triangle_cnt;
+    }
+}
+
+void meshletIndices(const MeshletMesh& mesh, vector<uint32_t>& out) {
+    out.resize(mesh.triangles.size());
+    for (size_t i = 0; i < mesh.meshlets.size(); ++i) {
+        const Meshlet& m = mesh.meshlets[i];
+        const uint32_t* verts = &mesh.vertices[m.vertex_offset];
+        size_t first = m.triangle_offset * 3;
+        for (size_t c = first; c < first + m.triangle_cnt * 3; ++c) {
+            out[c] = verts[mesh.triangles[c]];
+        }
+    }
+}
+
+void cullMeshlets(const MeshletMesh& mesh, const Frustum& frustum,
+                  const vec3& offset, const vec3& camera,
+                  const OcclusionBuffer* occlusion, uint32_t first_index,
+                  vector<DrawIndirectCmd>& cmds, MeshletCullStats& stats) {
+    // instances are only translated, so cones stay in object space
+    vec3 eye = camera - offset;
+    size_t merge_from = cmds.size();  // never merge into another instance
+    for (size_t i = 0; i < mesh.meshlets.size(); ++i) {
+        const Meshlet& m = mesh.meshlets[i];
+        ++stats.meshlets;
+
+        vec3 center = m.center + offset;
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; ++p) {
+            const vec4& pl = frustum.planes[p];
+            inside = dot(vec3(pl), center) + pl.w >= -m.radius;
+        }
+        if (!inside) {
+            ++stats.frustum_culled;
+            continue;
+        }
+
+        // the whole sphere sees only back faces of the cone
+        vec3 view = m.center - eye;
+        if (dot(view, m.cone_axis) >=
+            m.cone_cutoff * length(view) + m.radius) {
+            ++stats.backface_culled;
+            continue;
+        }
+
+        if (occlusion) {
+            AABB box = {center - vec3(m.radius), center + vec3(m.radius)};
+            if (!occlusion->testBox(box)) {
+                ++stats.occlusion_culled;
+                continue;
+            }
+        }
+
+        uint32_t first = first_index + m.triangle_offset * 3;
+        if (cmds.size() > merge_from &&
+            cmds.back().first_index + cmds.back().count == first) {
+            cmds.back().count += m.triangle_cnt * 3;
+            continue;
+        }
+        DrawIndirectCmd cmd = {m.triangle_cnt * 3, 1, first, 0, 0};
+        cmds.push_back(cmd);
+        ++stats.cmds;
+    }
+}
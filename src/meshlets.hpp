@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "culling.hpp"
+#include "occlusion.hpp"
+
+// limits that fit mesh shader outputs; 124 keeps a meshlet's triangle
+// bytes a multiple of 4
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+struct Meshlet {
+    uint32_t vertex_offset;    // into MeshletMesh::vertices
+    uint32_t triangle_offset;  // in triangles, into MeshletMesh::triangles
+    uint32_t vertex_cnt;
+    uint32_t triangle_cnt;
+    // object space bounding sphere
+    glm::vec3 center;
+    float radius;
+    // every triangle normal is within the cone around axis; cutoff is the
+    // sine of its half angle, 1 when the cone is too wide to ever cull
+    glm::vec3 cone_axis;
+    float cone_cutoff;
+};
+
+struct MeshletMesh {
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices;  // meshlet-local -> mesh vertex
+    std::vector<uint8_t> triangles;  // 3 meshlet-local indices each
+};
+
+// layout of glMultiDrawElementsIndirect commands
+struct DrawIndirectCmd {
+    uint32_t count;
+    uint32_t instance_cnt;
+    uint32_t first_index;
+    int32_t base_vertex;
+    uint32_t base_instance;
+};
+
+struct MeshletCullStats {
+    unsigned int meshlets;  // tested
+    unsigned int frustum_culled;
+    unsigned int backface_culled;
+    unsigned int occlusion_culled;
+    unsigned int cmds;  // draws emitted after merging
+};
+
+// Greedy clustering: a meshlet grows by the triangle adjacent to it that
+// adds the fewest new vertices, and closes when the next one would break a
+// limit or no adjacent triangle is left.
+void buildMeshlets(const std::vector<glm::vec3>& positions,
+                   const std::vector<uint32_t>& indices, MeshletMesh& out);
+
+// triangles of all meshlets as one index buffer into the mesh vertices,
+// so meshlet m starts at index triangle_offset * 3
+void meshletIndices(const MeshletMesh& mesh, std::vector<uint32_t>& out);
+
+// Tests each meshlet of a translated instance against the frustum, with
+// camera the eye in world space its normal cone, and the bounds of its
+// sphere against occlusion unless that is NULL. Surviving meshlets append
+// draws of their range in meshletIndices starting at first_index; adjacent
+// ranges merge into one draw. stats are accumulated.
+void cullMeshlets(const MeshletMesh& mesh, const Frustum& frustum,
+                  const glm::vec3& offset, const glm::vec3& camera,
+                  const OcclusionBuffer* occlusion, uint32_t first_index,
+                  std::vector<DrawIndirectCmd>& cmds,
+                  MeshletCullStats& stats);
@@ -0,0 +1,142 @@
+#include "normals.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+using namespace std;
+using namespace glm;
+
+#include "mesh-index.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+
+#define NORMAL_GRAIN 4096
+
+namespace {
+
+// unit normals of triangles [lo, hi), SIMD_WIDTH at a time
+void faceNormals(const vector<vec3>& vertices, size_t lo, size_t hi,
+                 vector<vec3>& face_n, vector<float>& area) {
+    float p[9][SIMD_WIDTH];  // x y z of the three corners, lane per triangle
+    for (size_t t0 = lo; t0 < hi; t0 += SIMD_WIDTH) {
+        size_t n = std::min<size_t>(SIMD_WIDTH, hi - t0);
+        for (size_t l = 0; l < SIMD_WIDTH; ++l) {
+            size_t t = t0 + (l < n ? l : 0);  // pad with the first triangle
+            for (int c = 0; c < 3; ++c) {
+                const vec3& v = vertices[t * 3 + c];
+                p[c * 3][l] = v.x;
+                p[c * 3 + 1][l] = v.y;
+                p[c * 3 + 2][l] = v.z;
+            }
+        }
+        vfloat ax = vload(p[0]), ay = vload(p[1]), az = vload(p[2]);
+        vfloat e1x = vload(p[3]) - ax, e1y = vload(p[4]) - ay;
+        vfloat e1z = vload(p[5]) - az;
+        vfloat e2x = vload(p[6]) - ax, e2y = vload(p[7]) - ay;
+        vfloat e2z = vload(p[8]) - az;
+        vfloat nx = e1y * e2z - e1z * e2y;
+        vfloat ny = e1z * e2x - e1x * e2z;
+        vfloat nz = e1x * e2y - e1y * e2x;
+        vfloat len = vsqrt(nx * nx + ny * ny + nz * nz);
+        // degenerate triangles get a zero normal and contribute nothing
+        vfloat valid = vfloat(0.0f) < len;
+        vfloat inv = select(valid, vfloat(1.0f) / len, vfloat(0.0f));
+        vstore(p[0], nx * inv);
+        vstore(p[1], ny * inv);
+        vstore(p[2], nz * inv);
+        vstore(p[3], len * vfloat(0.5f));
+        for (size_t l = 0; l < n; ++l) {
+            face_n[t0 + l] = vec3(p[0][l], p[1][l], p[2][l]);
+            area[t0 + l] = p[3][l];
+        }
+    }
+}
+
+// interior angle of the triangle at corner c
+float cornerAngle(const vector<vec3>& vertices, size_t c) {
+    size_t t = c / 3 * 3;
+    const vec3& v = vertices[c];
+    vec3 a = vertices[t + (c - t + 1) % 3] - v;
+    vec3 b = vertices[t + (c - t + 2) % 3] - v;
+    float la = length(a), lb = length(b);
+    if (la == 0.0f || lb == 0.0f) return 0.0f;
+    float d = dot(a, b) / (la * lb);
+    return acos(std::max(-1.0f, std::min(1.0f, d)));
+}
+
+vec3 safeNormalize(const vec3& n, const vec3& fallback) {
+    float len = length(n);
+    return len > 0.0f ? n / len : fallback;
+}
+
+}  // namespace
+
+void generateNormals(const vector<vec3>& vertices, vector<vec3>& normals,
+                     NormalWeighting weighting, float crease_deg) {
+    TRACE_SCOPE("generateNormals");
+    size_t corner_cnt = vertices.size() / 3 * 3;
+    size_t tri_cnt = corner_cnt / 3;
+    normals.assign(vertices.size(), vec3(0.0f, 0.0f, 1.0f));
+    if (tri_cnt == 0) return;
+
+    vector<uint32_t> indices;
+    uint32_t vertex_cnt = weldVertices(&vertices[0], corner_cnt, sizeof(vec3),
+                                       indices);
+
+    vector<vec3> face_n(tri_cnt);
+    vector<float> area(tri_cnt);
+    vector<float> weight(corner_cnt);
+    parallelFor(0, tri_cnt, NORMAL_GRAIN, [&](size_t lo, size_t hi) {
+        faceNormals(vertices, lo, hi, face_n, area);
+        for (size_t c = lo * 3; c < hi * 3; ++c) {
+            weight[c] = weighting == NORMAL_WEIGHT_AREA
+                            ? area[c / 3]
+                            : cornerAngle(vertices, c);
+        }
+    });
+
+    VertexAdjacency adj;
+    buildAdjacency(indices, vertex_cnt, adj);
+
+    if (crease_deg >= NORMAL_NO_CREASE) {
+        // one normal per welded vertex, gathered without write conflicts
+        vector<vec3> vertex_n(vertex_cnt);
+        parallelFor(0, vertex_cnt, NORMAL_GRAIN, [&](size_t lo, size_t hi) {
+            for (size_t v = lo; v < hi; ++v) {
+                vec3 sum(0.0f);
+                for (uint32_t k = adj.offsets[v]; k < adj.offsets[v + 1];
+                     ++k) {
+                    uint32_t c = adj.corners[k];
+                    sum += face_n[c / 3] * weight[c];
+                }
+                vertex_n[v] = sum;
+            }
+        });
+        parallelFor(0, corner_cnt, NORMAL_GRAIN, [&](size_t lo, size_t hi) {
+            for (size_t c = lo; c < hi; ++c) {
+                normals[c] = safeNormalize(vertex_n[indices[c]], face_n[c / 3]);
+            }
+        });
+        return;
+    }
+
+    // with a crease angle each corner only sums the faces around its vertex
+    // that are close enough to its own
+    float cos_crease = cos(radians(crease_deg));
+    parallelFor(0, corner_cnt, NORMAL_GRAIN, [&](size_t lo, size_t hi) {
+        for (size_t c = lo; c < hi; ++c) {
+            const vec3& own = face_n[c / 3];
+            uint32_t v = indices[c];
+            vec3 sum(0.0f);
+            for (uint32_t k = adj.offsets[v]; k < adj.offsets[v + 1]; ++k) {
+                uint32_t other = adj.corners[k];
+                if (dot(own, face_n[other / 3]) >= cos_crease) {
+                    sum += face_n[other / 3] * weight[other];
+                }
+            }
+            normals[c] = safeNormalize(sum, own);
+        }
+    });
+}
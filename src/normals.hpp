@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// faces meeting at a sharper angle than this (degrees) keep separate
+// normals; the default smooths across every edge
+#define NORMAL_NO_CREASE 180.0f
+
+enum NormalWeighting {
+    NORMAL_WEIGHT_AREA,   // larger faces pull harder
+    NORMAL_WEIGHT_ANGLE,  // by the corner angle, independent of tessellation
+};
+
+// Smooth per-corner normals for a triangle soup (3 vertices per triangle,
+// as returned by loadOBJ). Corners are welded by position, face normals
+// are computed in SIMD batches and summed per vertex through a vertex to
+// corner adjacency, both passes in parallel.
+void generateNormals(const std::vector<glm::vec3>& vertices,
+                     std::vector<glm::vec3>& normals,
+                     NormalWeighting weighting = NORMAL_WEIGHT_ANGLE,
+                     float crease_deg = NORMAL_NO_CREASE);
@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <cfloat>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -11,332 +13,343 @@ using namespace std;
 #include <GL/glew.h>
 
 #include <glfw3.h>
-GLFWwindow* window;
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 using namespace glm;
 
+#include "bvh.hpp"
+#include "culling.hpp"
+#include "dds.hpp"
+#include "frame-data.hpp"
+#include "frame-stats.hpp"
+#include "gl-state.hpp"
+#include "gl-upload.hpp"
+#include "gpu-timer.hpp"
+#include "headless.hpp"
+#include "image.hpp"
+#include "memory-stats.hpp"
+#include "mesh.hpp"
+#include "meshlets.hpp"
+#include "occlusion.hpp"
+#include "render-queue.hpp"
+#include "shader.hpp"
+#include "simplify.hpp"
+#include "soft-raster.hpp"
+#include "texture.hpp"
+#include "trace.hpp"
+
 #define W_WIDTH 1024
 #define W_HEIGHT 768
+#define W_SAMPLES 4
+
+// software occlusion buffer at half the window resolution; the nearest
+// instances occlude with a level of detail up to OCCLUDER_PIXEL_ERROR of its
+// pixels coarser than the mesh
+#define OCCLUSION_WIDTH (W_WIDTH / 2)
+#define OCCLUSION_HEIGHT (W_HEIGHT / 2)
+#define OCCLUDER_MAX 16
+#define OCCLUDER_TRIANGLES 100000
+#define OCCLUDER_PIXEL_ERROR 1.0f
+
+// seconds on a monotonic clock, with or without GLFW
+double getTime() {
+    return chrono::duration<double>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
 
-mat4 v_mat;
-mat4 p_mat;
-
-mat4 getViewMatrix() { return v_mat; }
-mat4 getProjectionMatrix() { return p_mat; }
-
-vec3 position = vec3(0, 0, 5);  // +Z
-float h_angle = 3.14f;          // -Z
-float v_angle = 0.0f;
-float init_fov = 45.0f;
-
-float speed = 10.0f;
-float mouse_speed = 0.005f;
-
-void computeMatricesFromInputs() {
-    static double last_t = glfwGetTime();  // called only once
-    double curr_t = glfwGetTime();
-    float delta_t = float(curr_t - last_t);
-
-    // double xpos, ypos;
-    // glfwGetCursorPos(window, &xpos, &ypos);               // get mouse pos
-    // glfwSetCursorPos(window, W_WIDTH / 2, W_HEIGHT / 2);  // reset pos
-
-    // get new orientation
-    // h_angle += mouse_speed * float(W_WIDTH / 2 - xpos);
-    // v_angle += mouse_speed * float(W_HEIGHT / 2 - ypos);
+// fly camera, moved with the arrow keys
+struct Camera {
+    vec3 position;
+    float h_angle;
+    float v_angle;
+    float fov;
+    float speed;
+    double last_t;
+    mat4 v_mat;
+    mat4 p_mat;
+
+    Camera()
+        : position(0, 0, 5),  // +Z
+          h_angle(3.14f),     // -Z
+          v_angle(0.0f),
+          fov(45.0f),
+          speed(10.0f),
+          last_t(getTime()) {}
+};
+
+// move the camera by the keys held since the last call; window is NULL
+// when headless
+void updateCamera(GLFWwindow* window, Camera& camera) {
+    double curr_t = getTime();
+    float delta_t = float(curr_t - camera.last_t);
 
     // convert spherical coordinates to cartesian coordinates
-    vec3 direction(cos(v_angle) * sin(h_angle), sin(v_angle),
-                   cos(v_angle) * cos(h_angle));
-
-    // vec3 right =
-    //     vec3(sin(h_angle - 3.14f / 2.0f), 0, cos(h_angle - 3.14f / 2.0f));
-    vec3 right =
-        vec3(sin(h_angle - 3.14f / 2.0f), 0, cos(h_angle - 3.14f / 2.0f));
+    vec3 direction(cos(camera.v_angle) * sin(camera.h_angle),
+                   sin(camera.v_angle),
+                   cos(camera.v_angle) * cos(camera.h_angle));
+    vec3 right = vec3(sin(camera.h_angle - 3.14f / 2.0f), 0,
+                      cos(camera.h_angle - 3.14f / 2.0f));
     vec3 up = cross(right, direction);
 
+    float step = delta_t * camera.speed;
     // move forward
-    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
-        position += direction * delta_t * speed;
+    if (window && glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
+        camera.position += direction * step;
     }
     // move backward
-    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
-        position -= direction * delta_t * speed;
+    if (window && glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
+        camera.position -= direction * step;
     }
     // rotate right
-    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
-        position += right * delta_t * speed;
+    if (window && glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
+        camera.position += right * step;
     }
     // rotate left
-    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
-        position -= right * delta_t * speed;
+    if (window && glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
+        camera.position -= right * step;
     }
 
-    // TODO: change fov using mouse wheel
-    float fov = init_fov;  // - 5 * glfwGetMouseWheel();
-
     // projection matrix: 45° field of view, 4:3 ratio
     // display range: 0.1 unit <-> 100 units
-    p_mat = perspective(fov, 4.0f / 3.0f, 0.1f, 100.0f);
+    camera.p_mat = perspective(camera.fov, 4.0f / 3.0f, 0.1f, 100.0f);
     // camera matrix
-    v_mat = lookAt(position,              // camera pos
-                   position + direction,  // look-at direction
-                   up                     // down: (0, -1, 0)
-                   );
+    camera.v_mat = lookAt(camera.position,              // camera pos
+                          camera.position + direction,  // look-at direction
+                          up                            // down: (0, -1, 0)
+                          );
 
-    last_t = curr_t;
+    camera.last_t = curr_t;
 }
 
-#define FOURCC_DXT1 0x31545844  // ASCII of "DXT1"
-#define FOURCC_DXT3 0x33545844
-#define FOURCC_DXT5 0x35545844
-
-GLuint loadDDS(const char* imagepath) {
-    unsigned char header[124];
-
-    FILE* fp;
-    fp = fopen(imagepath, "rb");
-    if (fp == NULL) {
-        fprintf(stderr, "Failed to open image.\n");
-        return 0;
-    }
-
-    // check file type
-    char filecode[4];
-    fread(filecode, 1, 4, fp);
-    if (strncmp(filecode, "DDS ", 4) != 0) {
-        fclose(fp);
-        return 0;
-    }
+// distance from the eye to an instance's bounding sphere, 0 inside it
+float instanceDistance(const MeshData& mesh, const vec3& offset,
+                       const vec3& eye) {
+    vec3 center = (mesh.bounds.min + mesh.bounds.max) * 0.5f + offset;
+    return std::max(0.0f, length(center - eye) - mesh.radius);
+}
 
-    fread(&header, 124, 1, fp);  // get surface desc
-
-    unsigned int height = *(unsigned int*)&(header[8]);
-    unsigned int width = *(unsigned int*)&(header[12]);
-    unsigned int linear_size = *(unsigned int*)&(header[16]);
-    unsigned int mip_map_cnt = *(unsigned int*)&(header[24]);
-    unsigned int four_cc = *(unsigned int*)&(header[80]);
-
-    unsigned char* buffer;
-    unsigned int bufsize;
-    bufsize = mip_map_cnt > 1 ? linear_size * 2 : linear_size;
-    buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char));
-    fread(buffer, 1, bufsize, fp);
-    fclose(fp);
-
-    // unsigned int components = (four_cc == FOURCC_DXT1) ? 3 : 4;
-    unsigned int format;
-    switch (four_cc) {
-        case FOURCC_DXT1:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-            break;
-        case FOURCC_DXT3:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-            break;
-        case FOURCC_DXT5:
-            format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-            break;
-        default:
-            free(buffer);
-            return 0;
+// rasterize the nearest visible instances into the occlusion buffer and
+// clear visible for the instances they hide; returns how many stay visible
+size_t cullOccluded(OcclusionBuffer& occlusion, const mat4& p_mat,
+                    const mat4& vp_mat, const vec3& eye,
+                    const vector<MeshData>& meshes,
+                    const vector<vec3>& offsets, const BoxSoA& world_boxes,
+                    unsigned char* visible) {
+    TRACE_SCOPE("occlusion cull");
+    vector<pair<float, int> > order;
+    for (unsigned int i = 0; i < offsets.size(); ++i) {
+        if (!visible[i]) continue;
+        const MeshData& mesh = meshes[i % meshes.size()];
+        order.push_back(make_pair(instanceDistance(mesh, offsets[i], eye),
+                                  int(i)));
     }
-
-    GLuint texture_id;
-    glGenTextures(1, &texture_id);
-
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-    unsigned int blockSize =
-        (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
-    unsigned int offset = 0;
-
-    // load mipmaps
-    for (unsigned int level = 0; level < mip_map_cnt && (width || height);
-         ++level) {
-        unsigned int size = ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
-        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0,
-                               size, buffer + offset);
-
-        offset += size;
-        width /= 2;
-        height /= 2;
-
-        if (width < 1) width = 1;
-        if (height < 1) height = 1;
+    sort(order.begin(), order.end());
+
+    // near to far, so tiles can skip occluders that are already hidden
+    occlusion.begin(vp_mat);
+    float proj_scale = lodProjScale(p_mat, occlusion.getHeight());
+    size_t tri_cnt = 0;
+    for (size_t k = 0; k < order.size() && k < OCCLUDER_MAX; ++k) {
+        int i = order[k].second;
+        const MeshData& mesh = meshes[i % meshes.size()];
+        const LODLevel& lod = mesh.lods[selectLOD(
+            mesh.lods, order[k].first, proj_scale, OCCLUDER_PIXEL_ERROR)];
+        if (tri_cnt + lod.count / 3 > OCCLUDER_TRIANGLES) break;
+        tri_cnt += lod.count / 3;
+        occlusion.addOccluder(mesh.positions, &mesh.indices[lod.first],
+                              lod.count, translate(mat4(1.0), offsets[i]));
     }
-    free(buffer);
-    return texture_id;
+    occlusion.end();
+    return occlusion.testBoxes(world_boxes, visible);
 }
 
-GLuint LoadShaders(const char* vertex_file_path,
-                   const char* fragment_file_path) {
-    GLuint v_shader_id = glCreateShader(GL_VERTEX_SHADER);
-    GLuint f_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
-
-    string v_shader_code;
-    ifstream v_shader_stream(vertex_file_path, ios::in);
-    if (v_shader_stream.is_open()) {
-        string line = "";
-        while (getline(v_shader_stream, line)) {
-            v_shader_code += "\n" + line;
+// cast a ray through the cursor against every visible instance
+void pickAt(double xpos, double ypos, const mat4& vp_mat,
+            const vector<MeshData>& meshes, const vector<vec3>& offsets,
+            const vector<unsigned char>& visible) {
+    double t0 = getTime();
+    float x = 2.0f * float(xpos) / W_WIDTH - 1.0f;
+    float y = 1.0f - 2.0f * float(ypos) / W_HEIGHT;
+    mat4 inv = inverse(vp_mat);
+    vec4 near_p = inv * vec4(x, y, -1.0f, 1.0f);
+    vec4 far_p = inv * vec4(x, y, 1.0f, 1.0f);
+    vec3 origin = vec3(near_p) / near_p.w;
+    vec3 dir = normalize(vec3(far_p) / far_p.w - origin);
+
+    RayHit best;
+    best.t = FLT_MAX;
+    int best_i = -1;
+    for (unsigned int i = 0; i < offsets.size(); ++i) {
+        if (!visible[i]) continue;
+        // instances are only translated
+        const MeshData& mesh = meshes[i % meshes.size()];
+        RayHit hit;
+        if (intersectBVH(mesh.bvh, origin - offsets[i], dir, best.t, hit)) {
+            best = hit;
+            best_i = i;
         }
-        v_shader_stream.close();
-    } else {
-        fprintf(stderr, "Failed to open shader.\n");
-        return 0;
-    }
-
-    string f_shader_code;
-    ifstream f_shader_stream(fragment_file_path, ios::in);
-    if (f_shader_stream.is_open()) {
-        string line = "";
-        while (getline(f_shader_stream, line)) f_shader_code += "\n" + line;
-        f_shader_stream.close();
     }
+    double dt = (getTime() - t0) * 1e6;
 
-    GLint result = GL_FALSE;
-    int info_log_len;
-
-    char const* v_source_ptr = v_shader_code.c_str();
-    glShaderSource(v_shader_id, 1, &v_source_ptr, NULL);
-    glCompileShader(v_shader_id);
-
-    glGetShaderiv(v_shader_id, GL_COMPILE_STATUS, &result);
-    glGetShaderiv(v_shader_id, GL_INFO_LOG_LENGTH, &info_log_len);
-    if (info_log_len > 0) {
-        vector<char> v_shader_errmsg(info_log_len + 1);
-        glGetShaderInfoLog(v_shader_id, info_log_len, NULL,
-                           &v_shader_errmsg[0]);
-        fprintf(stderr, "%s\n", &v_shader_errmsg[0]);
-    }
-
-    char const* f_source_ptr = f_shader_code.c_str();
-    glShaderSource(f_shader_id, 1, &f_source_ptr, NULL);
-    glCompileShader(f_shader_id);
-
-    glGetShaderiv(f_shader_id, GL_COMPILE_STATUS, &result);
-    glGetShaderiv(f_shader_id, GL_INFO_LOG_LENGTH, &info_log_len);
-    if (info_log_len > 0) {
-        vector<char> f_shader_errmsg(info_log_len + 1);
-        glGetShaderInfoLog(f_shader_id, info_log_len, NULL,
-                           &f_shader_errmsg[0]);
-        fprintf(stderr, "%s\n", &f_shader_errmsg[0]);
+    if (best_i < 0) {
+        printf("pick: nothing (%.1f us)\n", dt);
+    } else {
+        printf("pick: %s instance %d, triangle %u at distance %.3f "
+               "(%.1f us)\n",
+               meshes[best_i % meshes.size()].path.c_str(), best_i, best.tri,
+               best.t, dt);
     }
+}
 
-    GLuint prog_id = glCreateProgram();
-    glAttachShader(prog_id, v_shader_id);
-    glAttachShader(prog_id, f_shader_id);
-    glLinkProgram(prog_id);
-
-    glGetProgramiv(prog_id, GL_LINK_STATUS, &result);
-    glGetProgramiv(prog_id, GL_INFO_LOG_LENGTH, &info_log_len);
-    if (info_log_len > 0) {
-        vector<char> prog_errmsg(info_log_len + 1);
-        glGetProgramInfoLog(prog_id, info_log_len, NULL, &prog_errmsg[0]);
-        fprintf(stderr, "%s\n", &prog_errmsg[0]);
+// the render queue through the software rasterizer, in the same order and
+// with the same index ranges as the GL submission; returns the draw count
+unsigned int drawSoftware(SoftRasterizer& soft, const Texture& texture,
+                          const RenderQueue& render_queue,
+                          const vector<MeshData>& meshes,
+                          const vector<DrawIndirectCmd>& indirect_cmds,
+                          const mat4& v_mat, const mat4& p_mat) {
+    TRACE_SCOPE("software draw");
+    unsigned int draw_cnt = 0;
+    soft.begin(v_mat, p_mat, vec3(4, 4, 4));
+    for (size_t i = 0; i < render_queue.size(); ++i) {
+        const DrawCmd& cmd = render_queue[i];
+        const MeshData* mesh = &meshes[cmd.mesh];
+        SoftMesh soft_mesh = {&mesh->positions, &mesh->normals, &mesh->uvs,
+                              &mesh->ao};
+        if (cmd.indirect_count == 0) {
+            soft.draw(soft_mesh, &mesh->indices[cmd.first], cmd.count,
+                      cmd.model, &texture);
+            ++draw_cnt;
+        }
+        for (int k = 0; k < cmd.indirect_count; ++k) {
+            const DrawIndirectCmd& d = indirect_cmds[cmd.indirect_first + k];
+            soft.draw(soft_mesh, &mesh->indices[d.first_index], d.count,
+                      cmd.model, &texture);
+            ++draw_cnt;
+        }
     }
-
-    glDetachShader(prog_id, v_shader_id);
-    glDetachShader(prog_id, f_shader_id);
-
-    glDeleteShader(v_shader_id);
-    glDeleteShader(f_shader_id);
-
-    return prog_id;
+    soft.end();
+    return draw_cnt;
 }
 
-int loadOBJ(const char* path, vector<vec3>& out_vertices, vector<vec2>& out_uvs,
-            vector<vec3>& out_normals) {
-    vector<unsigned int> vertex_idx, uv_idx, normal_idx;
-    vector<vec3> temp_vertices;
-    vector<vec2> temp_uvs;
-    vector<vec3> temp_normals;
+// copy the software image into draw_framebuffer, the bound draw framebuffer,
+// which must be single sampled; returns the bytes uploaded
+size_t presentSoftware(const SoftRasterizer& soft, GLuint texture,
+                       GLuint framebuffer, GLuint draw_framebuffer) {
+    TRACE_SCOPE("software present");
+    int width = soft.getWidth(), height = soft.getHeight();
+    gl_state.bindTexture(0, GL_TEXTURE_2D, texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA,
+                    GL_UNSIGNED_BYTE, soft.getColors());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, draw_framebuffer);
+    return size_t(width) * height * 4;
+}
 
-    FILE* file = fopen(path, "r");
-    if (file == NULL) {
-        return -1;
+// hand GPU times read back since the last frame to the frame statistics
+void recordGPUTimes(const GPUTimer& gpu_timer, unsigned int frame_cnt,
+                    FrameStats& frame_stats) {
+    unsigned int first = frame_cnt > GPU_TIMER_FRAMES
+                             ? frame_cnt - GPU_TIMER_FRAMES
+                             : 0;
+    for (unsigned int f = first; f < frame_cnt; ++f) {
+        double ms;
+        if (gpu_timer.getFrameTime(f, ms)) frame_stats.setGPUTime(f, ms);
     }
+}
 
-    char line[128];
-    while (fscanf(file, "%s", line) != EOF) {
-        if (strcmp(line, "v") == 0) {
-            vec3 vertex;
-            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-            temp_vertices.push_back(vertex);
-        } else if (strcmp(line, "vt") == 0) {
-            vec2 uv;
-            fscanf(file, "%f %f\n", &uv.x, &uv.y);
-            uv.y = -uv.y;  // invert v coordinate for DDS texture
-            temp_uvs.push_back(uv);
-        } else if (strcmp(line, "vn") == 0) {
-            vec3 normal;
-            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-            temp_normals.push_back(normal);
-        } else if (strcmp(line, "f") == 0) {
-            int sz = (temp_uvs.size() ? 1 : 0) + (temp_normals.size() ? 1 : 0);
-            unsigned int vertex_i, uv_i, normal_i;
-
-            for (int i = 0; i < 3; ++i) {
-                if (sz) {
-                    fscanf(file, "%d/%d/%d", &vertex_i, &uv_i, &normal_i);
-                    uv_idx.push_back(uv_i);
-                    normal_idx.push_back(normal_i);
-                } else {
-                    fscanf(file, "%d", &vertex_i);
-                }
-                vertex_idx.push_back(vertex_i);
-            }
+int main(int argc, char* argv[]) {
+    // usage: obj-loader [--instances N] [--no-ao] [--no-lod] [--no-meshlets]
+    //                   [--occlusion] [--software] [--headless]
+    //                   [--frames N] [--output image.png|ppm]
+    //                   [--trace trace.json] [--stats-csv stats.csv]
+    //                   [model.obj ...]
+    // --software shades on the CPU and only presents through GL; --headless
+    // renders offscreen through EGL, one frame unless --frames says
+    // otherwise; --output saves the last frame; --trace writes the timed
+    // scopes of the whole run for chrome://tracing at exit; --stats-csv
+    // logs every frame's times and counters
+    vector<const char*> paths;
+    int instance_cnt = 1;
+    bool bake_ao = true;
+    bool build_lods = true;
+    bool build_meshlets = true;
+    bool occlusion_culling = false;
+    bool software = false;
+    bool headless = false;
+    unsigned int frame_limit = 0;  // run until closed
+    const char* output_path = NULL;
+    const char* trace_path = NULL;
+    const char* stats_path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            instance_cnt = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--no-ao") == 0) {
+            bake_ao = false;
+        } else if (strcmp(argv[i], "--no-lod") == 0) {
+            build_lods = false;
+        } else if (strcmp(argv[i], "--no-meshlets") == 0) {
+            build_meshlets = false;
+        } else if (strcmp(argv[i], "--occlusion") == 0) {
+            occlusion_culling = true;
+        } else if (strcmp(argv[i], "--software") == 0) {
+            software = true;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frame_limit = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--stats-csv") == 0 && i + 1 < argc) {
+            stats_path = argv[++i];
         } else {
-            char tmpbuffer[1000];
-            fgets(tmpbuffer, 1000, file);
+            paths.push_back(argv[i]);
         }
     }
-
-    int sz = (temp_uvs.size() ? 1 : 0) + (temp_normals.size() ? 1 : 0);
-    for (unsigned int i = 0; i < vertex_idx.size(); i++) {
-        unsigned int vertex_i = vertex_idx[i];
-        vec3 vertex = temp_vertices[vertex_i - 1];
-        out_vertices.push_back(vertex);
-
-        if (sz) {
-            unsigned int uv_i = uv_idx[i];
-            unsigned int normal_i = normal_idx[i];
-
-            vec2 uv = temp_uvs[uv_i - 1];
-            vec3 normal = temp_normals[normal_i - 1];
-
-            out_uvs.push_back(uv);
-            out_normals.push_back(normal);
-        }
+    if (paths.empty()) paths.push_back("suzanne.obj");
+    if (trace_path) {
+        traceThreadName("main");
+        startTrace();
     }
+    if ((headless || output_path) && frame_limit == 0) frame_limit = 1;
+    // the software image is blitted, which multisampled targets refuse
+    int samples = software ? 1 : W_SAMPLES;
+
+    GLFWwindow* window = NULL;  // stays NULL when headless
+    HeadlessContext headless_context;
+    if (headless) {
+        if (!headless_context.init()) return -1;
+    } else {
+        if (!glfwInit()) {
+            fprintf(stderr, "Failed to initialize GLFW.\n");
+            return -1;
+        }
 
-    return (temp_uvs.size() ? 1 : 0);
-}
-
-int main(void) {
-    if (!glfwInit()) {
-        fprintf(stderr, "Failed to initialize GLFW.\n");
-        return -1;
-    }
-
-    glfwWindowHint(GLFW_SAMPLES, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);  // OS X required
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    // open window
-    window = glfwCreateWindow(W_WIDTH, W_HEIGHT, "OBJ Loader", NULL, NULL);
-    if (window == NULL) {
-        fprintf(stderr, "Failed to open GLFW window.\n");
-        glfwTerminate();
-        return -1;
+        glfwWindowHint(GLFW_SAMPLES, samples);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);  // OS X required
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // open window
+        window =
+            glfwCreateWindow(W_WIDTH, W_HEIGHT, "OBJ Loader", NULL, NULL);
+        if (window == NULL) {
+            fprintf(stderr, "Failed to open GLFW window.\n");
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
     }
-    glfwMakeContextCurrent(window);
 
+    // GLEW resolves entry points through GLX, which libglvnd dispatches to
+    // the current EGL context as well
     glewExperimental = true;
     if (glewInit() != GLEW_OK) {
         fprintf(stderr, "Failed to initialize GLEW.\n");
@@ -344,7 +357,15 @@ int main(void) {
         return -1;
     }
 
-    glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+    if (headless) {
+        if (!headless_context.createFramebuffer(W_WIDTH, W_HEIGHT,
+                                                samples)) {
+            headless_context.destroy();
+            return -1;
+        }
+    } else {
+        glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+    }
     // glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     // glfwPollEvents();
     // glfwSetCursorPos(window, W_WIDTH / 2, W_HEIGHT / 2);
@@ -352,135 +373,429 @@ int main(void) {
     // black background
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
-    glEnable(GL_DEPTH_TEST);
+    gl_state.enable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
-    glEnable(GL_CULL_FACE);
-
-    GLuint v_array_id;
-    glGenVertexArrays(1, &v_array_id);
-    glBindVertexArray(v_array_id);
+    gl_state.enable(GL_CULL_FACE);
 
     GLuint prog_id = LoadShaders("StandardShading.vertexshader",
                                  "StandardShading.fragmentshader");
 
-    GLuint mat_id = glGetUniformLocation(prog_id, "MVP");
-    GLuint v_mat_id = glGetUniformLocation(prog_id, "V");
-    GLuint m_mat_id = glGetUniformLocation(prog_id, "M");
+    DDSImage dds;
+    if (!loadDDS("uvmap.DDS", dds)) return -1;
+    GLuint texture = uploadDDS(dds);
+    GLint texture_id = getUniformLocation(prog_id, "myTextureSampler");
+    // meshes without a baked AO buffer read this as fully unoccluded
+    glVertexAttrib1f(3, 1.0f);
+
+    // read obj files
+    MeshOptions options = {bake_ao, build_lods, build_meshlets};
+    vector<MeshData> meshes(paths.size());
+    vector<MeshBuffers> mesh_buffers(paths.size());
+    for (unsigned int i = 0; i < paths.size(); ++i) {
+        if (!loadMesh(paths[i], options, meshes[i])) return -1;
+        uploadMesh(meshes[i], mesh_buffers[i]);
+    }
 
-    GLuint texture = loadDDS("uvmap.DDS");
-    GLuint texture_id = glGetUniformLocation(prog_id, "myTextureSampler");
+    // instances of every mesh are laid out on a square grid
+    int draw_cnt = instance_cnt * meshes.size();
+    int grid_side = int(ceil(sqrt(float(draw_cnt))));
+    vector<vec3> offsets(draw_cnt);
+    BoxSoA world_boxes;
+    world_boxes.resize(draw_cnt);
+    for (int i = 0; i < draw_cnt; ++i) {
+        offsets[i] = vec3(i % grid_side - (grid_side - 1) * 0.5f,
+                          i / grid_side - (grid_side - 1) * 0.5f, 0.0f) *
+                     3.0f;
+        const AABB& bounds = meshes[i % meshes.size()].bounds;
+        world_boxes.set(i, transformBounds(bounds, translate(mat4(1.0),
+                                                             offsets[i])));
+    }
+    vector<unsigned char> visible(draw_cnt);
 
-    // read obj file
-    vector<vec3> vertices;
-    vector<vec2> uvs;
-    vector<vec3> normals;
-    int res = loadOBJ("suzanne.obj", vertices, uvs, normals);
-    if (res < 0) {
-        fprintf(stderr, "Failed to parse obj file.\n");
+    // per-frame constants are written into a fenced ring
+    FrameRing frame_ring;
+    if (!frame_ring.init((draw_cnt + 1) * (sizeof(DrawData) + 256))) {
+        glfwTerminate();
         return -1;
     }
-
-    GLuint vertexbuffer;
-    glGenBuffers(1, &vertexbuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vec3), &vertices[0],
-                 GL_STATIC_DRAW);
-
-    GLuint uvbuffer;
-    if (res) {
-        glGenBuffers(1, &uvbuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-        glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(vec2), &uvs[0],
-                     GL_STATIC_DRAW);
+    // per pass GPU time, read back a few frames late
+    GPUTimer gpu_timer;
+    gpu_timer.init();
+    FrameStats frame_stats;
+    if (stats_path && !frame_stats.openCSV(stats_path)) {
+        glfwTerminate();
+        return -1;
     }
-
-    GLuint normalbuffer;
-    if (res) {
-        glGenBuffers(1, &normalbuffer);
-        glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-        glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(vec3),
-                     &normals[0], GL_STATIC_DRAW);
+    RenderQueue render_queue;
+    OcclusionBuffer occlusion;
+    occlusion.init(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+
+    // meshlet draws are rebuilt every frame; without multi draw indirect
+    // they go through glMultiDrawElements from client memory
+    bool multi_draw_indirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+    GLuint indirect_buffer;
+    glGenBuffers(1, &indirect_buffer);
+    vector<DrawIndirectCmd> indirect_cmds;
+    vector<GLsizei> multi_counts;
+    vector<const GLvoid*> multi_offsets;
+
+    // the software path shades into soft and blits through soft_framebuffer
+    // into the one scenes are drawn into
+    SoftRasterizer soft;
+    Texture soft_texture;
+    GLuint soft_image = 0, soft_framebuffer = 0;
+    GLuint scene_framebuffer =
+        headless ? headless_context.getFramebuffer() : 0;
+    if (software) {
+        decodeDDS(dds, soft_texture);
+        soft.init(W_WIDTH, W_HEIGHT);
+        glGenTextures(1, &soft_image);
+        gl_state.bindTexture(0, GL_TEXTURE_2D, soft_image);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, W_WIDTH, W_HEIGHT, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        setTextureBytes(soft_image, W_WIDTH * W_HEIGHT * 4);
+        glGenFramebuffers(1, &soft_framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, soft_framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, soft_image, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, scene_framebuffer);
     }
 
-    glUseProgram(prog_id);
-    GLuint light_id = glGetUniformLocation(prog_id, "LightPosition_worldspace");
-
+    // sampler units are program state, set once
+    gl_state.useProgram(prog_id);
+    glUniform1i(texture_id, 0);
+
+    Camera camera;
+    unsigned int frame_cnt = 0;
+    double start_t = getTime();
+    double report_t = getTime();
+    unsigned int report_frames = 0;
+    double cull_t = 0.0;
+    size_t visible_cnt = 0;
+    size_t unoccluded_cnt = 0;
+    size_t tri_cnt = 0;  // submitted in the last frame
+    MeshletCullStats meshlet_stats;
+    bool mouse_down = false;
+    double frame_end_t = start_t;
     do {
+        TRACE_SCOPE("frame");
+        double frame_t0 = getTime();
+        FrameSample sample;
+        memset(&sample, 0, sizeof(sample));
+        sample.frame = frame_cnt;
+        sample.gpu_ms = -1.0;
+        unsigned int issued0 = gl_state.getTotalStats().issued;
+        size_t ring_bytes0 = frame_ring.getStats().bytes;
+
+        frame_ring.beginFrame();
+        gpu_timer.beginFrame();
+        recordGPUTimes(gpu_timer, frame_cnt, frame_stats);
+        gl_state.beginFrame();
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glUseProgram(prog_id);
-
-        computeMatricesFromInputs();
-        mat4 p_mat = getProjectionMatrix();
-        mat4 v_mat = getViewMatrix();
-        mat4 m_mat = mat4(1.0);
-        mat4 MVP = p_mat * v_mat * m_mat;
-
-        glUniformMatrix4fv(mat_id, 1, GL_FALSE, &MVP[0][0]);
-        glUniformMatrix4fv(m_mat_id, 1, GL_FALSE, &m_mat[0][0]);
-        glUniformMatrix4fv(v_mat_id, 1, GL_FALSE, &v_mat[0][0]);
-
-        vec3 lightPos = vec3(4, 4, 4);
-        glUniform3f(light_id, lightPos.x, lightPos.y, lightPos.z);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glUniform1i(texture_id, 0);
-
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-        glVertexAttribPointer(0,         // attribute
-                              3,         // size
-                              GL_FLOAT,  // type
-                              GL_FALSE,  // normalized?
-                              0,         // stride
-                              (void*)0   // array buffer offset
-                              );
-
-        if (res) {
-            glEnableVertexAttribArray(1);
-            glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-            glVertexAttribPointer(1,         // attribute
-                                  2,         // size
-                                  GL_FLOAT,  // type
-                                  GL_FALSE,  // normalized?
-                                  0,         // stride
-                                  (void*)0   // array buffer offset
-                                  );
-
-            glEnableVertexAttribArray(2);
-            glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-            glVertexAttribPointer(2,         // attribute
-                                  3,         // size
-                                  GL_FLOAT,  // type
-                                  GL_FALSE,  // normalized?
-                                  0,         // stride
-                                  (void*)0   // array buffer offset
-                                  );
+        updateCamera(window, camera);
+        const mat4& p_mat = camera.p_mat;
+        const mat4& v_mat = camera.v_mat;
+
+        // view data is shared by every program and draw this frame
+        ViewData view_data;
+        view_data.v = v_mat;
+        view_data.p = p_mat;
+        view_data.light_pos = vec4(4, 4, 4, 1);
+        GLintptr view_offset = frame_ring.push(&view_data, sizeof(view_data));
+        frame_ring.bindRange(VIEW_DATA_BINDING, view_offset, sizeof(view_data));
+
+        Frustum frustum;
+        extractFrustum(p_mat * v_mat, frustum);
+        double t0 = getTime();
+        {
+            TRACE_SCOPE("frustum cull");
+            visible_cnt = cullBoxes(frustum, world_boxes, &visible[0]);
+        }
+        cull_t += getTime() - t0;
+        unoccluded_cnt = visible_cnt;
+        if (occlusion_culling) {
+            unoccluded_cnt = cullOccluded(occlusion, p_mat, p_mat * v_mat,
+                                          camera.position, meshes, offsets,
+                                          world_boxes, &visible[0]);
         }
 
-        glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        // pick with the left mouse button
+        int button = window ? glfwGetMouseButton(window,
+                                                 GLFW_MOUSE_BUTTON_LEFT)
+                            : GLFW_RELEASE;
+        if (button == GLFW_PRESS && !mouse_down) {
+            double xpos, ypos;
+            glfwGetCursorPos(window, &xpos, &ypos);
+            pickAt(xpos, ypos, p_mat * v_mat, meshes, offsets, visible);
+        }
+        mouse_down = button == GLFW_PRESS;
+
+        // build the queue, then submit in state order; each instance picks
+        // the coarsest level whose error stays under a pixel
+        {
+            TRACE_SCOPE("build queue");
+            render_queue.clear();
+            float proj_scale = lodProjScale(p_mat, W_HEIGHT);
+            tri_cnt = 0;
+            indirect_cmds.clear();
+            memset(&meshlet_stats, 0, sizeof(meshlet_stats));
+            for (int i = 0; i < draw_cnt; ++i) {
+                if (!visible[i]) continue;
+                int mesh_i = i % meshes.size();
+                const MeshData& mesh = meshes[mesh_i];
+                float distance = instanceDistance(mesh, offsets[i],
+                                                  camera.position);
+                int level = selectLOD(mesh.lods, distance, proj_scale);
+                const LODLevel& lod = mesh.lods[level];
+
+                DrawCmd cmd;
+                cmd.program = prog_id;
+                cmd.texture = texture;
+                cmd.vertex_array = mesh_buffers[mesh_i].v_array_id;
+                cmd.mesh = mesh_i;
+                cmd.first = lod.first;
+                cmd.count = lod.count;
+                cmd.indirect_first = cmd.indirect_count = 0;
+                cmd.model = translate(mat4(1.0), offsets[i]);
+                if (level == 0 && !mesh.meshlets.meshlets.empty()) {
+                    // full detail is drawn as the meshlets that survive
+                    // culling
+                    cmd.indirect_first = indirect_cmds.size();
+                    cullMeshlets(mesh.meshlets, frustum, offsets[i],
+                                 camera.position,
+                                 occlusion_culling ? &occlusion : NULL,
+                                 mesh.meshlet_first, indirect_cmds,
+                                 meshlet_stats);
+                    cmd.indirect_count =
+                        indirect_cmds.size() - cmd.indirect_first;
+                    if (cmd.indirect_count == 0) continue;
+                    for (size_t k = cmd.indirect_first;
+                         k < indirect_cmds.size(); ++k) {
+                        tri_cnt += indirect_cmds[k].count / 3;
+                    }
+                } else {
+                    tri_cnt += lod.count / 3;
+                }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+                float depth = -(v_mat * vec4(offsets[i], 1.0f)).z;
+                render_queue.push(cmd, 0, 0, mesh_i, depth);
+            }
+            render_queue.sort();
+        }
+        if (software) {
+            sample.draws =
+                drawSoftware(soft, soft_texture, render_queue, meshes,
+                             indirect_cmds, v_mat, p_mat);
+            int pass = gpu_timer.beginPass("present");
+            sample.upload_bytes += presentSoftware(
+                soft, soft_image, soft_framebuffer, scene_framebuffer);
+            gpu_timer.endPass(pass);
+        } else {
+            TRACE_SCOPE("submit");
+            int pass = gpu_timer.beginPass("scene");
+            if (multi_draw_indirect && !indirect_cmds.empty()) {
+                gl_state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+                glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                             indirect_cmds.size() * sizeof(DrawIndirectCmd),
+                             &indirect_cmds[0], GL_STREAM_DRAW);
+                setBufferBytes(indirect_buffer,
+                               indirect_cmds.size() * sizeof(DrawIndirectCmd));
+                sample.upload_bytes +=
+                    indirect_cmds.size() * sizeof(DrawIndirectCmd);
+            }
 
-    } while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
-             glfwWindowShouldClose(window) == 0);
+            for (size_t i = 0; i < render_queue.size(); ++i) {
+                const DrawCmd& cmd = render_queue[i];
+                gl_state.useProgram(cmd.program);
+                gl_state.bindTexture(0, GL_TEXTURE_2D, cmd.texture);
+                gl_state.bindVertexArray(cmd.vertex_array);
+
+                DrawData draw_data;
+                draw_data.mvp = p_mat * v_mat * cmd.model;
+                draw_data.m = cmd.model;
+                GLintptr draw_offset =
+                    frame_ring.push(&draw_data, sizeof(draw_data));
+                if (draw_offset < 0) continue;  // ring full, counted in stats
+                frame_ring.bindRange(DRAW_DATA_BINDING, draw_offset,
+                                     sizeof(draw_data));
+
+                ++sample.draws;
+                if (cmd.indirect_count == 0) {
+                    glDrawElements(GL_TRIANGLES, cmd.count, GL_UNSIGNED_INT,
+                                   (void*)(cmd.first * sizeof(uint32_t)));
+                } else if (multi_draw_indirect) {
+                    glMultiDrawElementsIndirect(
+                        GL_TRIANGLES, GL_UNSIGNED_INT,
+                        (void*)(cmd.indirect_first * sizeof(DrawIndirectCmd)),
+                        cmd.indirect_count, 0);
+                } else {
+                    multi_counts.clear();
+                    multi_offsets.clear();
+                    for (int k = 0; k < cmd.indirect_count; ++k) {
+                        const DrawIndirectCmd& d =
+                            indirect_cmds[cmd.indirect_first + k];
+                        multi_counts.push_back(d.count);
+                        multi_offsets.push_back(
+                            (const GLvoid*)(d.first_index * sizeof(uint32_t)));
+                    }
+                    glMultiDrawElements(GL_TRIANGLES, &multi_counts[0],
+                                        GL_UNSIGNED_INT, &multi_offsets[0],
+                                        cmd.indirect_count);
+                }
+            }
+            gpu_timer.endPass(pass);
+        }
 
-    glDeleteBuffers(1, &vertexbuffer);
-    if (res) {
-        glDeleteBuffers(1, &uvbuffer);
-        glDeleteBuffers(1, &normalbuffer);
+        frame_ring.endFrame();
+        ++frame_cnt;
+
+        // report once per second
+        ++report_frames;
+        if (getTime() - report_t >= 1.0) {
+            printf("cull (%s): %u/%d visible, %.1f Mboxes/s\n",
+                   cullingPath(), (unsigned int)visible_cnt, draw_cnt,
+                   cull_t > 0.0 ? draw_cnt * report_frames / cull_t * 1e-6
+                                : 0.0);
+            printf("lod: %u triangles submitted\n", (unsigned int)tri_cnt);
+            frame_stats.print(stdout, FRAME_STATS_WINDOW);
+            if (meshlet_stats.meshlets > 0) {
+                unsigned int culled = meshlet_stats.frustum_culled +
+                                      meshlet_stats.backface_culled +
+                                      meshlet_stats.occlusion_culled;
+                double pct = 100.0 / meshlet_stats.meshlets;
+                printf("meshlets: %u/%u drawn, %.1f%% culled (%.1f%% "
+                       "frustum, %.1f%% backface, %.1f%% occluded), %u "
+                       "indirect draws\n",
+                       meshlet_stats.meshlets - culled, meshlet_stats.meshlets,
+                       culled * pct, meshlet_stats.frustum_culled * pct,
+                       meshlet_stats.backface_culled * pct,
+                       meshlet_stats.occlusion_culled * pct,
+                       meshlet_stats.cmds);
+            }
+            if (software) {
+                const SoftRasterStats& ss = soft.getStats();
+                printf("software: %u triangles binned, %u pixels shaded, "
+                       "%.2f ms (vertex %.2f, setup %.2f, raster %.2f)\n",
+                       ss.binned, ss.pixels,
+                       ss.vertex_ms + ss.setup_ms + ss.raster_ms,
+                       ss.vertex_ms, ss.setup_ms, ss.raster_ms);
+            }
+            if (occlusion_culling) {
+                const OcclusionStats& occ = occlusion.getStats();
+                printf("occlusion: %u occluders, %u triangles in %.2f ms, "
+                       "%u/%u instances hidden\n",
+                       occ.occluders, occ.triangles,
+                       occ.setup_ms + occ.raster_ms + occ.pyramid_ms,
+                       (unsigned int)(visible_cnt - unoccluded_cnt),
+                       (unsigned int)visible_cnt);
+            }
+            const GPUTimerStats& gpu = gpu_timer.getStats();
+            if (gpu.frames > 0) {
+                printf("gpu: %.2f ms per frame", gpu.frame_ms);
+                for (int p = 0; p < gpu.pass_cnt; ++p) {
+                    printf("%s%s %.2f", p ? ", " : " (", gpu.pass_names[p],
+                           gpu.pass_ms[p]);
+                }
+                printf("%s, %u frames late\n", gpu.pass_cnt ? ")" : "",
+                       gpu.latency);
+            }
+            report_t = getTime();
+            report_frames = 0;
+            cull_t = 0.0;
+        }
+        // the last frame is read back before it is swapped away
+        if (output_path && frame_cnt == frame_limit) {
+            TRACE_SCOPE("readback");
+            int pass = gpu_timer.beginPass("readback");
+            vector<unsigned char> rgb;
+            if (headless) {
+                headless_context.readPixels(rgb);
+            } else {
+                readFramebuffer(W_WIDTH, W_HEIGHT, rgb);
+            }
+            gpu_timer.endPass(pass);
+            if (writeImage(output_path, W_WIDTH, W_HEIGHT, rgb)) {
+                printf("wrote frame %u to %s\n", frame_cnt, output_path);
+            }
+        }
+        gpu_timer.endFrame();
+        sample.cpu_ms = (getTime() - frame_t0) * 1e3;
+        sample.triangles = tri_cnt;
+        sample.state_changes = gl_state.getTotalStats().issued - issued0;
+        sample.upload_bytes += frame_ring.getStats().bytes - ring_bytes0;
+        if (window) {
+            TRACE_SCOPE("swap");
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        double now = getTime();
+        sample.frame_ms = (now - frame_end_t) * 1e3;
+        frame_end_t = now;
+        frame_stats.add(sample);
+
+    } while (frame_cnt != frame_limit &&
+             (window == NULL ||
+              (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
+               glfwWindowShouldClose(window) == 0)));
+    {
+        TRACE_SCOPE("finish");
+        glFinish();
+    }
+    double run_t = getTime() - start_t;
+    printf("frames: %u in %.1f ms, %.2f ms per frame\n", frame_cnt,
+           run_t * 1e3, run_t * 1e3 / frame_cnt);
+
+    const FrameRingStats& ring_stats = frame_ring.getStats();
+    printf("frame ring (%s): %u frames, %u fence waits, %.2f ms waiting\n",
+           frame_ring.isPersistent() ? "persistent" : "fallback",
+           ring_stats.frames, ring_stats.fence_waits, ring_stats.wait_ms);
+    frame_ring.destroy();
+
+    gpu_timer.collect();  // everything is done after glFinish
+    recordGPUTimes(gpu_timer, frame_cnt, frame_stats);
+    frame_stats.print(stdout, 0);
+    frame_stats.closeCSV();
+    if (gpu_timer.isAvailable()) {
+        const GPUTimerStats& gpu = gpu_timer.getStats();
+        printf("gpu timer: %u frames timed, %u dropped, %.2f ms last frame\n",
+               gpu.frames, gpu.dropped, gpu.frame_ms);
+    }
+    gpu_timer.destroy();
+
+    // steady state numbers, setup calls are only in the totals
+    const GLStateStats& gl_stats = gl_state.getFrameStats();
+    const GLStateStats& gl_total = gl_state.getTotalStats();
+    printf("gl state: %u calls issued, %u elided per frame "
+           "(%u / %u over %u frames)\n",
+           gl_stats.issued, gl_stats.elided, gl_total.issued, gl_total.elided,
+           frame_cnt);
+
+    StateChanges changes = render_queue.countStateChanges();
+    printf("render queue: %u draws, %u program / %u texture / %u vao "
+           "changes per frame\n",
+           (unsigned int)render_queue.size(), changes.programs,
+           changes.materials, changes.vertex_arrays);
+
+    deleteBuffer(indirect_buffer);
+    if (software) {
+        glDeleteFramebuffers(1, &soft_framebuffer);
+        deleteTexture(soft_image);
+    }
+    for (unsigned int i = 0; i < mesh_buffers.size(); ++i) {
+        deleteMesh(mesh_buffers[i]);
     }
     glDeleteProgram(prog_id);
-    glDeleteTextures(1, &texture_id);
-    glDeleteVertexArrays(1, &v_array_id);
+    deleteTexture(texture);
 
-    glfwTerminate();
+    if (headless) {
+        headless_context.destroy();
+    } else {
+        glfwTerminate();
+    }
+    // current is what the loaded model still holds on the CPU
+    printMemoryReport(stdout);
 
+    if (trace_path) writeTrace(trace_path);
     return 0;
 }
@@ -0,0 +1,369 @@
+#include "obj.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+using namespace std;
+using namespace glm;
+
+#include "memory-stats.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+namespace {
+
+// the whitespace strtof and strtol skip, except line ends
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+// a cursor over one line; numbers never continue past its end, which
+// strtof and strtol would otherwise skip to as whitespace
+struct LineReader {
+    const char* p;
+    const char* end;
+
+    void skipBlanks() {
+        while (p < end && isBlank(*p)) ++p;
+    }
+    bool atEnd() {
+        skipBlanks();
+        return p == end || *p == '\r';
+    }
+    float readFloat() {
+        if (atEnd()) return 0.0f;
+        char* next;
+        float f = strtof(p, &next);
+        p = next;
+        return f;
+    }
+    long readInt() {
+        if (atEnd()) return 0;
+        char* next;
+        long i = strtol(p, &next, 10);
+        p = next;
+        return i;
+    }
+    // "v", "v/vt", "v//vn" or "v/vt/vn"; missing indices are left at 0.
+    // Returns false when no index could be read.
+    bool readCorner(long& vertex_i, long& uv_i, long& normal_i) {
+        const char* start = p;
+        vertex_i = readInt();
+        uv_i = normal_i = 0;
+        if (p == start) return false;
+        if (p < end && *p == '/') {
+            ++p;
+            if (p < end && *p != '/') uv_i = readInt();
+            if (p < end && *p == '/') {
+                ++p;
+                normal_i = readInt();
+            }
+        }
+        return true;
+    }
+};
+
+// negative obj indices count back from the last element defined so far
+inline long resolveIndex(long i, size_t defined) {
+    return i < 0 ? long(defined) + 1 + i : i;
+}
+
+// 1-based obj index into a vector, or NULL when out of range
+template <typename T>
+const T* at(const vector<T>& v, long i) {
+    return i >= 1 && size_t(i) <= v.size() ? &v[i - 1] : NULL;
+}
+
+enum LineKey { KEY_V, KEY_VT, KEY_VN, KEY_F, KEY_OTHER };
+
+// reads the keyword starting a line and leaves the reader after it
+LineKey readKey(LineReader& line) {
+    line.skipBlanks();
+    const char* key = line.p;
+    while (line.p < line.end && !isBlank(*line.p) && *line.p != '\r') {
+        ++line.p;
+    }
+    size_t key_len = line.p - key;
+    if (key_len == 1 && key[0] == 'v') return KEY_V;
+    if (key_len == 1 && key[0] == 'f') return KEY_F;
+    if (key_len == 2 && key[0] == 'v' && key[1] == 't') return KEY_VT;
+    if (key_len == 2 && key[0] == 'v' && key[1] == 'n') return KEY_VN;
+    return KEY_OTHER;
+}
+
+struct ElementCounts {
+    size_t vertices, uvs, normals;
+};
+
+// One run of whole lines: its elements, its faces as resolved indices into
+// the elements of the whole file, and later its corners.
+struct Chunk {
+    const char* begin;
+    const char* end;
+    ElementCounts before;  // defined by the chunks in front of this one
+    vector<vec3> vertices;
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    vector<long> vertex_idx, uv_idx, normal_idx;
+    vector<vec3> out_vertices;
+    vector<vec2> out_uvs;
+    vector<vec3> out_normals;
+};
+
+ElementCounts countElements(const char* p, const char* end) {
+    ElementCounts counts = {0, 0, 0};
+    while (p < end) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        LineReader line = {p, eol};
+        p = eol + 1;
+        LineKey key = readKey(line);
+        counts.vertices += key == KEY_V;
+        counts.uvs += key == KEY_VT;
+        counts.normals += key == KEY_VN;
+    }
+    return counts;
+}
+
+void parseChunk(Chunk& chunk) {
+    vector<long> face;  // resolved indices of one face, three per corner
+    const char* p = chunk.begin;
+    while (p < chunk.end) {
+        const char* eol = (const char*)memchr(p, '\n', chunk.end - p);
+        LineReader line = {p, eol};
+        p = eol + 1;
+
+        LineKey key = readKey(line);
+        if (key == KEY_V) {
+            vec3 vertex;
+            vertex.x = line.readFloat();
+            vertex.y = line.readFloat();
+            vertex.z = line.readFloat();
+            chunk.vertices.push_back(vertex);
+        } else if (key == KEY_VT) {
+            vec2 uv;
+            uv.x = line.readFloat();
+            uv.y = line.readFloat();
+            uv.y = -uv.y;  // invert v coordinate for DDS texture
+            chunk.uvs.push_back(uv);
+        } else if (key == KEY_VN) {
+            vec3 normal;
+            normal.x = line.readFloat();
+            normal.y = line.readFloat();
+            normal.z = line.readFloat();
+            chunk.normals.push_back(normal);
+        } else if (key == KEY_F) {
+            size_t vertex_cnt = chunk.before.vertices + chunk.vertices.size();
+            size_t uv_cnt = chunk.before.uvs + chunk.uvs.size();
+            size_t normal_cnt = chunk.before.normals + chunk.normals.size();
+            face.clear();
+            long vertex_i, uv_i, normal_i;
+            while (!line.atEnd() &&
+                   line.readCorner(vertex_i, uv_i, normal_i)) {
+                face.push_back(resolveIndex(vertex_i, vertex_cnt));
+                face.push_back(resolveIndex(uv_i, uv_cnt));
+                face.push_back(resolveIndex(normal_i, normal_cnt));
+            }
+            // polygons are fanned around their first corner
+            for (size_t k = 3; k + 3 < face.size(); k += 3) {
+                const size_t corners[3] = {0, k, k + 3};
+                for (int i = 0; i < 3; ++i) {
+                    chunk.vertex_idx.push_back(face[corners[i]]);
+                    chunk.uv_idx.push_back(face[corners[i] + 1]);
+                    chunk.normal_idx.push_back(face[corners[i] + 2]);
+                }
+            }
+        }
+    }
+}
+
+// Corners without a uv index get (0, 0) and those without a normal index
+// the face normal, so files mixing corner forms keep every face. Faces with
+// an index out of range are dropped; returns how many.
+size_t gatherCorners(const Chunk& chunk, const vector<vec3>& all_vertices,
+                     const vector<vec2>& all_uvs,
+                     const vector<vec3>& all_normals,
+                     vector<vec3>& out_vertices, vector<vec2>& out_uvs,
+                     vector<vec3>& out_normals) {
+    static const vec2 no_uv(0.0f);
+    bool has_uvs = !all_uvs.empty(), has_normals = !all_normals.empty();
+    size_t dropped = 0;
+    for (size_t i = 0; i + 3 <= chunk.vertex_idx.size(); i += 3) {
+        const vec3* vertices[3];
+        const vec2* uvs[3];
+        const vec3* normals[3];
+        bool valid = true, missing_normal = false;
+        for (int k = 0; k < 3; ++k) {
+            long uv_i = chunk.uv_idx[i + k], normal_i = chunk.normal_idx[i + k];
+            vertices[k] = at(all_vertices, chunk.vertex_idx[i + k]);
+            uvs[k] = uv_i == 0 ? &no_uv : at(all_uvs, uv_i);
+            normals[k] = normal_i == 0 ? NULL : at(all_normals, normal_i);
+            missing_normal = missing_normal || normal_i == 0;
+            valid = valid && vertices[k] && (!has_uvs || uvs[k]) &&
+                    (!has_normals || normal_i == 0 || normals[k]);
+        }
+        if (!valid) {
+            ++dropped;
+            continue;
+        }
+        vec3 face_n(0.0f);  // stays zero for degenerate faces
+        if (has_normals && missing_normal) {
+            vec3 n = cross(*vertices[1] - *vertices[0],
+                           *vertices[2] - *vertices[0]);
+            if (length(n) > 0.0f) face_n = normalize(n);
+        }
+        for (int k = 0; k < 3; ++k) {
+            out_vertices.push_back(*vertices[k]);
+            if (has_uvs) out_uvs.push_back(*uvs[k]);
+            if (has_normals) {
+                out_normals.push_back(normals[k] ? *normals[k] : face_n);
+            }
+        }
+    }
+    return dropped;
+}
+
+template <typename T>
+void append(vector<T>& to, const vector<T>& from) {
+    to.insert(to.end(), from.begin(), from.end());
+}
+
+}  // namespace
+
+int parseOBJ(const char* data, size_t size, vector<vec3>& out_vertices,
+             vector<vec2>& out_uvs, vector<vec3>& out_normals,
+             size_t* dropped_faces) {
+    TRACE_SCOPE("parseOBJ");
+    // strtof needs a terminator after the last number of the file
+    string copy;
+    if (size > 0 && data[size - 1] != '\n') {
+        copy.assign(data, size);
+        copy += '\n';
+        data = copy.c_str();
+        size = copy.size();
+    }
+
+    // large files are cut at line ends into chunks parsed in parallel
+    size_t chunk_cnt = 1;
+    if (size >= OBJ_PARALLEL_BYTES && workerCount() > 1) {
+        chunk_cnt = std::min<size_t>(size / OBJ_CHUNK_BYTES, workerCount() * 4);
+    }
+    vector<Chunk> chunks(chunk_cnt);
+    const char* end = data + size;
+    for (size_t c = 0; c < chunk_cnt; ++c) {
+        const char* begin = c ? chunks[c - 1].end : data;
+        const char* cut = data + size / chunk_cnt * (c + 1);
+        if (c + 1 == chunk_cnt || cut <= begin) cut = end;
+        if (cut < end) cut = (const char*)memchr(cut, '\n', end - cut) + 1;
+        chunks[c].begin = begin;
+        chunks[c].end = cut;
+    }
+
+    // a counting pass first, so each chunk knows how many elements come
+    // before it and resolves negative indices as one pass over the file would
+    ElementCounts total = {0, 0, 0};
+    if (chunk_cnt > 1) {
+        vector<ElementCounts> counts(chunk_cnt);
+        parallelFor(0, chunk_cnt, 1, [&](size_t lo, size_t hi) {
+            for (size_t c = lo; c < hi; ++c) {
+                counts[c] = countElements(chunks[c].begin, chunks[c].end);
+            }
+        });
+        for (size_t c = 0; c < chunk_cnt; ++c) {
+            chunks[c].before = total;
+            total.vertices += counts[c].vertices;
+            total.uvs += counts[c].uvs;
+            total.normals += counts[c].normals;
+        }
+    } else {
+        chunks[0].before = total;
+    }
+    parallelFor(0, chunk_cnt, 1, [&](size_t lo, size_t hi) {
+        for (size_t c = lo; c < hi; ++c) parseChunk(chunks[c]);
+    });
+
+    vector<vec3> temp_vertices;
+    vector<vec2> temp_uvs;
+    vector<vec3> temp_normals;
+    if (chunk_cnt == 1) {
+        temp_vertices.swap(chunks[0].vertices);
+        temp_uvs.swap(chunks[0].uvs);
+        temp_normals.swap(chunks[0].normals);
+    } else {
+        temp_vertices.reserve(total.vertices);
+        temp_uvs.reserve(total.uvs);
+        temp_normals.reserve(total.normals);
+        for (size_t c = 0; c < chunk_cnt; ++c) {
+            append(temp_vertices, chunks[c].vertices);
+            append(temp_uvs, chunks[c].uvs);
+            append(temp_normals, chunks[c].normals);
+            chunks[c].vertices = vector<vec3>();
+            chunks[c].uvs = vector<vec2>();
+            chunks[c].normals = vector<vec3>();
+        }
+    }
+
+    MemoryCharge temporaries;
+    size_t temp_bytes = copy.capacity() + capacityBytes(temp_vertices) +
+                        capacityBytes(temp_uvs) + capacityBytes(temp_normals);
+    for (size_t c = 0; c < chunk_cnt; ++c) {
+        temp_bytes += capacityBytes(chunks[c].vertex_idx) +
+                      capacityBytes(chunks[c].uv_idx) +
+                      capacityBytes(chunks[c].normal_idx);
+    }
+    temporaries.set(MEMORY_LOADER, temp_bytes);
+
+    size_t dropped = 0;
+    if (chunk_cnt == 1) {
+        dropped = gatherCorners(chunks[0], temp_vertices, temp_uvs,
+                                temp_normals, out_vertices, out_uvs,
+                                out_normals);
+    } else {
+        vector<size_t> chunk_dropped(chunk_cnt);
+        parallelFor(0, chunk_cnt, 1, [&](size_t lo, size_t hi) {
+            for (size_t c = lo; c < hi; ++c) {
+                chunk_dropped[c] = gatherCorners(
+                    chunks[c], temp_vertices, temp_uvs, temp_normals,
+                    chunks[c].out_vertices, chunks[c].out_uvs,
+                    chunks[c].out_normals);
+            }
+        });
+        for (size_t c = 0; c < chunk_cnt; ++c) {
+            append(out_vertices, chunks[c].out_vertices);
+            append(out_uvs, chunks[c].out_uvs);
+            append(out_normals, chunks[c].out_normals);
+            dropped += chunk_dropped[c];
+        }
+    }
+    if (dropped_faces) *dropped_faces = dropped;
+
+    return (temp_uvs.size() ? 1 : 0);
+}
+
+int loadOBJ(const char* path, vector<vec3>& out_vertices, vector<vec2>& out_uvs,
+            vector<vec3>& out_normals) {
+    TRACE_SCOPE("loadOBJ");
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    vector<char> data;
+    char chunk[65536];
+    for (size_t n; (n = fread(chunk, 1, sizeof(chunk), file)) > 0;) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(file);
+    data.push_back('\n');  // saves parseOBJ a terminated copy
+    MemoryCharge file_bytes;
+    file_bytes.set(MEMORY_LOADER, capacityBytes(data));
+
+    size_t dropped = 0;
+    int res = parseOBJ(&data[0], data.size(), out_vertices, out_uvs,
+                       out_normals, &dropped);
+    if (dropped) {
+        fprintf(stderr, "Dropped %u faces of %s indexing past its elements.\n",
+                (unsigned int)dropped, path);
+    }
+    return res;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// files from this size on are parsed in parallel, in chunks of about
+// OBJ_CHUNK_BYTES cut at line ends
+#define OBJ_PARALLEL_BYTES (4 << 20)
+#define OBJ_CHUNK_BYTES (1 << 20)
+
+// Parse an obj file held in memory into flat per-corner arrays. Faces may
+// be polygons, which are fanned into triangles, and may use negative
+// indices and any of the v, v/vt, v//vn and v/vt/vn corner forms, mixed
+// within a file. uvs and normals are filled when the file has any: corners
+// without a uv get (0, 0) and those without a normal the face normal.
+// Faces indexing past the elements are dropped and, if dropped_faces is not
+// NULL, counted there. Returns 1 if it has texture coordinates, 0 otherwise.
+// Large files give the same result as small ones, parsed on up to
+// workerCount() threads.
+int parseOBJ(const char* data, size_t size,
+             std::vector<glm::vec3>& out_vertices,
+             std::vector<glm::vec2>& out_uvs,
+             std::vector<glm::vec3>& out_normals,
+             size_t* dropped_faces = NULL);
+
+// Read an obj file into flat per-corner arrays, reporting dropped faces on
+// stderr. Returns -1 if the file cannot be opened, otherwise as parseOBJ.
+int loadOBJ(const char* path, std::vector<glm::vec3>& out_vertices,
+            std::vector<glm::vec2>& out_uvs,
+            std::vector<glm::vec3>& out_normals);
@@ -0,0 +1,350 @@
+#include "occlusion.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+using namespace std;
+using namespace glm;
+
+#include "parallel.hpp"
+#include "raster.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+
+// triangles per binning chunk at least, so small frames stay on one thread
+#define OCCLUSION_MIN_CHUNK 1024
+#define OCCLUSION_PYRAMID_GRAIN 16
+// triangles rasterized into a tile between refreshes of its far depth
+#define OCCLUSION_FAR_REFRESH 32
+
+namespace {
+
+double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+}  // namespace
+
+OcclusionBuffer::OcclusionBuffer()
+    : width(0), height(0), tiles_x(0), tiles_y(0) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool OcclusionBuffer::init(int w, int h) {
+    if (w <= 0 || h <= 0) return false;
+    width = w;
+    height = h;
+    tiles_x = (w + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+    tiles_y = (h + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+
+    // level 0 is padded to whole tiles so SIMD rows never leave it
+    levels.clear();
+    Level base;
+    base.width = w;
+    base.height = h;
+    base.pitch = tiles_x * OCCLUSION_TILE_WIDTH;
+    base.depth.assign(size_t(base.pitch) * tiles_y * OCCLUSION_TILE_HEIGHT,
+                      1.0f);
+    levels.push_back(base);
+    while (w > 1 || h > 1) {
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+        Level l;
+        l.width = l.pitch = w;
+        l.height = h;
+        l.depth.assign(size_t(w) * h, 1.0f);
+        levels.push_back(l);
+    }
+    return true;
+}
+
+void OcclusionBuffer::begin(const mat4& vp_mat) {
+    vp = vp_mat;
+    occluders.clear();
+    fill(levels[0].depth.begin(), levels[0].depth.end(), 1.0f);
+    memset(&stats, 0, sizeof(stats));
+}
+
+void OcclusionBuffer::addOccluder(const vector<vec3>& positions,
+                                  const uint32_t* indices, size_t index_cnt,
+                                  const mat4& model) {
+    Occluder o = {&positions, indices, index_cnt, vp * model};
+    occluders.push_back(o);
+}
+
+void OcclusionBuffer::setupChunk(size_t first, size_t last, Bin& bin) {
+    TRACE_SCOPE("occlusion setup");
+    bin.tris.clear();
+    bin.tiles.resize(tiles_x * tiles_y);
+    for (size_t t = 0; t < bin.tiles.size(); ++t) bin.tiles[t].clear();
+
+    size_t o = upper_bound(tri_starts.begin(), tri_starts.end(), first) -
+               tri_starts.begin() - 1;
+    for (size_t t = first; t < last; ++t) {
+        while (t >= tri_starts[o + 1]) ++o;
+        const Occluder& occ = occluders[o];
+        const uint32_t* idx = occ.indices + (t - tri_starts[o]) * 3;
+        const vec3* positions = &(*occ.positions)[0];
+
+        ScreenTri tri;
+        bool clipped = false;
+        for (int k = 0; k < 3; ++k) {
+            vec4 c = transformPoint(occ.mvp, positions[idx[k]]);
+            if (c.z < -c.w) {
+                clipped = true;
+                break;
+            }
+            float inv_w = 1.0f / c.w;
+            tri.x[k] = (c.x * inv_w * 0.5f + 0.5f) * width;
+            tri.y[k] = (c.y * inv_w * 0.5f + 0.5f) * height;
+            tri.z[k] = c.z * inv_w * 0.5f + 0.5f;
+        }
+        if (clipped) continue;
+
+        // both windings occlude; store counter-clockwise
+        float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) -
+                     (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+        if (area == 0.0f) continue;
+        if (area < 0.0f) {
+            swap(tri.x[1], tri.x[2]);
+            swap(tri.y[1], tri.y[2]);
+            swap(tri.z[1], tri.z[2]);
+        }
+
+        // pixels whose centers the bounds contain
+        float min_x = std::min(tri.x[0], std::min(tri.x[1], tri.x[2]));
+        float max_x = std::max(tri.x[0], std::max(tri.x[1], tri.x[2]));
+        float min_y = std::min(tri.y[0], std::min(tri.y[1], tri.y[2]));
+        float max_y = std::max(tri.y[0], std::max(tri.y[1], tri.y[2]));
+        int x0, x1, y0, y1;
+        pixelSpan(min_x, max_x, width, x0, x1);
+        pixelSpan(min_y, max_y, height, y0, y1);
+        if (x0 > x1 || y0 > y1) continue;
+
+        uint32_t id = bin.tris.size();
+        bin.tris.push_back(tri);
+        for (int ty = y0 / OCCLUSION_TILE_HEIGHT;
+             ty <= y1 / OCCLUSION_TILE_HEIGHT; ++ty) {
+            for (int tx = x0 / OCCLUSION_TILE_WIDTH;
+                 tx <= x1 / OCCLUSION_TILE_WIDTH; ++tx) {
+                bin.tiles[ty * tiles_x + tx].push_back(id);
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::rasterTile(int tile) {
+    TRACE_SCOPE("occlusion tile");
+    int tile_x0 = (tile % tiles_x) * OCCLUSION_TILE_WIDTH;
+    int tile_y0 = (tile / tiles_x) * OCCLUSION_TILE_HEIGHT;
+    int tile_x1 = std::min(width, tile_x0 + OCCLUSION_TILE_WIDTH) - 1;
+    int tile_y1 = std::min(height, tile_y0 + OCCLUSION_TILE_HEIGHT) - 1;
+    Level& base = levels[0];
+    vfloat lanes = vload(lane_centers);
+    vfloat zero(0.0f);
+
+    // farthest depth in the tile, refreshed now and then; triangles behind
+    // it cannot change anything
+    float tile_far = 1.0f;
+    int since_refresh = 0;
+
+    // chunks in order, so the result does not depend on the thread count
+    for (size_t b = 0; b < bins.size(); ++b) {
+        const vector<uint32_t>& list = bins[b].tiles[tile];
+        for (size_t i = 0; i < list.size(); ++i) {
+            const ScreenTri& tri = bins[b].tris[list[i]];
+            const float* x = tri.x;
+            const float* y = tri.y;
+            const float* z = tri.z;
+            if (std::min(z[0], std::min(z[1], z[2])) >= tile_far) continue;
+            if (++since_refresh == OCCLUSION_FAR_REFRESH) {
+                since_refresh = 0;
+                vfloat far_v = zero;
+                for (int py = tile_y0; py <= tile_y1; ++py) {
+                    const float* row = &base.depth[size_t(py) * base.pitch];
+                    for (int sx = tile_x0; sx < tile_x0 + OCCLUSION_TILE_WIDTH;
+                         sx += SIMD_WIDTH) {
+                        far_v = vmax(far_v, vload(row + sx));
+                    }
+                }
+                float lanes_far[SIMD_WIDTH];
+                vstore(lanes_far, far_v);
+                tile_far = 0.0f;
+                for (int k = 0; k < SIMD_WIDTH; ++k) {
+                    tile_far = std::max(tile_far, lanes_far[k]);
+                }
+            }
+
+            float min_x = std::min(x[0], std::min(x[1], x[2]));
+            float max_x = std::max(x[0], std::max(x[1], x[2]));
+            float min_y = std::min(y[0], std::min(y[1], y[2]));
+            float max_y = std::max(y[0], std::max(y[1], y[2]));
+            int px0, px1, py0, py1;
+            pixelSpan(min_x, max_x, width, px0, px1);
+            pixelSpan(min_y, max_y, height, py0, py1);
+            px0 = std::max(px0, tile_x0);
+            px1 = std::min(px1, tile_x1);
+            py0 = std::max(py0, tile_y0);
+            py1 = std::min(py1, tile_y1);
+            if (px0 > px1 || py0 > py1) continue;
+
+            // edge k runs from vertex k to k + 1, inside is e >= 0
+            float ea[3], eb[3], ec[3];
+            for (int k = 0; k < 3; ++k) {
+                int n = (k + 1) % 3;
+                ea[k] = y[k] - y[n];
+                eb[k] = x[n] - x[k];
+                ec[k] = (y[n] - y[k]) * x[k] - (x[n] - x[k]) * y[k];
+            }
+            float area = (x[1] - x[0]) * (y[2] - y[0]) -
+                         (x[2] - x[0]) * (y[1] - y[0]);
+            float dzdx = ((z[1] - z[0]) * (y[2] - y[0]) -
+                          (z[2] - z[0]) * (y[1] - y[0])) / area;
+            float dzdy = ((z[2] - z[0]) * (x[1] - x[0]) -
+                          (z[1] - z[0]) * (x[2] - x[0])) / area;
+            float zc = z[0] - dzdx * x[0] - dzdy * y[0];
+
+            int sx0 = px0 & ~(SIMD_WIDTH - 1);
+            vfloat ea0(ea[0]), ea1(ea[1]), ea2(ea[2]), vdzdx(dzdx);
+            for (int py = py0; py <= py1; ++py) {
+                float fy = py + 0.5f;
+                float* row = &base.depth[size_t(py) * base.pitch];
+                vfloat c0(eb[0] * fy + ec[0]), c1(eb[1] * fy + ec[1]);
+                vfloat c2(eb[2] * fy + ec[2]), zrow(dzdy * fy + zc);
+                for (int sx = sx0; sx <= px1; sx += SIMD_WIDTH) {
+                    vfloat fx = vfloat(float(sx)) + lanes;
+                    vfloat inside = (zero <= ea0 * fx + c0) &
+                                    (zero <= ea1 * fx + c1) &
+                                    (zero <= ea2 * fx + c2);
+                    if (!movemask(inside)) continue;
+                    vfloat zs = vdzdx * fx + zrow;
+                    vfloat d = vload(row + sx);
+                    vstore(row + sx, select(inside, vmin(d, zs), d));
+                }
+            }
+        }
+    }
+}
+
+void OcclusionBuffer::buildPyramid() {
+    TRACE_SCOPE("occlusion pyramid");
+    for (size_t l = 1; l < levels.size(); ++l) {
+        const Level& src = levels[l - 1];
+        Level& dst = levels[l];
+        parallelFor(0, dst.height, OCCLUSION_PYRAMID_GRAIN,
+                    [&](size_t lo, size_t hi) {
+            for (size_t y = lo; y < hi; ++y) {
+                int y0 = int(y) * 2, y1 = std::min(y0 + 1, src.height - 1);
+                const float* r0 = &src.depth[size_t(y0) * src.pitch];
+                const float* r1 = &src.depth[size_t(y1) * src.pitch];
+                float* out = &dst.depth[y * dst.pitch];
+                for (int x = 0; x < dst.width; ++x) {
+                    int x0 = x * 2, x1 = std::min(x0 + 1, src.width - 1);
+                    out[x] = std::max(std::max(r0[x0], r0[x1]),
+                                      std::max(r1[x0], r1[x1]));
+                }
+            }
+        });
+    }
+}
+
+void OcclusionBuffer::end() {
+    TRACE_SCOPE("occlusion raster");
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    tri_starts.resize(occluders.size() + 1);
+    tri_starts[0] = 0;
+    for (size_t o = 0; o < occluders.size(); ++o) {
+        tri_starts[o + 1] = tri_starts[o] + occluders[o].index_cnt / 3;
+    }
+    size_t tri_cnt = tri_starts.back();
+    stats.occluders = occluders.size();
+    stats.triangles = tri_cnt;
+
+    // a few chunks per worker keep binning balanced
+    size_t chunk_cnt = std::max<size_t>(1, std::min<size_t>(
+        workerCount() * 4, tri_cnt / OCCLUSION_MIN_CHUNK));
+    size_t chunk = (tri_cnt + chunk_cnt - 1) / chunk_cnt;
+    bins.resize(chunk_cnt);
+    parallelFor(0, chunk_cnt, 1, [&](size_t lo, size_t hi) {
+        for (size_t c = lo; c < hi; ++c) {
+            setupChunk(std::min(tri_cnt, c * chunk),
+                       std::min(tri_cnt, (c + 1) * chunk), bins[c]);
+        }
+    });
+    for (size_t c = 0; c < chunk_cnt; ++c) stats.binned += bins[c].tris.size();
+    stats.setup_ms = msSince(t0);
+
+    t0 = chrono::steady_clock::now();
+    parallelFor(0, tiles_x * tiles_y, 1, [&](size_t lo, size_t hi) {
+        for (size_t t = lo; t < hi; ++t) rasterTile(int(t));
+    });
+    stats.raster_ms = msSince(t0);
+
+    t0 = chrono::steady_clock::now();
+    buildPyramid();
+    stats.pyramid_ms = msSince(t0);
+}
+
+bool OcclusionBuffer::testBox(const AABB& box) const {
+    float min_x = FLT_MAX, max_x = -FLT_MAX;
+    float min_y = FLT_MAX, max_y = -FLT_MAX;
+    float min_z = FLT_MAX;
+    // clip space corners from one corner and the three edge vectors
+    vec4 base = transformPoint(vp, box.min);
+    vec3 size = box.max - box.min;
+    vec4 ex = vec4(vp[0][0], vp[0][1], vp[0][2], vp[0][3]) * size.x;
+    vec4 ey = vec4(vp[1][0], vp[1][1], vp[1][2], vp[1][3]) * size.y;
+    vec4 ez = vec4(vp[2][0], vp[2][1], vp[2][2], vp[2][3]) * size.z;
+    for (int k = 0; k < 8; ++k) {
+        vec4 c = base;
+        if (k & 1) c += ex;
+        if (k & 2) c += ey;
+        if (k & 4) c += ez;
+        if (c.z < -c.w) return true;  // reaches past the near plane
+        float inv_w = 1.0f / c.w;
+        float sx = (c.x * inv_w * 0.5f + 0.5f) * width;
+        float sy = (c.y * inv_w * 0.5f + 0.5f) * height;
+        min_x = std::min(min_x, sx);
+        max_x = std::max(max_x, sx);
+        min_y = std::min(min_y, sy);
+        max_y = std::max(max_y, sy);
+        min_z = std::min(min_z, c.z * inv_w * 0.5f + 0.5f);
+    }
+
+    // every pixel the box touches, since the screen samples other points
+    // than this buffer does
+    if (max_x < 0.0f || max_y < 0.0f || min_x >= width || min_y >= height) {
+        return false;
+    }
+    int x0 = std::max(0, int(min_x)), x1 = std::min(width - 1, int(max_x));
+    int y0 = std::max(0, int(min_y)), y1 = std::min(height - 1, int(max_y));
+
+    // the finest level where the rect spans at most 4x4 texels
+    int l = 0;
+    while ((x1 >> l) - (x0 >> l) > 3 || (y1 >> l) - (y0 >> l) > 3) ++l;
+    const Level& lv = levels[l];
+    float far_z = 0.0f;
+    for (int y = y0 >> l; y <= y1 >> l; ++y) {
+        for (int x = x0 >> l; x <= x1 >> l; ++x) {
+            far_z = std::max(far_z, lv.depth[size_t(y) * lv.pitch + x]);
+        }
+    }
+    return min_z <= far_z;
+}
+
+size_t OcclusionBuffer::testBoxes(const BoxSoA& boxes,
+                                  unsigned char* visible) const {
+    size_t visible_cnt = 0;
+    for (size_t i = 0; i < boxes.count; ++i) {
+        if (!visible[i]) continue;
+        AABB box;
+        box.min = vec3(boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]);
+        box.max = vec3(boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]);
+        visible[i] = testBox(box);
+        visible_cnt += visible[i];
+    }
+    return visible_cnt;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "culling.hpp"
+
+// screen tiles the rasterizer works on independently
+#define OCCLUSION_TILE_WIDTH 64
+#define OCCLUSION_TILE_HEIGHT 32
+
+struct OcclusionStats {
+    unsigned int occluders;
+    unsigned int triangles;  // submitted
+    unsigned int binned;     // survived near plane, size and screen tests
+    double setup_ms;         // vertex transform and binning
+    double raster_ms;
+    double pyramid_ms;
+};
+
+// Software depth buffer of a few occluders for culling whatever they hide.
+// Triangles are transformed and binned into screen tiles in parallel chunks,
+// tiles are rasterized in parallel with SIMD edge functions into a nearest
+// depth buffer, skipping triangles behind everything already in the tile.
+// A max depth pyramid over it answers box queries with at most 16 texel
+// reads. Depth is z/w mapped to [0, 1], rows run bottom up as in GL window
+// space. Occluder triangles crossing the near plane are skipped, which only
+// ever makes the buffer less occluding. No GL involved.
+class OcclusionBuffer {
+   public:
+    OcclusionBuffer();
+
+    bool init(int width, int height);
+
+    // start a frame: clear depth and forget the occluders
+    void begin(const glm::mat4& vp_mat);
+    // triangles of an occluder placed by model; the arrays must stay alive
+    // until end(). Adding near to far lets tiles skip hidden triangles.
+    void addOccluder(const std::vector<glm::vec3>& positions,
+                     const uint32_t* indices, size_t index_cnt,
+                     const glm::mat4& model);
+    // rasterize all occluders and build the pyramid
+    void end();
+
+    // false only when the box is certainly hidden (or off screen)
+    bool testBox(const AABB& box) const;
+    // clears visible[i] of hidden boxes among the visible ones, returns how
+    // many stay visible
+    size_t testBoxes(const BoxSoA& boxes, unsigned char* visible) const;
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int levelCount() const { return int(levels.size()); }
+    // pyramid level 0 is the depth buffer itself, rows of levelPitch floats
+    const float* level(int l) const { return &levels[l].depth[0]; }
+    int levelPitch(int l) const { return levels[l].pitch; }
+    const OcclusionStats& getStats() const { return stats; }
+
+   private:
+    struct Occluder {
+        const std::vector<glm::vec3>* positions;
+        const uint32_t* indices;
+        size_t index_cnt;
+        glm::mat4 mvp;
+    };
+    struct ScreenTri {
+        float x[3], y[3], z[3];
+    };
+    struct Level {
+        int width, height, pitch;
+        std::vector<float> depth;
+    };
+    // triangles set up by one binning chunk, listed per tile
+    struct Bin {
+        std::vector<ScreenTri> tris;
+        std::vector<std::vector<uint32_t> > tiles;
+    };
+
+    void setupChunk(size_t first, size_t last, Bin& bin);
+    void rasterTile(int tile);
+    void buildPyramid();
+
+    int width, height;
+    int tiles_x, tiles_y;
+    glm::mat4 vp;
+    std::vector<Occluder> occluders;
+    std::vector<size_t> tri_starts;  // first triangle of each occluder
+    std::vector<Bin> bins;
+    std::vector<Level> levels;
+    OcclusionStats stats;
+};
@@ -0,0 +1,219 @@
+#include "packed-mesh.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+using namespace std;
+using namespace glm;
+
+#include "file-stamp.hpp"
+#include "trace.hpp"
+
+#define PACKED_MESH_MAGIC "OBJM"
+#define PACKED_MESH_TEXTURED 1u
+
+namespace {
+
+struct PackedHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t vertex_cnt;
+    uint32_t index_cnt;
+    uint32_t index_size;  // 2 or 4 bytes
+    float bounds_min[3];
+    float bounds_max[3];
+    FileStamp source;  // of the obj, for packedMeshCurrent
+};
+
+bool readHeader(FILE* file, PackedHeader& header) {
+    return fread(&header, sizeof(header), 1, file) == 1 &&
+           memcmp(header.magic, PACKED_MESH_MAGIC, 4) == 0 &&
+           header.version == PACKED_MESH_VERSION &&
+           (header.index_size == 2 || header.index_size == 4);
+}
+
+inline int16_t snorm16(float f) {
+    return int16_t(roundf(clamp(f, -1.0f, 1.0f) * 32767.0f));
+}
+
+// fold the lower hemisphere over the upper one, so the unit octahedron
+// maps onto the whole square
+vec2 octEncode(vec3 n) {
+    float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if (l1 == 0.0f) return vec2(0.0f);
+    n /= l1;
+    vec2 p(n.x, n.y);
+    if (n.z < 0.0f) {
+        p = (1.0f - abs(vec2(p.y, p.x))) *
+            vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return p;
+}
+
+// unfolds what octEncode folded
+vec3 octDecode(vec2 p) {
+    vec3 n(p.x, p.y, 1.0f - fabsf(p.x) - fabsf(p.y));
+    if (n.z < 0.0f) {
+        vec2 q = (1.0f - abs(vec2(n.y, n.x))) *
+                 vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+        n.x = q.x;
+        n.y = q.y;
+    }
+    return normalize(n);
+}
+
+}  // namespace
+
+void packMesh(const IndexedMesh& mesh, PackedMesh& packed) {
+    TRACE_SCOPE("packMesh");
+    packed.textured = !mesh.uvs.empty();
+    packed.bounds = computeBounds(mesh.positions);
+    vec3 extent = packed.bounds.max - packed.bounds.min;
+    vec3 scale(extent.x > 0.0f ? 65535.0f / extent.x : 0.0f,
+               extent.y > 0.0f ? 65535.0f / extent.y : 0.0f,
+               extent.z > 0.0f ? 65535.0f / extent.z : 0.0f);
+
+    packed.vertices.resize(mesh.positions.size());
+    for (size_t v = 0; v < mesh.positions.size(); ++v) {
+        PackedVertex& out = packed.vertices[v];
+        vec3 q = (mesh.positions[v] - packed.bounds.min) * scale;
+        for (int k = 0; k < 3; ++k) {
+            out.position[k] = uint16_t(clamp(q[k] + 0.5f, 0.0f, 65535.0f));
+        }
+        out.position[3] = 0;
+        vec2 n = mesh.normals.empty() ? vec2(0.0f)
+                                      : octEncode(mesh.normals[v]);
+        out.normal[0] = snorm16(n.x);
+        out.normal[1] = snorm16(n.y);
+        uint32_t uv = packed.textured ? packHalf2x16(mesh.uvs[v]) : 0;
+        out.uv[0] = uint16_t(uv);
+        out.uv[1] = uint16_t(uv >> 16);
+    }
+    packed.indices = mesh.indices;
+}
+
+void unpackMesh(const PackedMesh& packed, IndexedMesh& mesh) {
+    size_t vertex_cnt = packed.vertices.size();
+    vec3 step = (packed.bounds.max - packed.bounds.min) / 65535.0f;
+    mesh.positions.resize(vertex_cnt);
+    mesh.normals.resize(vertex_cnt);
+    mesh.uvs.resize(packed.textured ? vertex_cnt : 0);
+    mesh.tangents.clear();
+    for (size_t v = 0; v < vertex_cnt; ++v) {
+        const PackedVertex& in = packed.vertices[v];
+        mesh.positions[v] =
+            packed.bounds.min +
+            vec3(in.position[0], in.position[1], in.position[2]) * step;
+        mesh.normals[v] =
+            octDecode(vec2(in.normal[0], in.normal[1]) / 32767.0f);
+        if (packed.textured) {
+            mesh.uvs[v] = unpackHalf2x16(in.uv[0] | uint32_t(in.uv[1]) << 16);
+        }
+    }
+    mesh.indices = packed.indices;
+}
+
+float packedPositionError(const PackedMesh& packed) {
+    // rounding is off by at most half a step on each axis
+    return length((packed.bounds.max - packed.bounds.min) / 65535.0f) * 0.5f;
+}
+
+bool writePackedMesh(const char* path, const PackedMesh& packed,
+                     const FileStamp& source, size_t* bytes) {
+    TRACE_SCOPE("writePackedMesh");
+    PackedHeader header;
+    memcpy(header.magic, PACKED_MESH_MAGIC, 4);
+    header.version = PACKED_MESH_VERSION;
+    header.flags = packed.textured ? PACKED_MESH_TEXTURED : 0;
+    header.vertex_cnt = packed.vertices.size();
+    header.index_cnt = packed.indices.size();
+    header.index_size = packed.vertices.size() <= 65536 ? 2 : 4;
+    memcpy(header.bounds_min, &packed.bounds.min[0], sizeof(vec3));
+    memcpy(header.bounds_max, &packed.bounds.max[0], sizeof(vec3));
+    header.source = source;
+
+    string tmp = string(path) + ".tmp";
+    FILE* file = fopen(tmp.c_str(), "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to create %s.\n", tmp.c_str());
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && !packed.vertices.empty()) {
+        ok = fwrite(&packed.vertices[0], sizeof(PackedVertex),
+                    packed.vertices.size(), file) == packed.vertices.size();
+    }
+    if (ok && header.index_size == 2) {
+        vector<uint16_t> short_indices(packed.indices.begin(),
+                                       packed.indices.end());
+        ok = short_indices.empty() ||
+             fwrite(&short_indices[0], 2, short_indices.size(), file) ==
+                 short_indices.size();
+    } else if (ok && !packed.indices.empty()) {
+        ok = fwrite(&packed.indices[0], 4, packed.indices.size(), file) ==
+             packed.indices.size();
+    }
+    ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+    if (ok) remove(path);  // rename does not replace files there
+#endif
+    if (ok) ok = rename(tmp.c_str(), path) == 0;
+    if (!ok) {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        remove(tmp.c_str());
+        return false;
+    }
+    if (bytes) {
+        *bytes = sizeof(header) +
+                 packed.vertices.size() * sizeof(PackedVertex) +
+                 packed.indices.size() * header.index_size;
+    }
+    return true;
+}
+
+bool readPackedMesh(const char* path, PackedMesh& packed) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s.\n", path);
+        return false;
+    }
+    PackedHeader header;
+    bool ok = readHeader(file, header);
+    if (ok) {
+        packed.textured = (header.flags & PACKED_MESH_TEXTURED) != 0;
+        memcpy(&packed.bounds.min[0], header.bounds_min, sizeof(vec3));
+        memcpy(&packed.bounds.max[0], header.bounds_max, sizeof(vec3));
+        packed.vertices.resize(header.vertex_cnt);
+        ok = header.vertex_cnt == 0 ||
+             fread(&packed.vertices[0], sizeof(PackedVertex),
+                   header.vertex_cnt, file) == header.vertex_cnt;
+    }
+    if (ok && header.index_size == 2) {
+        vector<uint16_t> short_indices(header.index_cnt);
+        ok = header.index_cnt == 0 ||
+             fread(&short_indices[0], 2, header.index_cnt, file) ==
+                 header.index_cnt;
+        packed.indices.assign(short_indices.begin(), short_indices.end());
+    } else if (ok) {
+        packed.indices.resize(header.index_cnt);
+        ok = header.index_cnt == 0 ||
+             fread(&packed.indices[0], 4, header.index_cnt, file) ==
+                 header.index_cnt;
+    }
+    fclose(file);
+    if (!ok) fprintf(stderr, "Failed to read packed mesh %s.\n", path);
+    return ok;
+}
+
+bool packedMeshCurrent(const char* obj_path, const char* cache_path) {
+    FileStamp source;
+    if (!fileStamp(obj_path, source)) return false;
+    FILE* file = fopen(cache_path, "rb");
+    if (file == NULL) return false;
+    PackedHeader header;
+    bool ok = readHeader(file, header) && header.source == source;
+    fclose(file);
+    return ok;
+}
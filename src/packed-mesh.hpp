@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "culling.hpp"
+#include "file-stamp.hpp"
+#include "mesh-index.hpp"
+
+// bumped whenever the layout below changes, so older caches are rebuilt
+#define PACKED_MESH_VERSION 2
+
+// 16 bytes, half of the float vertex, ready for glVertexAttribPointer
+struct PackedVertex {
+    uint16_t position[4];  // unorm16 across the bounds, w is 0
+    int16_t normal[2];     // octahedral, snorm16
+    uint16_t uv[2];        // half floats, 0 when untextured
+};
+
+// An indexed mesh quantized for the GPU: positions relative to the bounds,
+// normals folded onto an octahedron and uvs as half floats. Indices are
+// written as 16 bits when every vertex fits.
+struct PackedMesh {
+    bool textured;
+    AABB bounds;
+    std::vector<PackedVertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+void packMesh(const IndexedMesh& mesh, PackedMesh& packed);
+// largest distance between a position and its quantized value
+float packedPositionError(const PackedMesh& packed);
+
+// write to path + ".tmp" and rename, so readers never see half a file;
+// source is the stamp of the obj taken before it was read, and bytes, if
+// not NULL, receives the file size
+bool writePackedMesh(const char* path, const PackedMesh& packed,
+                     const FileStamp& source, size_t* bytes);
+bool readPackedMesh(const char* path, PackedMesh& packed);
+// back to float attributes, within the quantization error of packMesh
+void unpackMesh(const PackedMesh& packed, IndexedMesh& mesh);
+// true when cache_path was written with this PACKED_MESH_VERSION from
+// obj_path as it is now, the same size and modification time
+bool packedMeshCurrent(const char* obj_path, const char* cache_path);
@@ -0,0 +1,427 @@
+#include "parallel.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <thread>
+using namespace std;
+
+#include "trace.hpp"
+
+// queued jobs per thread, a power of two; pushes past it run inline
+#define JOB_DEQUE_SIZE 4096
+// workers and other threads that queue work at the same time
+#define JOB_MAX_THREADS 256
+// rounds an idle worker looks for work before it sleeps
+#define JOB_SPIN 256
+
+namespace {
+
+struct Job {
+    void (*run)(Job* job);  // deletes the job
+    atomic<int>* pending;   // decremented after run, if not NULL
+};
+
+struct FuncJob : Job {
+    function<void()> fn;
+};
+
+void runFunc(Job* job) {
+    FuncJob* f = static_cast<FuncJob*>(job);
+    f->fn();
+    delete f;
+}
+
+// Chase-Lev deque over a fixed ring, with the memory orders of Le et al.,
+// "Correct and efficient work-stealing for weak memory models". The owner
+// pushes and pops at the bottom, any thread steals at the top.
+class WorkDeque {
+   public:
+    WorkDeque() : top(0), bottom(0) {
+        for (int i = 0; i < JOB_DEQUE_SIZE; ++i) ring[i] = NULL;
+    }
+
+    bool push(Job* job) {
+        int64_t b = bottom.load(memory_order_relaxed);
+        int64_t t = top.load(memory_order_acquire);
+        if (b - t >= JOB_DEQUE_SIZE) return false;
+        ring[b & (JOB_DEQUE_SIZE - 1)].store(job, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        bottom.store(b + 1, memory_order_relaxed);
+        return true;
+    }
+
+    Job* pop() {
+        int64_t b = bottom.load(memory_order_relaxed) - 1;
+        bottom.store(b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t t = top.load(memory_order_relaxed);
+        if (t > b) {
+            bottom.store(b + 1, memory_order_relaxed);
+            return NULL;
+        }
+        Job* job = ring[b & (JOB_DEQUE_SIZE - 1)].load(memory_order_relaxed);
+        if (t == b) {
+            // the last job, thieves may be after it too
+            if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst,
+                                             memory_order_relaxed)) {
+                job = NULL;
+            }
+            bottom.store(b + 1, memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* steal() {
+        int64_t t = top.load(memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        int64_t b = bottom.load(memory_order_acquire);
+        if (t >= b) return NULL;
+        Job* job = ring[t & (JOB_DEQUE_SIZE - 1)].load(memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst,
+                                         memory_order_relaxed)) {
+            return NULL;  // lost to the owner or another thief
+        }
+        return job;
+    }
+
+    // exact for the owner, a hint for anyone else
+    bool empty() const {
+        return bottom.load(memory_order_relaxed) <=
+               top.load(memory_order_relaxed);
+    }
+
+   private:
+    atomic<int64_t> top;
+    char pad0[64];  // thieves write top, the owner bottom
+    atomic<int64_t> bottom;
+    char pad1[64];
+    atomic<Job*> ring[JOB_DEQUE_SIZE];
+};
+
+// Deques are never freed: a thread's deque goes back to the free list when
+// it exits, and thieves may still be looking at it.
+struct Pool {
+    mutex lock;
+    condition_variable wake;
+    vector<thread> threads;
+    atomic<bool> started;
+    atomic<bool> stop;
+    atomic<unsigned int> epoch;  // bumped by every push, for sleepers
+    atomic<int> sleeping;
+    WorkDeque* deques[JOB_MAX_THREADS];
+    atomic<int> deque_cnt;
+    vector<int> free_deques;
+};
+
+Pool& pool() {
+    static Pool* p = new Pool();  // zeroed, outlives exiting threads
+    return *p;
+}
+
+atomic<unsigned int> worker_cnt(0);
+
+unsigned int detectWorkers() {
+    const char* env = getenv("OBJ_LOADER_THREADS");
+    int n = env ? atoi(env) : 0;
+    unsigned int cnt = n > 0 ? n : thread::hardware_concurrency();
+    return cnt ? cnt : 1;
+}
+
+int acquireDeque() {
+    Pool& p = pool();
+    lock_guard<mutex> guard(p.lock);
+    if (!p.free_deques.empty()) {
+        int i = p.free_deques.back();
+        p.free_deques.pop_back();
+        return i;
+    }
+    int i = p.deque_cnt.load(memory_order_relaxed);
+    if (i == JOB_MAX_THREADS) return -1;
+    p.deques[i] = new WorkDeque();
+    p.deque_cnt.store(i + 1, memory_order_release);
+    return i;
+}
+
+// a thread only exits once everything it queued has run, so the deque it
+// hands back is empty
+struct ThreadSlot {
+    int deque;
+    uint32_t rng;  // picks the first victim to steal from
+    ThreadSlot() : deque(acquireDeque()), rng(deque * 0x9e3779b9u + 1) {}
+    ~ThreadSlot() {
+        if (deque < 0) return;
+        Pool& p = pool();
+        lock_guard<mutex> guard(p.lock);
+        p.free_deques.push_back(deque);
+    }
+};
+
+ThreadSlot& threadSlot() {
+    thread_local ThreadSlot slot;
+    return slot;
+}
+
+Job* findJob(ThreadSlot& slot) {
+    Pool& p = pool();
+    if (slot.deque >= 0) {
+        Job* job = p.deques[slot.deque]->pop();
+        if (job) return job;
+    }
+    int cnt = p.deque_cnt.load(memory_order_acquire);
+    slot.rng ^= slot.rng << 13;
+    slot.rng ^= slot.rng >> 17;
+    slot.rng ^= slot.rng << 5;
+    int first = cnt ? int(slot.rng % cnt) : 0;
+    for (int k = 0; k < cnt; ++k) {
+        int victim = (first + k) % cnt;
+        if (victim == slot.deque) continue;
+        Job* job = p.deques[victim]->steal();
+        if (job) return job;
+    }
+    return NULL;
+}
+
+void runJob(Job* job) {
+    atomic<int>* pending = job->pending;
+    job->run(job);
+    if (pending) pending->fetch_sub(1, memory_order_release);
+}
+
+void workerMain() {
+    traceThreadName("worker");
+    Pool& p = pool();
+    ThreadSlot& slot = threadSlot();
+    int idle = 0;
+    while (!p.stop.load(memory_order_acquire)) {
+        Job* job = findJob(slot);
+        if (job) {
+            runJob(job);
+            idle = 0;
+            continue;
+        }
+        if (++idle < JOB_SPIN) {
+            this_thread::yield();
+            continue;
+        }
+        // announce the sleep before the last look, so a push either sees
+        // the sleeper or is seen by the look
+        p.sleeping.fetch_add(1);
+        unsigned int epoch = p.epoch.load();
+        job = findJob(slot);
+        if (job == NULL) {
+            unique_lock<mutex> guard(p.lock);
+            while (p.epoch.load() == epoch && !p.stop.load()) {
+                p.wake.wait(guard);
+            }
+        }
+        p.sleeping.fetch_sub(1);
+        if (job) runJob(job);
+        idle = 0;
+    }
+}
+
+void startWorkers() {
+    Pool& p = pool();
+    if (p.started.load(memory_order_acquire)) return;
+    lock_guard<mutex> guard(p.lock);
+    if (p.started.load(memory_order_relaxed)) return;
+    p.stop.store(false);
+    for (unsigned int i = 1; i < workerCount(); ++i) {
+        p.threads.push_back(thread(workerMain));
+    }
+    p.started.store(true, memory_order_release);
+}
+
+void stopWorkers() {
+    Pool& p = pool();
+    {
+        lock_guard<mutex> guard(p.lock);
+        if (!p.started.load()) return;
+        p.stop.store(true);
+        p.epoch.fetch_add(1);
+        p.wake.notify_all();
+    }
+    for (size_t i = 0; i < p.threads.size(); ++i) p.threads[i].join();
+    p.threads.clear();
+    p.started.store(false);
+}
+
+// queue on this thread's deque, or run right away when there is none or
+// it is full
+void pushJob(Job* job) {
+    startWorkers();
+    Pool& p = pool();
+    ThreadSlot& slot = threadSlot();
+    if (slot.deque < 0 || !p.deques[slot.deque]->push(job)) {
+        runJob(job);
+        return;
+    }
+    p.epoch.fetch_add(1);
+    if (p.sleeping.load() > 0) {
+        lock_guard<mutex> guard(p.lock);
+        p.wake.notify_one();
+    }
+}
+
+// the calling thread takes part until pending drops to 0
+template <typename Done>
+void helpUntil(const Done& done) {
+    ThreadSlot& slot = threadSlot();
+    while (!done()) {
+        Job* job = findJob(slot);
+        if (job) {
+            runJob(job);
+        } else {
+            this_thread::yield();
+        }
+    }
+}
+
+void waitFor(const atomic<int>& pending) {
+    helpUntil([&]() { return pending.load(memory_order_acquire) == 0; });
+}
+
+struct Loop {
+    const function<void(size_t, size_t)>* body;
+    size_t grain;
+    atomic<int> pending;  // halves queued and not finished
+};
+
+struct RangeJob : Job {
+    Loop* loop;
+    size_t begin, end;
+};
+
+void runRange(Loop& loop, size_t begin, size_t end);
+
+void runRangeJob(Job* job) {
+    RangeJob* range = static_cast<RangeJob*>(job);
+    runRange(*range->loop, range->begin, range->end);
+    delete range;
+}
+
+// lazy binary splitting: while the deque still holds the last half given
+// away nobody is idle, so the range runs in grain sized calls
+void runRange(Loop& loop, size_t begin, size_t end) {
+    WorkDeque* deque = NULL;
+    int i = threadSlot().deque;
+    if (i >= 0) deque = pool().deques[i];
+    while (begin < end) {
+        if (deque && end - begin > loop.grain && deque->empty()) {
+            RangeJob* half = new RangeJob();
+            half->run = runRangeJob;
+            half->pending = &loop.pending;
+            half->loop = &loop;
+            half->begin = begin + (end - begin) / 2;
+            half->end = end;
+            end = half->begin;
+            loop.pending.fetch_add(1, memory_order_relaxed);
+            pushJob(half);
+        }
+        size_t last = std::min(begin + loop.grain, end);
+        (*loop.body)(begin, last);
+        begin = last;
+    }
+}
+
+}  // namespace
+
+unsigned int workerCount() {
+    unsigned int cnt = worker_cnt.load(memory_order_relaxed);
+    if (cnt == 0) {
+        cnt = detectWorkers();
+        worker_cnt.store(cnt, memory_order_relaxed);
+    }
+    return cnt;
+}
+
+void setWorkerCount(unsigned int cnt) {
+    stopWorkers();
+    worker_cnt.store(cnt ? cnt : detectWorkers(), memory_order_relaxed);
+}
+
+void parallelFor(size_t begin, size_t end, size_t grain,
+                 const function<void(size_t, size_t)>& body) {
+    if (end <= begin) return;
+    if (grain == 0) grain = 1;
+    if (workerCount() == 1 || end - begin <= grain) {
+        body(begin, end);
+        return;
+    }
+    startWorkers();
+    Loop loop;
+    loop.body = &body;
+    loop.grain = grain;
+    loop.pending.store(0);
+    runRange(loop, begin, end);
+    waitFor(loop.pending);
+}
+
+TaskGroup::TaskGroup() : pending(0) {}
+
+TaskGroup::~TaskGroup() { wait(); }
+
+void TaskGroup::run(const function<void()>& task) {
+    if (workerCount() == 1) {
+        task();
+        return;
+    }
+    FuncJob* job = new FuncJob();
+    job->run = runFunc;
+    job->pending = &pending;
+    job->fn = task;
+    pending.fetch_add(1, memory_order_relaxed);
+    pushJob(job);
+}
+
+void TaskGroup::wait() { waitFor(pending); }
+
+Task::Task(const function<void()>& body)
+    : body(body), blockers(1), submitted(false), finished(false),
+      done(false) {}
+
+Task::~Task() { wait(); }
+
+void Task::after(Task& dependency) {
+    lock_guard<mutex> guard(dependency.lock);
+    if (dependency.finished) return;
+    dependency.successors.push_back(this);
+    blockers.fetch_add(1);
+}
+
+void Task::submit() {
+    submitted = true;
+    release();
+}
+
+void Task::release() {
+    if (blockers.fetch_sub(1) != 1) return;
+    FuncJob* job = new FuncJob();
+    job->run = runFunc;
+    job->pending = NULL;
+    job->fn = [this]() {
+        body();
+        finish();
+    };
+    pushJob(job);
+}
+
+void Task::finish() {
+    vector<Task*> next;
+    {
+        lock_guard<mutex> guard(lock);
+        finished = true;
+        next.swap(successors);
+    }
+    for (size_t i = 0; i < next.size(); ++i) next[i]->release();
+    // the owner may destroy the task as soon as it sees this
+    done.store(true, memory_order_release);
+}
+
+void Task::wait() {
+    if (!submitted) return;
+    helpUntil([this]() { return isDone(); });
+}
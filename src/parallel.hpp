@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// One work-stealing pool shared by every loop and task: workerCount() - 1
+// worker threads started on first use, plus any thread that waits, which
+// runs queued work instead of blocking. Every thread queues into its own
+// Chase-Lev deque and pops the newest work from it; idle threads steal
+// the oldest from the others, so large pieces move and small ones stay
+// where their data is warm.
+
+// number of threads parallel loops may use, hardware concurrency unless
+// OBJ_LOADER_THREADS is set
+unsigned int workerCount();
+// overrides the count for the rest of the process, 0 goes back to the
+// default; the workers are restarted, so nothing may be running
+void setWorkerCount(unsigned int cnt);
+
+// Run body(first, last) over [begin, end) with every thread helping. The
+// range is split lazily: a thread runs grain items per call and halves
+// what it has left only when its last half was stolen, so chunks adapt to
+// the imbalance instead of being cut up front. Loops nest.
+void parallelFor(size_t begin, size_t end, size_t grain,
+                 const std::function<void(size_t, size_t)>& body);
+
+// Fork-join group for recursive work. run() queues the task for any thread
+// to take; wait() runs queued work on the calling thread until everything
+// this group started is done.
+class TaskGroup {
+   public:
+    TaskGroup();
+    ~TaskGroup();
+    void run(const std::function<void()>& task);
+    void wait();
+
+   private:
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+
+    std::atomic<int> pending;
+};
+
+// A task that starts once the tasks it depends on have finished, for
+// stages that form a graph rather than a tree. Dependencies are added
+// before submit(); the task is queued by whichever finishes last.
+class Task {
+   public:
+    explicit Task(const std::function<void()>& body);
+    ~Task();  // waits for a submitted task
+
+    // run only after dependency has finished
+    void after(Task& dependency);
+    void submit();
+    bool isDone() const { return done.load(std::memory_order_acquire); }
+    // run queued work on the calling thread until this task has finished
+    void wait();
+
+   private:
+    Task(const Task&);
+    Task& operator=(const Task&);
+
+    void finish();
+    void release();
+
+    std::function<void()> body;
+    std::atomic<int> blockers;  // unfinished dependencies, +1 until submit
+    bool submitted;
+    std::mutex lock;  // finished and successors
+    bool finished;
+    std::vector<Task*> successors;
+    std::atomic<bool> done;  // the last thing finish() touches
+};
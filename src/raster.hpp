@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+// Helpers shared by the software rasterizers (occlusion buffer and shaded
+// rasterizer).
+
+// m * (p, 1) written out; glm's operator does not inline here and would
+// dominate triangle setup
+inline glm::vec4 transformPoint(const glm::mat4& m, const glm::vec3& p) {
+    return glm::vec4(m[0][0] * p.x + m[1][0] * p.y + m[2][0] * p.z + m[3][0],
+                     m[0][1] * p.x + m[1][1] * p.y + m[2][1] * p.z + m[3][1],
+                     m[0][2] * p.x + m[1][2] * p.y + m[2][2] * p.z + m[3][2],
+                     m[0][3] * p.x + m[1][3] * p.y + m[2][3] * p.z + m[3][3]);
+}
+
+// m * (d, 0) written out
+inline glm::vec3 transformVector(const glm::mat4& m, const glm::vec3& d) {
+    return glm::vec3(m[0][0] * d.x + m[1][0] * d.y + m[2][0] * d.z,
+                     m[0][1] * d.x + m[1][1] * d.y + m[2][1] * d.z,
+                     m[0][2] * d.x + m[1][2] * d.y + m[2][2] * d.z);
+}
+
+// first and last pixel whose center lies in [lo, hi], clamped to [0, size);
+// libm's ceil and floor are calls without SSE 4.1
+inline void pixelSpan(float lo, float hi, int size, int& first, int& last) {
+    lo = std::max(lo - 0.5f, -1.0f);
+    hi = std::min(hi - 0.5f, float(size));
+    int l = int(lo), h = int(hi);
+    first = std::max(0, l + (lo > float(l)));
+    last = std::min(size - 1, h - (hi < float(h)));
+}
+
+// pixel center offsets of the lanes of one SIMD step
+const float lane_centers[8] = {0.5f, 1.5f, 2.5f, 3.5f,
+                               4.5f, 5.5f, 6.5f, 7.5f};
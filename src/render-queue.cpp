@@ -0,0 +1,91 @@
+#include "render-queue.hpp"
+
+#include <cstring>
+using namespace std;
+
+uint64_t makeSortKey(unsigned int program, unsigned int material,
+                     unsigned int vertex_array, float depth) {
+    uint32_t depth_bits;
+    if (!(depth > 0.0f)) depth = 0.0f;  // also maps NaN and -0 to +0
+    memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+    uint64_t key = program & ((1u << KEY_PROGRAM_BITS) - 1);
+    key = (key << KEY_MATERIAL_BITS) |
+          (material & ((1u << KEY_MATERIAL_BITS) - 1));
+    key = (key << KEY_VERTEX_ARRAY_BITS) |
+          (vertex_array & ((1u << KEY_VERTEX_ARRAY_BITS) - 1));
+    return (key << 32) | depth_bits;
+}
+
+void radixSort(vector<SortItem>& items, vector<SortItem>& scratch) {
+    size_t n = items.size();
+    if (n < 2) return;
+    scratch.resize(n);
+
+    // all eight histograms in a single pass over the keys
+    uint32_t hist[8][256];
+    memset(hist, 0, sizeof(hist));
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t key = items[i].key;
+        for (int b = 0; b < 8; ++b) ++hist[b][(key >> (b * 8)) & 0xff];
+    }
+
+    SortItem* src = &items[0];
+    SortItem* dst = &scratch[0];
+    for (int b = 0; b < 8; ++b) {
+        uint32_t* h = hist[b];
+        int shift = b * 8;
+
+        // nothing to reorder if all keys share this byte
+        if (h[(src[0].key >> shift) & 0xff] == n) continue;
+
+        uint32_t sum = 0;
+        for (int i = 0; i < 256; ++i) {
+            uint32_t c = h[i];
+            h[i] = sum;
+            sum += c;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            dst[h[(src[i].key >> shift) & 0xff]++] = src[i];
+        }
+        SortItem* t = src;
+        src = dst;
+        dst = t;
+    }
+
+    if (src != &items[0]) items.swap(scratch);
+}
+
+void RenderQueue::clear() {
+    cmds.clear();
+    items.clear();
+}
+
+void RenderQueue::push(const DrawCmd& cmd, unsigned int program_slot,
+                       unsigned int material_slot,
+                       unsigned int vertex_array_slot, float depth) {
+    SortItem item;
+    item.key = makeSortKey(program_slot, material_slot, vertex_array_slot,
+                           depth);
+    item.cmd = (uint32_t)cmds.size();
+    cmds.push_back(cmd);
+    items.push_back(item);
+}
+
+void RenderQueue::sort() { radixSort(items, scratch); }
+
+StateChanges RenderQueue::countStateChanges() const {
+    StateChanges changes;
+    memset(&changes, 0, sizeof(changes));
+    const DrawCmd* prev = NULL;
+    for (size_t i = 0; i < items.size(); ++i) {
+        const DrawCmd& cmd = cmds[items[i].cmd];
+        if (!prev || prev->program != cmd.program) ++changes.programs;
+        if (!prev || prev->texture != cmd.texture) ++changes.materials;
+        if (!prev || prev->vertex_array != cmd.vertex_array) {
+            ++changes.vertex_arrays;
+        }
+        prev = &cmd;
+    }
+    return changes;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// sort key layout, most significant first:
+//   program 8 | material 12 | vertex array 12 | depth 32
+#define KEY_PROGRAM_BITS 8
+#define KEY_MATERIAL_BITS 12
+#define KEY_VERTEX_ARRAY_BITS 12
+
+struct DrawCmd {
+    unsigned int program;       // GL names, resolved at submit time
+    unsigned int texture;
+    unsigned int vertex_array;
+    unsigned int mesh;  // the caller's index of the mesh drawn, for CPU paths
+    int first;
+    int count;
+    // meshlet draws in the frame's indirect command list; when
+    // indirect_count is nonzero they replace first and count
+    int indirect_first;
+    int indirect_count;
+    glm::mat4 model;
+};
+
+struct SortItem {
+    uint64_t key;
+    uint32_t cmd;  // index into the command list
+};
+
+struct StateChanges {
+    unsigned int programs;
+    unsigned int materials;
+    unsigned int vertex_arrays;
+};
+
+// pack slot indices (not GL names) and view depth into a sort key; depth
+// must be >= 0 so its float bits order like the value
+uint64_t makeSortKey(unsigned int program, unsigned int material,
+                     unsigned int vertex_array, float depth);
+
+// LSD radix sort by key, 8 bits per pass; passes where every key has the
+// same byte are skipped
+void radixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch);
+
+class RenderQueue {
+   public:
+    void clear();
+    void push(const DrawCmd& cmd, unsigned int program_slot,
+              unsigned int material_slot, unsigned int vertex_array_slot,
+              float depth);
+    void sort();
+
+    size_t size() const { return items.size(); }
+    const DrawCmd& operator[](size_t i) const { return cmds[items[i].cmd]; }
+
+    // state transitions when submitting in the current order
+    StateChanges countStateChanges() const;
+
+   private:
+    std::vector<DrawCmd> cmds;
+    std::vector<SortItem> items;
+    std::vector<SortItem> scratch;
+};
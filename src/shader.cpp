@@ -0,0 +1,259 @@
+#include "shader.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+using namespace std;
+
+#include "frame-data.hpp"
+#include "trace.hpp"
+
+// reflection results of every program linked through LoadShaders
+static vector<ProgramInfo> programs;
+
+static bool uniformLess(const UniformInfo& a, const UniformInfo& b) {
+    return a.name < b.name;
+}
+
+const UniformInfo* ProgramInfo::findUniform(const char* name) const {
+    int lo = 0, hi = (int)uniforms.size() - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(uniforms[mid].name.c_str(), name);
+        if (cmp == 0) return &uniforms[mid];
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return NULL;
+}
+
+const UniformBlockInfo* ProgramInfo::findBlock(const char* name) const {
+    for (unsigned int i = 0; i < blocks.size(); ++i) {
+        if (blocks[i].name == name) return &blocks[i];
+    }
+    return NULL;
+}
+
+GLuint LoadShaders(const char* vertex_file_path,
+                   const char* fragment_file_path) {
+    TRACE_SCOPE("LoadShaders");
+    GLuint v_shader_id = glCreateShader(GL_VERTEX_SHADER);
+    GLuint f_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
+
+    string v_shader_code;
+    ifstream v_shader_stream(vertex_file_path, ios::in);
+    if (v_shader_stream.is_open()) {
+        string line = "";
+        while (getline(v_shader_stream, line)) {
+            v_shader_code += "\n" + line;
+        }
+        v_shader_stream.close();
+    } else {
+        fprintf(stderr, "Failed to open shader.\n");
+        return 0;
+    }
+
+    string f_shader_code;
+    ifstream f_shader_stream(fragment_file_path, ios::in);
+    if (f_shader_stream.is_open()) {
+        string line = "";
+        while (getline(f_shader_stream, line)) f_shader_code += "\n" + line;
+        f_shader_stream.close();
+    }
+
+    GLint result = GL_FALSE;
+    int info_log_len;
+
+    char const* v_source_ptr = v_shader_code.c_str();
+    glShaderSource(v_shader_id, 1, &v_source_ptr, NULL);
+    glCompileShader(v_shader_id);
+
+    glGetShaderiv(v_shader_id, GL_COMPILE_STATUS, &result);
+    glGetShaderiv(v_shader_id, GL_INFO_LOG_LENGTH, &info_log_len);
+    if (info_log_len > 0) {
+        vector<char> v_shader_errmsg(info_log_len + 1);
+        glGetShaderInfoLog(v_shader_id, info_log_len, NULL,
+                           &v_shader_errmsg[0]);
+        fprintf(stderr, "%s\n", &v_shader_errmsg[0]);
+    }
+
+    char const* f_source_ptr = f_shader_code.c_str();
+    glShaderSource(f_shader_id, 1, &f_source_ptr, NULL);
+    glCompileShader(f_shader_id);
+
+    glGetShaderiv(f_shader_id, GL_COMPILE_STATUS, &result);
+    glGetShaderiv(f_shader_id, GL_INFO_LOG_LENGTH, &info_log_len);
+    if (info_log_len > 0) {
+        vector<char> f_shader_errmsg(info_log_len + 1);
+        glGetShaderInfoLog(f_shader_id, info_log_len, NULL,
+                           &f_shader_errmsg[0]);
+        fprintf(stderr, "%s\n", &f_shader_errmsg[0]);
+    }
+
+    GLuint prog_id = glCreateProgram();
+    glAttachShader(prog_id, v_shader_id);
+    glAttachShader(prog_id, f_shader_id);
+    glLinkProgram(prog_id);
+
+    glGetProgramiv(prog_id, GL_LINK_STATUS, &result);
+    glGetProgramiv(prog_id, GL_INFO_LOG_LENGTH, &info_log_len);
+    if (info_log_len > 0) {
+        vector<char> prog_errmsg(info_log_len + 1);
+        glGetProgramInfoLog(prog_id, info_log_len, NULL, &prog_errmsg[0]);
+        fprintf(stderr, "%s\n", &prog_errmsg[0]);
+    }
+
+    glDetachShader(prog_id, v_shader_id);
+    glDetachShader(prog_id, f_shader_id);
+
+    glDeleteShader(v_shader_id);
+    glDeleteShader(f_shader_id);
+
+    if (result == GL_TRUE) reflectProgram(prog_id);
+
+    return prog_id;
+}
+
+// GL 4.3 program interface query
+static void reflectResources(GLuint prog_id, ProgramInfo& info) {
+    GLint cnt = 0;
+    glGetProgramInterfaceiv(prog_id, GL_UNIFORM, GL_ACTIVE_RESOURCES, &cnt);
+    const GLenum props[] = {GL_NAME_LENGTH, GL_TYPE,        GL_ARRAY_SIZE,
+                            GL_LOCATION,    GL_BLOCK_INDEX, GL_OFFSET};
+    for (GLint i = 0; i < cnt; ++i) {
+        GLint vals[6];
+        glGetProgramResourceiv(prog_id, GL_UNIFORM, i, 6, props, 6, NULL,
+                               vals);
+        vector<char> name(vals[0] + 1);
+        glGetProgramResourceName(prog_id, GL_UNIFORM, i, vals[0] + 1, NULL,
+                                 &name[0]);
+
+        UniformInfo u;
+        u.name = &name[0];
+        u.type = vals[1];
+        u.size = vals[2];
+        u.location = vals[3];
+        u.block = vals[4];
+        u.offset = vals[5];
+        info.uniforms.push_back(u);
+    }
+
+    glGetProgramInterfaceiv(prog_id, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES,
+                            &cnt);
+    const GLenum block_props[] = {GL_NAME_LENGTH, GL_BUFFER_DATA_SIZE};
+    for (GLint i = 0; i < cnt; ++i) {
+        GLint vals[2];
+        glGetProgramResourceiv(prog_id, GL_UNIFORM_BLOCK, i, 2, block_props,
+                               2, NULL, vals);
+        vector<char> name(vals[0] + 1);
+        glGetProgramResourceName(prog_id, GL_UNIFORM_BLOCK, i, vals[0] + 1,
+                                 NULL, &name[0]);
+
+        UniformBlockInfo b;
+        b.name = &name[0];
+        b.data_size = vals[1];
+        b.binding = 0;
+        info.blocks.push_back(b);
+    }
+}
+
+// GL 3.x introspection
+static void reflectActive(GLuint prog_id, ProgramInfo& info) {
+    GLint cnt = 0, max_len = 0;
+    glGetProgramiv(prog_id, GL_ACTIVE_UNIFORMS, &cnt);
+    glGetProgramiv(prog_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_len);
+    vector<char> name(max_len + 1);
+    for (GLint i = 0; i < cnt; ++i) {
+        GLuint idx = i;
+        GLsizei len = 0;
+        UniformInfo u;
+        glGetActiveUniform(prog_id, idx, max_len + 1, &len, &u.size, &u.type,
+                           &name[0]);
+        u.name.assign(&name[0], len);
+        u.location = glGetUniformLocation(prog_id, u.name.c_str());
+        glGetActiveUniformsiv(prog_id, 1, &idx, GL_UNIFORM_BLOCK_INDEX,
+                              &u.block);
+        glGetActiveUniformsiv(prog_id, 1, &idx, GL_UNIFORM_OFFSET, &u.offset);
+        info.uniforms.push_back(u);
+    }
+
+    glGetProgramiv(prog_id, GL_ACTIVE_UNIFORM_BLOCKS, &cnt);
+    glGetProgramiv(prog_id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                   &max_len);
+    name.resize(max_len + 1);
+    for (GLint i = 0; i < cnt; ++i) {
+        GLsizei len = 0;
+        UniformBlockInfo b;
+        glGetActiveUniformBlockName(prog_id, i, max_len + 1, &len, &name[0]);
+        b.name.assign(&name[0], len);
+        glGetActiveUniformBlockiv(prog_id, i, GL_UNIFORM_BLOCK_DATA_SIZE,
+                                  &b.data_size);
+        b.binding = 0;
+        info.blocks.push_back(b);
+    }
+}
+
+bool reflectProgram(GLuint prog_id) {
+    forgetProgram(prog_id);
+
+    ProgramInfo info;
+    info.id = prog_id;
+    if (GLEW_VERSION_4_3 || GLEW_ARB_program_interface_query) {
+        reflectResources(prog_id, info);
+    } else {
+        reflectActive(prog_id, info);
+    }
+    sort(info.uniforms.begin(), info.uniforms.end(), uniformLess);
+
+    // shared blocks get fixed binding points so a program switch never
+    // needs the view data re-uploaded or rebound
+    for (unsigned int i = 0; i < info.blocks.size(); ++i) {
+        UniformBlockInfo& b = info.blocks[i];
+        GLint expected = 0;
+        if (b.name == "ViewData") {
+            b.binding = VIEW_DATA_BINDING;
+            expected = sizeof(ViewData);
+        } else if (b.name == "DrawData") {
+            b.binding = DRAW_DATA_BINDING;
+            expected = sizeof(DrawData);
+        } else {
+            fprintf(stderr, "Unknown uniform block %s.\n", b.name.c_str());
+            continue;
+        }
+        if (b.data_size != expected) {
+            fprintf(stderr, "Uniform block %s is %d bytes, expected %d.\n",
+                    b.name.c_str(), b.data_size, expected);
+        }
+        glUniformBlockBinding(prog_id, i, b.binding);
+    }
+
+    programs.push_back(info);
+    return true;
+}
+
+void forgetProgram(GLuint prog_id) {
+    for (unsigned int i = 0; i < programs.size(); ++i) {
+        if (programs[i].id == prog_id) {
+            programs.erase(programs.begin() + i);
+            return;
+        }
+    }
+}
+
+const ProgramInfo* getProgramInfo(GLuint prog_id) {
+    for (unsigned int i = 0; i < programs.size(); ++i) {
+        if (programs[i].id == prog_id) return &programs[i];
+    }
+    return NULL;
+}
+
+GLint getUniformLocation(GLuint prog_id, const char* name) {
+    const ProgramInfo* info = getProgramInfo(prog_id);
+    if (info == NULL) return -1;
+    const UniformInfo* u = info->findUniform(name);
+    return u ? u->location : -1;
+}
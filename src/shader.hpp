@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+struct UniformInfo {
+    std::string name;
+    GLenum type;
+    GLint size;      // array size, 1 for scalars
+    GLint location;  // -1 for uniform block members
+    GLint block;     // uniform block index, -1 for loose uniforms
+    GLint offset;    // byte offset inside the block
+};
+
+struct UniformBlockInfo {
+    std::string name;
+    GLint data_size;
+    GLuint binding;
+};
+
+// Active uniforms of a linked program, sorted by name so lookups do not
+// have to go back to the driver.
+struct ProgramInfo {
+    GLuint id;
+    std::vector<UniformInfo> uniforms;
+    std::vector<UniformBlockInfo> blocks;
+
+    const UniformInfo* findUniform(const char* name) const;
+    const UniformBlockInfo* findBlock(const char* name) const;
+};
+
+GLuint LoadShaders(const char* vertex_file_path,
+                   const char* fragment_file_path);
+
+// reflect a linked program and bind its known uniform blocks to the shared
+// binding points; called by LoadShaders
+bool reflectProgram(GLuint prog_id);
+void forgetProgram(GLuint prog_id);
+
+const ProgramInfo* getProgramInfo(GLuint prog_id);
+GLint getUniformLocation(GLuint prog_id, const char* name);
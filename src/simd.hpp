@@ -0,0 +1,182 @@
+#pragma once
+
+// Minimal float vector for the SIMD kernels: 8 lanes with AVX, 4 with SSE,
+// 4 emulated lanes elsewhere. Comparisons return lane masks that
+// select(), movemask() and the bitwise operators understand.
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_AVX
+#define SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || _M_IX86_FP >= 2
+#include <emmintrin.h>
+#define SIMD_SSE
+#define SIMD_WIDTH 4
+#else
+#include <math.h>
+#define SIMD_SCALAR
+#define SIMD_WIDTH 4
+#endif
+
+#if defined(SIMD_AVX)
+
+struct vfloat {
+    __m256 v;
+    vfloat() {}
+    vfloat(__m256 x) : v(x) {}
+    explicit vfloat(float x) : v(_mm256_set1_ps(x)) {}
+};
+
+inline vfloat vload(const float* p) { return _mm256_loadu_ps(p); }
+inline void vstore(float* p, vfloat a) { _mm256_storeu_ps(p, a.v); }
+inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v, b.v); }
+inline vfloat operator&(vfloat a, vfloat b) { return _mm256_and_ps(a.v, b.v); }
+inline vfloat operator|(vfloat a, vfloat b) { return _mm256_or_ps(a.v, b.v); }
+inline vfloat vsqrt(vfloat a) { return _mm256_sqrt_ps(a.v); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a.v, b.v); }
+inline vfloat operator<(vfloat a, vfloat b) {
+    return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ);
+}
+inline vfloat operator<=(vfloat a, vfloat b) {
+    return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ);
+}
+inline vfloat operator>=(vfloat a, vfloat b) {
+    return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ);
+}
+inline vfloat andnot(vfloat mask, vfloat a) {
+    return _mm256_andnot_ps(mask.v, a.v);
+}
+inline vfloat select(vfloat mask, vfloat a, vfloat b) {
+    return _mm256_blendv_ps(b.v, a.v, mask.v);
+}
+inline int movemask(vfloat mask) { return _mm256_movemask_ps(mask.v); }
+inline vfloat vabs(vfloat a) {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v);
+}
+
+#elif defined(SIMD_SSE)
+
+struct vfloat {
+    __m128 v;
+    vfloat() {}
+    vfloat(__m128 x) : v(x) {}
+    explicit vfloat(float x) : v(_mm_set1_ps(x)) {}
+};
+
+inline vfloat vload(const float* p) { return _mm_loadu_ps(p); }
+inline void vstore(float* p, vfloat a) { _mm_storeu_ps(p, a.v); }
+inline vfloat operator+(vfloat a, vfloat b) { return _mm_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm_div_ps(a.v, b.v); }
+inline vfloat operator&(vfloat a, vfloat b) { return _mm_and_ps(a.v, b.v); }
+inline vfloat operator|(vfloat a, vfloat b) { return _mm_or_ps(a.v, b.v); }
+inline vfloat vsqrt(vfloat a) { return _mm_sqrt_ps(a.v); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a.v, b.v); }
+inline vfloat operator<(vfloat a, vfloat b) { return _mm_cmplt_ps(a.v, b.v); }
+inline vfloat operator<=(vfloat a, vfloat b) { return _mm_cmple_ps(a.v, b.v); }
+inline vfloat operator>=(vfloat a, vfloat b) { return _mm_cmpge_ps(a.v, b.v); }
+inline vfloat andnot(vfloat mask, vfloat a) {
+    return _mm_andnot_ps(mask.v, a.v);
+}
+inline vfloat select(vfloat mask, vfloat a, vfloat b) {
+    return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+inline int movemask(vfloat mask) { return _mm_movemask_ps(mask.v); }
+inline vfloat vabs(vfloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+
+#else
+
+struct vfloat {
+    float v[SIMD_WIDTH];
+    vfloat() {}
+    explicit vfloat(float x) {
+        for (int i = 0; i < SIMD_WIDTH; ++i) v[i] = x;
+    }
+};
+
+inline uint32_t vbits(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+inline float vfrombits(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+#define SIMD_LANEWISE(expr)                                  \
+    vfloat r;                                                \
+    for (int i = 0; i < SIMD_WIDTH; ++i) r.v[i] = (expr);    \
+    return r
+
+#define SIMD_MASK(cond) vfrombits((cond) ? 0xffffffffu : 0u)
+
+inline vfloat vload(const float* p) { SIMD_LANEWISE(p[i]); }
+inline void vstore(float* p, vfloat a) {
+    for (int i = 0; i < SIMD_WIDTH; ++i) p[i] = a.v[i];
+}
+inline vfloat operator+(vfloat a, vfloat b) { SIMD_LANEWISE(a.v[i] + b.v[i]); }
+inline vfloat operator-(vfloat a, vfloat b) { SIMD_LANEWISE(a.v[i] - b.v[i]); }
+inline vfloat operator*(vfloat a, vfloat b) { SIMD_LANEWISE(a.v[i] * b.v[i]); }
+inline vfloat operator/(vfloat a, vfloat b) { SIMD_LANEWISE(a.v[i] / b.v[i]); }
+inline vfloat operator&(vfloat a, vfloat b) {
+    SIMD_LANEWISE(vfrombits(vbits(a.v[i]) & vbits(b.v[i])));
+}
+inline vfloat operator|(vfloat a, vfloat b) {
+    SIMD_LANEWISE(vfrombits(vbits(a.v[i]) | vbits(b.v[i])));
+}
+inline vfloat vsqrt(vfloat a) { SIMD_LANEWISE(sqrtf(a.v[i])); }
+inline vfloat vmin(vfloat a, vfloat b) {
+    SIMD_LANEWISE(a.v[i] < b.v[i] ? a.v[i] : b.v[i]);
+}
+inline vfloat vmax(vfloat a, vfloat b) {
+    SIMD_LANEWISE(a.v[i] > b.v[i] ? a.v[i] : b.v[i]);
+}
+inline vfloat operator<(vfloat a, vfloat b) {
+    SIMD_LANEWISE(SIMD_MASK(a.v[i] < b.v[i]));
+}
+inline vfloat operator<=(vfloat a, vfloat b) {
+    SIMD_LANEWISE(SIMD_MASK(a.v[i] <= b.v[i]));
+}
+inline vfloat operator>=(vfloat a, vfloat b) {
+    SIMD_LANEWISE(SIMD_MASK(a.v[i] >= b.v[i]));
+}
+inline vfloat andnot(vfloat mask, vfloat a) {
+    SIMD_LANEWISE(vfrombits(~vbits(mask.v[i]) & vbits(a.v[i])));
+}
+inline vfloat select(vfloat mask, vfloat a, vfloat b) {
+    SIMD_LANEWISE(vbits(mask.v[i]) ? a.v[i] : b.v[i]);
+}
+inline int movemask(vfloat mask) {
+    int m = 0;
+    for (int i = 0; i < SIMD_WIDTH; ++i) m |= (vbits(mask.v[i]) >> 31) << i;
+    return m;
+}
+inline vfloat vabs(vfloat a) { SIMD_LANEWISE(a.v[i] < 0 ? -a.v[i] : a.v[i]); }
+
+#undef SIMD_LANEWISE
+#undef SIMD_MASK
+
+#endif
+
+#define SIMD_ALL_LANES ((1 << SIMD_WIDTH) - 1)
+
+inline const char* simdName() {
+#if defined(SIMD_AVX)
+    return "avx";
+#elif defined(SIMD_SSE)
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
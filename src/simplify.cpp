@@ -0,0 +1,375 @@
+#include "simplify.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+using namespace std;
+using namespace glm;
+
+#include "parallel.hpp"
+#include "trace.hpp"
+
+#define SIMPLIFY_GRAIN 4096
+// border planes are weighted this much above surface planes
+#define BORDER_WEIGHT 10.0
+// normal and uv differences are scaled by the squared collapse length
+#define ATTRIBUTE_WEIGHT 1.0f
+// chains stop below this many triangles
+#define LOD_MIN_TRIANGLES 16
+
+namespace {
+
+enum VertexKind {
+    KIND_MANIFOLD,  // free to collapse into any neighbour
+    KIND_BORDER,    // only along its border edges, into border vertices
+    KIND_LOCKED,    // seams, non-manifold and complex border vertices
+};
+
+// area weighted sum of squared plane distances, w is the total weight
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double w;
+};
+
+void addPlane(Quadric& q, const dvec3& n, double d, double w) {
+    q.a00 += w * n.x * n.x;
+    q.a01 += w * n.x * n.y;
+    q.a02 += w * n.x * n.z;
+    q.a11 += w * n.y * n.y;
+    q.a12 += w * n.y * n.z;
+    q.a22 += w * n.z * n.z;
+    q.b0 += w * n.x * d;
+    q.b1 += w * n.y * d;
+    q.b2 += w * n.z * d;
+    q.c += w * d * d;
+    q.w += w;
+}
+
+void addQuadric(Quadric& q, const Quadric& o) {
+    q.a00 += o.a00;
+    q.a01 += o.a01;
+    q.a02 += o.a02;
+    q.a11 += o.a11;
+    q.a12 += o.a12;
+    q.a22 += o.a22;
+    q.b0 += o.b0;
+    q.b1 += o.b1;
+    q.b2 += o.b2;
+    q.c += o.c;
+    q.w += o.w;
+}
+
+double evalQuadric(const Quadric& q, const vec3& p) {
+    double x = p.x, y = p.y, z = p.z;
+    double r = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+               2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+               2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+    return fabs(r);
+}
+
+inline uint64_t edgeKey(uint32_t a, uint32_t b) {
+    return (uint64_t(a) << 32) | b;
+}
+
+struct Collapse {
+    uint32_t v;      // removed vertex
+    uint32_t t;      // vertex it merges into
+    float cost;      // squared distance plus the attribute penalty
+    float distance;  // squared object space distance alone
+    bool operator<(const Collapse& o) const { return cost < o.cost; }
+};
+
+struct Simplifier {
+    const IndexedMesh* mesh;
+    vector<uint32_t> pos_id;  // vertex -> welded position
+    vector<uint32_t> wedges;  // vertices per welded position
+    vector<Quadric> quadrics;  // accumulated since init, so errors are
+                               // measured against the input of init
+    float reached;             // largest distance collapsed so far
+
+    // per pass topology, of the index list last classified
+    vector<uint64_t> half_edges;  // sorted, in welded position space
+    vector<unsigned char> kinds;  // per welded position
+    VertexAdjacency adj;
+    bool stale;  // the list was compacted since, by this or an earlier run
+
+    bool hasHalfEdge(uint32_t pa, uint32_t pb) const {
+        return binary_search(half_edges.begin(), half_edges.end(),
+                             edgeKey(pa, pb));
+    }
+    bool isBorderEdge(uint32_t pa, uint32_t pb) const {
+        return hasHalfEdge(pa, pb) != hasHalfEdge(pb, pa);
+    }
+
+    void init(const IndexedMesh& m, const vector<uint32_t>& indices);
+    void run(vector<uint32_t>& indices, size_t target_index_cnt,
+             float max_error);
+
+    void classify(const vector<uint32_t>& indices);
+    void computeQuadrics(const vector<uint32_t>& indices);
+    bool flips(const vector<uint32_t>& indices, uint32_t v, uint32_t t) const;
+    Collapse evaluate(const vector<uint32_t>& indices, uint32_t v,
+                      uint32_t t) const;
+};
+
+void Simplifier::classify(const vector<uint32_t>& indices) {
+    size_t pos_cnt = wedges.size();
+    half_edges.resize(indices.size());
+    for (size_t c = 0; c < indices.size(); ++c) {
+        size_t next = c - c % 3 + (c + 1) % 3;
+        half_edges[c] = edgeKey(pos_id[indices[c]], pos_id[indices[next]]);
+    }
+    sort(half_edges.begin(), half_edges.end());
+
+    vector<unsigned char> border_out(pos_cnt), border_in(pos_cnt);
+    kinds.assign(pos_cnt, KIND_MANIFOLD);
+    for (size_t i = 0; i < half_edges.size(); ++i) {
+        uint32_t pa = half_edges[i] >> 32, pb = uint32_t(half_edges[i]);
+        if (i + 1 < half_edges.size() && half_edges[i + 1] == half_edges[i]) {
+            kinds[pa] = kinds[pb] = KIND_LOCKED;  // non-manifold edge
+        }
+        if (!hasHalfEdge(pb, pa)) {
+            border_out[pa] = std::min(border_out[pa] + 1, 2);
+            border_in[pb] = std::min(border_in[pb] + 1, 2);
+        }
+    }
+    for (size_t p = 0; p < pos_cnt; ++p) {
+        if (wedges[p] > 1) kinds[p] = KIND_LOCKED;  // attribute seam
+        if (kinds[p] == KIND_LOCKED || (!border_out[p] && !border_in[p])) {
+            continue;
+        }
+        // a single border loop passes through, anything else is complex
+        bool simple = border_out[p] == 1 && border_in[p] == 1;
+        kinds[p] = simple ? KIND_BORDER : KIND_LOCKED;
+    }
+    buildAdjacency(indices, mesh->positions.size(), adj);
+}
+
+void Simplifier::computeQuadrics(const vector<uint32_t>& indices) {
+    const vector<vec3>& p = mesh->positions;
+    Quadric zero = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    quadrics.assign(p.size(), zero);
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        dvec3 p0(p[indices[t]]), p1(p[indices[t + 1]]), p2(p[indices[t + 2]]);
+        dvec3 n = cross(p1 - p0, p2 - p0);
+        double len = length(n);
+        if (len == 0.0) continue;
+        n /= len;
+        double area = len * 0.5;
+        for (int k = 0; k < 3; ++k) {
+            addPlane(quadrics[indices[t + k]], n, -dot(n, p0), area);
+        }
+
+        // planes through border edges, perpendicular to the face, keep
+        // borders from shrinking
+        for (int k = 0; k < 3; ++k) {
+            uint32_t a = indices[t + k], b = indices[t + (k + 1) % 3];
+            if (!isBorderEdge(pos_id[a], pos_id[b])) continue;
+            dvec3 pa(p[a]), pb(p[b]);
+            dvec3 e = pb - pa;
+            dvec3 bn = cross(e, n);
+            double bl = length(bn);
+            if (bl == 0.0) continue;
+            bn /= bl;
+            double w = dot(e, e) * BORDER_WEIGHT;
+            addPlane(quadrics[a], bn, -dot(bn, pa), w);
+            addPlane(quadrics[b], bn, -dot(bn, pa), w);
+        }
+    }
+}
+
+// would moving v onto t turn any of v's remaining triangles over
+bool Simplifier::flips(const vector<uint32_t>& indices, uint32_t v,
+                       uint32_t t) const {
+    const vector<vec3>& p = mesh->positions;
+    for (uint32_t k = adj.offsets[v]; k < adj.offsets[v + 1]; ++k) {
+        uint32_t c = adj.corners[k];
+        size_t base = c - c % 3;
+        uint32_t a = indices[base + (c + 1) % 3];
+        uint32_t b = indices[base + (c + 2) % 3];
+        if (a == t || b == t) continue;  // collapses away
+        vec3 n0 = cross(p[a] - p[v], p[b] - p[v]);
+        vec3 n1 = cross(p[a] - p[t], p[b] - p[t]);
+        if (dot(n0, n1) <= 0.0f) return true;
+    }
+    return false;
+}
+
+Collapse Simplifier::evaluate(const vector<uint32_t>& indices, uint32_t v,
+                              uint32_t t) const {
+    Collapse c = {v, t, FLT_MAX, FLT_MAX};
+    unsigned char kv = kinds[pos_id[v]], kt = kinds[pos_id[t]];
+    if (kv == KIND_LOCKED || pos_id[v] == pos_id[t]) return c;
+    if (kv == KIND_BORDER &&
+        (kt == KIND_MANIFOLD || !isBorderEdge(pos_id[v], pos_id[t]))) {
+        return c;
+    }
+    if (flips(indices, v, t)) return c;
+
+    const vec3& pt = mesh->positions[t];
+    const Quadric& qv = quadrics[v];
+    const Quadric& qt = quadrics[t];
+    double w = qv.w + qt.w;
+    double distance = (evalQuadric(qv, pt) + evalQuadric(qt, pt)) /
+                      (w > 0.0 ? w : 1.0);
+
+    // shading changes matter too but are not geometric error
+    vec3 d = pt - mesh->positions[v];
+    float attr = 0.0f;
+    if (!mesh->normals.empty()) {
+        vec3 dn = mesh->normals[t] - mesh->normals[v];
+        attr += dot(dn, dn);
+    }
+    if (!mesh->uvs.empty()) {
+        vec2 du = mesh->uvs[t] - mesh->uvs[v];
+        attr += dot(du, du);
+    }
+    c.distance = float(distance);
+    c.cost = float(distance + ATTRIBUTE_WEIGHT * attr * dot(d, d));
+    return c;
+}
+
+void Simplifier::init(const IndexedMesh& m, const vector<uint32_t>& indices) {
+    mesh = &m;
+    size_t vertex_cnt = m.positions.size();
+    uint32_t pos_cnt = weldVertices(&m.positions[0], vertex_cnt, sizeof(vec3),
+                                    pos_id);
+    wedges.assign(pos_cnt, 0);
+    for (size_t v = 0; v < vertex_cnt; ++v) ++wedges[pos_id[v]];
+    classify(indices);
+    stale = false;
+    computeQuadrics(indices);
+    reached = 0.0f;
+}
+
+void Simplifier::run(vector<uint32_t>& out, size_t target_index_cnt,
+                     float max_error) {
+    size_t vertex_cnt = mesh->positions.size();
+    double max_distance = double(max_error) * max_error;
+    vector<uint32_t> remap(vertex_cnt);
+    vector<unsigned char> touched(vertex_cnt);
+    vector<uint64_t> edges;
+    vector<Collapse> collapses;
+    while (out.size() > target_index_cnt) {
+        if (stale) {
+            classify(out);  // topology changed
+            stale = false;
+        }
+
+        // unique edges, each evaluated in both directions
+        edges.resize(out.size());
+        for (size_t c = 0; c < out.size(); ++c) {
+            uint32_t a = out[c], b = out[c - c % 3 + (c + 1) % 3];
+            edges[c] = a < b ? edgeKey(a, b) : edgeKey(b, a);
+        }
+        sort(edges.begin(), edges.end());
+        edges.erase(unique(edges.begin(), edges.end()), edges.end());
+
+        collapses.resize(edges.size());
+        parallelFor(0, edges.size(), SIMPLIFY_GRAIN, [&](size_t lo,
+                                                         size_t hi) {
+            for (size_t e = lo; e < hi; ++e) {
+                uint32_t a = edges[e] >> 32, b = uint32_t(edges[e]);
+                Collapse ab = evaluate(out, a, b), ba = evaluate(out, b, a);
+                collapses[e] = ba.cost < ab.cost ? ba : ab;
+            }
+        });
+        sort(collapses.begin(), collapses.end());
+
+        // cheapest first; each collapse freezes the ring around it so the
+        // flip checks above stay valid for the rest of the pass
+        size_t tri_cnt = out.size() / 3, target_tris = target_index_cnt / 3;
+        size_t pass_goal = (tri_cnt - target_tris + 1) / 2;
+        size_t applied = 0;
+        for (size_t v = 0; v < vertex_cnt; ++v) remap[v] = v;
+        fill(touched.begin(), touched.end(), 0);
+        for (size_t i = 0; i < collapses.size() && applied < pass_goal; ++i) {
+            const Collapse& c = collapses[i];
+            if (c.cost == FLT_MAX) break;
+            if (c.distance > max_distance) continue;
+            if (touched[c.v] || touched[c.t]) continue;
+            remap[c.v] = c.t;
+            addQuadric(quadrics[c.t], quadrics[c.v]);
+            reached = std::max(reached, sqrt(c.distance));
+            touched[c.t] = 1;
+            for (uint32_t k = adj.offsets[c.v]; k < adj.offsets[c.v + 1];
+                 ++k) {
+                uint32_t corner = adj.corners[k];
+                size_t base = corner - corner % 3;
+                touched[out[base]] = touched[out[base + 1]] =
+                    touched[out[base + 2]] = 1;
+            }
+            ++applied;
+        }
+        if (applied == 0) break;
+
+        size_t kept = 0;
+        for (size_t t = 0; t + 2 < out.size(); t += 3) {
+            uint32_t a = remap[out[t]], b = remap[out[t + 1]];
+            uint32_t c = remap[out[t + 2]];
+            if (a == b || b == c || c == a) continue;
+            out[kept++] = a;
+            out[kept++] = b;
+            out[kept++] = c;
+        }
+        out.resize(kept);
+        stale = true;
+    }
+}
+
+}  // namespace
+
+float simplifyMesh(const IndexedMesh& mesh, const vector<uint32_t>& indices,
+                   size_t target_index_cnt, float max_error,
+                   vector<uint32_t>& out) {
+    out = indices;
+    if (mesh.positions.empty() || indices.size() <= target_index_cnt) {
+        return 0.0f;
+    }
+    Simplifier s;
+    s.init(mesh, out);
+    s.run(out, target_index_cnt, max_error);
+    return s.reached;
+}
+
+void buildLODChain(const IndexedMesh& mesh, LODChain& chain, int max_levels,
+                   float ratio) {
+    TRACE_SCOPE("buildLODChain");
+    chain.indices = mesh.indices;
+    chain.levels.clear();
+    LODLevel base = {0, uint32_t(mesh.indices.size()), 0.0f};
+    chain.levels.push_back(base);
+    if (mesh.positions.empty()) return;
+
+    // one progressive run with a snapshot per level, so every level's
+    // error is measured against the full mesh
+    Simplifier s;
+    s.init(mesh, mesh.indices);
+    vector<uint32_t> current = mesh.indices;
+    while ((int)chain.levels.size() < max_levels) {
+        size_t prev_cnt = current.size();
+        size_t target = size_t(prev_cnt / 3 * ratio) * 3;
+        if (target < LOD_MIN_TRIANGLES * 3) break;
+        s.run(current, target, FLT_MAX);
+        if (current.size() > prev_cnt * 9 / 10) break;  // stuck
+
+        LODLevel level = {uint32_t(chain.indices.size()),
+                          uint32_t(current.size()), s.reached};
+        chain.levels.push_back(level);
+        chain.indices.insert(chain.indices.end(), current.begin(),
+                             current.end());
+    }
+}
+
+int selectLOD(const vector<LODLevel>& levels, float distance,
+              float proj_scale, float pixel_error) {
+    distance = std::max(distance, 1e-6f);
+    for (int l = int(levels.size()) - 1; l > 0; --l) {
+        if (levels[l].error * proj_scale / distance <= pixel_error) {
+            return l;
+        }
+    }
+    return 0;
+}
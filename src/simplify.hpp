@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh-index.hpp"
+
+#define LOD_MAX_LEVELS 8
+// each level aims for this fraction of the previous level's triangles
+#define LOD_RATIO 0.5f
+
+// Garland-Heckbert quadric simplification by half edge collapses, so the
+// result indexes the same vertex buffer. Normal and uv differences along a
+// collapse add to its error, border edges get extra plane quadrics, and
+// vertices on uv or normal seams or non-manifold edges never move. Stops at
+// target_index_cnt or when the next collapse would exceed max_error (object
+// space distance). Returns the distance reached; the attribute terms only
+// order the collapses.
+float simplifyMesh(const IndexedMesh& mesh,
+                   const std::vector<uint32_t>& indices,
+                   size_t target_index_cnt, float max_error,
+                   std::vector<uint32_t>& out);
+
+struct LODLevel {
+    uint32_t first;  // offset into LODChain::indices
+    uint32_t count;
+    float error;  // object space distance bound to the full mesh
+};
+
+// all levels share one index buffer, level 0 is the mesh itself
+struct LODChain {
+    std::vector<uint32_t> indices;
+    std::vector<LODLevel> levels;
+};
+
+// one progressive simplification with a snapshot per level, until a level
+// shrinks by less than a tenth or max_levels is reached
+void buildLODChain(const IndexedMesh& mesh, LODChain& chain,
+                   int max_levels = LOD_MAX_LEVELS, float ratio = LOD_RATIO);
+
+// pixels per object space unit at distance 1 for a projection matrix
+inline float lodProjScale(const glm::mat4& p_mat, float viewport_height) {
+    return p_mat[1][1] * viewport_height * 0.5f;
+}
+
+// coarsest level whose error projects to at most pixel_error pixels when
+// seen from distance
+int selectLOD(const std::vector<LODLevel>& levels, float distance,
+              float proj_scale, float pixel_error = 1.0f);
@@ -0,0 +1,583 @@
+#include "soft-raster.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+using namespace glm;
+
+#include "parallel.hpp"
+#include "raster.hpp"
+#include "simd.hpp"
+#include "trace.hpp"
+
+#define RASTER_VERTEX_GRAIN 4096
+// triangles per binning chunk at least, so small frames stay on one thread
+#define RASTER_MIN_CHUNK 1024
+// chunk index and triangle share a 32 bit id: 8 bits chunk, 24 bits index
+#define RASTER_MAX_CHUNKS 255
+// near clipping bins a triangle as at most two, so chunks of up to this
+// many triangles keep their binned indices within the 24 bits
+#define RASTER_MAX_CHUNK_TRIS (1 << 23)
+#define RASTER_EMPTY 0xffffffffu
+// triangles rasterized into a tile between refreshes of its far depth
+#define RASTER_FAR_REFRESH 16
+// margin for the depth of block and tile rejection against float error
+#define RASTER_Z_EPS 1e-6f
+
+// StandardShading.fragmentshader constants
+#define LIGHT_POWER 50.0f
+#define AMBIENT_FACTOR 0.1f
+#define SPECULAR_COLOR 0.3f
+
+#define BLOCKS_PER_TILE (RASTER_TILE_SIZE / RASTER_BLOCK_SIZE)
+
+namespace {
+
+double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+// clip space outcodes
+enum {
+    OUT_LEFT = 1,
+    OUT_RIGHT = 2,
+    OUT_BOTTOM = 4,
+    OUT_TOP = 8,
+    OUT_NEAR = 16,
+    OUT_FAR = 32,
+};
+
+inline int outcode(const vec4& c) {
+    return (c.x < -c.w) * OUT_LEFT | (c.x > c.w) * OUT_RIGHT |
+           (c.y < -c.w) * OUT_BOTTOM | (c.y > c.w) * OUT_TOP |
+           (c.z < -c.w) * OUT_NEAR | (c.z > c.w) * OUT_FAR;
+}
+
+inline float idToFloat(uint32_t id) {
+    float f;
+    memcpy(&f, &id, sizeof(f));
+    return f;
+}
+
+inline uint32_t floatToId(float f) {
+    uint32_t id;
+    memcpy(&id, &f, sizeof(id));
+    return id;
+}
+
+inline uint32_t packColor(float r, float g, float b) {
+    r = std::min(std::max(r, 0.0f), 1.0f);
+    g = std::min(std::max(g, 0.0f), 1.0f);
+    b = std::min(std::max(b, 0.0f), 1.0f);
+    return uint32_t(r * 255.0f + 0.5f) | uint32_t(g * 255.0f + 0.5f) << 8 |
+           uint32_t(b * 255.0f + 0.5f) << 16 | 0xff000000u;
+}
+
+}  // namespace
+
+SoftRasterizer::SoftRasterizer()
+    : width(0), height(0), tiles_x(0), tiles_y(0) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool SoftRasterizer::init(int w, int h) {
+    if (w <= 0 || h <= 0) return false;
+    width = w;
+    height = h;
+    tiles_x = (w + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    tiles_y = (h + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    colors.assign(size_t(w) * h, 0xff000000u);
+    return true;
+}
+
+void SoftRasterizer::begin(const mat4& v, const mat4& p,
+                           const vec3& light_pos) {
+    v_mat = v;
+    p_mat = p;
+    light_cam = vec3(transformPoint(v, light_pos));
+    batches.clear();
+    draws.clear();
+    memset(&stats, 0, sizeof(stats));
+}
+
+void SoftRasterizer::draw(const SoftMesh& mesh, const uint32_t* indices,
+                          size_t index_cnt, const mat4& model,
+                          const Texture* texture) {
+    ++stats.draws;
+    stats.triangles += index_cnt / 3;
+    bool same = !batches.empty();
+    if (same) {
+        const Batch& last = batches.back();
+        same = last.mesh.positions == mesh.positions &&
+               last.mesh.normals == mesh.normals &&
+               last.mesh.uvs == mesh.uvs && last.mesh.ao == mesh.ao &&
+               last.texture == texture && last.model == model;
+    }
+    if (!same) {
+        Batch batch;
+        batch.mesh = mesh;
+        batch.model = model;
+        batch.texture = texture;
+        batch.vertex_first = 0;
+        // a disabled uv array reads as (0, 0) everywhere
+        batch.flat_color = vec3(1.0f);
+        if (texture) {
+            batch.flat_color = sampleTexture(*texture, vec2(0.0f), -FLT_MAX);
+        }
+        batches.push_back(batch);
+    }
+    DrawItem item = {uint32_t(batches.size() - 1), indices, index_cnt};
+    draws.push_back(item);
+}
+
+// StandardShading.vertexshader, keeping camera space positions instead of
+// world space ones: light distances agree when the view is rigid
+void SoftRasterizer::shadeVertices(size_t first, size_t last) {
+    TRACE_SCOPE("soft vertices");
+    size_t b = upper_bound(batches.begin(), batches.end(), first,
+                           [](size_t v, const Batch& batch) {
+                               return v < batch.vertex_first;
+                           }) -
+               batches.begin() - 1;
+    for (size_t i = first; i < last; ++i) {
+        while (b + 1 < batches.size() && i >= batches[b + 1].vertex_first) {
+            ++b;
+        }
+        const Batch& batch = batches[b];
+        size_t v = i - batch.vertex_first;
+        const vec3& p = (*batch.mesh.positions)[v];
+        Vertex& out = vertices[i];
+        out.clip = transformPoint(batch.mvp, p);
+        vec3 pos = vec3(transformPoint(batch.mv, p));
+        vec3 n = transformVector(batch.mv, (*batch.mesh.normals)[v]);
+        vec2 uv = batch.mesh.uvs->empty() ? vec2(0.0f)
+                                          : (*batch.mesh.uvs)[v];
+        float* f = out.varyings;
+        f[0] = pos.x;
+        f[1] = pos.y;
+        f[2] = pos.z;
+        f[3] = n.x;
+        f[4] = n.y;
+        f[5] = n.z;
+        f[6] = uv.x;
+        f[7] = uv.y;
+        f[8] = batch.mesh.ao->empty() ? 1.0f : (*batch.mesh.ao)[v];
+    }
+}
+
+void SoftRasterizer::setupTriangle(const Vertex* const v[3], uint32_t batch,
+                                   Bin& bin) {
+    float x[3], y[3], z[3], inv_w[3];
+    for (int k = 0; k < 3; ++k) {
+        const vec4& c = v[k]->clip;
+        inv_w[k] = 1.0f / c.w;
+        x[k] = (c.x * inv_w[k] * 0.5f + 0.5f) * width;
+        y[k] = (c.y * inv_w[k] * 0.5f + 0.5f) * height;
+        z[k] = c.z * inv_w[k] * 0.5f + 0.5f;
+    }
+    // counter-clockwise is front facing; back faces are culled
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (!(area > 0.0f)) return;
+
+    float min_x = std::min(x[0], std::min(x[1], x[2]));
+    float max_x = std::max(x[0], std::max(x[1], x[2]));
+    float min_y = std::min(y[0], std::min(y[1], y[2]));
+    float max_y = std::max(y[0], std::max(y[1], y[2]));
+    Triangle tri;
+    pixelSpan(min_x, max_x, width, tri.x0, tri.x1);
+    pixelSpan(min_y, max_y, height, tri.y0, tri.y1);
+    if (tri.x0 > tri.x1 || tri.y0 > tri.y1) return;
+
+    // edge k runs from vertex k to k + 1, inside is e >= 0. Coefficients
+    // come from the endpoints in a fixed order, so a shared edge evaluates
+    // to exactly opposite values in both triangles, and the top-left rule
+    // gives pixels on it to one of them.
+    for (int k = 0; k < 3; ++k) {
+        int n = (k + 1) % 3;
+        bool flip = x[k] > x[n] || (x[k] == x[n] && y[k] > y[n]);
+        int p = flip ? n : k, q = flip ? k : n;
+        float a = y[p] - y[q];
+        float b = x[q] - x[p];
+        float c = (y[q] - y[p]) * x[p] - (x[q] - x[p]) * y[p];
+        if (flip) {
+            a = -a;
+            b = -b;
+            c = -c;
+        }
+        tri.ea[k] = a;
+        tri.eb[k] = b;
+        tri.ec[k] = c;
+        bool top_left = a > 0.0f || (a == 0.0f && b < 0.0f);
+        tri.bias[k] = top_left ? 0.0f : FLT_MIN;
+        tri.eps[k] = (fabsf(a) * width + fabsf(b) * height + fabsf(c)) * 1e-6f;
+    }
+
+    float inv_area = 1.0f / area;
+    float dx1 = x[1] - x[0], dx2 = x[2] - x[0];
+    float dy1 = y[1] - y[0], dy2 = y[2] - y[0];
+    tri.dzdx = ((z[1] - z[0]) * dy2 - (z[2] - z[0]) * dy1) * inv_area;
+    tri.dzdy = ((z[2] - z[0]) * dx1 - (z[1] - z[0]) * dx2) * inv_area;
+    tri.zc = z[0] - tri.dzdx * x[0] - tri.dzdy * y[0];
+    tri.z_min = std::min(z[0], std::min(z[1], z[2]));
+
+    // perspective correct varyings: f / w is affine in window space
+    tri.ref_x = x[0];
+    tri.ref_y = y[0];
+    for (int j = 0; j <= RASTER_VARYINGS; ++j) {
+        float f[3];
+        for (int k = 0; k < 3; ++k) {
+            f[k] = j < RASTER_VARYINGS ? v[k]->varyings[j] * inv_w[k]
+                                       : inv_w[k];
+        }
+        tri.planes[j][0] = f[0];
+        tri.planes[j][1] = ((f[1] - f[0]) * dy2 - (f[2] - f[0]) * dy1) *
+                           inv_area;
+        tri.planes[j][2] = ((f[2] - f[0]) * dx1 - (f[1] - f[0]) * dx2) *
+                           inv_area;
+    }
+    tri.batch = batch;
+
+    uint32_t id = bin.tris.size();
+    bin.tris.push_back(tri);
+    for (int ty = tri.y0 / RASTER_TILE_SIZE; ty <= tri.y1 / RASTER_TILE_SIZE;
+         ++ty) {
+        for (int tx = tri.x0 / RASTER_TILE_SIZE;
+             tx <= tri.x1 / RASTER_TILE_SIZE; ++tx) {
+            bin.tiles[ty * tiles_x + tx].push_back(id);
+        }
+    }
+}
+
+void SoftRasterizer::setupChunk(size_t first, size_t last, Bin& bin) {
+    TRACE_SCOPE("soft setup");
+    bin.tris.clear();
+    bin.tiles.resize(tiles_x * tiles_y);
+    for (size_t t = 0; t < bin.tiles.size(); ++t) bin.tiles[t].clear();
+
+    size_t d = upper_bound(tri_starts.begin(), tri_starts.end(), first) -
+               tri_starts.begin() - 1;
+    for (size_t t = first; t < last; ++t) {
+        while (t >= tri_starts[d + 1]) ++d;
+        const DrawItem& item = draws[d];
+        const uint32_t* idx = item.indices + (t - tri_starts[d]) * 3;
+        const Vertex* base = &vertices[batches[item.batch].vertex_first];
+        const Vertex* v[3] = {base + idx[0], base + idx[1], base + idx[2]};
+
+        int c0 = outcode(v[0]->clip), c1 = outcode(v[1]->clip);
+        int c2 = outcode(v[2]->clip);
+        if (c0 & c1 & c2) continue;  // outside one plane
+        if (!((c0 | c1 | c2) & OUT_NEAR)) {
+            setupTriangle(v, item.batch, bin);
+            continue;
+        }
+
+        // clip against the near plane z = -w into a polygon of up to 4
+        // vertices, interpolating linearly in clip space as GL does
+        Vertex clipped[4];
+        int n = 0;
+        for (int k = 0; k < 3; ++k) {
+            const Vertex& a = *v[k];
+            const Vertex& b = *v[(k + 1) % 3];
+            float da = a.clip.z + a.clip.w, db = b.clip.z + b.clip.w;
+            if (da >= 0.0f) clipped[n++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                float s = da / (da - db);
+                Vertex& out = clipped[n++];
+                out.clip = a.clip + (b.clip - a.clip) * s;
+                for (int j = 0; j < RASTER_VARYINGS; ++j) {
+                    out.varyings[j] = a.varyings[j] +
+                                      (b.varyings[j] - a.varyings[j]) * s;
+                }
+            }
+        }
+        for (int k = 1; k + 1 < n; ++k) {
+            const Vertex* fan[3] = {&clipped[0], &clipped[k], &clipped[k + 1]};
+            setupTriangle(fan, item.batch, bin);
+        }
+    }
+}
+
+uint32_t SoftRasterizer::shadePixel(const Triangle& tri, float fx,
+                                    float fy) const {
+    const float(*p)[3] = tri.planes;
+    float dx = fx - tri.ref_x, dy = fy - tri.ref_y;
+    float f[RASTER_VARYINGS];
+    float w = 1.0f / (p[RASTER_VARYINGS][0] + p[RASTER_VARYINGS][1] * dx +
+                      p[RASTER_VARYINGS][2] * dy);
+    for (int j = 0; j < RASTER_VARYINGS; ++j) {
+        f[j] = (p[j][0] + p[j][1] * dx + p[j][2] * dy) * w;
+    }
+
+    const Batch& batch = batches[tri.batch];
+    vec3 diffuse = batch.flat_color;
+    if (batch.texture && !batch.mesh.uvs->empty()) {
+        // derivatives from the neighbours to the right and above
+        float wx = 1.0f / (p[RASTER_VARYINGS][0] +
+                           p[RASTER_VARYINGS][1] * (dx + 1.0f) +
+                           p[RASTER_VARYINGS][2] * dy);
+        float wy = 1.0f / (p[RASTER_VARYINGS][0] +
+                           p[RASTER_VARYINGS][1] * dx +
+                           p[RASTER_VARYINGS][2] * (dy + 1.0f));
+        vec2 uv(f[6], f[7]);
+        vec2 uv_x((p[6][0] + p[6][1] * (dx + 1.0f) + p[6][2] * dy) * wx,
+                  (p[7][0] + p[7][1] * (dx + 1.0f) + p[7][2] * dy) * wx);
+        vec2 uv_y((p[6][0] + p[6][1] * dx + p[6][2] * (dy + 1.0f)) * wy,
+                  (p[7][0] + p[7][1] * dx + p[7][2] * (dy + 1.0f)) * wy);
+        diffuse = sampleTexture(*batch.texture, uv,
+                                textureLOD(*batch.texture, uv_x - uv,
+                                           uv_y - uv));
+    }
+
+    // StandardShading.fragmentshader in camera space
+    float lx = light_cam.x - f[0], ly = light_cam.y - f[1];
+    float lz = light_cam.z - f[2];
+    float dist2 = lx * lx + ly * ly + lz * lz;
+    float inv_l = 1.0f / sqrtf(dist2);
+    lx *= inv_l;
+    ly *= inv_l;
+    lz *= inv_l;
+    float inv_n = 1.0f / sqrtf(f[3] * f[3] + f[4] * f[4] + f[5] * f[5]);
+    float nx = f[3] * inv_n, ny = f[4] * inv_n, nz = f[5] * inv_n;
+    float inv_e = 1.0f / sqrtf(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+    float ex = -f[0] * inv_e, ey = -f[1] * inv_e, ez = -f[2] * inv_e;
+
+    float n_dot_l = nx * lx + ny * ly + nz * lz;
+    float cos_theta = std::min(std::max(n_dot_l, 0.0f), 1.0f);
+    // reflect(-l, n)
+    float rx = 2.0f * n_dot_l * nx - lx, ry = 2.0f * n_dot_l * ny - ly;
+    float rz = 2.0f * n_dot_l * nz - lz;
+    float cos_alpha = std::min(std::max(ex * rx + ey * ry + ez * rz, 0.0f),
+                               1.0f);
+    float cos_alpha2 = cos_alpha * cos_alpha;
+
+    float ao = f[8];
+    float inv_d2 = LIGHT_POWER / dist2;
+    // ao darkens the ambient term only, as the shader's does
+    float diffuse_k = ao * AMBIENT_FACTOR + cos_theta * inv_d2;
+    float specular = SPECULAR_COLOR * cos_alpha2 * cos_alpha2 * cos_alpha *
+                     inv_d2;
+    return packColor(diffuse.x * diffuse_k + specular,
+                     diffuse.y * diffuse_k + specular,
+                     diffuse.z * diffuse_k + specular);
+}
+
+void SoftRasterizer::renderTile(int tile, TileStats& ts) {
+    TRACE_SCOPE("soft tile");
+    int tile_x0 = (tile % tiles_x) * RASTER_TILE_SIZE;
+    int tile_y0 = (tile / tiles_x) * RASTER_TILE_SIZE;
+    int tile_x1 = std::min(width, tile_x0 + RASTER_TILE_SIZE) - 1;
+    int tile_y1 = std::min(height, tile_y0 + RASTER_TILE_SIZE) - 1;
+
+    // tile local depth and triangle ids (as float bits, so the SIMD select
+    // can write them)
+    float depth[RASTER_TILE_SIZE * RASTER_TILE_SIZE];
+    float ids[RASTER_TILE_SIZE * RASTER_TILE_SIZE];
+    float block_far[BLOCKS_PER_TILE * BLOCKS_PER_TILE];
+    float empty = idToFloat(RASTER_EMPTY);
+    fill(depth, depth + RASTER_TILE_SIZE * RASTER_TILE_SIZE, 1.0f);
+    fill(ids, ids + RASTER_TILE_SIZE * RASTER_TILE_SIZE, empty);
+    fill(block_far, block_far + BLOCKS_PER_TILE * BLOCKS_PER_TILE, 1.0f);
+    float tile_far = 1.0f;
+    int since_refresh = 0;
+
+    vfloat lanes = vload(lane_centers);
+    // chunks in order, so triangles keep submission order for GL_LESS ties
+    for (size_t b = 0; b < bins.size(); ++b) {
+        const vector<uint32_t>& list = bins[b].tiles[tile];
+        for (size_t i = 0; i < list.size(); ++i) {
+            const Triangle& tri = bins[b].tris[list[i]];
+            if (tri.z_min - RASTER_Z_EPS >= tile_far) continue;
+            if (++since_refresh == RASTER_FAR_REFRESH) {
+                since_refresh = 0;
+                tile_far = *max_element(
+                    block_far, block_far + BLOCKS_PER_TILE * BLOCKS_PER_TILE);
+            }
+            vfloat id_v(idToFloat(uint32_t(b) << 24 | list[i]));
+
+            int px0 = std::max(tri.x0, tile_x0) - tile_x0;
+            int px1 = std::min(tri.x1, tile_x1) - tile_x0;
+            int py0 = std::max(tri.y0, tile_y0) - tile_y0;
+            int py1 = std::min(tri.y1, tile_y1) - tile_y0;
+            for (int by = py0 / RASTER_BLOCK_SIZE;
+                 by <= py1 / RASTER_BLOCK_SIZE; ++by) {
+                for (int bx = px0 / RASTER_BLOCK_SIZE;
+                     bx <= px1 / RASTER_BLOCK_SIZE; ++bx) {
+                    ++ts.blocks;
+                    // first pixel center of the block in window space
+                    float fx0 = tile_x0 + bx * RASTER_BLOCK_SIZE + 0.5f;
+                    float fy0 = tile_y0 + by * RASTER_BLOCK_SIZE + 0.5f;
+                    const float span = RASTER_BLOCK_SIZE - 1;
+
+                    // edges at the block corners: all outside one edge
+                    // rejects the block, all inside every edge needs no
+                    // per pixel test
+                    bool culled = false, full = true;
+                    for (int k = 0; k < 3; ++k) {
+                        float e = tri.ea[k] * fx0 + (tri.eb[k] * fy0 +
+                                                     tri.ec[k]);
+                        float e_max = e + (std::max(tri.ea[k], 0.0f) +
+                                           std::max(tri.eb[k], 0.0f)) * span;
+                        float e_min = e + (std::min(tri.ea[k], 0.0f) +
+                                           std::min(tri.eb[k], 0.0f)) * span;
+                        culled |= e_max + tri.eps[k] < tri.bias[k];
+                        full &= e_min - tri.eps[k] >= tri.bias[k];
+                    }
+                    if (culled) {
+                        ++ts.blocks_culled;
+                        continue;
+                    }
+
+                    // early depth: nearest point of the plane in the block
+                    // against the farthest depth already there
+                    int block = by * BLOCKS_PER_TILE + bx;
+                    float z0 = tri.dzdx * fx0 + tri.dzdy * fy0 + tri.zc;
+                    float z_near = std::max(
+                        tri.z_min, z0 + (std::min(tri.dzdx, 0.0f) +
+                                         std::min(tri.dzdy, 0.0f)) * span);
+                    if (z_near - RASTER_Z_EPS >= block_far[block]) {
+                        ++ts.blocks_hidden;
+                        continue;
+                    }
+
+                    vfloat bias0(tri.bias[0]), bias1(tri.bias[1]);
+                    vfloat bias2(tri.bias[2]);
+                    vfloat ea0(tri.ea[0]), ea1(tri.ea[1]), ea2(tri.ea[2]);
+                    vfloat dzdx(tri.dzdx);
+                    vfloat far_v(0.0f);
+                    for (int r = 0; r < RASTER_BLOCK_SIZE; ++r) {
+                        float fy = fy0 + r;
+                        int row = (by * RASTER_BLOCK_SIZE + r) *
+                                      RASTER_TILE_SIZE +
+                                  bx * RASTER_BLOCK_SIZE;
+                        vfloat c0(tri.eb[0] * fy + tri.ec[0]);
+                        vfloat c1(tri.eb[1] * fy + tri.ec[1]);
+                        vfloat c2(tri.eb[2] * fy + tri.ec[2]);
+                        vfloat zrow(tri.dzdy * fy + tri.zc);
+                        for (int sx = 0; sx < RASTER_BLOCK_SIZE;
+                             sx += SIMD_WIDTH) {
+                            vfloat fx = vfloat(fx0 - 0.5f + sx) + lanes;
+                            vfloat z = dzdx * fx + zrow;
+                            vfloat d = vload(depth + row + sx);
+                            vfloat pass = z < d;
+                            if (!full) {
+                                pass = pass & (bias0 <= ea0 * fx + c0) &
+                                       (bias1 <= ea1 * fx + c1) &
+                                       (bias2 <= ea2 * fx + c2);
+                            }
+                            d = select(pass, z, d);
+                            vstore(depth + row + sx, d);
+                            vstore(ids + row + sx,
+                                   select(pass, id_v,
+                                          vload(ids + row + sx)));
+                            far_v = vmax(far_v, d);
+                        }
+                    }
+                    float lanes_far[SIMD_WIDTH];
+                    vstore(lanes_far, far_v);
+                    block_far[block] =
+                        *max_element(lanes_far, lanes_far + SIMD_WIDTH);
+                }
+            }
+        }
+    }
+
+    // shade what stayed visible
+    for (int y = tile_y0; y <= tile_y1; ++y) {
+        const float* row_ids = ids + (y - tile_y0) * RASTER_TILE_SIZE;
+        uint32_t* out = &colors[size_t(y) * width];
+        for (int x = tile_x0; x <= tile_x1; ++x) {
+            uint32_t id = floatToId(row_ids[x - tile_x0]);
+            if (id == RASTER_EMPTY) {
+                out[x] = 0xff000000u;  // black clear color
+                continue;
+            }
+            const Triangle& tri = bins[id >> 24].tris[id & 0xffffff];
+            out[x] = shadePixel(tri, x + 0.5f, y + 0.5f);
+            ++ts.pixels;
+        }
+    }
+}
+
+void SoftRasterizer::end() {
+    TRACE_SCOPE("soft raster");
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    size_t vertex_cnt = 0;
+    for (size_t b = 0; b < batches.size(); ++b) {
+        Batch& batch = batches[b];
+        batch.mv = v_mat * batch.model;
+        batch.mvp = p_mat * batch.mv;
+        batch.vertex_first = vertex_cnt;
+        vertex_cnt += batch.mesh.positions->size();
+    }
+    vertices.resize(vertex_cnt);
+    parallelFor(0, vertex_cnt, RASTER_VERTEX_GRAIN,
+                [&](size_t lo, size_t hi) { shadeVertices(lo, hi); });
+    stats.vertices = vertex_cnt;
+    stats.vertex_ms = msSince(t0);
+
+    t0 = chrono::steady_clock::now();
+    tri_starts.resize(draws.size() + 1);
+    tri_starts[0] = 0;
+    for (size_t d = 0; d < draws.size(); ++d) {
+        tri_starts[d + 1] = tri_starts[d] + draws[d].index_cnt / 3;
+    }
+    size_t tri_cnt = tri_starts.back();
+
+    if (tri_cnt > size_t(RASTER_MAX_CHUNKS) * RASTER_MAX_CHUNK_TRIS) {
+        fprintf(stderr, "Failed to bin %lu triangles, drawing the first "
+                        "%lu.\n",
+                (unsigned long)tri_cnt,
+                (unsigned long)RASTER_MAX_CHUNKS * RASTER_MAX_CHUNK_TRIS);
+        tri_cnt = size_t(RASTER_MAX_CHUNKS) * RASTER_MAX_CHUNK_TRIS;
+    }
+    // a few chunks per worker keep binning balanced, and more are cut when
+    // a chunk would outgrow its triangle ids
+    size_t chunk_cnt = std::max<size_t>(1, std::min<size_t>(
+        std::min<size_t>(workerCount() * 4, RASTER_MAX_CHUNKS),
+        tri_cnt / RASTER_MIN_CHUNK));
+    chunk_cnt = std::max<size_t>(
+        chunk_cnt,
+        (tri_cnt + RASTER_MAX_CHUNK_TRIS - 1) / RASTER_MAX_CHUNK_TRIS);
+    size_t chunk = (tri_cnt + chunk_cnt - 1) / chunk_cnt;
+    bins.resize(chunk_cnt);
+    parallelFor(0, chunk_cnt, 1, [&](size_t lo, size_t hi) {
+        for (size_t c = lo; c < hi; ++c) {
+            setupChunk(std::min(tri_cnt, c * chunk),
+                       std::min(tri_cnt, (c + 1) * chunk), bins[c]);
+        }
+    });
+    for (size_t c = 0; c < chunk_cnt; ++c) stats.binned += bins[c].tris.size();
+    stats.setup_ms = msSince(t0);
+
+    t0 = chrono::steady_clock::now();
+    vector<TileStats> tile_stats(tiles_x * tiles_y);
+    memset(&tile_stats[0], 0, tile_stats.size() * sizeof(TileStats));
+    parallelFor(0, tiles_x * tiles_y, 1, [&](size_t lo, size_t hi) {
+        for (size_t t = lo; t < hi; ++t) renderTile(int(t), tile_stats[t]);
+    });
+    for (size_t t = 0; t < tile_stats.size(); ++t) {
+        stats.blocks += tile_stats[t].blocks;
+        stats.blocks_culled += tile_stats[t].blocks_culled;
+        stats.blocks_hidden += tile_stats[t].blocks_hidden;
+        stats.pixels += tile_stats[t].pixels;
+    }
+    stats.raster_ms = msSince(t0);
+}
+
+void SoftRasterizer::readPixels(vector<unsigned char>& rgb) const {
+    rgb.resize(size_t(width) * height * 3);
+    for (int y = 0; y < height; ++y) {
+        const uint32_t* row = &colors[size_t(height - 1 - y) * width];
+        unsigned char* out = &rgb[size_t(y) * width * 3];
+        for (int x = 0; x < width; ++x) {
+            out[x * 3 + 0] = row[x] & 0xff;
+            out[x * 3 + 1] = (row[x] >> 8) & 0xff;
+            out[x * 3 + 2] = (row[x] >> 16) & 0xff;
+        }
+    }
+}
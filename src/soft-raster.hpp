@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "texture.hpp"
+
+// screen tiles rasterized and shaded as one job, in blocks of 8x8 pixels
+// for the hierarchical coverage and depth tests
+#define RASTER_TILE_SIZE 64
+#define RASTER_BLOCK_SIZE 8
+
+// interpolated per vertex: camera space position and normal, uv, ao
+#define RASTER_VARYINGS 9
+
+// vertex streams of a mesh, as bound to StandardShading's attributes; uvs
+// and ao may be empty like disabled attribute arrays
+struct SoftMesh {
+    const std::vector<glm::vec3>* positions;
+    const std::vector<glm::vec3>* normals;
+    const std::vector<glm::vec2>* uvs;
+    const std::vector<float>* ao;
+};
+
+struct SoftRasterStats {
+    unsigned int draws;
+    unsigned int vertices;       // shaded
+    unsigned int triangles;      // submitted
+    unsigned int binned;         // after culling and near plane clipping
+    unsigned int blocks;         // 8x8 blocks under triangle bounds
+    unsigned int blocks_culled;  // outside an edge
+    unsigned int blocks_hidden;  // behind everything already in the block
+    unsigned int pixels;         // shaded
+    double vertex_ms;
+    double setup_ms;   // clipping, culling and binning
+    double raster_ms;  // rasterization and shading
+};
+
+// Tile based renderer of StandardShading for machines without a GPU.
+// Vertices are shaded in parallel, triangles are clipped against the near
+// plane, back face culled and binned into screen tiles in parallel chunks,
+// and each tile is one job. A tile rasterizes its triangles in submission
+// order with SIMD edge functions over 8x8 blocks, skipping blocks outside
+// an edge or behind the farthest depth already in them, into a tile local
+// depth and triangle id buffer; only the pixels left visible are shaded.
+// Shading matches the fragment shader with a single sample, assuming
+// rigid view matrices as lookAt builds.
+class SoftRasterizer {
+   public:
+    SoftRasterizer();
+
+    bool init(int width, int height);
+
+    // start a frame: clear to black and forget the draws
+    void begin(const glm::mat4& v_mat, const glm::mat4& p_mat,
+               const glm::vec3& light_pos);
+    // index_cnt indices of mesh placed by model; the mesh, indices and
+    // texture must stay alive until end(). Consecutive draws of the same
+    // mesh and model share shaded vertices. A NULL texture is white.
+    void draw(const SoftMesh& mesh, const uint32_t* indices, size_t index_cnt,
+              const glm::mat4& model, const Texture* texture);
+    // render all draws
+    void end();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // RGBA8 rows bottom up, as GL stores them
+    const uint32_t* getColors() const { return &colors[0]; }
+    // top-down RGB rows
+    void readPixels(std::vector<unsigned char>& rgb) const;
+    const SoftRasterStats& getStats() const { return stats; }
+
+   private:
+    // vertices of one mesh under one model matrix
+    struct Batch {
+        SoftMesh mesh;
+        glm::mat4 model;
+        glm::mat4 mvp, mv;  // set by end()
+        const Texture* texture;
+        size_t vertex_first;  // into vertices
+        glm::vec3 flat_color;  // texture color of meshes without uvs
+    };
+    struct DrawItem {
+        uint32_t batch;
+        const uint32_t* indices;
+        size_t index_cnt;
+    };
+    struct Vertex {
+        glm::vec4 clip;
+        float varyings[RASTER_VARYINGS];
+    };
+    // screen space setup of a clipped triangle
+    struct Triangle {
+        float ea[3], eb[3], ec[3];  // edge k inside where ea x + eb y + ec
+        float bias[3];              // >= bias, for the top-left rule
+        float eps[3];               // float error bound of the edge values
+        float dzdx, dzdy, zc;       // window depth plane
+        float z_min;
+        int x0, y0, x1, y1;  // pixel bounds
+        // varyings / w and 1 / w as f0 + dfdx (x - ref_x) + dfdy (y - ref_y)
+        float ref_x, ref_y;
+        float planes[RASTER_VARYINGS + 1][3];
+        uint32_t batch;
+    };
+    struct Bin {
+        std::vector<Triangle> tris;
+        std::vector<std::vector<uint32_t> > tiles;
+    };
+    struct TileStats {
+        unsigned int blocks, blocks_culled, blocks_hidden, pixels;
+    };
+
+    void shadeVertices(size_t first, size_t last);
+    void setupChunk(size_t first, size_t last, Bin& bin);
+    void setupTriangle(const Vertex* const v[3], uint32_t batch, Bin& bin);
+    void renderTile(int tile, TileStats& tile_stats);
+    uint32_t shadePixel(const Triangle& tri, float fx, float fy) const;
+
+    int width, height;
+    int tiles_x, tiles_y;
+    glm::mat4 v_mat, p_mat;
+    glm::vec3 light_cam;  // light position in camera space
+    std::vector<Batch> batches;
+    std::vector<DrawItem> draws;
+    std::vector<Vertex> vertices;
+    std::vector<size_t> tri_starts;  // first triangle of each draw
+    std::vector<Bin> bins;
+    std::vector<uint32_t> colors;
+    SoftRasterStats stats;
+};
@@ -0,0 +1,333 @@
+#include "synthetic.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+using namespace std;
+
+#include "parallel.hpp"
+
+// elements (vertices or faces) formatted per job
+#define SYNTHETIC_CHUNK 16384
+// chunks formatted per worker before they are written out in order
+#define SYNTHETIC_CHUNKS_PER_WORKER 8
+
+namespace {
+
+// murmur3 finalizer; per vertex noise without a shared generator state
+inline uint32_t hash32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+int64_t inverseMod(int64_t a, int64_t n) {
+    int64_t t = 0, new_t = 1, r = n, new_r = a;
+    while (new_r != 0) {
+        int64_t q = r / new_r;
+        int64_t tmp = t - q * new_t;
+        t = new_t;
+        new_t = tmp;
+        tmp = r - q * new_r;
+        r = new_r;
+        new_r = tmp;
+    }
+    return t < 0 ? t + n : t;
+}
+
+uint64_t gcd(uint64_t a, uint64_t b) {
+    while (b) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// i -> (mul i + add) mod n, a bijection that sends neighbours far apart;
+// computable per element, so chunks can be formatted independently
+struct Permutation {
+    uint64_t n, mul, add, inv;
+
+    void init(uint64_t size, uint32_t seed, bool identity) {
+        n = std::max<uint64_t>(size, 1);
+        mul = inv = 1;
+        add = 0;
+        if (identity || n < 3) return;
+        mul = n / 2 + hash32(seed) % (n / 2);
+        while (gcd(mul, n) != 1) ++mul;
+        mul %= n;
+        add = hash32(seed + 1) % n;
+        inv = inverseMod(mul, n);
+    }
+    // sizes stay below 2^32, so the products fit; the divisions are most of
+    // a face's cost, so grid order skips them
+    uint64_t operator()(uint64_t i) const {
+        return mul == 1 && add == 0 ? i : (mul * i + add) % n;
+    }
+    uint64_t inverse(uint64_t i) const {
+        return mul == 1 && add == 0 ? i : (i + n - add) % n * inv % n;
+    }
+};
+
+// torus of rows x cols vertices; faces cover strip cells of one row each,
+// odd sized polygons leave a triangle next to them
+struct Grid {
+    int rows, cols;
+    int strip;
+    bool odd;
+
+    void init(size_t triangles, int polygon_size) {
+        odd = polygon_size % 2 != 0;
+        strip = odd ? (polygon_size - 1) / 2 : (polygon_size - 2) / 2;
+        double cells = std::max(1.0, triangles * 0.5);
+        rows = std::max(3, int(sqrt(cells) + 0.5));
+        int segs = std::max(1, int(cells / rows / strip + 0.5));
+        cols = std::max(segs, (3 + strip - 1) / strip) * strip;
+    }
+    size_t vertexCount() const { return size_t(rows) * cols; }
+    size_t faceCount() const {
+        return size_t(rows) * (cols / strip) * (odd ? 2 : 1);
+    }
+    size_t triangleCount() const { return size_t(rows) * cols * 2; }
+
+    // grid vertex ids of face f; returns the corner count
+    int face(size_t f, uint32_t* ids) const {
+        int parts = odd ? 2 : 1;
+        size_t per_row = size_t(cols / strip) * parts;
+        uint32_t i = f / per_row;
+        int seg = int(f % per_row) / parts, part = int(f % per_row) % parts;
+        uint32_t bottom = i * cols, top = (i + 1) % rows * cols;
+        int j = seg * strip;
+        if (part == 1) {
+            ids[0] = bottom + j;
+            ids[1] = top + (j + 1) % cols;
+            ids[2] = top + j;
+            return 3;
+        }
+        int cnt = 0;
+        for (int k = 0; k <= strip; ++k) ids[cnt++] = bottom + (j + k) % cols;
+        for (int k = strip; k >= (odd ? 1 : 0); --k) {
+            ids[cnt++] = top + (j + k) % cols;
+        }
+        return cnt;
+    }
+};
+
+// the formatters write through a cursor into buffers sized for the worst
+// case element, so nothing checks capacity per character
+char* putString(char* p, const char* s) {
+    while (*s) *p++ = *s++;
+    return p;
+}
+
+char* putInt(char* p, int64_t v) {
+    char buf[24];
+    char* b = buf + sizeof(buf);
+    uint64_t u = v < 0 ? uint64_t(-v) : uint64_t(v);
+    do {
+        *--b = char('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0) *--b = '-';
+    while (b < buf + sizeof(buf)) *p++ = *b++;
+    return p;
+}
+
+// six decimals like %f, without the locale and format string costs
+char* putFixed(char* p, float v) {
+    int64_t q = llround(double(v) * 1e6);
+    if (q < 0) {
+        *p++ = '-';
+        q = -q;
+    }
+    p = putInt(p, q / 1000000);
+    *p++ = '.';
+    int64_t f = q % 1000000;
+    for (int k = 5; k >= 0; --k, f /= 10) p[k] = char('0' + f % 10);
+    return p + 6;
+}
+
+struct Writer {
+    const SyntheticOptions& options;
+    Grid grid;
+    Permutation vertex_order, face_order;
+    const char* eol;
+    uint32_t noise_seed;
+
+    explicit Writer(const SyntheticOptions& o) : options(o) {
+        grid.init(o.triangles, std::max(3, o.polygon_size));
+        vertex_order.init(grid.vertexCount(), o.seed * 3 + 1, !o.shuffled);
+        face_order.init(grid.faceCount(), o.seed * 3 + 2, !o.shuffled);
+        eol = o.crlf ? "\r\n" : "\n";
+        noise_seed = hash32(o.seed);
+    }
+
+    // bytes an element may take at most, its comment included
+    size_t maxElementBytes(bool faces) const {
+        return 48 + (faces ? 2 + size_t(options.polygon_size) * 72 : 192);
+    }
+
+    char* comment(char* p, size_t e) const {
+        if (options.comment_every && e % options.comment_every == 0) {
+            p = putString(p, "# element ");
+            p = putInt(p, e);
+            p = putString(p, eol);
+        }
+        return p;
+    }
+
+    char* vertex(char* p, size_t k) const {
+        uint32_t g = vertex_order(k);
+        int i = g / grid.cols, j = g % grid.cols;
+        float a = 6.2831853f * i / grid.rows;
+        float b = 6.2831853f * j / grid.cols;
+        float noise = (hash32(noise_seed ^ g) >> 8) * (1.0f / 16777216.0f);
+        float r = 0.3f + 0.02f * (noise - 0.5f);
+        float n[3] = {cosf(a) * cosf(b), sinf(b), sinf(a) * cosf(b)};
+        float pos[3] = {cosf(a) + r * n[0], r * n[1], sinf(a) + r * n[2]};
+        *p++ = 'v';
+        for (int c = 0; c < 3; ++c) {
+            *p++ = ' ';
+            p = putFixed(p, pos[c]);
+        }
+        p = putString(p, eol);
+        if (options.uvs) {
+            p = putString(p, "vt ");
+            p = putFixed(p, float(i) / grid.rows);
+            *p++ = ' ';
+            p = putFixed(p, float(j) / grid.cols);
+            p = putString(p, eol);
+        }
+        if (options.normals) {
+            p = putString(p, "vn");
+            for (int c = 0; c < 3; ++c) {
+                *p++ = ' ';
+                p = putFixed(p, n[c]);
+            }
+            p = putString(p, eol);
+        }
+        return p;
+    }
+
+    char* face(char* p, size_t f) const {
+        uint32_t ids[64];
+        int cnt = grid.face(face_order(f), ids);
+        int64_t vertex_cnt = grid.vertexCount();
+        *p++ = 'f';
+        for (int c = 0; c < cnt; ++c) {
+            int64_t idx = vertex_order.inverse(ids[c]) + 1;
+            // every vertex is written before the first face
+            if (options.negative_indices) idx -= vertex_cnt + 1;
+            *p++ = ' ';
+            p = putInt(p, idx);
+            if (options.uvs || options.normals) {
+                *p++ = '/';
+                if (options.uvs) p = putInt(p, idx);
+            }
+            if (options.normals) {
+                *p++ = '/';
+                p = putInt(p, idx);
+            }
+        }
+        return putString(p, eol);
+    }
+};
+
+}  // namespace
+
+SyntheticOptions defaultSyntheticOptions(size_t triangles) {
+    SyntheticOptions options;
+    options.triangles = triangles;
+    options.polygon_size = 3;
+    options.uvs = true;
+    options.normals = true;
+    options.negative_indices = false;
+    options.shuffled = false;
+    options.comment_every = 0;
+    options.crlf = false;
+    options.seed = 1;
+    return options;
+}
+
+bool writeSyntheticOBJ(const char* path, const SyntheticOptions& options,
+                       SyntheticStats* stats) {
+    if (options.polygon_size > 64) {
+        fprintf(stderr, "Failed to generate %s: polygons of %d corners.\n",
+                path, options.polygon_size);
+        return false;
+    }
+    Writer writer(options);
+    size_t vertex_cnt = writer.grid.vertexCount();
+    size_t face_cnt = writer.grid.faceCount();
+    if (vertex_cnt + face_cnt >= (size_t(1) << 32)) {
+        fprintf(stderr, "Failed to generate %s: too many elements.\n", path);
+        return false;
+    }
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to create %s.\n", path);
+        return false;
+    }
+
+    char header[128];
+    char* p = putString(header, "# synthetic torus: ");
+    p = putInt(p, vertex_cnt);
+    p = putString(p, " vertices, ");
+    p = putInt(p, face_cnt);
+    p = putString(p, " faces, seed ");
+    p = putInt(p, options.seed);
+    p = putString(p, writer.eol);
+    size_t bytes = fwrite(header, 1, p - header, fp);
+
+    // vertex chunks, then face chunks; each batch is formatted in parallel
+    // and written in order
+    size_t vertex_chunks = (vertex_cnt + SYNTHETIC_CHUNK - 1) /
+                           SYNTHETIC_CHUNK;
+    size_t chunk_cnt =
+        vertex_chunks + (face_cnt + SYNTHETIC_CHUNK - 1) / SYNTHETIC_CHUNK;
+    size_t batch = size_t(workerCount()) * SYNTHETIC_CHUNKS_PER_WORKER;
+    vector<vector<char> > buffers(batch);
+    bool ok = true;
+    for (size_t first = 0; first < chunk_cnt && ok; first += batch) {
+        size_t last = std::min(chunk_cnt, first + batch);
+        parallelFor(first, last, 1, [&](size_t c0, size_t c1) {
+            for (size_t c = c0; c < c1; ++c) {
+                vector<char>& out = buffers[c - first];
+                bool faces = c >= vertex_chunks;
+                size_t begin = (faces ? c - vertex_chunks : c) *
+                               SYNTHETIC_CHUNK;
+                size_t end = std::min(begin + SYNTHETIC_CHUNK,
+                                      faces ? face_cnt : vertex_cnt);
+                out.resize((end - begin) * writer.maxElementBytes(faces));
+                char* p = &out[0];
+                for (size_t e = begin; e < end; ++e) {
+                    p = writer.comment(p, faces ? vertex_cnt + e : e);
+                    p = faces ? writer.face(p, e) : writer.vertex(p, e);
+                }
+                out.resize(p - &out[0]);
+            }
+        });
+        for (size_t c = first; c < last && ok; ++c) {
+            const vector<char>& out = buffers[c - first];
+            ok = fwrite(&out[0], 1, out.size(), fp) == out.size();
+            bytes += out.size();
+        }
+    }
+    ok = fclose(fp) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        return false;
+    }
+    if (stats) {
+        stats->vertices = vertex_cnt;
+        stats->faces = face_cnt;
+        stats->triangles = writer.grid.triangleCount();
+        stats->bytes = bytes;
+    }
+    return true;
+}
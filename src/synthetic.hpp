@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Layout of a generated obj file. The surface is a noisy torus tessellated
+// as a grid, written row by row so nearby faces share nearby vertices, or
+// scrambled so they do not.
+struct SyntheticOptions {
+    size_t triangles;   // after triangulation, rounded to the grid
+    int polygon_size;   // corners per face, 3 or more
+    bool uvs;           // vt lines and the v/vt or v/vt/vn corner forms
+    bool normals;       // vn lines and the v//vn or v/vt/vn corner forms
+    bool negative_indices;
+    bool shuffled;          // vertex and face order scrambled
+    size_t comment_every;   // a comment line before every n-th element
+    bool crlf;
+    uint32_t seed;
+};
+
+struct SyntheticStats {
+    size_t vertices;
+    size_t faces;
+    size_t triangles;
+    size_t bytes;
+};
+
+// v/vt/vn triangles in grid order, no comments, seed 1
+SyntheticOptions defaultSyntheticOptions(size_t triangles);
+
+// Write the file with every worker thread formatting chunks of lines; the
+// same options always produce the same bytes. stats may be NULL.
+bool writeSyntheticOBJ(const char* path, const SyntheticOptions& options,
+                       SyntheticStats* stats);
@@ -0,0 +1,150 @@
+#include "tangents.hpp"
+
+#include <algorithm>
+#include <cmath>
+using namespace std;
+using namespace glm;
+
+#include "parallel.hpp"
+
+#define TANGENT_GRAIN 4096
+
+namespace {
+
+// uv orientation of a triangle; ones with zero uv area have none
+enum Orientation { ORIENT_NONE, ORIENT_POS, ORIENT_NEG };
+
+vec3 safeNormalize(const vec3& v) {
+    float len = length(v);
+    return len > 0.0f ? v / len : vec3(0.0f);
+}
+
+// any unit vector perpendicular to n, for vertices without a uv gradient
+vec3 perpendicular(const vec3& n) {
+    vec3 axis = fabs(n.x) < 0.9f ? vec3(1.0f, 0.0f, 0.0f)
+                                 : vec3(0.0f, 1.0f, 0.0f);
+    return safeNormalize(cross(axis, n));
+}
+
+}  // namespace
+
+bool generateTangents(IndexedMesh& mesh) {
+    size_t vertex_cnt = mesh.positions.size();
+    if (mesh.uvs.size() != vertex_cnt || mesh.normals.size() != vertex_cnt) {
+        return false;
+    }
+    size_t tri_cnt = mesh.indices.size() / 3;
+    const vector<uint32_t>& idx = mesh.indices;
+
+    // s direction of each triangle in object space, sign fixed so mirrored
+    // triangles still point along +s, and the orientation of its uvs
+    vector<vec3> tri_s(tri_cnt);
+    vector<unsigned char> orient(tri_cnt);
+    parallelFor(0, tri_cnt, TANGENT_GRAIN, [&](size_t lo, size_t hi) {
+        for (size_t t = lo; t < hi; ++t) {
+            uint32_t i0 = idx[t * 3], i1 = idx[t * 3 + 1], i2 = idx[t * 3 + 2];
+            vec3 d1 = mesh.positions[i1] - mesh.positions[i0];
+            vec3 d2 = mesh.positions[i2] - mesh.positions[i0];
+            // loadOBJ flips v for DDS, flip it back to the file's convention
+            vec2 t21 = mesh.uvs[i1] - mesh.uvs[i0];
+            vec2 t31 = mesh.uvs[i2] - mesh.uvs[i0];
+            t21.y = -t21.y;
+            t31.y = -t31.y;
+            float area = t21.x * t31.y - t21.y * t31.x;
+            vec3 s = t31.y * d1 - t21.y * d2;
+            tri_s[t] = area < 0.0f ? -s : (area > 0.0f ? s : vec3(0.0f));
+            orient[t] = area > 0.0f ? ORIENT_POS
+                                    : (area < 0.0f ? ORIENT_NEG : ORIENT_NONE);
+        }
+    });
+
+    // each corner's share: s in the normal plane times the corner angle
+    vector<vec3> corner_s(tri_cnt * 3);
+    parallelFor(0, tri_cnt, TANGENT_GRAIN, [&](size_t lo, size_t hi) {
+        for (size_t c = lo * 3; c < hi * 3; ++c) {
+            size_t t = c / 3;
+            uint32_t v = idx[c];
+            const vec3& n = mesh.normals[v];
+            const vec3& p = mesh.positions[v];
+            vec3 e1 = mesh.positions[idx[t * 3 + (c + 1) % 3]] - p;
+            vec3 e2 = mesh.positions[idx[t * 3 + (c + 2) % 3]] - p;
+            e1 = safeNormalize(e1 - n * dot(n, e1));
+            e2 = safeNormalize(e2 - n * dot(n, e2));
+            float angle = acos(std::max(-1.0f, std::min(1.0f, dot(e1, e2))));
+            vec3 s = safeNormalize(tri_s[t] - n * dot(n, tri_s[t]));
+            corner_s[c] = s * angle;
+        }
+    });
+
+    VertexAdjacency adj;
+    buildAdjacency(idx, vertex_cnt, adj);
+
+    // sum per vertex and orientation; bit 0 / 1 of used marks which occur,
+    // triangles without one neither add nor count
+    vector<vec3> sum_pos(vertex_cnt), sum_neg(vertex_cnt);
+    vector<unsigned char> used(vertex_cnt);
+    parallelFor(0, vertex_cnt, TANGENT_GRAIN, [&](size_t lo, size_t hi) {
+        for (size_t v = lo; v < hi; ++v) {
+            vec3 pos(0.0f), neg(0.0f);
+            unsigned char bits = 0;
+            for (uint32_t k = adj.offsets[v]; k < adj.offsets[v + 1]; ++k) {
+                uint32_t c = adj.corners[k];
+                if (orient[c / 3] == ORIENT_POS) {
+                    pos += corner_s[c];
+                    bits |= 1;
+                } else if (orient[c / 3] == ORIENT_NEG) {
+                    neg += corner_s[c];
+                    bits |= 2;
+                }
+            }
+            sum_pos[v] = pos;
+            sum_neg[v] = neg;
+            used[v] = bits;
+        }
+    });
+
+    // the negative side of a vertex used both ways becomes a new vertex
+    vector<uint32_t> split(vertex_cnt, 0);
+    uint32_t next = vertex_cnt;
+    for (size_t v = 0; v < vertex_cnt; ++v) {
+        if (used[v] == 3) split[v] = next++;
+    }
+    mesh.positions.resize(next);
+    mesh.uvs.resize(next);
+    mesh.normals.resize(next);
+    mesh.tangents.resize(next);
+    for (size_t v = 0; v < vertex_cnt; ++v) {
+        if (!split[v]) continue;
+        mesh.positions[split[v]] = mesh.positions[v];
+        mesh.uvs[split[v]] = mesh.uvs[v];
+        mesh.normals[split[v]] = mesh.normals[v];
+    }
+
+    parallelFor(0, vertex_cnt, TANGENT_GRAIN, [&](size_t lo, size_t hi) {
+        for (size_t v = lo; v < hi; ++v) {
+            const vec3& n = mesh.normals[v];
+            vec3 t_pos = safeNormalize(sum_pos[v]);
+            vec3 t_neg = safeNormalize(sum_neg[v]);
+            if (t_pos == vec3(0.0f)) t_pos = perpendicular(n);
+            if (t_neg == vec3(0.0f)) t_neg = perpendicular(n);
+            if (used[v] == 3) {
+                mesh.tangents[v] = vec4(t_pos, 1.0f);
+                mesh.tangents[split[v]] = vec4(t_neg, -1.0f);
+            } else if (used[v] == 2) {
+                mesh.tangents[v] = vec4(t_neg, -1.0f);
+            } else {
+                mesh.tangents[v] = vec4(t_pos, 1.0f);
+            }
+        }
+    });
+    // corners without an orientation keep the vertex they attach to
+    parallelFor(0, tri_cnt, TANGENT_GRAIN, [&](size_t lo, size_t hi) {
+        for (size_t c = lo * 3; c < hi * 3; ++c) {
+            uint32_t v = mesh.indices[c];
+            if (split[v] && orient[c / 3] == ORIENT_NEG) {
+                mesh.indices[c] = split[v];
+            }
+        }
+    });
+    return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "mesh-index.hpp"
+
+// Tangent space in the MikkTSpace convention with its default 180 degree
+// threshold: per corner the triangle's texture space s direction is
+// projected into the vertex normal's plane, weighted by the corner angle,
+// and summed over the corners of the vertex with the same uv orientation.
+// Vertices shared by both orientations (mirrored uv seams) are split, all
+// others stay shared. Triangles with zero uv area have no orientation, as
+// in MikkTSpace: they add to no sum, split nothing and use the tangent of
+// the vertex they share. tangents[v].w is the bitangent sign, so
+// bitangent = w * cross(normal, tangent). Triangle passes run in parallel.
+//
+// Unlike MikkTSpace, corners of one orientation around a vertex are merged
+// even if they are not connected through shared edges; meshes with bow-tie
+// vertices can differ there. Returns false without uvs or normals.
+bool generateTangents(IndexedMesh& mesh);
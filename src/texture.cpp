@@ -0,0 +1,190 @@
+#include "texture.hpp"
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+using namespace std;
+using namespace glm;
+
+#include "dds.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+// GL picks magnification below this level of detail when magnifying
+// bilinearly and minifying with GL_NEAREST_MIPMAP_LINEAR
+#define MAG_LOD_THRESHOLD 0.5f
+// rows of 4x4 blocks per decode call
+#define TEXTURE_DECODE_GRAIN 16
+
+namespace {
+
+inline uint32_t readU32(const unsigned char* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+}
+
+// 5:6:5 to 8 bits per channel, replicating the high bits
+inline void expand565(unsigned int c, unsigned char* rgb) {
+    unsigned int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// the color half of a block into 16 RGBA texels; DXT1 blocks with
+// color0 <= color1 have three colors and transparent black
+void decodeColors(const unsigned char* block, bool dxt1,
+                  unsigned char out[16][4]) {
+    unsigned int c0 = block[0] | block[1] << 8;
+    unsigned int c1 = block[2] | block[3] << 8;
+    unsigned char palette[4][4];
+    expand565(c0, palette[0]);
+    expand565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+    for (int k = 0; k < 3; ++k) {
+        if (!dxt1 || c0 > c1) {
+            palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+            palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+        } else {
+            palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+            palette[3][k] = 0;
+        }
+    }
+    if (dxt1 && c0 <= c1) palette[3][3] = 0;
+    uint32_t bits = readU32(block + 4);
+    for (int i = 0; i < 16; ++i) {
+        memcpy(out[i], palette[(bits >> (2 * i)) & 3], 4);
+    }
+}
+
+// DXT5 alpha: two endpoints and 3 bit indices
+void decodeAlpha5(const unsigned char* block, unsigned char out[16][4]) {
+    unsigned int a[8];
+    a[0] = block[0];
+    a[1] = block[1];
+    if (a[0] > a[1]) {
+        for (int k = 1; k < 7; ++k) a[k + 1] = ((7 - k) * a[0] + k * a[1]) / 7;
+    } else {
+        for (int k = 1; k < 5; ++k) a[k + 1] = ((5 - k) * a[0] + k * a[1]) / 5;
+        a[6] = 0;
+        a[7] = 255;
+    }
+    uint64_t bits = 0;
+    for (int k = 0; k < 6; ++k) bits |= uint64_t(block[2 + k]) << (8 * k);
+    for (int i = 0; i < 16; ++i) out[i][3] = a[(bits >> (3 * i)) & 7];
+}
+
+// one row of 4x4 blocks
+void decodeRow(const unsigned char* data, unsigned int four_cc, int by,
+               TextureLevel& level) {
+    int block_size = four_cc == FOURCC_DXT1 ? 8 : 16;
+    int blocks_x = (level.width + 3) / 4;
+    unsigned char texels[16][4];
+    for (int bx = 0; bx < blocks_x; ++bx) {
+        const unsigned char* block =
+            data + (size_t(by) * blocks_x + bx) * block_size;
+        if (four_cc == FOURCC_DXT1) {
+            decodeColors(block, true, texels);
+        } else {
+            decodeColors(block + 8, false, texels);
+            if (four_cc == FOURCC_DXT3) {
+                // explicit 4 bit alpha
+                for (int i = 0; i < 16; ++i) {
+                    unsigned int a = (block[i / 2] >> (4 * (i & 1))) & 15;
+                    texels[i][3] = a * 17;
+                }
+            } else {
+                decodeAlpha5(block, texels);
+            }
+        }
+        // blocks overhanging small levels are cut off
+        for (int i = 0; i < 16; ++i) {
+            int x = bx * 4 + (i & 3), y = by * 4 + i / 4;
+            if (x >= level.width || y >= level.height) continue;
+            memcpy(&level.texels[(size_t(y) * level.width + x) * 4],
+                   texels[i], 4);
+        }
+    }
+}
+
+void decodeLevel(const unsigned char* data, unsigned int four_cc,
+                 TextureLevel& level) {
+    int blocks_y = (level.height + 3) / 4;
+    level.texels.resize(size_t(level.width) * level.height * 4);
+    // rows of blocks write disjoint rows of texels
+    parallelFor(0, blocks_y, TEXTURE_DECODE_GRAIN, [&](size_t lo, size_t hi) {
+        for (size_t by = lo; by < hi; ++by) {
+            decodeRow(data, four_cc, int(by), level);
+        }
+    });
+}
+
+inline int wrap(int i, int size) {
+    i %= size;
+    return i < 0 ? i + size : i;
+}
+
+inline vec3 fetch(const TextureLevel& level, int x, int y) {
+    const unsigned char* t =
+        &level.texels[(size_t(wrap(y, level.height)) * level.width +
+                       wrap(x, level.width)) * 4];
+    return vec3(t[0], t[1], t[2]) * (1.0f / 255.0f);
+}
+
+vec3 sampleNearest(const TextureLevel& level, const vec2& uv) {
+    return fetch(level, int(floorf(uv.x * level.width)),
+                 int(floorf(uv.y * level.height)));
+}
+
+vec3 sampleBilinear(const TextureLevel& level, const vec2& uv) {
+    float x = uv.x * level.width - 0.5f, y = uv.y * level.height - 0.5f;
+    float fx = floorf(x), fy = floorf(y);
+    int x0 = int(fx), y0 = int(fy);
+    float ax = x - fx, ay = y - fy;
+    vec3 bottom = mix(fetch(level, x0, y0), fetch(level, x0 + 1, y0), ax);
+    vec3 top = mix(fetch(level, x0, y0 + 1), fetch(level, x0 + 1, y0 + 1), ax);
+    return mix(bottom, top, ay);
+}
+
+}  // namespace
+
+bool loadDDSTexture(const char* path, Texture& texture) {
+    DDSImage image;
+    if (!loadDDS(path, image)) return false;
+    decodeDDS(image, texture);
+    return true;
+}
+
+void decodeDDS(const DDSImage& image, Texture& texture) {
+    TRACE_SCOPE("decodeDDS");
+    texture.levels.resize(image.levels.size());
+    size_t bytes = 0;
+    for (size_t l = 0; l < image.levels.size(); ++l) {
+        TextureLevel& level = texture.levels[l];
+        level.width = image.levels[l].width;
+        level.height = image.levels[l].height;
+        decodeLevel(&image.data[image.levels[l].offset], image.four_cc,
+                    level);
+        bytes += capacityBytes(level.texels);
+    }
+    texture.memory.set(MEMORY_TEXTURE, bytes);
+}
+
+float textureLOD(const Texture& texture, const vec2& dx, const vec2& dy) {
+    const TextureLevel& base = texture.levels[0];
+    vec2 size(base.width, base.height);
+    float rho2 = std::max(dot(dx * size, dx * size), dot(dy * size, dy * size));
+    return 0.5f * log2f(rho2);  // -inf for constant coordinates
+}
+
+vec3 sampleTexture(const Texture& texture, const vec2& uv, float lod) {
+    if (!(lod > MAG_LOD_THRESHOLD)) {
+        return sampleBilinear(texture.levels[0], uv);
+    }
+    int last = int(texture.levels.size()) - 1;
+    if (lod >= float(last)) return sampleNearest(texture.levels[last], uv);
+    int level = int(lod);
+    float t = lod - float(level);
+    return mix(sampleNearest(texture.levels[level], uv),
+               sampleNearest(texture.levels[level + 1], uv), t);
+}
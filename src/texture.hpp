@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "dds.hpp"
+
+struct TextureLevel {
+    int width, height;
+    std::vector<unsigned char> texels;  // RGBA8, rows in file order
+};
+
+// mip chain decoded for sampling on the CPU
+struct Texture {
+    std::vector<TextureLevel> levels;
+    MemoryCharge memory;  // the texels, as MEMORY_TEXTURE
+};
+
+// Read a DXT1, DXT3 or DXT5 compressed DDS file and decode every mip level
+// to RGBA8, so the software rasterizer sees what glCompressedTexImage2D
+// would upload. Rows of blocks are decoded in parallel.
+bool loadDDSTexture(const char* path, Texture& texture);
+void decodeDDS(const DDSImage& image, Texture& texture);
+
+// level of detail for the texture coordinate derivatives along x and y in
+// window space, as GL computes it (no anisotropy)
+float textureLOD(const Texture& texture, const glm::vec2& dx,
+                 const glm::vec2& dy);
+
+// Sample with GL's default sampler state: repeat wrapping, bilinear
+// magnification and GL_NEAREST_MIPMAP_LINEAR minification.
+glm::vec3 sampleTexture(const Texture& texture, const glm::vec2& uv,
+                        float lod);
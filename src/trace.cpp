@@ -0,0 +1,268 @@
+#include "trace.hpp"
+
+#include <cstdio>
+
+#ifdef OBJ_LOADER_TRACE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// steady_clock costs tens of nanoseconds where the time stamp counter costs
+// a few; its rate is measured against steady_clock while recording
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define TRACE_TSC
+#endif
+
+// events per chunk; a thread keeps up to TRACE_MAX_CHUNKS of them
+#define TRACE_CHUNK 4096
+#define TRACE_MAX_CHUNKS 1024
+// shortest span the tick rate is measured over
+#define TRACE_CALIBRATE_MS 50
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    int64_t begin, end;  // ticks
+};
+
+// Written only by the thread holding it: events up to count are complete,
+// count is published with release so writeTrace can read them meanwhile.
+struct TraceBuffer {
+    int tid;
+    string name;  // under the registry lock
+    bool steady_ns;  // a track: times are steady_clock nanoseconds
+    TraceEvent* chunks[TRACE_MAX_CHUNKS];
+    atomic<size_t> count;
+    atomic<size_t> dropped;
+};
+
+// tools and benches start and stop threads of their own, and the pool
+// restarts its workers on setWorkerCount, so buffers of finished threads go
+// to the next thread instead of piling up; tids stay small and a trace
+// shows one row per concurrent worker
+struct Registry {
+    mutex lock;
+    vector<TraceBuffer*> buffers;
+    vector<TraceBuffer*> free_buffers;
+    vector<TraceBuffer*> tracks;
+};
+
+Registry& registry() {
+    static Registry* reg = new Registry();  // outlives exiting threads
+    return *reg;
+}
+
+int64_t nsNow() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+inline int64_t ticksNow() {
+#ifdef TRACE_TSC
+    return int64_t(__rdtsc());
+#else
+    return nsNow();
+#endif
+}
+
+atomic<bool> recording(false);
+int64_t start_ticks, start_ns;  // set by startTrace
+
+// with the registry locked
+TraceBuffer* newBuffer(Registry& reg, bool steady_ns) {
+    TraceBuffer* buffer = new TraceBuffer();
+    buffer->tid = int(reg.buffers.size()) + 1;
+    buffer->steady_ns = steady_ns;
+    for (int i = 0; i < TRACE_MAX_CHUNKS; ++i) buffer->chunks[i] = NULL;
+    buffer->count = 0;
+    buffer->dropped = 0;
+    reg.buffers.push_back(buffer);
+    return buffer;
+}
+
+TraceBuffer* acquireBuffer() {
+    Registry& reg = registry();
+    lock_guard<mutex> guard(reg.lock);
+    if (!reg.free_buffers.empty()) {
+        TraceBuffer* buffer = reg.free_buffers.back();
+        reg.free_buffers.pop_back();
+        return buffer;
+    }
+    return newBuffer(reg, false);
+}
+
+struct ThreadSlot {
+    TraceBuffer* buffer;
+    ThreadSlot() : buffer(acquireBuffer()) {}
+    ~ThreadSlot() {
+        Registry& reg = registry();
+        lock_guard<mutex> guard(reg.lock);
+        buffer->name.clear();
+        reg.free_buffers.push_back(buffer);
+    }
+};
+
+TraceBuffer* threadBuffer() {
+    thread_local ThreadSlot slot;
+    return slot.buffer;
+}
+
+void record(TraceBuffer* buffer, const char* name, int64_t begin,
+            int64_t end) {
+    size_t i = buffer->count.load(memory_order_relaxed);
+    size_t chunk = i / TRACE_CHUNK;
+    if (chunk >= TRACE_MAX_CHUNKS) {
+        buffer->dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    if (buffer->chunks[chunk] == NULL) {
+        buffer->chunks[chunk] = new TraceEvent[TRACE_CHUNK];
+    }
+    TraceEvent& e = buffer->chunks[chunk][i % TRACE_CHUNK];
+    e.name = name;
+    e.begin = begin;
+    e.end = end;
+    buffer->count.store(i + 1, memory_order_release);
+}
+
+void putJSONString(FILE* fp, const char* s) {
+    fputc('"', fp);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') fputc('\\', fp);
+        if ((unsigned char)*s >= ' ') fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+}  // namespace
+
+TraceScope::TraceScope(const char* name)
+    : name(name),
+      begin(recording.load(memory_order_relaxed) ? ticksNow() : 0) {}
+
+TraceScope::~TraceScope() {
+    if (begin) record(threadBuffer(), name, begin, ticksNow());
+}
+
+void startTrace() {
+    if (recording) return;
+    start_ns = nsNow();
+    start_ticks = ticksNow();
+    recording = true;
+}
+
+void traceThreadName(const char* name) {
+    TraceBuffer* buffer = threadBuffer();
+    lock_guard<mutex> guard(registry().lock);
+    buffer->name = name;
+}
+
+int traceTrack(const char* name) {
+    Registry& reg = registry();
+    lock_guard<mutex> guard(reg.lock);
+    TraceBuffer* buffer = newBuffer(reg, true);
+    buffer->name = name;
+    reg.tracks.push_back(buffer);
+    return int(reg.tracks.size()) - 1;
+}
+
+void traceTrackEvent(int track, const char* name, int64_t begin_ns,
+                     int64_t end_ns) {
+    if (track < 0 || !recording.load(memory_order_relaxed)) return;
+    TraceBuffer* buffer;
+    {
+        Registry& reg = registry();
+        lock_guard<mutex> guard(reg.lock);
+        buffer = reg.tracks[track];
+    }
+    record(buffer, name, begin_ns, end_ns);
+}
+
+bool writeTrace(const char* path) {
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to create %s.\n", path);
+        return false;
+    }
+    double ns_per_tick = 1.0;
+#ifdef TRACE_TSC
+    int64_t wait_ns = TRACE_CALIBRATE_MS * 1000000LL - (nsNow() - start_ns);
+    if (wait_ns > 0) this_thread::sleep_for(chrono::nanoseconds(wait_ns));
+    int64_t ticks = std::max<int64_t>(ticksNow() - start_ticks, 1);
+    ns_per_tick = double(nsNow() - start_ns) / double(ticks);
+#endif
+    Registry& reg = registry();
+    lock_guard<mutex> guard(reg.lock);
+    size_t event_cnt = 0, dropped = 0;
+    fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    const char* sep = "\n";
+    for (size_t b = 0; b < reg.buffers.size(); ++b) {
+        TraceBuffer* buffer = reg.buffers[b];
+        if (!buffer->name.empty()) {
+            fprintf(fp, "%s{\"ph\": \"M\", \"name\": \"thread_name\", "
+                    "\"pid\": 1, \"tid\": %d, \"args\": {\"name\": ",
+                    sep, buffer->tid);
+            putJSONString(fp, buffer->name.c_str());
+            fprintf(fp, "}}");
+            sep = ",\n";
+        }
+        int64_t start = buffer->steady_ns ? start_ns : start_ticks;
+        double scale = (buffer->steady_ns ? 1.0 : ns_per_tick) * 1e-3;
+        size_t n = buffer->count.load(memory_order_acquire);
+        for (size_t i = 0; i < n; ++i) {
+            const TraceEvent& e = buffer->chunks[i / TRACE_CHUNK]
+                                                [i % TRACE_CHUNK];
+            fprintf(fp, "%s{\"ph\": \"X\", \"name\": ", sep);
+            putJSONString(fp, e.name);
+            fprintf(fp, ", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, "
+                    "\"dur\": %.3f}",
+                    buffer->tid, (e.begin - start) * scale,
+                    (e.end - e.begin) * scale);
+            sep = ",\n";
+        }
+        event_cnt += n;
+        dropped += buffer->dropped;
+    }
+    fprintf(fp, "\n]}\n");
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Failed to write %s.\n", path);
+        return false;
+    }
+    printf("trace: %u events on %u threads written to %s",
+           (unsigned int)event_cnt, (unsigned int)reg.buffers.size(), path);
+    if (dropped) printf(", %u dropped", (unsigned int)dropped);
+    printf("\n");
+    return true;
+}
+
+#else
+
+void startTrace() {}
+
+bool writeTrace(const char* path) {
+    fprintf(stderr, "Failed to write %s: built without OBJ_LOADER_TRACE.\n",
+            path);
+    return false;
+}
+
+void traceThreadName(const char*) {}
+
+int traceTrack(const char*) { return -1; }
+
+void traceTrackEvent(int, const char*, int64_t, int64_t) {}
+
+#endif
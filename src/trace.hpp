@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+// Scoped timers exported as Chrome trace_event JSON (chrome://tracing or
+// ui.perfetto.dev). TRACE_SCOPE("name") times the rest of the enclosing
+// block on the calling thread; scopes nest by time. Names must be string
+// literals. Events go to a buffer owned by the thread, without locks.
+// Nothing is recorded until startTrace(); building without
+// OBJ_LOADER_TRACE removes the scopes entirely.
+
+#ifdef OBJ_LOADER_TRACE
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) \
+    TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+class TraceScope {
+   public:
+    explicit TraceScope(const char* name);
+    ~TraceScope();
+
+   private:
+    const char* name;
+    int64_t begin;  // clock ticks, 0 while not recording
+};
+
+#else
+
+#define TRACE_SCOPE(name) \
+    do {                  \
+    } while (0)
+
+#endif
+
+// start recording on every thread
+void startTrace();
+// write everything recorded so far; fails when built without tracing
+bool writeTrace(const char* path);
+// label the calling thread in the trace
+void traceThreadName(const char* name);
+
+// An extra row for events timed elsewhere, such as GPU timestamps; times
+// are steady_clock nanoseconds. A track is written from one thread at a
+// time. traceTrack returns -1 when built without tracing.
+int traceTrack(const char* name);
+void traceTrackEvent(int track, const char* name, int64_t begin_ns,
+                     int64_t end_ns);
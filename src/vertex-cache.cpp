@@ -0,0 +1,189 @@
+#include "vertex-cache.hpp"
+
+#include <cmath>
+using namespace std;
+
+#include "trace.hpp"
+
+// Forsyth's tuning: the last triangle's vertices score a little below the
+// entries behind them, so strips do not turn back on themselves
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRI_SCORE 0.75f
+// vertices with few triangles left are finished first, so they leave no
+// stragglers behind
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+// valences past this score the same
+#define VALENCE_MAX 32
+
+#define VERTEX_UNUSED 0xffffffffu
+
+namespace {
+
+struct ScoreTables {
+    float cache[VERTEX_CACHE_SIZE];
+    float valence[VALENCE_MAX + 1];
+
+    ScoreTables() {
+        for (int i = 0; i < VERTEX_CACHE_SIZE; ++i) {
+            cache[i] = i < 3 ? LAST_TRI_SCORE
+                             : powf(1.0f - float(i - 3) /
+                                               (VERTEX_CACHE_SIZE - 3),
+                                    CACHE_DECAY_POWER);
+        }
+        valence[0] = 0.0f;
+        for (int i = 1; i <= VALENCE_MAX; ++i) {
+            valence[i] = VALENCE_BOOST_SCALE * powf(float(i),
+                                                    -VALENCE_BOOST_POWER);
+        }
+    }
+};
+
+// vertices without triangles left score -1, so no triangle picks them
+inline float vertexScore(const ScoreTables& tables, int cache_pos,
+                         uint32_t live) {
+    if (live == 0) return -1.0f;
+    float score = cache_pos >= 0 ? tables.cache[cache_pos] : 0.0f;
+    return score + tables.valence[live < VALENCE_MAX ? live : VALENCE_MAX];
+}
+
+template <typename T>
+void remapArray(vector<T>& v, const vector<uint32_t>& remap, uint32_t cnt) {
+    if (v.empty()) return;
+    vector<T> out(cnt);
+    for (size_t i = 0; i < remap.size(); ++i) {
+        if (remap[i] != VERTEX_UNUSED) out[remap[i]] = v[i];
+    }
+    v.swap(out);
+}
+
+}  // namespace
+
+void optimizeVertexCache(vector<uint32_t>& indices, uint32_t vertex_cnt) {
+    TRACE_SCOPE("optimizeVertexCache");
+    static const ScoreTables tables;
+    size_t tri_cnt = indices.size() / 3;
+    if (tri_cnt == 0) return;
+
+    // the corners of triangles not emitted yet come first in each
+    // vertex's adjacency range, live[v] of them
+    VertexAdjacency adj;
+    buildAdjacency(indices, vertex_cnt, adj);
+    vector<uint32_t> live(vertex_cnt);
+    vector<int> cache_pos(vertex_cnt, -1);
+    vector<float> vertex_scores(vertex_cnt);
+    for (uint32_t v = 0; v < vertex_cnt; ++v) {
+        live[v] = adj.offsets[v + 1] - adj.offsets[v];
+        vertex_scores[v] = vertexScore(tables, -1, live[v]);
+    }
+    size_t best = 0;
+    float best_score = -1.0f;
+    for (size_t t = 0; t < tri_cnt; ++t) {
+        float score = vertex_scores[indices[t * 3]] +
+                      vertex_scores[indices[t * 3 + 1]] +
+                      vertex_scores[indices[t * 3 + 2]];
+        if (score > best_score) {
+            best_score = score;
+            best = t;
+        }
+    }
+
+    vector<bool> emitted(tri_cnt, false);
+    vector<uint32_t> out(tri_cnt * 3);
+    uint32_t cache[VERTEX_CACHE_SIZE + 3], new_cache[VERTEX_CACHE_SIZE + 3];
+    int cache_cnt = 0;
+    size_t cursor = 0;  // triangles in front of it are all emitted
+    for (size_t k = 0; k < tri_cnt; ++k) {
+        if (best == tri_cnt) {
+            // nothing around the cache is left, start over somewhere else
+            while (emitted[cursor]) ++cursor;
+            best = cursor;
+        }
+        const uint32_t* tri = &indices[best * 3];
+        emitted[best] = true;
+        int new_cnt = 0;
+        for (int c = 0; c < 3; ++c) {
+            uint32_t v = tri[c];
+            out[k * 3 + c] = v;
+            uint32_t* corners = &adj.corners[adj.offsets[v]];
+            uint32_t corner = uint32_t(best * 3 + c);
+            for (uint32_t j = 0; j < live[v]; ++j) {
+                if (corners[j] == corner) {
+                    corners[j] = corners[live[v] - 1];
+                    corners[live[v] - 1] = corner;
+                    --live[v];
+                    break;
+                }
+            }
+            bool listed = false;
+            for (int j = 0; j < new_cnt; ++j) listed |= new_cache[j] == v;
+            if (!listed) new_cache[new_cnt++] = v;
+        }
+        for (int i = 0; i < cache_cnt; ++i) {
+            uint32_t v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                new_cache[new_cnt++] = v;
+            }
+        }
+
+        // rescore the cache and the vertices pushed out of it, then the
+        // triangles around them; the best of those comes next
+        for (int i = 0; i < new_cnt; ++i) {
+            uint32_t v = new_cache[i];
+            cache_pos[v] = i < VERTEX_CACHE_SIZE ? i : -1;
+            vertex_scores[v] = vertexScore(tables, cache_pos[v], live[v]);
+        }
+        best = tri_cnt;
+        best_score = -1.0f;
+        for (int i = 0; i < new_cnt; ++i) {
+            uint32_t v = new_cache[i];
+            const uint32_t* corners = &adj.corners[adj.offsets[v]];
+            for (uint32_t j = 0; j < live[v]; ++j) {
+                size_t t = corners[j] / 3;
+                float score = vertex_scores[indices[t * 3]] +
+                              vertex_scores[indices[t * 3 + 1]] +
+                              vertex_scores[indices[t * 3 + 2]];
+                if (score > best_score) {
+                    best_score = score;
+                    best = t;
+                }
+            }
+        }
+        cache_cnt = new_cnt < VERTEX_CACHE_SIZE ? new_cnt : VERTEX_CACHE_SIZE;
+        for (int i = 0; i < cache_cnt; ++i) cache[i] = new_cache[i];
+    }
+    out.insert(out.end(), indices.begin() + tri_cnt * 3, indices.end());
+    indices.swap(out);
+}
+
+void optimizeVertexFetch(IndexedMesh& mesh) {
+    TRACE_SCOPE("optimizeVertexFetch");
+    vector<uint32_t> remap(mesh.positions.size(), VERTEX_UNUSED);
+    uint32_t cnt = 0;
+    for (size_t i = 0; i < mesh.indices.size(); ++i) {
+        uint32_t& v = remap[mesh.indices[i]];
+        if (v == VERTEX_UNUSED) v = cnt++;
+        mesh.indices[i] = v;
+    }
+    remapArray(mesh.positions, remap, cnt);
+    remapArray(mesh.uvs, remap, cnt);
+    remapArray(mesh.normals, remap, cnt);
+    remapArray(mesh.tangents, remap, cnt);
+}
+
+float vertexCacheMissRatio(const vector<uint32_t>& indices,
+                           uint32_t vertex_cnt, int cache_size) {
+    size_t tri_cnt = indices.size() / 3;
+    if (tri_cnt == 0) return 0.0f;
+    // a vertex is still in the FIFO while fewer than cache_size misses
+    // came after its own; stamps are the miss count + 1, 0 for never
+    vector<size_t> stamps(vertex_cnt, 0);
+    size_t misses = 0;
+    for (size_t i = 0; i < tri_cnt * 3; ++i) {
+        size_t& stamp = stamps[indices[i]];
+        if (stamp == 0 || misses - (stamp - 1) > size_t(cache_size)) {
+            stamp = ++misses;
+        }
+    }
+    return float(misses) / float(tri_cnt);
+}
@@ -0,0 +1,283 @@
+// Batch conversion of obj files into packed meshes (src/packed-mesh.hpp):
+// every input is parsed, welded, reordered for the vertex cache and for
+// fetching, quantized and written to input + ".mesh", or into DIR. Inputs
+// whose cache was written from the obj as it is now (the same size and
+// modification time) are skipped. --verify reads every file written back
+// and checks it against the mesh it was packed from.
+//
+// usage: obj-convert [--threads N] [--out DIR] [--force] [--verify]
+//                    [--quiet] input.obj|pattern|@list ...
+//        (default: every hardware thread, caches beside the inputs)
+//
+// Patterns are expanded with glob(3) for shells that pass them quoted, and
+// @list names a file with one input per line. Files are converted side by
+// side, largest first; threads that run out of files steal chunks of the
+// large ones still being parsed.
+
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <glob.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "src/mesh-index.hpp"
+#include "src/normals.hpp"
+#include "src/obj.hpp"
+#include "src/packed-mesh.hpp"
+#include "src/parallel.hpp"
+#include "src/vertex-cache.hpp"
+
+struct Job {
+    string input;
+    string output;
+    size_t in_bytes;
+    // filled in by convert
+    bool ok;
+    size_t out_bytes;
+    size_t triangles;
+    size_t vertices;
+    float acmr_before, acmr_after;
+    double ms;
+};
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+static void addInputs(const char* arg, vector<string>& inputs) {
+    if (arg[0] == '@') {
+        FILE* fp = fopen(arg + 1, "r");
+        if (fp == NULL) {
+            fprintf(stderr, "Failed to open input list %s.\n", arg + 1);
+            return;
+        }
+        char line[4096];
+        while (fgets(line, sizeof(line), fp)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0]) inputs.push_back(line);
+        }
+        fclose(fp);
+        return;
+    }
+#ifndef _WIN32
+    if (strpbrk(arg, "*?[")) {
+        glob_t matches;
+        if (glob(arg, 0, NULL, &matches) == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; ++i) {
+                inputs.push_back(matches.gl_pathv[i]);
+            }
+        } else {
+            fprintf(stderr, "Failed to match any file with %s.\n", arg);
+        }
+        globfree(&matches);
+        return;
+    }
+#endif
+    inputs.push_back(arg);
+}
+
+static string outputPath(const string& input, const char* out_dir) {
+    if (out_dir == NULL) return input + ".mesh";
+    size_t slash = input.find_last_of("/\\");
+    string name = slash == string::npos ? input : input.substr(slash + 1);
+    return string(out_dir) + "/" + name + ".mesh";
+}
+
+// the cache decodes to mesh within the quantization: positions within
+// packedPositionError, normals within a quarter of a degree and uvs
+// within half float rounding
+static bool verify(const char* path, const IndexedMesh& mesh,
+                   const PackedMesh& packed) {
+    PackedMesh read;
+    if (!readPackedMesh(path, read)) return false;
+    IndexedMesh unpacked;
+    unpackMesh(read, unpacked);
+    const char* error = NULL;
+    if (unpacked.positions.size() != mesh.positions.size() ||
+        read.textured != !mesh.uvs.empty()) {
+        error = "vertex count or layout";
+    } else if (unpacked.indices != mesh.indices) {
+        error = "indices";
+    }
+    float max_distance = packedPositionError(packed) * 1.001f + 1e-6f;
+    for (size_t v = 0; v < unpacked.positions.size() && !error; ++v) {
+        if (distance(unpacked.positions[v], mesh.positions[v]) >
+            max_distance) {
+            error = "positions";
+        } else if (!mesh.normals.empty() && length(mesh.normals[v]) > 0.0f &&
+                   dot(unpacked.normals[v], normalize(mesh.normals[v])) <
+                       0.99999f) {
+            error = "normals";
+        } else if (!mesh.uvs.empty()) {
+            vec2 d = abs(unpacked.uvs[v] - mesh.uvs[v]);
+            vec2 tolerance = max(abs(mesh.uvs[v]), vec2(6.2e-5f)) / 1024.0f;
+            if (d.x > tolerance.x || d.y > tolerance.y) error = "uvs";
+        }
+    }
+    if (error) {
+        fprintf(stderr, "Failed to verify %s: %s differ.\n", path, error);
+    }
+    return error == NULL;
+}
+
+static void convert(Job& job, bool verify_output, bool quiet) {
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    job.ok = false;
+    // taken first, so an edit while converting leaves the cache stale
+    FileStamp source;
+    if (!fileStamp(job.input.c_str(), source)) {
+        fprintf(stderr, "Failed to open %s.\n", job.input.c_str());
+        return;
+    }
+    vector<vec3> vertices;
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    int res = loadOBJ(job.input.c_str(), vertices, uvs, normals);
+    if (res < 0 || vertices.empty()) {
+        fprintf(stderr, "Failed to parse obj file %s.\n", job.input.c_str());
+        return;
+    }
+    if (normals.size() != vertices.size()) {
+        generateNormals(vertices, normals);
+    }
+    IndexedMesh mesh;
+    indexMesh(vertices, res ? uvs : vector<vec2>(), normals, mesh);
+    vector<vec3>().swap(vertices);
+    vector<vec2>().swap(uvs);
+    vector<vec3>().swap(normals);
+
+    uint32_t vertex_cnt = mesh.positions.size();
+    job.acmr_before = vertexCacheMissRatio(mesh.indices, vertex_cnt);
+    optimizeVertexCache(mesh.indices, vertex_cnt);
+    job.acmr_after = vertexCacheMissRatio(mesh.indices, vertex_cnt);
+    optimizeVertexFetch(mesh);
+
+    PackedMesh packed;
+    packMesh(mesh, packed);
+    if (!writePackedMesh(job.output.c_str(), packed, source,
+                         &job.out_bytes)) {
+        return;
+    }
+    if (verify_output && !verify(job.output.c_str(), mesh, packed)) {
+        // its header is valid, so it would pass as up to date next time
+        remove(job.output.c_str());
+        return;
+    }
+    job.triangles = packed.indices.size() / 3;
+    job.vertices = packed.vertices.size();
+    job.ms = msSince(t0);
+    job.ok = true;
+    if (!quiet) {
+        printf("%s: %u triangles, %u vertices, acmr %.2f -> %.2f, "
+               "%.1f -> %.1f MB, error %g, %.0f ms\n",
+               job.output.c_str(), (unsigned int)job.triangles,
+               (unsigned int)job.vertices, job.acmr_before, job.acmr_after,
+               job.in_bytes * 1e-6, job.out_bytes * 1e-6,
+               packedPositionError(packed), job.ms);
+    }
+}
+
+static bool largerFirst(const Job& a, const Job& b) {
+    return a.in_bytes > b.in_bytes;
+}
+
+int main(int argc, char* argv[]) {
+    const char* out_dir = NULL;
+    bool force = false, verify_output = false, quiet = false;
+    vector<string> inputs;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            setWorkerCount(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "--force") == 0) {
+            force = true;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify_output = true;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            quiet = true;
+        } else {
+            addInputs(argv[i], inputs);
+        }
+    }
+    if (inputs.empty()) {
+        fprintf(stderr, "usage: obj-convert [--threads N] [--out DIR] "
+                        "[--force] [--verify] [--quiet] "
+                        "input.obj|pattern|@list ...\n");
+        return 1;
+    }
+    sort(inputs.begin(), inputs.end());
+    inputs.erase(unique(inputs.begin(), inputs.end()), inputs.end());
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    vector<Job> jobs;
+    unsigned int skipped = 0, failed = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        struct stat st;
+        if (stat(inputs[i].c_str(), &st) != 0) {
+            fprintf(stderr, "Failed to open %s.\n", inputs[i].c_str());
+            ++failed;
+            continue;
+        }
+        Job job = Job();
+        job.input = inputs[i];
+        job.output = outputPath(inputs[i], out_dir);
+        job.in_bytes = st.st_size;
+        if (!force && packedMeshCurrent(job.input.c_str(),
+                                        job.output.c_str())) {
+            ++skipped;
+            continue;
+        }
+        jobs.push_back(job);
+    }
+
+    // the largest files start first, so they do not finish last alone
+    sort(jobs.begin(), jobs.end(), largerFirst);
+    parallelFor(0, jobs.size(), 1, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+            convert(jobs[i], verify_output, quiet);
+        }
+    });
+    double ms = msSince(t0);
+
+    size_t in_bytes = 0, out_bytes = 0, triangles = 0;
+    double misses_before = 0.0, misses_after = 0.0;
+    unsigned int converted = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const Job& job = jobs[i];
+        if (!job.ok) {
+            ++failed;
+            continue;
+        }
+        ++converted;
+        in_bytes += job.in_bytes;
+        out_bytes += job.out_bytes;
+        triangles += job.triangles;
+        misses_before += job.acmr_before * job.triangles;
+        misses_after += job.acmr_after * job.triangles;
+    }
+    printf("%u converted%s, %u up to date, %u failed in %.0f ms on %u "
+           "threads\n",
+           converted, verify_output ? " and verified" : "", skipped, failed,
+           ms, workerCount());
+    if (converted) {
+        printf("%.1f MB obj -> %.1f MB packed, %.1f MB/s, %.2f M "
+               "triangles/s, acmr %.2f -> %.2f\n",
+               in_bytes * 1e-6, out_bytes * 1e-6, in_bytes / ms * 1e-3,
+               triangles / ms * 1e-3, misses_before / triangles,
+               misses_after / triangles);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+// Synthetic obj files for scale testing: a noisy torus of about N
+// triangles, written by every worker thread.
+//
+// usage: obj-gen [--triangles N] [--polygon N] [--attributes FORM]
+//                [--negative] [--shuffle] [--comments N] [--crlf]
+//                [--seed N] output.obj
+//        (default: 1M triangles, polygons of 3, v/vt/vn, seed 1)
+//
+// N accepts k, M and G suffixes. FORM is the corner form: v, v/vt, v//vn or
+// v/vt/vn. --shuffle scrambles vertex and face order to destroy index
+// locality; --comments N puts a comment before every N-th element.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+using namespace std;
+
+#include "src/parallel.hpp"
+#include "src/synthetic.hpp"
+
+static double msSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - t0)
+        .count();
+}
+
+static size_t parseCount(const char* s) {
+    char* end;
+    double n = strtod(s, &end);
+    if (*end == 'k' || *end == 'K') n *= 1e3;
+    if (*end == 'm' || *end == 'M') n *= 1e6;
+    if (*end == 'g' || *end == 'G') n *= 1e9;
+    return size_t(n);
+}
+
+int main(int argc, char* argv[]) {
+    SyntheticOptions options = defaultSyntheticOptions(1000000);
+    const char* path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--triangles") == 0 && i + 1 < argc) {
+            options.triangles = parseCount(argv[++i]);
+        } else if (strcmp(argv[i], "--polygon") == 0 && i + 1 < argc) {
+            options.polygon_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--attributes") == 0 && i + 1 < argc) {
+            const char* form = argv[++i];
+            options.uvs = strstr(form, "vt") != NULL;
+            options.normals = strstr(form, "vn") != NULL;
+        } else if (strcmp(argv[i], "--negative") == 0) {
+            options.negative_indices = true;
+        } else if (strcmp(argv[i], "--shuffle") == 0) {
+            options.shuffled = true;
+        } else if (strcmp(argv[i], "--comments") == 0 && i + 1 < argc) {
+            options.comment_every = parseCount(argv[++i]);
+        } else if (strcmp(argv[i], "--crlf") == 0) {
+            options.crlf = true;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            options.seed = strtoul(argv[++i], NULL, 10);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "usage: obj-gen [options] output.obj\n");
+        return 1;
+    }
+    if (options.polygon_size < 3) {
+        fprintf(stderr, "Failed to generate: polygons need 3 corners.\n");
+        return 1;
+    }
+
+    SyntheticStats stats;
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    if (!writeSyntheticOBJ(path, options, &stats)) return 1;
+    double ms = msSince(t0);
+    printf("%s: %u vertices, %u faces, %u triangles, %.1f MB in %.0f ms "
+           "(%.0f MB/s on %u threads)\n",
+           path, (unsigned int)stats.vertices, (unsigned int)stats.faces,
+           (unsigned int)stats.triangles, stats.bytes * 1e-6, ms,
+           stats.bytes / ms * 1e-3, workerCount());
+    return 0;
+}